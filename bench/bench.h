@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+
+// Timing for the benchmarks. Every result is printed as one line of JSON, e.g.
+//   {"bench":"smoothing/ring_buffer","params":"window=60","ns_per_op":1.52,"ops":2000000}
+// so that runs can be collected and compared by a script. Anything else a benchmark prints starts with '#'.
+//
+// Arguments: --quick runs everything just long enough to check that it works, --filter <text> only runs benchmarks whose name contains text.
+namespace Bench {
+	struct Settings
+	{
+		bool isQuick = false;
+		const char *filter = nullptr;
+	};
+
+	inline Settings & GetSettings()
+	{
+		static Settings s_settings;
+		return s_settings;
+	}
+
+	inline void ParseArgs(int argc, char **argv)
+	{
+		Settings &settings = GetSettings();
+		for (int i = 1; i < argc; i++) {
+			if (strcmp(argv[i], "--quick") == 0) {
+				settings.isQuick = true;
+			}
+			else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+				settings.filter = argv[++i];
+			}
+		}
+	}
+
+	inline bool IsSelected(const char *name)
+	{
+		const char *filter = GetSettings().filter;
+		return !filter || strstr(name, filter) != nullptr;
+	}
+
+	// Keeps the compiler from optimizing away a result that nothing else uses
+	template <typename T>
+	inline void DoNotOptimize(const T &value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "g"(&value) : "memory");
+#else
+		const volatile char *bytes = reinterpret_cast<const volatile char *>(&value);
+		(void)bytes[0];
+#endif
+	}
+
+	// A result that isn't a timing, e.g. an error or a latency
+	inline void ReportValue(const char *name, const char *params, const char *key, double value)
+	{
+		std::printf("{\"bench\":\"%s\",\"params\":\"%s\",\"%s\":%.6g}\n", name, params, key, value);
+		std::fflush(stdout);
+	}
+
+	// Calls run(numOps), which has to do numOps of whatever is being measured, with more and more ops until one call takes long enough to time.
+	// Then reports the best time per op out of a few calls that size.
+	template <typename Function>
+	inline void Run(const char *name, const char *params, Function &&run)
+	{
+		if (!IsSelected(name)) return;
+
+		typedef std::chrono::steady_clock Clock;
+		const double minSeconds = GetSettings().isQuick ? 0.002 : 0.1;
+		const int numSamples = GetSettings().isQuick ? 1 : 5;
+
+		uint64_t numOps = 1;
+		double seconds = 0.0;
+		while (true) {
+			Clock::time_point start = Clock::now();
+			run(numOps);
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			if (seconds >= minSeconds || numOps >= (uint64_t(1) << 40)) break;
+			numOps *= seconds > 0.0 && minSeconds / seconds < 10.0 ? 2 : 10;
+		}
+
+		double bestSeconds = seconds;
+		for (int i = 1; i < numSamples; i++) {
+			Clock::time_point start = Clock::now();
+			run(numOps);
+			double sampleSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+			if (sampleSeconds < bestSeconds) bestSeconds = sampleSeconds;
+		}
+
+		std::printf("{\"bench\":\"%s\",\"params\":\"%s\",\"ns_per_op\":%.4g,\"ops\":%llu}\n", name, params, bestSeconds * 1e9 / double(numOps), (unsigned long long)numOps);
+		std::fflush(stdout);
+	}
+}
@@ -0,0 +1,292 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+
+#include "bench.h"
+#include "config.h"
+#include "magiccore.h"
+#include "replay.h"
+
+using namespace MagicCore;
+
+
+// Not timings: feeds synthetic hand traces through the caster's aim smoothing at several frame rates,
+// and reports how far the smoothed aim lags behind the hand with the frame-count box filter and with the time-based exponential filter,
+// each without and with aim prediction, and how far the prediction overshoots when the hand stops.
+//
+// Then does the same for a recorded session: --trace <file> replays a file written with RecordFrameInputs = 1. Without one, a synthetic session is
+// recorded and replayed instead, so that the recorded path always runs.
+namespace {
+	const float kDegrees = 0.017453292f;
+
+	enum class Prediction
+	{
+		None,
+		Velocity,
+		Acceleration,
+	};
+
+	const char * GetPredictionName(Prediction prediction)
+	{
+		switch (prediction) {
+		case Prediction::Velocity: return "velocity";
+		case Prediction::Acceleration: return "acceleration";
+		default: return "none";
+		}
+	}
+
+	Config::Options MakeOptions(bool useTimeBasedSmoothing, Prediction prediction)
+	{
+		Config::Options options;
+		options.useTimeBasedSmoothing = useTimeBasedSmoothing;
+		options.enableAimPrediction = prediction != Prediction::None;
+		options.aimPredictionUseAcceleration = prediction == Prediction::Acceleration;
+		return options;
+	}
+
+	Mat33 AimRotation(float angle)
+	{
+		Mat33 rot;
+		rot.data[0][0] = cosf(angle); rot.data[0][1] = -sinf(angle);
+		rot.data[1][0] = sinf(angle); rot.data[1][1] = cosf(angle);
+		return rot;
+	}
+
+	float AimAngle(const Vec3 &forward)
+	{
+		return atan2f(-forward.x, forward.y);
+	}
+
+	// Forward is +y, i.e. the rotation's second column
+	Vec3 GetForward(const Transform &transform)
+	{
+		return { transform.rot.data[0][1], transform.rot.data[1][1], transform.rot.data[2][1] };
+	}
+
+	float GetAngleBetween(const Vec3 &a, const Vec3 &b)
+	{
+		float cosAngle = DotProduct(a, b) / sqrtf(VectorLengthSquared(a) * VectorLengthSquared(b));
+		return acosf(cosAngle > 1.f ? 1.f : (cosAngle < -1.f ? -1.f : cosAngle));
+	}
+
+	struct Scenario
+	{
+		int frameRate;
+		SpellSkillLevel level;
+		bool useTimeBasedSmoothing;
+		Prediction prediction;
+	};
+
+	// Runs the caster on angle(t) for duration seconds after a second of holding still at angle(0),
+	// and calls measure(t, handAngle, smoothedAngle) every frame
+	template <typename Trace, typename Measure>
+	void RunTrace(const Scenario &scenario, Trace &&angle, float duration, Measure &&measure)
+	{
+		Config::Options options = MakeOptions(scenario.useTimeBasedSmoothing, scenario.prediction);
+		Caster caster;
+		Inputs inputs;
+		inputs.primarySpell.isValid = true;
+		inputs.primarySpell.skillLevel = scenario.level;
+
+		float deltaTime = 1.f / float(scenario.frameRate);
+		inputs.primaryAimWorld.rot = AimRotation(angle(0.f));
+		for (int i = 0; i < scenario.frameRate; i++) {
+			caster.Step(options, inputs, deltaTime);
+		}
+
+		int numFrames = int(duration * float(scenario.frameRate));
+		for (int i = 1; i <= numFrames; i++) {
+			float t = float(i) * deltaTime;
+			float handAngle = angle(t);
+			inputs.primaryAimWorld.rot = AimRotation(handAngle);
+			Outputs outputs = caster.Step(options, inputs, deltaTime);
+			measure(t, handAngle, AimAngle(outputs.primaryAimForward));
+		}
+	}
+
+	void MeasureScenario(const Scenario &scenario)
+	{
+		const char *name = scenario.useTimeBasedSmoothing ? "aim_latency/exponential" : "aim_latency/box";
+		std::string params = "hz=" + std::to_string(scenario.frameRate) + ",level=" + (scenario.level == SpellSkillLevel::Master ? "master" : "novice");
+		if (scenario.prediction != Prediction::None) {
+			params += std::string(",prediction=") + GetPredictionName(scenario.prediction);
+		}
+
+		// A 20 degree flick: time until the smoothed aim has covered half and 90% of it, and how far past it the aim goes
+		const float kStep = 20.f * kDegrees;
+		float halfTime = -1.f, ninetyTime = -1.f, stepOvershoot = 0.f;
+		RunTrace(scenario, [&](float t) { return t > 0.f ? kStep : 0.f; }, 2.f, [&](float t, float, float smoothed) {
+			if (halfTime < 0.f && smoothed >= 0.5f * kStep) halfTime = t;
+			if (ninetyTime < 0.f && smoothed >= 0.9f * kStep) ninetyTime = t;
+			stepOvershoot = std::fmax(stepOvershoot, smoothed - kStep);
+		});
+		Bench::ReportValue(name, (params + ",trace=step").c_str(), "t50_ms", halfTime * 1000.f);
+		Bench::ReportValue(name, (params + ",trace=step").c_str(), "t90_ms", ninetyTime * 1000.f);
+		Bench::ReportValue(name, (params + ",trace=step").c_str(), "overshoot_deg", stepOvershoot / kDegrees);
+
+		// A steady 60 degree per second sweep: once settled, how far behind the hand the aim is, in time
+		const float kSweepRate = 60.f * kDegrees;
+		float lag = 0.f;
+		RunTrace(scenario, [&](float t) { return kSweepRate * t; }, 1.5f, [&](float, float hand, float smoothed) {
+			lag = (hand - smoothed) / kSweepRate;
+		});
+		Bench::ReportValue(name, (params + ",trace=sweep").c_str(), "lag_ms", lag * 1000.f);
+
+		// The same sweep, stopping dead after a second: where prediction pays for its lead, by carrying on past where the hand stopped
+		const float kStopTime = 1.f;
+		float stopOvershoot = 0.f;
+		RunTrace(scenario, [&](float t) { return kSweepRate * std::fmin(t, kStopTime); }, 2.f, [&](float t, float, float smoothed) {
+			if (t > kStopTime) stopOvershoot = std::fmax(stopOvershoot, smoothed - kSweepRate * kStopTime);
+		});
+		Bench::ReportValue(name, (params + ",trace=sweep_stop").c_str(), "overshoot_deg", stopOvershoot / kDegrees);
+
+		// Physiological tremor around a fixed aim: 1 degree at 8.7 Hz, which doesn't line up with any of the frame rates. What's left of it after smoothing, RMS in degrees.
+		double sumSquares = 0.0;
+		int numSamples = 0;
+		RunTrace(scenario, [&](float t) { return 1.f * kDegrees * sinf(2.f * 3.14159265f * 8.7f * t); }, 3.f, [&](float t, float, float smoothed) {
+			if (t < 1.f) return;
+			sumSquares += double(smoothed) * double(smoothed);
+			numSamples++;
+		});
+		Bench::ReportValue(name, (params + ",trace=tremor").c_str(), "rms_deg", std::sqrt(sumSquares / numSamples) / kDegrees);
+	}
+
+	// Half a minute of made up play at 90 Hz, recorded the way the plugin does it: slow sweeps with tremor, flicks, and a break with the spell put away
+	bool RecordSyntheticSession(const char *path)
+	{
+		Replay::Recorder recorder;
+		if (!recorder.Open(path)) return false;
+
+		Config::Options options;
+		Caster caster;
+		Inputs inputs;
+		inputs.primarySpell.isValid = true;
+		inputs.primarySpell.skillLevel = SpellSkillLevel::Expert;
+		inputs.secondarySpell = inputs.primarySpell;
+		const float kDeltaTime = 1.f / 90.f;
+		bool wasActive = false;
+		for (int i = 0; i < 90 * 30; i++) {
+			if (i % 256 == 0) recorder.Flush();
+
+			if (i >= 90 * 14 && i < 90 * 16) {
+				recorder.AddInactiveFrame();
+				wasActive = false;
+				continue;
+			}
+			if (!wasActive) {
+				caster.ResetSmoothing();
+				recorder.AddResetSmoothing();
+				wasActive = true;
+			}
+
+			float t = float(i) * kDeltaTime;
+			float angle = 0.6f * sinf(t * 0.9f) + 0.3f * (fmodf(t, 4.f) > 2.f ? 1.f : 0.f) + 0.01f * sinf(2.f * 3.14159265f * 8.7f * t);
+			inputs.primaryAimWorld.rot = AimRotation(angle);
+			inputs.secondaryAimWorld.rot = AimRotation(-angle);
+			Outputs outputs = caster.Step(options, inputs, kDeltaTime);
+
+			Replay::FrameRecord record{};
+			record.primarySpellFormId = 0x00012FCD;
+			record.secondarySpellFormId = 0x00012FCD;
+			record.deltaTime = kDeltaTime;
+			record.flags = Replay::FrameRecord::kFlag_IsWeaponDrawn;
+			Replay::FromInputs(inputs, record);
+			recorder.WriteFrame(record, inputs, outputs);
+		}
+		recorder.Close();
+		return recorder.GetNumDropped() == 0;
+	}
+
+	// Replays a recorded session with each filter and prediction. Reports how far the aim is from where the hand points, on average,
+	// and the jerk of the aim (RMS of its second difference), which is what shows up as jitter.
+	void MeasureRecordedTrace(const char *path, const char *traceName)
+	{
+		for (bool useTimeBasedSmoothing : { false, true }) {
+			const char *name = useTimeBasedSmoothing ? "aim_latency/exponential" : "aim_latency/box";
+			if (!Bench::IsSelected(name)) continue;
+
+			for (Prediction prediction : { Prediction::None, Prediction::Velocity, Prediction::Acceleration }) {
+				Replay::Reader reader;
+				if (!reader.Open(path)) {
+					std::printf("# Couldn't read %s\n", path);
+					return;
+				}
+
+				Config::Options options = MakeOptions(useTimeBasedSmoothing, prediction);
+				Replay::Replayer replayer;
+				Replay::Frame frame;
+				double sumError = 0.0, sumJerkSquares = 0.0;
+				int numFrames = 0, numJerkSamples = 0, numFramesInRun = 0;
+				Vec3 previous[2];
+				while (reader.Read(frame)) {
+					if (frame.gapBefore.numInactiveFrames || frame.gapBefore.numDroppedFrames) {
+						numFramesInRun = 0;
+					}
+
+					Outputs outputs = replayer.Step(options, frame);
+					if (!outputs.hasPrimaryAimForward) {
+						numFramesInRun = 0;
+						continue;
+					}
+
+					Vec3 forward = VectorNormalized(outputs.primaryAimForward);
+					sumError += GetAngleBetween(forward, GetForward(frame.inputs.primaryAimWorld));
+					numFrames++;
+
+					if (numFramesInRun >= 2) {
+						Vec3 jerk = forward - previous[0] * 2.f + previous[1];
+						sumJerkSquares += double(VectorLengthSquared(jerk));
+						numJerkSamples++;
+					}
+					previous[1] = previous[0];
+					previous[0] = forward;
+					numFramesInRun++;
+				}
+
+				std::string params = std::string("trace=") + traceName;
+				if (prediction != Prediction::None) {
+					params += std::string(",prediction=") + GetPredictionName(prediction);
+				}
+				Bench::ReportValue(name, params.c_str(), "mean_error_deg", numFrames ? sumError / numFrames / kDegrees : 0.0);
+				Bench::ReportValue(name, params.c_str(), "jerk_deg", numJerkSamples ? std::sqrt(sumJerkSquares / numJerkSamples) / kDegrees : 0.0);
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	const char *tracePath = nullptr;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--trace") == 0) tracePath = argv[i + 1];
+	}
+
+	for (bool useTimeBasedSmoothing : { false, true }) {
+		if (!Bench::IsSelected(useTimeBasedSmoothing ? "aim_latency/exponential" : "aim_latency/box")) continue;
+		for (Prediction prediction : { Prediction::None, Prediction::Velocity, Prediction::Acceleration }) {
+			for (int frameRate : { 72, 90, 120 }) {
+				for (SpellSkillLevel level : { SpellSkillLevel::Novice, SpellSkillLevel::Master }) {
+					MeasureScenario({ frameRate, level, useTimeBasedSmoothing, prediction });
+				}
+			}
+		}
+	}
+
+	if (tracePath) {
+		MeasureRecordedTrace(tracePath, "recorded");
+	}
+	else {
+		const char *kSyntheticPath = "bench_aimlatency.bin";
+		if (!RecordSyntheticSession(kSyntheticPath)) {
+			std::printf("# Couldn't record the synthetic session\n");
+			return 1;
+		}
+		MeasureRecordedTrace(kSyntheticPath, "synthetic_recording");
+		std::remove(kSyntheticPath);
+	}
+	return 0;
+}
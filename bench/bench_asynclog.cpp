@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "asynclog.h"
+
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	// Stands in for the log file: the writer thread formats every record as usual, and the line goes nowhere
+	std::atomic<uint64_t> g_numLinesWritten{ 0 };
+	std::atomic<uint64_t> g_numWarningLines{ 0 };
+
+	void CountingSink(AsyncLog::Level level, const char *line)
+	{
+		Bench::DoNotOptimize(line);
+		if (level == AsyncLog::Level::Warning) {
+			// "dropped n records"
+			g_numWarningLines.fetch_add(1, std::memory_order_relaxed);
+		}
+		g_numLinesWritten.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Logs what the per-frame diagnostics do: a few numbers, and sometimes a string
+	void LogFrame(uint64_t frame)
+	{
+		AsyncLog::Debug("Frame %llu: magicka %.2f, scale %.3f", (unsigned long long)frame, 0.75 + frame * 1e-6, 1.25);
+	}
+
+	void LogFrameWithString(uint64_t frame)
+	{
+		AsyncLog::Debug("Frame %llu: magicka %.2f, scale %.3f, spell %s", (unsigned long long)frame, 0.75 + frame * 1e-6, 1.25, "Firebolt");
+	}
+
+	void WaitUntilWritten(uint64_t numLines)
+	{
+		while (g_numLinesWritten.load(std::memory_order_relaxed) - g_numWarningLines.load(std::memory_order_relaxed) < numLines) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	// What a log call costs the hook thread. Timed by hand in batches that fit in the ring and the string arena, letting the writer catch up in between
+	// without timing it, since at one or two records a frame neither ever fills in the game.
+	template <typename LogFunction>
+	void BenchHotPath(const char *params, LogFunction log)
+	{
+		if (!Bench::IsSelected("asynclog/hot_path")) return;
+
+		const int kBatchSize = 128;
+		const int numBatches = Bench::GetSettings().isQuick ? 10 : 2000;
+		uint64_t numDroppedBefore = AsyncLog::GetNumDropped();
+		uint64_t numLinesBefore = g_numLinesWritten.load() - g_numWarningLines.load();
+		uint64_t numLogged = 0;
+		double seconds = 0.0;
+		for (int batch = 0; batch < numBatches; batch++) {
+			WaitUntilWritten(numLinesBefore + numLogged);
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < kBatchSize; i++) {
+				log(numLogged + i);
+			}
+			seconds += std::chrono::duration<double>(Clock::now() - start).count();
+			numLogged += kBatchSize;
+		}
+		WaitUntilWritten(numLinesBefore + numLogged);
+
+		Bench::ReportValue("asynclog/hot_path", params, "ns_per_op", seconds * 1e9 / double(numLogged));
+		Bench::ReportValue("asynclog/hot_path", params, "dropped", double(AsyncLog::GetNumDropped() - numDroppedBefore));
+	}
+
+	// What the hook used to pay: formatting and writing the line itself
+	void BenchSynchronous()
+	{
+		std::FILE *file = std::tmpfile();
+		if (!file) return;
+
+		Bench::Run("asynclog/synchronous", "args=4", [&](uint64_t numOps) {
+			char line[1024];
+			for (uint64_t i = 0; i < numOps; i++) {
+				snprintf(line, sizeof(line), "Frame %llu: magicka %.2f, scale %.3f, spell %s", (unsigned long long)i, 0.75 + i * 1e-6, 1.25, "Firebolt");
+				std::fputs(line, file);
+				std::fputc('\n', file);
+			}
+			std::fflush(file);
+		});
+		std::fclose(file);
+	}
+
+	// How many records a second get through to the file, and how many are dropped, with producers logging flat out (more than the writer can ever format)
+	// or in bursts every millisecond (which it can, as long as it wakes up in time to keep the ring from filling)
+	void BenchThroughput(int numProducers, int burstSize)
+	{
+		char params[64];
+		snprintf(params, sizeof(params), "producers=%d,rate=%s", numProducers, burstSize ? "bursts" : "flat_out");
+		if (!Bench::IsSelected("asynclog/throughput")) return;
+
+		const uint64_t numPerProducer = Bench::GetSettings().isQuick ? 2000 : 200000;
+		uint64_t numLinesBefore = g_numLinesWritten.load() - g_numWarningLines.load();
+		uint64_t numDroppedBefore = AsyncLog::GetNumDropped();
+
+		Clock::time_point start = Clock::now();
+		std::vector<std::thread> producers;
+		for (int p = 0; p < numProducers; p++) {
+			producers.emplace_back([numPerProducer, burstSize]() {
+				Clock::time_point nextBurst = Clock::now();
+				for (uint64_t i = 0; i < numPerProducer; i++) {
+					if (burstSize && i % burstSize == 0) {
+						nextBurst += std::chrono::milliseconds(1);
+						std::this_thread::sleep_until(nextBurst);
+					}
+					LogFrame(i);
+				}
+			});
+		}
+		for (std::thread &producer : producers) {
+			producer.join();
+		}
+		uint64_t numDropped = AsyncLog::GetNumDropped() - numDroppedBefore;
+		WaitUntilWritten(numLinesBefore + numPerProducer * numProducers - numDropped);
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		uint64_t numWritten = numPerProducer * numProducers - numDropped;
+		Bench::ReportValue("asynclog/throughput", params, "written_per_second", double(numWritten) / seconds);
+		Bench::ReportValue("asynclog/throughput", params, "dropped_fraction", double(numDropped) / double(numPerProducer * numProducers));
+	}
+
+	// The ring alone, without the formatting: one push and one pop
+	void BenchRing()
+	{
+		static AsyncLog::MpscRing<AsyncLog::Record, 2048> s_ring;
+		AsyncLog::Record record{};
+		record.format = "%d";
+		record.numArgs = 1;
+		record.argTypes[0] = AsyncLog::ArgType::Int;
+
+		Bench::Run("asynclog/ring_push_pop", "", [&](uint64_t numOps) {
+			AsyncLog::Record popped;
+			for (uint64_t i = 0; i < numOps; i++) {
+				record.args[0].i = int64_t(i);
+				s_ring.TryPush(record);
+				s_ring.TryPop(popped);
+			}
+			Bench::DoNotOptimize(popped);
+		});
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	// Once started, the writer runs until the process exits
+	AsyncLog::Start(CountingSink);
+
+	BenchRing();
+	BenchHotPath("args=3", LogFrame);
+	BenchHotPath("args=4,string", LogFrameWithString);
+	BenchSynchronous();
+	BenchThroughput(1, 0);
+	BenchThroughput(2, 0);
+	// 500k records a second each, 5000 in what used to be the writer's 10 ms nap
+	BenchThroughput(1, 500);
+	BenchThroughput(2, 500);
+	return 0;
+}
@@ -0,0 +1,219 @@
+#include <cmath>
+#include <initializer_list>
+#include <string>
+
+#include "bench.h"
+#include "config.h"
+#include "configsnapshot.h"
+#include "magiccore.h"
+#include "profiling.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	Mat33 AimRotation(float angle)
+	{
+		Mat33 rot;
+		rot.data[0][0] = cosf(angle); rot.data[0][1] = -sinf(angle);
+		rot.data[1][0] = sinf(angle); rot.data[1][1] = cosf(angle);
+		return rot;
+	}
+
+	Inputs MakeInputs()
+	{
+		Inputs inputs;
+		inputs.primaryOffsetWorld.pos = { 10.f, 0.f, 0.f };
+		inputs.secondaryOffsetWorld.pos = { -10.f, 0.f, 0.f };
+		inputs.primaryOffsetLocal = inputs.primaryOffsetWorld;
+		inputs.secondaryOffsetLocal = inputs.secondaryOffsetWorld;
+		inputs.primarySpell.isValid = true;
+		inputs.primarySpell.skillLevel = SpellSkillLevel::Master;
+		inputs.secondarySpell.isValid = true;
+		inputs.secondarySpell.skillLevel = SpellSkillLevel::Master;
+		inputs.hasDualCaster = true;
+		return inputs;
+	}
+
+	// Every key, the way the shipped misvr.ini has them
+	const char *kFullConfig =
+		"[Settings]\n"
+		"dualCastHandsCloseSpellScale = 1.0\n"
+		"dualCastHandsFarSpellScale = 2.0\n"
+		"DualCastHandSeparationScalingDistance = 90.0\n"
+		"SpellScaleWhenMagickaEmpty = 0.35\n"
+		"SpellScaleWhenMagickaFull = 1.0\n"
+		"ParticleScaleMode = 0\n"
+		"ScaleParticleVelocity = 0\n"
+		"EnableEmissionLod = 0\n"
+		"EmissionLodExponent = 1.0\n"
+		"MinEmissionScale = 0.25\n"
+		"EmissionLodParticleBudget = 0\n"
+		"useCastingTimeForMergeTime = 0\n"
+		"spellMergeTime = 0.15\n"
+		"spellUnMergeTime = 0.1\n"
+		"MagicRotationRoll = 0.0\n"
+		"MagicRotationYaw = 0.0\n"
+		"numSmoothingFramesNovice = 10\n"
+		"numSmoothingFramesApprentice = 15\n"
+		"numSmoothingFramesAdept = 20\n"
+		"numSmoothingFramesExpert = 25\n"
+		"numSmoothingFramesMaster = 40\n"
+		"smoothingDualCastMultiplier = 1.25\n"
+		"useTimeBasedSmoothing = 0\n"
+		"smoothingTimeNovice = 0.05\n"
+		"smoothingTimeApprentice = 0.075\n"
+		"smoothingTimeAdept = 0.1\n"
+		"smoothingTimeExpert = 0.13\n"
+		"smoothingTimeMaster = 0.2\n"
+		"EnableAimPrediction = 0\n"
+		"AimPredictionLeadNovice = 0.025\n"
+		"AimPredictionLeadApprentice = 0.035\n"
+		"AimPredictionLeadAdept = 0.05\n"
+		"AimPredictionLeadExpert = 0.065\n"
+		"AimPredictionLeadMaster = 0.1\n"
+		"AimPredictionMaxAngle = 10.0\n"
+		"AimPredictionUseAcceleration = 0\n"
+		"UseOffHandForDualCastAiming = 0\n"
+		"UseMainHandForDualCastAiming = 0\n"
+		"EnableProfiling = 0\n"
+		"ProfilingReportInterval = 10.0\n"
+		"RecordFrameInputs = 0\n"
+		"LogFrameDiagnostics = 0\n"
+		"ReloadConfigOnChange = 0\n"
+		"EnableNpcCasters = 0\n"
+		"MaxNpcCasters = 16\n";
+
+	const float kDeltaTime = 1.f / 90.f;
+}
+
+// One frame of aim smoothing and state machine for the player, with the aim turning a little every frame
+void BenchCasterStep(const char *name, const Config::Options &options, bool isDualCasting)
+{
+	Caster caster;
+	Inputs inputs = MakeInputs();
+	inputs.isCastingDual = isDualCasting;
+	Caster::StepFunction step = Caster::GetStepFunction(options);
+
+	Bench::Run(name, isDualCasting ? "dual_cast=1" : "dual_cast=0", [&](uint64_t numOps) {
+		float angle = 0.f;
+		for (uint64_t i = 0; i < numOps; i++) {
+			angle += 0.001f;
+			inputs.primaryAimWorld.rot = AimRotation(angle);
+			inputs.secondaryAimWorld.rot = AimRotation(-angle);
+			Outputs outputs = (caster.*step)(options, inputs, kDeltaTime);
+			Bench::DoNotOptimize(outputs);
+		}
+	});
+}
+
+// The dual cast / merge state machine alone, as it is run for each NPC caster: a cast that merges, holds and unmerges, over and over
+void BenchMergerStep()
+{
+	Config::Options options;
+	DualCastMerger merger;
+	Inputs inputs = MakeInputs();
+
+	Bench::Run("merge/merger_step", "cycle=60", [&](uint64_t numOps) {
+		for (uint64_t i = 0; i < numOps; i++) {
+			inputs.isCastingDual = (i % 60) < 40;
+			Outputs outputs = merger.Step(options, inputs, kDeltaTime);
+			Bench::DoNotOptimize(outputs);
+		}
+	});
+}
+
+// Reading misvr.ini once it's in memory: splitting it up, then looking up every key through the descriptor table
+void BenchConfigParse()
+{
+	Bench::Run("config/parse_and_read", "keys=all", [&](uint64_t numOps) {
+		for (uint64_t i = 0; i < numOps; i++) {
+			Ini::File file;
+			file.Parse(kFullConfig);
+			Config::Options options;
+			bool readAll = Config::ReadConfigOptions(file, options);
+			Bench::DoNotOptimize(readAll);
+		}
+	});
+}
+
+// The same, with misvr.ini at the end of a big file full of other sections, e.g. a merged ini of many mods
+void BenchConfigParseLarge(int numExtraLines)
+{
+	std::string text;
+	for (int i = 0; i < numExtraLines; i++) {
+		if (i % 50 == 0) {
+			text += "[OtherMod" + std::to_string(i / 50) + "]\n";
+		}
+		else if (i % 10 == 0) {
+			text += "; a comment about the next few keys\n";
+		}
+		else {
+			text += "someOption" + std::to_string(i) + " = " + std::to_string(i * 0.25) + "\n";
+		}
+	}
+	text += kFullConfig;
+
+	std::string params = "lines=" + std::to_string(numExtraLines);
+	Bench::Run("config/parse_and_read_large", params.c_str(), [&](uint64_t numOps) {
+		for (uint64_t i = 0; i < numOps; i++) {
+			Ini::File file;
+			file.Parse(text);
+			Config::Options options;
+			bool readAll = Config::ReadConfigOptions(file, options);
+			Bench::DoNotOptimize(readAll);
+		}
+	});
+}
+
+// What each hook pays to pin the current options at entry
+void BenchConfigSnapshot()
+{
+	Bench::Run("config/snapshot", "readers=1", [&](uint64_t numOps) {
+		for (uint64_t i = 0; i < numOps; i++) {
+			Config::Snapshot snapshot;
+			Bench::DoNotOptimize(snapshot->magicRotationRoll);
+		}
+	});
+}
+
+// What a ScopedTimer around a hook stage costs, with profiling off (what everyone pays) and on
+void BenchScopedTimer(bool isEnabled)
+{
+	Profiling::g_isEnabled = isEnabled;
+	Bench::Run("profiling/scoped_timer", isEnabled ? "enabled=1" : "enabled=0", [&](uint64_t numOps) {
+		for (uint64_t i = 0; i < numOps; i++) {
+			Profiling::ScopedTimer timer(Profiling::Stage::Smoothing);
+		}
+	});
+	Profiling::g_isEnabled = false;
+	Profiling::g_histograms[int(Profiling::Stage::Smoothing)].Reset();
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	Config::Options frameCountOptions;
+	BenchCasterStep("smoothing/caster_step_frame_count", frameCountOptions, false);
+	BenchCasterStep("smoothing/caster_step_frame_count", frameCountOptions, true);
+
+	Config::Options timeBasedOptions;
+	timeBasedOptions.useTimeBasedSmoothing = true;
+	BenchCasterStep("smoothing/caster_step_time_based", timeBasedOptions, false);
+	BenchCasterStep("smoothing/caster_step_time_based", timeBasedOptions, true);
+
+	Config::Options predictionOptions;
+	predictionOptions.enableAimPrediction = true;
+	BenchCasterStep("smoothing/caster_step_prediction", predictionOptions, false);
+
+	BenchMergerStep();
+	BenchConfigParse();
+	for (int numExtraLines : { 1000, 10000, 100000 }) {
+		BenchConfigParseLarge(numExtraLines);
+	}
+	BenchConfigSnapshot();
+	BenchScopedTimer(false);
+	BenchScopedTimer(true);
+	return 0;
+}
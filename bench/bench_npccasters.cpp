@@ -0,0 +1,154 @@
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "casterselection.h"
+#include "magiccore.h"
+
+using namespace MagicCore;
+
+
+// The per-frame NPC pass of npccasters.cpp without the engine: hundreds of synthetic NPCs wandering around the player, some of them dual casting,
+// ranked by distance each frame with the closest few getting their dual cast merge stepped.
+namespace {
+	// Cheap deterministic pseudo-random numbers
+	uint32_t NextRandom(uint32_t &state)
+	{
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	float RandomFloat(uint32_t &state, float min, float max)
+	{
+		return min + (max - min) * float(NextRandom(state) & 0xFFFF) / 65535.f;
+	}
+
+	struct SyntheticActor
+	{
+		float x, y;
+		float heading;
+		bool isCasting; // hands out
+		bool isDualCasting;
+		DualCastMerger merger; // kept per actor rather than per record, which is the same amount of stepping
+		bool isTracked = false;
+	};
+
+	struct Crowd
+	{
+		std::vector<SyntheticActor> actors;
+		std::vector<CasterCandidate> ranking;
+		uint32_t random = 1;
+
+		explicit Crowd(int numActors)
+		{
+			for (int i = 0; i < numActors; i++) {
+				SyntheticActor actor;
+				actor.x = RandomFloat(random, -8000.f, 8000.f);
+				actor.y = RandomFloat(random, -8000.f, 8000.f);
+				actor.heading = RandomFloat(random, 0.f, 6.2831853f);
+				actor.isCasting = NextRandom(random) % 3 != 0;
+				actor.isDualCasting = NextRandom(random) % 4 == 0;
+				actors.push_back(actor);
+			}
+		}
+
+		// Everyone walks on a bit, now and then someone turns, readies or sheathes, or starts or stops dual casting
+		void Move(float deltaTime)
+		{
+			for (SyntheticActor &actor : actors) {
+				actor.x += cosf(actor.heading) * 150.f * deltaTime;
+				actor.y += sinf(actor.heading) * 150.f * deltaTime;
+			}
+			for (int i = 0; i < 4; i++) {
+				SyntheticActor &actor = actors[NextRandom(random) % actors.size()];
+				actor.heading = RandomFloat(random, 0.f, 6.2831853f);
+				if (NextRandom(random) % 8 == 0) actor.isCasting = !actor.isCasting;
+				if (NextRandom(random) % 2 == 0) actor.isDualCasting = !actor.isDualCasting;
+			}
+		}
+
+		// Returns how many NPCs started being looked after this frame
+		int Update(const Config::Options &options, int maxCasters, float deltaTime)
+		{
+			ranking.clear();
+			for (size_t i = 0; i < actors.size(); i++) {
+				const SyntheticActor &actor = actors[i];
+				if (actor.isCasting) {
+					ranking.push_back({ uint32_t(i), actor.x * actor.x + actor.y * actor.y, actor.isTracked });
+				}
+			}
+			int numSelected = SelectNearestCasters(ranking.data(), int(ranking.size()), maxCasters);
+
+			for (int i = numSelected; i < int(ranking.size()); i++) {
+				actors[ranking[i].id].isTracked = false;
+			}
+			int numStarted = 0;
+			for (int i = 0; i < numSelected; i++) {
+				SyntheticActor &actor = actors[ranking[i].id];
+				if (!actor.isTracked) {
+					actor.merger = DualCastMerger();
+					actor.isTracked = true;
+					numStarted++;
+				}
+
+				Inputs inputs;
+				inputs.primaryOffsetWorld.pos = { actor.x + 10.f, actor.y, 100.f };
+				inputs.secondaryOffsetWorld.pos = { actor.x - 10.f, actor.y, 100.f };
+				inputs.primaryOffsetLocal.pos = { 10.f, 0.f, 0.f };
+				inputs.secondaryOffsetLocal.pos = { -10.f, 0.f, 0.f };
+				inputs.primaryOffsetParentWorld.pos = { actor.x, actor.y, 100.f };
+				inputs.secondaryOffsetParentWorld.pos = { actor.x, actor.y, 100.f };
+				inputs.primarySpell.isValid = true;
+				inputs.secondarySpell.isValid = true;
+				inputs.hasDualCaster = true;
+				inputs.isCastingDual = actor.isDualCasting;
+				Outputs outputs = actor.merger.Step(options, inputs, deltaTime);
+				Bench::DoNotOptimize(outputs);
+			}
+			// Sheathed ones aren't ranked at all
+			for (SyntheticActor &actor : actors) {
+				if (!actor.isCasting) actor.isTracked = false;
+			}
+			return numStarted;
+		}
+	};
+
+	const float kDeltaTime = 1.f / 90.f;
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+	Config::Options options;
+
+	for (int numActors : { 100, 300, 1000 }) {
+		for (int maxCasters : { 16, 64 }) {
+			std::string params = "actors=" + std::to_string(numActors) + ",max_casters=" + std::to_string(maxCasters);
+
+			// One op per frame
+			Crowd crowd(numActors);
+			Bench::Run("npccasters/frame", params.c_str(), [&](uint64_t numOps) {
+				for (uint64_t i = 0; i < numOps; i++) {
+					crowd.Move(kDeltaTime);
+					Bench::DoNotOptimize(crowd.Update(options, maxCasters, kDeltaTime));
+				}
+			});
+
+			// How often the selection changes hands, which throws away the merge state and particle caches of whoever drops out
+			if (Bench::IsSelected("npccasters/switches")) {
+				Crowd switching(numActors);
+				int numFrames = 900, numStarted = 0;
+				for (int i = 0; i < numFrames; i++) {
+					switching.Move(kDeltaTime);
+					int started = switching.Update(options, maxCasters, kDeltaTime);
+					if (i > 0) numStarted += started; // everyone starts on the first frame
+				}
+				Bench::ReportValue("npccasters/switches", params.c_str(), "started_per_second", double(numStarted) / (double(numFrames) * kDeltaTime));
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,95 @@
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.h"
+#include "overridetable.h"
+
+using namespace Config;
+
+
+namespace {
+	// Form ids the way a big load order has them: spread over a couple of hundred plugins, a few thousand records each
+	std::vector<uint32_t> MakeFormIds(int count, uint32_t seed)
+	{
+		std::vector<uint32_t> formIds(count);
+		uint32_t state = seed;
+		for (int i = 0; i < count; i++) {
+			state = state * 1664525u + 1013904223u;
+			uint32_t modIndex = (state >> 24) % 200;
+			formIds[i] = (modIndex << 24) | ((state >> 4) & 0xFFFFF);
+		}
+		return formIds;
+	}
+
+	// Looking up the overrides of every spell cast, half of which have none. Only happens the first time a spell is seen in the game,
+	// but it's what the table is built for.
+	void BenchLookup(int numEntries)
+	{
+		std::vector<uint32_t> formIds = MakeFormIds(numEntries, 1);
+		std::vector<uint32_t> misses = MakeFormIds(numEntries, 2);
+		std::vector<uint32_t> queries;
+		for (int i = 0; i < 4096; i++) {
+			queries.push_back(i % 2 ? formIds[(i * 7919) % numEntries] : misses[(i * 104729) % numEntries]);
+		}
+		std::string params = "entries=" + std::to_string(numEntries);
+
+		SpellOverrideTable table;
+		for (uint32_t formId : formIds) {
+			table.Add(formId).fields = SpellOverrides::kSpellMergeTime;
+		}
+		table.Build();
+		Bench::Run("overrides/lookup", params.c_str(), [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				const SpellOverrides *overrides = table.Find(queries[i & 4095]);
+				Bench::DoNotOptimize(overrides);
+			}
+		});
+
+		// What a plain hash map does with the same lookups
+		std::unordered_map<uint32_t, SpellOverrides> map;
+		for (uint32_t formId : formIds) {
+			map[formId].fields = SpellOverrides::kSpellMergeTime;
+		}
+		Bench::Run("overrides/lookup_unordered_map", params.c_str(), [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				auto it = map.find(queries[i & 4095]);
+				const SpellOverrides *overrides = it != map.end() ? &it->second : nullptr;
+				Bench::DoNotOptimize(overrides);
+			}
+		});
+	}
+
+	// Compiling the table at data load, with one form in ten listed twice
+	void BenchBuild(int numEntries)
+	{
+		std::vector<uint32_t> formIds = MakeFormIds(numEntries, 1);
+		std::string params = "entries=" + std::to_string(numEntries);
+		Bench::Run("overrides/build", params.c_str(), [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				SpellOverrideTable table;
+				for (int j = 0; j < numEntries; j++) {
+					SpellOverrides &overrides = table.Add(formIds[j]);
+					overrides.fields = SpellOverrides::kSpellMergeTime;
+					if (j % 10 == 0) table.Add(formIds[j]).fields = SpellOverrides::kNumSmoothingFrames;
+				}
+				table.Build();
+				Bench::DoNotOptimize(table);
+			}
+		});
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	for (int numEntries : { 100, 1000, 5000, 20000 }) {
+		BenchLookup(numEntries);
+	}
+	for (int numEntries : { 1000, 20000 }) {
+		BenchBuild(numEntries);
+	}
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include <cstdlib>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "particlescale.h"
+
+using namespace MagicCore;
+
+
+// Per-frame particle scaling, for each kernel, with and without particles dying and spawning in between
+namespace {
+	float RandomFloat(float min, float max)
+	{
+		return min + (max - min) * float(rand()) / float(RAND_MAX);
+	}
+
+	struct Particles
+	{
+		std::vector<float> sizes;
+		std::vector<ParticleInfo> infos;
+
+		void Spawn()
+		{
+			ParticleInfo info = {};
+			info.velocity = { RandomFloat(-50.f, 50.f), RandomFloat(-50.f, 50.f), RandomFloat(0.f, 100.f) };
+			info.lifeSpan = RandomFloat(1.f, 3.f);
+			sizes.push_back(RandomFloat(0.5f, 2.f));
+			infos.push_back(info);
+		}
+
+		// Same as the engine: the last particle takes the dead one's place
+		void Kill(int i)
+		{
+			sizes[i] = sizes.back();
+			infos[i] = infos.back();
+			sizes.pop_back();
+			infos.pop_back();
+		}
+
+		void Update(float deltaTime)
+		{
+			for (ParticleInfo &info : infos) {
+				info.age += deltaTime;
+				info.velocity.z -= 980.f * deltaTime;
+			}
+		}
+	};
+
+	const char *GetName(SimdLevel level)
+	{
+		switch (level) {
+		case SimdLevel::Sse2: return "sse2";
+		case SimdLevel::Avx2: return "avx2";
+		default: return "scalar";
+		}
+	}
+
+	const float kDeltaTime = 1.f / 90.f;
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	std::vector<SimdLevel> levels = { SimdLevel::Scalar };
+	if (GetSupportedSimdLevel() >= SimdLevel::Sse2) levels.push_back(SimdLevel::Sse2);
+	if (GetSupportedSimdLevel() >= SimdLevel::Avx2) levels.push_back(SimdLevel::Avx2);
+
+	for (int count : { 256, 1024, 4096 }) {
+		// Percent of the particles replaced each frame
+		for (int churn : { 0, 2 }) {
+			for (SimdLevel level : levels) {
+				std::string params = "count=" + std::to_string(count) + ",churn=" + std::to_string(churn) + ",impl=" + GetName(level);
+
+				srand(1);
+				Particles particles;
+				for (int i = 0; i < count; i++) particles.Spawn();
+				ParticleScaler scaler;
+				scaler.SetSimdLevel(level);
+				int numReplaced = count * churn / 100;
+
+				// One op per particle scaled
+				Bench::Run("particlescale/apply", params.c_str(), [&](uint64_t numOps) {
+					for (uint64_t i = 0; i < numOps; i += count) {
+						particles.Update(kDeltaTime);
+						for (int j = 0; j < numReplaced; j++) {
+							particles.Kill(rand() % count);
+							particles.Spawn();
+						}
+						float scale = 0.5f + 0.001f * float(i % 500);
+						scaler.Apply(particles.sizes.data(), particles.infos.data(), count, scale, true);
+						Bench::DoNotOptimize(particles.sizes[0]);
+					}
+				});
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "replay.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	const char *kPath = "bench_replay.bin";
+	const float kDeltaTime = 1.f / 90.f;
+	const int kNumFrames = 90 * 60; // a minute of play
+
+	Mat33 AimRotation(float angle)
+	{
+		Mat33 rot;
+		rot.data[0][0] = cosf(angle); rot.data[0][1] = -sinf(angle);
+		rot.data[1][0] = sinf(angle); rot.data[1][1] = cosf(angle);
+		return rot;
+	}
+
+	// A hand sweeping slowly with some tremor on top, dual casting now and then
+	Inputs MakeInputs(int frame)
+	{
+		Inputs inputs;
+		float t = frame * kDeltaTime;
+		float angle = 0.5f * sinf(t * 0.7f) + 0.01f * sinf(t * 53.f);
+		inputs.primaryAimWorld.rot = AimRotation(angle);
+		inputs.secondaryAimWorld.rot = AimRotation(-angle);
+		inputs.primaryOffsetWorld.pos = { 10.f, 0.f, 0.f };
+		inputs.secondaryOffsetWorld.pos = { -10.f, 0.f, 0.f };
+		inputs.primaryOffsetLocal = inputs.primaryOffsetWorld;
+		inputs.secondaryOffsetLocal = inputs.secondaryOffsetWorld;
+		inputs.primarySpell.isValid = true;
+		inputs.primarySpell.skillLevel = SpellSkillLevel::Master;
+		inputs.secondarySpell.isValid = true;
+		inputs.secondarySpell.skillLevel = SpellSkillLevel::Master;
+		inputs.hasDualCaster = true;
+		inputs.isCastingDual = (frame % 300) >= 100 && (frame % 300) < 220;
+		return inputs;
+	}
+
+	bool IsActive(int frame)
+	{
+		// The spell put away for a second, every ten
+		return frame % 900 < 810;
+	}
+
+	// What the hook thread pays to record a frame: packing it and pushing it to the writer thread. Timed by hand in batches the ring can hold,
+	// with the writer let catch up in between and not timed, since a game doesn't make frames anywhere near fast enough to fill it.
+	void BenchRecord(const Config::Options &options)
+	{
+		std::vector<Inputs> inputs(kNumFrames);
+		std::vector<Outputs> outputs(kNumFrames);
+		Caster caster;
+		for (int i = 0; i < kNumFrames; i++) {
+			inputs[i] = MakeInputs(i);
+			outputs[i] = caster.Step(options, inputs[i], kDeltaTime);
+		}
+
+		if (!Bench::IsSelected("replay/record_frame")) return;
+
+		typedef std::chrono::steady_clock Clock;
+		const int kBatchSize = 256;
+		const int numPasses = Bench::GetSettings().isQuick ? 1 : 20;
+
+		Replay::Recorder recorder;
+		if (!recorder.Open(kPath)) return;
+		double seconds = 0.0;
+		uint64_t numRecorded = 0;
+		for (int pass = 0; pass < numPasses; pass++) {
+			for (int start = 0; start < kNumFrames; start += kBatchSize) {
+				int end = std::min(start + kBatchSize, kNumFrames);
+				Clock::time_point startTime = Clock::now();
+				for (int frame = start; frame < end; frame++) {
+					Replay::FrameRecord record{};
+					record.primarySpellFormId = 0x00012FCD;
+					record.secondarySpellFormId = 0x00012FCD;
+					record.deltaTime = kDeltaTime;
+					Replay::FromInputs(inputs[frame], record);
+					recorder.WriteFrame(record, inputs[frame], outputs[frame]);
+				}
+				seconds += std::chrono::duration<double>(Clock::now() - startTime).count();
+				numRecorded += end - start;
+				recorder.Flush();
+			}
+		}
+		recorder.Close();
+		Bench::ReportValue("replay/record_frame", "", "ns_per_op", seconds * 1e9 / double(numRecorded));
+		Bench::ReportValue("replay/record_frame", "", "dropped_frames", double(recorder.GetNumDropped()));
+		std::remove(kPath);
+	}
+
+	// Records a minute of play with the frame count filter, the way the hooks would
+	bool RecordSession(const Config::Options &options)
+	{
+		Replay::Recorder recorder;
+		if (!recorder.Open(kPath)) return false;
+
+		Caster caster;
+		bool wasActive = false;
+		for (int i = 0; i < kNumFrames; i++) {
+			if (i % 256 == 0) recorder.Flush();
+			if (!IsActive(i)) {
+				recorder.AddInactiveFrame();
+				wasActive = false;
+				continue;
+			}
+			if (!wasActive) {
+				caster.ResetSmoothing();
+				recorder.AddResetSmoothing();
+				wasActive = true;
+			}
+
+			Inputs inputs = MakeInputs(i);
+			Outputs outputs = caster.Step(options, inputs, kDeltaTime);
+			Replay::FrameRecord record{};
+			record.primarySpellFormId = 0x00012FCD;
+			record.secondarySpellFormId = 0x00012FCD;
+			record.deltaTime = kDeltaTime;
+			Replay::FromInputs(inputs, record);
+			recorder.WriteFrame(record, inputs, outputs);
+		}
+		recorder.Close();
+		return recorder.GetNumDropped() == 0;
+	}
+
+	// Replays the recording with options, timing read + step per frame and reporting how far the outputs are from what was recorded.
+	// With the options it was recorded with that has to be 0, with others it's how much they change the aim.
+	void BenchReplay(const char *params, const Config::Options &options)
+	{
+		int numMismatches = 0;
+		float maxDifference = 0.f;
+		Bench::Run("replay/replay_frame", params, [&](uint64_t numOps) {
+			Replay::Reader reader;
+			Replay::Replayer replayer;
+			Replay::Frame frame;
+			numMismatches = 0;
+			maxDifference = 0.f;
+			for (uint64_t i = 0; i < numOps; i++) {
+				if (!reader.Read(frame)) {
+					// Start over, with a new caster as if the game had been restarted
+					reader.Open(kPath);
+					replayer = Replay::Replayer();
+					if (!reader.Read(frame)) return;
+				}
+				Outputs outputs = replayer.Step(options, frame);
+				float difference = Replay::GetOutputsDifference(outputs, frame.outputs);
+				if (difference > 1e-5f) numMismatches++;
+				maxDifference = std::fmax(maxDifference, difference);
+			}
+		});
+		Bench::ReportValue("replay/replay_frame", params, "mismatched_frames", numMismatches);
+		Bench::ReportValue("replay/replay_frame", params, "max_difference", maxDifference);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	Config::Options frameCountOptions;
+	BenchRecord(frameCountOptions);
+
+	if (!RecordSession(frameCountOptions)) {
+		std::printf("# Couldn't record the session to replay\n");
+		return 1;
+	}
+	BenchReplay("filter=frame_count", frameCountOptions);
+
+	Config::Options timeBasedOptions;
+	timeBasedOptions.useTimeBasedSmoothing = true;
+	BenchReplay("filter=time_based", timeBasedOptions);
+
+	std::remove(kPath);
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "scaletargets.h"
+
+using namespace MagicCore;
+
+
+// Per-frame cost of finding and scaling everything under a magic node: walking the whole subtree with the type checks every frame,
+// as SetParticleScaleDownstream used to, against checking the cached flat list and going through that.
+namespace {
+	// Stand-ins for the engine types. The type checks are a virtual call and a dynamic_cast, as GetAsBSTriShape / DYNAMIC_CAST / GetAsNiNode are.
+	struct FakeNode;
+	struct FakeObject
+	{
+		virtual ~FakeObject() {}
+		virtual FakeNode * GetAsNode() { return nullptr; }
+		virtual bool IsGeometry() const { return false; }
+		float scale = 1.f;
+	};
+	struct FakeGeometry : FakeObject
+	{
+		bool IsGeometry() const override { return true; }
+	};
+	struct FakeParticleSystem : FakeObject {};
+	struct FakeNode : FakeObject
+	{
+		FakeNode * GetAsNode() override { return this; }
+		std::vector<FakeObject *> children;
+	};
+
+	struct FakeTraits
+	{
+		typedef FakeObject Object;
+		typedef FakeNode Node;
+		typedef FakeObject *ObjectHandle;
+		typedef FakeNode *NodeHandle;
+
+		static ScaleTargetKind Classify(FakeObject *object, FakeNode *&node)
+		{
+			if (object->IsGeometry()) return ScaleTargetKind::Geometry;
+			if (dynamic_cast<FakeParticleSystem *>(object)) return ScaleTargetKind::ParticleSystem;
+			node = object->GetAsNode();
+			return node ? ScaleTargetKind::Node : ScaleTargetKind::Other;
+		}
+		static int GetNumChildren(FakeNode *node) { return int(node->children.size()); }
+		static FakeObject * GetChild(FakeNode *node, int index) { return node->children[index]; }
+	};
+
+	struct FakeTarget
+	{
+		FakeObject *object;
+		bool isParticleSystem;
+	};
+
+	// Every node has branching child nodes down to depth, and each node also holds a geometry and a particle system, as VFX meshes tend to
+	struct SyntheticTree
+	{
+		std::vector<std::unique_ptr<FakeObject>> objects;
+		FakeNode *root;
+		int numTargets = 0;
+
+		SyntheticTree(int depth, int branching)
+		{
+			root = AddNode(nullptr, depth, branching);
+		}
+
+		template <typename T>
+		T * Add(FakeNode *parent)
+		{
+			objects.emplace_back(new T());
+			T *object = static_cast<T *>(objects.back().get());
+			if (parent) parent->children.push_back(object);
+			return object;
+		}
+
+		FakeNode * AddNode(FakeNode *parent, int depth, int branching)
+		{
+			FakeNode *node = Add<FakeNode>(parent);
+			Add<FakeGeometry>(node);
+			Add<FakeParticleSystem>(node);
+			numTargets += 2;
+			if (depth > 1) {
+				for (int i = 0; i < branching; i++) {
+					AddNode(node, depth - 1, branching);
+				}
+			}
+			return node;
+		}
+	};
+
+	void Scale(FakeObject *object, float scale)
+	{
+		object->scale = object->scale * scale + 0.001f;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	struct Shape { int depth, branching; };
+	for (Shape shape : { Shape{ 2, 2 }, Shape{ 4, 3 }, Shape{ 6, 3 }, Shape{ 8, 2 }, Shape{ 4, 8 } }) {
+		SyntheticTree tree(shape.depth, shape.branching);
+		std::string params = "depth=" + std::to_string(shape.depth) + ",branching=" + std::to_string(shape.branching) + ",targets=" + std::to_string(tree.numTargets);
+
+		Bench::Run("scale_targets/walk", params.c_str(), [&](uint64_t numOps) {
+			auto onNode = [](FakeNode *) {};
+			auto onTarget = [](FakeObject *object, bool) { Scale(object, 0.999f); };
+			for (uint64_t i = 0; i < numOps; i++) {
+				WalkScaleTargets<FakeTraits>(tree.root, onNode, onTarget);
+			}
+		});
+
+		ScaleTargetCache<FakeTraits, FakeTarget> cache;
+		Bench::Run("scale_targets/cached", params.c_str(), [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				if (!cache.IsValidFor(tree.root)) {
+					cache.Build(tree.root);
+				}
+				for (FakeTarget &target : cache.targets) {
+					Scale(target.object, 0.999f);
+				}
+			}
+		});
+
+		Bench::Run("scale_targets/rebuild", params.c_str(), [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				cache.Build(tree.root);
+			}
+		});
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "addressresolver.h"
+#include "sigscan.h"
+
+
+namespace {
+	const char *kCachePath = "bench_sigscan.ini";
+	const size_t kHeaderSize = 0x400;
+	const size_t kCodeOffset = 0x1000;
+
+	// Bytes with roughly the mix of x86-64 code, where the bytes a signature starts with are common
+	std::vector<uint8_t> MakeCodeLikeBlob(size_t size)
+	{
+		static const uint8_t kCommon[] = { 0x00, 0x48, 0x89, 0x8B, 0xE8, 0xCC, 0x0F, 0x4C, 0x24, 0xFF };
+		std::vector<uint8_t> blob(size);
+		uint32_t state = 1;
+		for (size_t i = 0; i < size; i++) {
+			state = state * 1664525u + 1013904223u;
+			blob[i] = (state >> 31) ? kCommon[(state >> 8) % sizeof(kCommon)] : uint8_t(state >> 16);
+		}
+		return blob;
+	}
+
+	// The worst case for a signature: not in the blob at all, so every position gets looked at
+	void BenchFind(const std::vector<uint8_t> &blob, const char *params)
+	{
+		SigScan::Pattern pattern;
+		SigScan::Parse("48 8B 05 ?? ?? ?? ?? 48 85 C0 74 ?? 48 8B 4C 24 01", pattern);
+
+		double mb = double(blob.size()) / (1 << 20);
+		std::printf("# each op scans %.0f MB\n", mb);
+		Bench::Run("sigscan/find", params, [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				Bench::DoNotOptimize(SigScan::Find(blob.data(), blob.size(), pattern));
+			}
+		});
+		Bench::Run("sigscan/find_scalar", params, [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				Bench::DoNotOptimize(SigScan::FindScalar(blob.data(), blob.size(), pattern));
+			}
+		});
+	}
+
+	// What a startup pays for all the addresses the plugin uses: scanning an exe for them the first time, and reading them from the cache after that
+	void BenchResolve(std::vector<uint8_t> &blob, const char *params)
+	{
+		const int kNumAddresses = 9;
+		std::vector<std::string> names(kNumAddresses);
+		std::vector<std::string> signatures(kNumAddresses);
+		std::vector<Addresses::Descriptor> descriptors(kNumAddresses);
+		for (int i = 0; i < kNumAddresses; i++) {
+			// Each one unique, spread over the code, starting with the common 48 8B
+			uint8_t code[16] = { 0x48, 0x8B, 0x0D, uint8_t(i), 0x11, 0x22, 0x33, 0xE8, 0x44, 0x55, 0x66, 0x77, 0x84, 0xC0, 0x74, uint8_t(0x10 + i) };
+			size_t at = kCodeOffset + (blob.size() - kCodeOffset - 16) / kNumAddresses * i + 7;
+			memcpy(blob.data() + at, code, sizeof(code));
+
+			char text[64];
+			std::snprintf(text, sizeof(text), "48 8B 0D %02X ?? ?? ?? E8 ?? ?? ?? ?? 84 C0 74 %02X", i, 0x10 + i);
+			names[i] = "Address" + std::to_string(i);
+			signatures[i] = text;
+			descriptors[i] = { names[i].c_str(), Addresses::Source::Signature, signatures[i].c_str(), 0, -1 };
+		}
+
+		Addresses::Image image{ blob.data(), blob.size(), kCodeOffset, blob.size() - kCodeOffset, kHeaderSize };
+		uint64_t offsets[kNumAddresses];
+		int numFailed = 0;
+		Bench::Run("sigscan/resolve_scan", params, [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				numFailed += Addresses::Resolve(image, descriptors.data(), kNumAddresses, nullptr, offsets) == Addresses::Result::Scanned ? 0 : 1;
+			}
+		});
+
+		std::remove(kCachePath);
+		numFailed += Addresses::Resolve(image, descriptors.data(), kNumAddresses, kCachePath, offsets) == Addresses::Result::Scanned ? 0 : 1;
+		Bench::Run("sigscan/resolve_cached", params, [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				numFailed += Addresses::Resolve(image, descriptors.data(), kNumAddresses, kCachePath, offsets) == Addresses::Result::Cached ? 0 : 1;
+			}
+		});
+		std::remove(kCachePath);
+		Bench::ReportValue("sigscan/resolve", params, "failed", double(numFailed));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	// Around the size of the VR exe's code section, and a smaller one
+	for (size_t mb : { 4, 64 }) {
+		if (Bench::GetSettings().isQuick && mb > 4) break;
+
+		std::vector<uint8_t> blob = MakeCodeLikeBlob(mb << 20);
+		std::string params = "size=" + std::to_string(mb) + "MB";
+		BenchFind(blob, params.c_str());
+		BenchResolve(blob, params.c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,92 @@
+#include <cstdlib>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "simdmath.h"
+
+using namespace MagicCore;
+
+
+// The SSE kernels against the scalar reference they stand in for
+namespace {
+	float RandomFloat(float min, float max)
+	{
+		return min + (max - min) * float(rand()) / float(RAND_MAX);
+	}
+
+	Transform RandomTransform()
+	{
+		Transform t;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				t.rot.data[i][j] = RandomFloat(-1.f, 1.f);
+			}
+		}
+		t.pos = { RandomFloat(-100.f, 100.f), RandomFloat(-100.f, 100.f), RandomFloat(-100.f, 100.f) };
+		t.scale = RandomFloat(0.5f, 2.f);
+		return t;
+	}
+
+	// Chains of transforms, as when walking up a node's parents
+	const int kNumTransforms = 64;
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+	srand(1);
+
+	std::vector<Transform> transforms(kNumTransforms);
+	for (Transform &t : transforms) t = RandomTransform();
+
+	Bench::Run("simd/transform_multiply", "impl=scalar", [&](uint64_t numOps) {
+		for (uint64_t i = 0; i < numOps; i++) {
+			Transform result = transforms[i % kNumTransforms] * transforms[(i + 1) % kNumTransforms];
+			Bench::DoNotOptimize(result);
+		}
+	});
+	Bench::Run("simd/transform_multiply", "impl=sse", [&](uint64_t numOps) {
+		for (uint64_t i = 0; i < numOps; i++) {
+			Transform result = Simd::Multiply(transforms[i % kNumTransforms], transforms[(i + 1) % kNumTransforms]);
+			Bench::DoNotOptimize(result);
+		}
+	});
+
+	Bench::Run("simd/transform_inverse", "impl=scalar", [&](uint64_t numOps) {
+		for (uint64_t i = 0; i < numOps; i++) {
+			Transform result = InverseTransform(transforms[i % kNumTransforms]);
+			Bench::DoNotOptimize(result);
+		}
+	});
+	Bench::Run("simd/transform_inverse", "impl=sse", [&](uint64_t numOps) {
+		for (uint64_t i = 0; i < numOps; i++) {
+			Transform result = Simd::Inverse(transforms[i % kNumTransforms]);
+			Bench::DoNotOptimize(result);
+		}
+	});
+
+	for (int count : { 2, 16, 256 }) {
+		std::string params = "count=" + std::to_string(count);
+		std::vector<Vec3> source(count), vectors(count);
+		for (Vec3 &v : source) v = { RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f), RandomFloat(-1.f, 1.f) };
+
+		// Per vector
+		Bench::Run("simd/normalize/scalar", params.c_str(), [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i += count) {
+				vectors = source;
+				for (Vec3 &v : vectors) v = VectorNormalized(v);
+				Bench::DoNotOptimize(vectors[0]);
+			}
+		});
+		Bench::Run("simd/normalize/sse", params.c_str(), [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i += count) {
+				vectors = source;
+				Simd::NormalizeVectors(vectors.data(), count);
+				Bench::DoNotOptimize(vectors[0]);
+			}
+		});
+	}
+	return 0;
+}
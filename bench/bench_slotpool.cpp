@@ -0,0 +1,158 @@
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.h"
+#include "magiccore.h"
+#include "slotpool.h"
+
+using namespace MagicCore;
+
+
+// NPC caster records kept in a SlotPool, with each candidate NPC holding its record's handle as npccasters.cpp does, against the obvious alternative
+// of a map from actor handle to a heap-allocated record. Churn is NPCs coming and going, the frame is the per-frame pass over everyone tracked.
+namespace {
+	struct Record
+	{
+		DualCastMerger merger;
+		std::vector<float> writtenSizes; // stands in for the particle caches' allocations
+		float spellScale = 1.f;
+
+		void Reset()
+		{
+			merger = DualCastMerger();
+			writtenSizes.clear();
+		}
+	};
+
+	const int kMaxCasters = 64;
+
+	// The same layout as npccasters.cpp
+	struct PoolTracker
+	{
+		struct Candidate
+		{
+			uint32_t actorHandle;
+			SlotHandle record;
+		};
+
+		SlotPool<Record, kMaxCasters> records;
+		std::vector<Candidate> candidates;
+
+		Record * Start(uint32_t actorHandle)
+		{
+			SlotHandle handle = records.Allocate();
+			if (!handle) return nullptr;
+			Record *record = records.Get(handle);
+			record->Reset();
+			record->writtenSizes.resize(256, 1.f);
+			candidates.push_back({ actorHandle, handle });
+			return record;
+		}
+
+		void Stop(int i)
+		{
+			records.Release(candidates[i].record);
+			candidates[i] = candidates.back();
+			candidates.pop_back();
+		}
+	};
+
+	struct MapTracker
+	{
+		std::unordered_map<uint32_t, std::unique_ptr<Record>> records;
+
+		Record * Start(uint32_t actorHandle)
+		{
+			std::unique_ptr<Record> &record = records[actorHandle];
+			record.reset(new Record());
+			record->writtenSizes.resize(256, 1.f);
+			return record.get();
+		}
+
+		void Stop(uint32_t actorHandle) { records.erase(actorHandle); }
+	};
+
+	// Cheap deterministic pseudo-random numbers, so that both sides churn in the same order
+	uint32_t NextRandom(uint32_t &state)
+	{
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	void TouchRecord(Record &record)
+	{
+		record.spellScale = record.spellScale * 0.999f + record.merger.GetDualCastScale() * 0.001f;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	for (int numActors : { 8, 32, 64 }) {
+		std::string params = "actors=" + std::to_string(numActors);
+
+		// One NPC leaves and another one arrives
+		{
+			PoolTracker pool;
+			for (int i = 0; i < numActors; i++) pool.Start(uint32_t(i + 1));
+			uint32_t nextActor = uint32_t(numActors + 1), random = 1;
+			Bench::Run("slotpool/churn/pool", params.c_str(), [&](uint64_t numOps) {
+				for (uint64_t i = 0; i < numOps; i++) {
+					pool.Stop(int(NextRandom(random) % uint32_t(pool.candidates.size())));
+					Bench::DoNotOptimize(*pool.Start(nextActor++));
+				}
+			});
+		}
+		{
+			MapTracker map;
+			std::vector<uint32_t> actors;
+			for (int i = 0; i < numActors; i++) {
+				actors.push_back(uint32_t(i + 1));
+				map.Start(actors.back());
+			}
+			uint32_t nextActor = uint32_t(numActors + 1), random = 1;
+			Bench::Run("slotpool/churn/map", params.c_str(), [&](uint64_t numOps) {
+				for (uint64_t i = 0; i < numOps; i++) {
+					uint32_t &actor = actors[NextRandom(random) % actors.size()];
+					map.Stop(actor);
+					actor = nextActor++;
+					Bench::DoNotOptimize(*map.Start(actor));
+				}
+			});
+		}
+
+		// A frame: get to each NPC's record and update it. Per NPC.
+		{
+			PoolTracker pool;
+			for (int i = 0; i < numActors; i++) pool.Start(uint32_t(i * 7919 + 1));
+			Bench::Run("slotpool/frame/pool", params.c_str(), [&](uint64_t numOps) {
+				for (uint64_t i = 0; i < numOps; i += numActors) {
+					for (const PoolTracker::Candidate &candidate : pool.candidates) {
+						TouchRecord(*pool.records.Get(candidate.record));
+					}
+				}
+			});
+		}
+		{
+			MapTracker map;
+			std::vector<uint32_t> actors;
+			for (int i = 0; i < numActors; i++) {
+				actors.push_back(uint32_t(i * 7919 + 1));
+				map.Start(actors.back());
+			}
+			Bench::Run("slotpool/frame/map", params.c_str(), [&](uint64_t numOps) {
+				for (uint64_t i = 0; i < numOps; i += numActors) {
+					for (uint32_t actor : actors) {
+						TouchRecord(*map.records.find(actor)->second);
+					}
+				}
+			});
+		}
+	}
+	return 0;
+}
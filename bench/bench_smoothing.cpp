@@ -0,0 +1,70 @@
+#include <cmath>
+#include <deque>
+#include <initializer_list>
+#include <string>
+
+#include "bench.h"
+#include "smoothing.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	// The aim history as it was before the ring buffer: 500 samples, newest at the front, and the window summed every frame
+	class DequeHistory
+	{
+	public:
+		void Push(const Vec3 &vector)
+		{
+			m_vectors.pop_back();
+			m_vectors.push_front(vector);
+		}
+
+		Vec3 GetSum(int numFrames) const
+		{
+			Vec3 sum;
+			int i = 0;
+			for (auto it = m_vectors.begin(); it != m_vectors.end() && i < numFrames; ++it, ++i) {
+				sum += *it;
+			}
+			return sum;
+		}
+
+	private:
+		std::deque<Vec3> m_vectors{ 500, Vec3() };
+	};
+
+	// A hand sweeping slowly, with some tremor on top
+	Vec3 AimSample(uint64_t frame)
+	{
+		float t = float(frame % 100000) * (1.f / 90.f);
+		return VectorNormalized({ sinf(t * 0.7f) + 0.01f * sinf(t * 53.f), 1.f, 0.2f * cosf(t * 0.3f) });
+	}
+
+	// One frame: push the new aim and read back the smoothed direction
+	template <typename History>
+	void BenchHistory(const char *name, int window)
+	{
+		std::string params = "window=" + std::to_string(window);
+		History history;
+		uint64_t frame = 0;
+		Bench::Run(name, params.c_str(), [&](uint64_t numOps) {
+			for (uint64_t i = 0; i < numOps; i++) {
+				history.Push(AimSample(frame++));
+				Vec3 smoothed = VectorNormalized(history.GetSum(window));
+				Bench::DoNotOptimize(smoothed);
+			}
+		});
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Bench::ParseArgs(argc, argv);
+
+	for (int window : { 10, 25, 50, 100, 250, 500 }) {
+		BenchHistory<DequeHistory>("smoothing/deque", window);
+		BenchHistory<AimHistory>("smoothing/ring_buffer", window);
+	}
+	return 0;
+}
@@ -97,7 +97,7 @@ static_assert(sizeof(NiPSysData) == 0xC0);
 
 struct NiPSysModifier : NiObject
 {
-	virtual bool Update(UInt64 unk0, NiPSysData *data, UInt64 unk1, UInt64 unk2, UInt64 unk3); // 25
+	virtual bool Update(float time, NiPSysData *data, NiPoint3 *position, NiPoint3 *radii, NiColorA *rotation); // 25
 
 	const char *name; // 10
 	UInt32 order = 3000; // 18 - default ORDER_GENERAL
@@ -0,0 +1,61 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include "addresscache.h"
+#include "iniparser.h"
+
+
+namespace AddressCache {
+	uint64_t HashImage(const uint8_t *imageBase, size_t headerSize)
+	{
+		// FNV-1a
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (size_t i = 0; i < headerSize; i++) {
+			hash ^= imageBase[i];
+			hash *= 0x100000001B3ull;
+		}
+		return hash;
+	}
+
+	namespace {
+		bool ParseHex(const char *value, uint64_t &out)
+		{
+			char *end;
+			out = std::strtoull(value, &end, 16);
+			return end != value;
+		}
+	}
+
+	bool Load(const char *path, uint64_t exeHash, const char *const *names, uint64_t *offsets, int count)
+	{
+		Ini::File file;
+		if (!file.Load(path)) return false;
+
+		const Ini::Entry *hashEntry = file.Find("Addresses", "ExeHash");
+		uint64_t fileHash;
+		if (!hashEntry || !ParseHex(hashEntry->value, fileHash) || fileHash != exeHash) return false;
+
+		for (int i = 0; i < count; i++) {
+			const Ini::Entry *entry = file.Find("Addresses", names[i]);
+			if (!entry || !ParseHex(entry->value, offsets[i]) || offsets[i] == 0) return false;
+		}
+		return true;
+	}
+
+	bool Save(const char *path, uint64_t exeHash, const char *const *names, const uint64_t *offsets, int count)
+	{
+		std::FILE *file = std::fopen(path, "w");
+		if (!file) return false;
+
+		std::fprintf(file, "; Written by MISVR. Delete this file to make it look for everything again.\n");
+		std::fprintf(file, "[Addresses]\n");
+		std::fprintf(file, "ExeHash = 0x%016" PRIX64 "\n", exeHash);
+		for (int i = 0; i < count; i++) {
+			std::fprintf(file, "%s = 0x%" PRIX64 "\n", names[i], offsets[i]);
+		}
+
+		bool isOk = !std::ferror(file);
+		return std::fclose(file) == 0 && isOk;
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Addresses resolved for one particular exe, saved so that they only have to be scanned for once. The file is an INI:
+//
+//   [Addresses]
+//   ExeHash = 0x0123456789ABCDEF
+//   PostMagicNodeUpdateHookLoc = 0x6AC035
+//
+// Everything is an offset from the exe's base address, since that changes from run to run.
+namespace AddressCache {
+	// Identifies a build of an exe from its PE headers, which include the link timestamp and the image checksum and size
+	uint64_t HashImage(const uint8_t *imageBase, size_t headerSize);
+
+	// Fills offsets[i] for names[i]. Fails if the file doesn't exist, is for a different exe, or is missing any of them.
+	bool Load(const char *path, uint64_t exeHash, const char *const *names, uint64_t *offsets, int count);
+	bool Save(const char *path, uint64_t exeHash, const char *const *names, const uint64_t *offsets, int count);
+}
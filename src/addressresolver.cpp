@@ -0,0 +1,98 @@
+#include <cstring>
+#include <vector>
+
+#include "addressresolver.h"
+#include "addresscache.h"
+#include "asynclog.h"
+#include "sigscan.h"
+
+
+namespace Addresses {
+	namespace {
+		// 0 if the signature doesn't match exactly once in the code
+		uint64_t Scan(const Image &image, const Descriptor &descriptor)
+		{
+			SigScan::Pattern pattern;
+			if (!SigScan::Parse(descriptor.signature, pattern)) {
+				AsyncLog::Warning("Malformed signature for %s", descriptor.name);
+				return 0;
+			}
+
+			const uint8_t *code = image.base + image.codeOffset;
+			const uint8_t *match = SigScan::Find(code, image.codeSize, pattern);
+			if (!match) {
+				AsyncLog::Warning("Couldn't find %s", descriptor.name);
+				return 0;
+			}
+			if (!SigScan::IsUnique(code, image.codeSize, pattern, match)) {
+				AsyncLog::Warning("Signature for %s matches in more than one place", descriptor.name);
+				return 0;
+			}
+
+			const uint8_t *at = match + descriptor.signatureOffset;
+			if (descriptor.source == Source::RipRelative) {
+				if (at < image.base || at + 4 > image.base + image.size) return 0;
+
+				int32_t displacement;
+				memcpy(&displacement, at, sizeof(displacement));
+				at += 4 + int64_t(displacement);
+			}
+			if (at < image.base || at >= image.base + image.size) return 0;
+			return uint64_t(at - image.base);
+		}
+	}
+
+	uint64_t GetCallTarget(const Image &image, uint64_t callOffset)
+	{
+		if (callOffset == 0 || callOffset + 5 > image.size) return 0;
+
+		const uint8_t *call = image.base + callOffset;
+		if (call[0] != 0xE8) return 0;
+
+		int32_t displacement;
+		memcpy(&displacement, call + 1, sizeof(displacement));
+		int64_t target = int64_t(callOffset) + 5 + displacement;
+		return target > 0 && uint64_t(target) < image.size ? uint64_t(target) : 0;
+	}
+
+	Result Resolve(const Image &image, const Descriptor *descriptors, int count, const char *cachePath, uint64_t *offsets)
+	{
+		std::vector<const char *> names(count);
+		for (int i = 0; i < count; i++) {
+			names[i] = descriptors[i].name;
+		}
+
+		uint64_t exeHash = AddressCache::HashImage(image.base, image.headerSize);
+		if (cachePath && AddressCache::Load(cachePath, exeHash, names.data(), offsets, count)) {
+			return Result::Cached;
+		}
+
+		bool resolvedAll = true;
+		for (int i = 0; i < count; i++) {
+			const Descriptor &descriptor = descriptors[i];
+
+			uint64_t offset = 0;
+			if (descriptor.source == Source::CallTarget) {
+				// Call sites always come before what they call
+				uint64_t callSite = descriptor.callSite >= 0 && descriptor.callSite < i ? offsets[descriptor.callSite] : 0;
+				offset = GetCallTarget(image, callSite);
+				if (!offset) AsyncLog::Warning("No call to %s where there should be", descriptor.name);
+			}
+			else if (!descriptor.signature) {
+				AsyncLog::Warning("No signature for %s", descriptor.name);
+			}
+			else {
+				offset = Scan(image, descriptor);
+			}
+
+			offsets[i] = offset;
+			if (!offset) resolvedAll = false;
+		}
+		if (!resolvedAll) return Result::Failed;
+
+		if (cachePath && !AddressCache::Save(cachePath, exeHash, names.data(), offsets, count)) {
+			AsyncLog::Warning("Failed to write %s", cachePath);
+		}
+		return Result::Scanned;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Finds addresses in an exe we have no known offsets for: from the cache for that exact exe if there is one (see AddressCache), or else by scanning its
+// code for byte signatures (see SigScan), caching what it finds. Works on any image in memory, so it can be tested on synthetic ones.
+//
+// The plugin still uses the known 1.4.15 offsets through RelocAddr. Signatures have to be made from the exe with a disassembler, and none have been yet.
+namespace Addresses {
+	enum class Source {
+		Signature, // scan the code for signature, then take the address signatureOffset bytes into the match
+		RipRelative, // same, but what's at signatureOffset is a rip-relative displacement to the address we want
+		CallTarget, // the target of the call instruction at the address of descriptor callSite
+	};
+
+	struct Descriptor
+	{
+		const char *name;
+		Source source;
+		const char *signature; // nullptr if there isn't one, which can't be scanned for
+		int signatureOffset;
+		int callSite; // index of an earlier descriptor, for CallTarget
+	};
+
+	// An exe mapped in memory. The code and headers are given as offsets from base.
+	struct Image
+	{
+		const uint8_t *base;
+		size_t size;
+		size_t codeOffset;
+		size_t codeSize;
+		size_t headerSize; // hashed to tell builds of the exe apart
+	};
+
+	enum class Result {
+		Cached,
+		Scanned,
+		Failed,
+	};
+
+	// The offset a call instruction goes to, or 0 if there is no call there
+	uint64_t GetCallTarget(const Image &image, uint64_t callOffset);
+
+	// Fills offsets[i], from base, for descriptors[i]. cachePath can be nullptr to always scan. Nothing is cached unless everything was found.
+	Result Resolve(const Image &image, const Descriptor *descriptors, int count, const char *cachePath, uint64_t *offsets);
+}
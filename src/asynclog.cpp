@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "asynclog.h"
+
+
+namespace AsyncLog {
+	constexpr size_t kRingSize = 2048;
+	// The writer sleeps while there's little to do, and only gets woken up once this much is waiting, so a record or two a frame never costs a wakeup
+	constexpr size_t kWakeSize = kRingSize / 8;
+	constexpr auto kMinWait = std::chrono::microseconds(100);
+	constexpr auto kMaxWait = std::chrono::milliseconds(5);
+
+	constexpr uint32_t kNumStringSlots = 256;
+
+	struct StringSlot
+	{
+		std::atomic<bool> isUsed{ false };
+		char text[kMaxStringLength + 1];
+	};
+
+	MpscRing<Record, kRingSize> g_ring;
+	std::atomic<uint64_t> g_numDropped{ 0 };
+	std::atomic<bool> g_isStarted{ false };
+
+	StringSlot g_stringSlots[kNumStringSlots];
+	std::atomic<uint32_t> g_nextStringSlot{ 0 };
+
+	struct Wake
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+	};
+	// Never destroyed: the writer is detached, and may still be waiting on it while the process exits
+	Wake &g_wake = *new Wake;
+	std::atomic<bool> g_isWriterWaiting{ false };
+
+	uint32_t CopyString(const char *string)
+	{
+		// Slots are handed out in turn, so one is only still in use if the writer is a whole arena behind
+		uint32_t index = g_nextStringSlot.fetch_add(1, std::memory_order_relaxed) % kNumStringSlots;
+		StringSlot &slot = g_stringSlots[index];
+		if (slot.isUsed.exchange(true, std::memory_order_acquire)) return kNoStringSlot;
+
+		if (!string) string = "(null)";
+		size_t length = 0;
+		while (length < size_t(kMaxStringLength) && string[length]) length++;
+		memcpy(slot.text, string, length);
+		slot.text[length] = 0;
+		return index;
+	}
+
+	void FreeStrings(const Record &record)
+	{
+		for (int i = 0; i < record.numArgs; i++) {
+			if (record.argTypes[i] == ArgType::String && record.args[i].stringSlot != kNoStringSlot) {
+				g_stringSlots[record.args[i].stringSlot].isUsed.store(false, std::memory_order_release);
+			}
+		}
+	}
+
+	const char * GetString(const Arg &arg)
+	{
+		return arg.stringSlot != kNoStringSlot ? g_stringSlots[arg.stringSlot].text : "(dropped)";
+	}
+
+	bool Push(const Record &record)
+	{
+		if (!g_ring.TryPush(record)) {
+			FreeStrings(record);
+			g_numDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		// Usually just the one load
+		if (g_isWriterWaiting.load(std::memory_order_relaxed) && g_ring.GetApproxSize() >= kWakeSize && g_isWriterWaiting.exchange(false)) {
+			g_wake.cv.notify_one();
+		}
+		return true;
+	}
+
+	uint64_t GetNumDropped()
+	{
+		return g_numDropped.load(std::memory_order_relaxed);
+	}
+
+	bool IsIntegerConversion(char c) { return strchr("diouxXc", c) != nullptr; }
+	bool IsFloatConversion(char c) { return strchr("eEfFgGaA", c) != nullptr; }
+
+	// Formats one conversion, e.g. "%8.2f", with the argument we captured for it.
+	// Length modifiers in the format are ignored - the argument's captured type decides what gets passed, so a mismatch can't read garbage.
+	int FormatArg(char *out, size_t size, const char *flags, size_t flagsLength, char conversion, ArgType type, const Arg &arg)
+	{
+		char spec[32];
+		if (flagsLength > sizeof(spec) - 4) flagsLength = sizeof(spec) - 4;
+		spec[0] = '%';
+		memcpy(spec + 1, flags, flagsLength);
+		char *end = spec + 1 + flagsLength;
+
+		if (IsIntegerConversion(conversion)) {
+			if (conversion != 'c') {
+				*end++ = 'l';
+				*end++ = 'l';
+			}
+			*end++ = conversion;
+			*end = 0;
+
+			long long value;
+			switch (type) {
+			case ArgType::Int: value = arg.i; break;
+			case ArgType::UInt: value = (long long)arg.u; break;
+			case ArgType::Double: value = (long long)arg.d; break;
+			case ArgType::String: value = 0; break;
+			default: value = (long long)(uintptr_t)arg.p; break;
+			}
+			if (conversion == 'c') return snprintf(out, size, spec, int(value));
+			return snprintf(out, size, spec, value);
+		}
+
+		*end++ = conversion;
+		*end = 0;
+
+		if (IsFloatConversion(conversion)) {
+			double value;
+			switch (type) {
+			case ArgType::Int: value = double(arg.i); break;
+			case ArgType::UInt: value = double(arg.u); break;
+			case ArgType::Double: value = arg.d; break;
+			default: value = 0.0; break;
+			}
+			return snprintf(out, size, spec, value);
+		}
+		if (conversion == 's') {
+			return snprintf(out, size, spec, type == ArgType::String ? GetString(arg) : "?");
+		}
+		if (conversion == 'p') {
+			return snprintf(out, size, spec, type == ArgType::Pointer ? arg.p : nullptr);
+		}
+		return snprintf(out, size, "?");
+	}
+
+	// printf, but with the arguments from the record
+	void Format(const Record &record, char *out, size_t size)
+	{
+		size_t length = 0;
+		int argIndex = 0;
+		for (const char *c = record.format; *c && length + 1 < size; c++) {
+			if (*c != '%') {
+				out[length++] = *c;
+				continue;
+			}
+
+			c++;
+			if (*c == '%') {
+				out[length++] = '%';
+				continue;
+			}
+
+			const char *flags = c;
+			while (*c && strchr("-+ #0123456789.", *c)) c++;
+			size_t flagsLength = c - flags;
+			while (*c && strchr("hlLzjtI", *c)) c++; // also skips MSVC's I64
+			while (*c >= '0' && *c <= '9') c++;
+			if (!*c) break;
+
+			if (argIndex >= record.numArgs) {
+				// More conversions than arguments
+				out[length++] = '?';
+				continue;
+			}
+
+			int written = FormatArg(out + length, size - length, flags, flagsLength, *c, record.argTypes[argIndex], record.args[argIndex]);
+			argIndex++;
+			if (written > 0) {
+				length += size_t(written);
+				if (length >= size) length = size - 1;
+			}
+		}
+		out[length] = 0;
+	}
+
+	void WriterThread(Sink sink)
+	{
+		uint64_t numDroppedReported = 0;
+		char line[1024];
+		Record record;
+		auto wait = kMinWait;
+		while (true) {
+			bool didWork = false;
+			while (g_ring.TryPop(record)) {
+				Format(record, line, sizeof(line));
+				FreeStrings(record);
+				sink(record.level, line);
+				didWork = true;
+			}
+
+			uint64_t numDropped = GetNumDropped();
+			if (numDropped != numDroppedReported) {
+				snprintf(line, sizeof(line), "Log ring was full, dropped %llu records", (unsigned long long)(numDropped - numDroppedReported));
+				sink(Level::Warning, line);
+				numDroppedReported = numDropped;
+			}
+
+			if (didWork) {
+				wait = kMinWait;
+				continue;
+			}
+
+			// Nothing to do, so wait a while, longer each time it stays quiet. Producers only wake us up early once a batch has built up,
+			// and a wakeup that gets missed in between only costs one wait.
+			g_isWriterWaiting.store(true);
+			if (g_ring.GetApproxSize() < kWakeSize) {
+				std::unique_lock<std::mutex> lock(g_wake.mutex);
+				g_wake.cv.wait_for(lock, wait);
+			}
+			g_isWriterWaiting.store(false, std::memory_order_relaxed);
+			wait = std::min<std::chrono::microseconds>(wait * 2, kMaxWait);
+		}
+	}
+
+	void Start(Sink sink)
+	{
+		if (g_isStarted.exchange(true)) return;
+
+		std::thread(WriterThread, sink).detach();
+	}
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+
+// Logging that's cheap enough to leave on every frame. The calling thread only packs the format string pointer and the raw arguments into a 64 byte record
+// and pushes it onto a lock-free ring; a background thread does the formatting and the actual writing. If the ring is full the record is dropped and counted.
+//
+// Formats follow printf, but since formatting happens later, format strings must outlive the call (string literals, in practice).
+// String arguments are the slow path: each is copied into a slot of a separate arena, up to kMaxStringLength bytes, and anything past that is cut off.
+// If the writer is so far behind that the slot is still in use, the argument is logged as "(dropped)".
+//
+// Once the writer thread is started it is the only thread that writes to the log file, so everything logged after that should go through here.
+namespace AsyncLog {
+	enum class Level : uint8_t {
+		Debug,
+		Message,
+		Warning,
+		Error,
+	};
+
+	enum class ArgType : uint8_t {
+		Int,
+		UInt,
+		Double,
+		String,
+		Pointer,
+	};
+
+	union Arg
+	{
+		int64_t i;
+		uint64_t u;
+		double d;
+		uint32_t stringSlot; // in the string arena, or kNoStringSlot
+		const void *p;
+	};
+
+	constexpr int kMaxStringLength = 255;
+	constexpr uint32_t kNoStringSlot = ~uint32_t(0);
+
+	struct Record
+	{
+		static constexpr int kMaxArgs = 6;
+
+		const char *format;
+		Arg args[kMaxArgs];
+		ArgType argTypes[kMaxArgs];
+		uint8_t numArgs;
+		Level level;
+	};
+	static_assert(sizeof(Record) == 64, "A log record should fill one cache line, no more");
+
+	// Bounded multi-producer single-consumer queue (Vyukov's). Each cell carries a sequence number that tells producers and the consumer whose turn it is,
+	// so a push is one CAS on the shared position plus a copy, and producers never wait on each other or on the consumer.
+	template <typename T, size_t capacity>
+	class MpscRing
+	{
+	public:
+		static constexpr size_t kCapacity = capacity;
+		static_assert((kCapacity & (kCapacity - 1)) == 0, "MpscRing capacity must be a power of two");
+
+		MpscRing()
+		{
+			for (size_t i = 0; i < kCapacity; i++) {
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		// Fails if the ring is full
+		bool TryPush(const T &item)
+		{
+			Cell *cell;
+			size_t position = m_pushPosition.load(std::memory_order_relaxed);
+			while (true) {
+				cell = &m_cells[position & kMask];
+				size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				intptr_t difference = intptr_t(sequence) - intptr_t(position);
+				if (difference == 0) {
+					if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+				}
+				else if (difference < 0) {
+					return false;
+				}
+				else {
+					// Another producer got this cell first
+					position = m_pushPosition.load(std::memory_order_relaxed);
+				}
+			}
+
+			cell->item = item;
+			cell->sequence.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer thread only. Fails if the ring is empty.
+		bool TryPop(T &item)
+		{
+			Cell &cell = m_cells[m_popPosition & kMask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if (sequence != m_popPosition + 1) return false;
+
+			item = cell.item;
+			cell.sequence.store(m_popPosition + kCapacity, std::memory_order_release);
+			m_popPosition++;
+			m_numPopped.store(m_popPosition, std::memory_order_relaxed);
+			return true;
+		}
+
+		// Any thread. Only a hint, since pushes and pops can happen while it's being worked out.
+		size_t GetApproxSize() const
+		{
+			size_t numPopped = m_numPopped.load(std::memory_order_relaxed);
+			size_t numPushed = m_pushPosition.load(std::memory_order_relaxed);
+			return numPushed > numPopped ? numPushed - numPopped : 0;
+		}
+
+	private:
+		static constexpr size_t kMask = kCapacity - 1;
+
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T item;
+		};
+
+		Cell m_cells[kCapacity];
+		alignas(64) std::atomic<size_t> m_pushPosition{ 0 };
+		alignas(64) size_t m_popPosition = 0;
+		std::atomic<size_t> m_numPopped{ 0 }; // m_popPosition, for other threads
+	};
+
+	typedef void(*Sink)(Level level, const char *line);
+
+	// Starts the writer thread, which hands every formatted line to sink. Anything logged before this is kept (as long as it fits) and written once it starts.
+	void Start(Sink sink);
+
+	// Frees the record's string slots if it can't be pushed
+	bool Push(const Record &record);
+
+	uint64_t GetNumDropped();
+
+	// Copies string into a free slot of the string arena. kNoStringSlot if there is none.
+	uint32_t CopyString(const char *string);
+
+	template <typename T>
+	inline void SetArg(Record &record, int index, T value)
+	{
+		Arg &arg = record.args[index];
+		ArgType &type = record.argTypes[index];
+		if constexpr (std::is_floating_point<T>::value) {
+			type = ArgType::Double;
+			arg.d = double(value);
+		}
+		else if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+			if constexpr (std::is_signed<T>::value) {
+				type = ArgType::Int;
+				arg.i = int64_t(value);
+			}
+			else {
+				type = ArgType::UInt;
+				arg.u = uint64_t(value);
+			}
+		}
+		else if constexpr (std::is_convertible<T, const char *>::value) {
+			type = ArgType::String;
+			arg.stringSlot = CopyString(value);
+		}
+		else {
+			static_assert(std::is_pointer<T>::value, "AsyncLog only takes numbers, strings and pointers");
+			type = ArgType::Pointer;
+			arg.p = value;
+		}
+	}
+
+	template <typename... Args>
+	inline void Log(Level level, const char *format, Args... args)
+	{
+		static_assert(sizeof...(Args) <= Record::kMaxArgs, "Too many arguments for one AsyncLog record");
+
+		Record record;
+		record.format = format;
+		record.numArgs = uint8_t(sizeof...(Args));
+		record.level = level;
+		int i = 0;
+		(SetArg(record, i++, args), ...);
+		(void)i;
+		Push(record);
+	}
+
+	template <typename... Args>
+	inline void Debug(const char *format, Args... args) { Log(Level::Debug, format, args...); }
+
+	template <typename... Args>
+	inline void Message(const char *format, Args... args) { Log(Level::Message, format, args...); }
+
+	template <typename... Args>
+	inline void Warning(const char *format, Args... args) { Log(Level::Warning, format, args...); }
+
+	template <typename... Args>
+	inline void Error(const char *format, Args... args) { Log(Level::Error, format, args...); }
+}
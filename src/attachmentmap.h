@@ -0,0 +1,242 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "slotpool.h"
+
+
+namespace MagicCore {
+	// The smallest power of two at least twice capacity
+	constexpr uint32_t GetAttachmentTableSize(int capacity)
+	{
+		uint32_t size = 1;
+		while (size < uint32_t(capacity) * 2) size *= 2;
+		return size;
+	}
+
+	// Items in a SlotPool that belong to objects we don't own, looked up by the object's address from whatever thread the object is being worked on.
+	// Add() and Remove() are for one owning thread, Find() can be called from any thread at the same time inside a ReadScope.
+	// A removed item isn't handed out again until every ReadScope that could have found it has ended: EndFrame() moves on to a new epoch once no reader
+	// is left in the one before, and an item waits kFramesBeforeReuse epochs. The address table works the same way: it is never changed except to add keys
+	// or clear their handle, and when it fills up with removed keys it gets rebuilt into a second table, which then waits out the same number of epochs
+	// before it can be rebuilt over.
+	template <typename Key, typename T, int capacity>
+	class AttachmentMap
+	{
+	public:
+		static constexpr int kCapacity = capacity;
+		static constexpr uint32_t kFramesBeforeReuse = 2;
+
+		AttachmentMap()
+		{
+			for (Table &table : m_tables) {
+				Clear(table);
+				table.retiredEpoch = 0;
+			}
+		}
+		AttachmentMap(const AttachmentMap &) = delete;
+		AttachmentMap & operator=(const AttachmentMap &) = delete;
+
+		// Any thread. Whatever Find() returns stays attached to its slot until the scope ends. Keep it short: nothing is reused while it's open.
+		class ReadScope
+		{
+		public:
+			explicit ReadScope(AttachmentMap &map) : m_map(map)
+			{
+				while (true) {
+					uint32_t epoch = map.m_epoch.load();
+					map.m_numReaders[epoch & 1].fetch_add(1);
+					// Otherwise EndFrame() could have checked that there was no one left in this epoch before we got counted
+					if (map.m_epoch.load() == epoch) {
+						m_parity = epoch & 1;
+						return;
+					}
+					map.m_numReaders[epoch & 1].fetch_sub(1, std::memory_order_release);
+				}
+			}
+			~ReadScope() { m_map.m_numReaders[m_parity].fetch_sub(1, std::memory_order_release); }
+			ReadScope(const ReadScope &) = delete;
+			ReadScope & operator=(const ReadScope &) = delete;
+
+		private:
+			AttachmentMap &m_map;
+			uint32_t m_parity;
+		};
+
+		// Owning thread only. Returns an invalid handle if there's no room. init(T &item) sets up the item, which is left as the last owner of its slot had it,
+		// before it can be found.
+		template <typename Init>
+		SlotHandle Add(const Key *key, Init &&init)
+		{
+			Table *table = &m_tables[m_current.load(std::memory_order_relaxed)];
+			if (!FindKey(*table, key) && (table->numKeys + 1) * 2 > kTableSize) {
+				// Mostly keys that have since been removed
+				table = Rebuild();
+				if (!table || (table->numKeys + 1) * 2 > kTableSize) return SlotHandle();
+			}
+
+			SlotHandle handle = m_pool.Allocate();
+			if (!handle) return handle;
+
+			init(*m_pool.Get(handle));
+			Insert(*table, key, handle);
+			m_numAttached++;
+			return handle;
+		}
+
+		// Owning thread only. Removing a handle that isn't attached to key (anymore) does nothing.
+		void Remove(SlotHandle handle, const Key *key)
+		{
+			Table &table = m_tables[m_current.load(std::memory_order_relaxed)];
+			std::atomic<uint32_t> *entry = FindKey(table, key);
+			if (!handle || !entry || entry->load(std::memory_order_relaxed) != handle.value) return;
+
+			entry->store(0, std::memory_order_release);
+			m_pendingReleases.push_back({ handle, m_epoch.load(std::memory_order_relaxed) });
+			m_numAttached--;
+		}
+
+		// The owning thread, or any thread inside a ReadScope. nullptr if nothing is attached to key.
+		T * Find(const Key *key)
+		{
+			const Table &table = m_tables[m_current.load(std::memory_order_acquire)];
+			for (uint32_t i = GetBucket(key), numProbed = 0; numProbed < kTableSize; i = (i + 1) & (kTableSize - 1), numProbed++) {
+				const Key *entryKey = table.keys[i].load(std::memory_order_acquire);
+				if (!entryKey) return nullptr;
+				if (entryKey == key) {
+					// A handle still in the table is attached, or was just now and won't be released while we're in the read scope. Either way its slot
+					// is safe to use, without going through the pool's free list and generations, which the owning thread changes as it goes.
+					SlotHandle handle{ table.handles[i].load(std::memory_order_acquire) };
+					return handle ? &m_pool.GetUnchecked(handle) : nullptr;
+				}
+			}
+			return nullptr;
+		}
+
+		// Owning thread only, for the item of a handle it was given by Add()
+		T * Get(SlotHandle handle) { return m_pool.Get(handle); }
+
+		// Owning thread only, once per frame
+		void EndFrame()
+		{
+			// A reader still in the epoch before this one holds everything back
+			uint32_t epoch = m_epoch.load(std::memory_order_relaxed);
+			if (m_numReaders[(epoch + 1) & 1].load() == 0) {
+				epoch++;
+				m_epoch.store(epoch);
+			}
+
+			for (size_t i = 0; i < m_pendingReleases.size();) {
+				if (epoch - m_pendingReleases[i].epoch >= kFramesBeforeReuse) {
+					m_pool.Release(m_pendingReleases[i].handle);
+					m_pendingReleases[i] = m_pendingReleases.back();
+					m_pendingReleases.pop_back();
+				}
+				else {
+					i++;
+				}
+			}
+		}
+
+		int GetNumAttached() const { return m_numAttached; }
+
+	private:
+		// Twice the capacity, so that probes stay short even when full
+		static constexpr uint32_t kTableSize = GetAttachmentTableSize(capacity);
+
+		struct Table
+		{
+			std::atomic<const Key *> keys[kTableSize];
+			std::atomic<uint32_t> handles[kTableSize]; // 0 once removed
+			uint32_t numKeys;
+			uint32_t retiredEpoch; // when it was last replaced by the other table
+		};
+
+		struct PendingRelease
+		{
+			SlotHandle handle;
+			uint32_t epoch;
+		};
+
+		static uint32_t GetBucket(const Key *key)
+		{
+			// The low bits of an address are mostly alignment
+			uint64_t hash = (uint64_t(uintptr_t(key)) >> 4) * 0x9E3779B97F4A7C15ull;
+			return uint32_t(hash >> 32) & (kTableSize - 1);
+		}
+
+		static void Clear(Table &table)
+		{
+			for (uint32_t i = 0; i < kTableSize; i++) {
+				table.keys[i].store(nullptr, std::memory_order_relaxed);
+				table.handles[i].store(0, std::memory_order_relaxed);
+			}
+			table.numKeys = 0;
+		}
+
+		static std::atomic<uint32_t> * FindKey(Table &table, const Key *key)
+		{
+			for (uint32_t i = GetBucket(key), numProbed = 0; numProbed < kTableSize; i = (i + 1) & (kTableSize - 1), numProbed++) {
+				const Key *entryKey = table.keys[i].load(std::memory_order_relaxed);
+				if (!entryKey) return nullptr;
+				if (entryKey == key) return &table.handles[i];
+			}
+			return nullptr;
+		}
+
+		// The table must have room for key
+		static void Insert(Table &table, const Key *key, SlotHandle handle)
+		{
+			uint32_t i = GetBucket(key);
+			while (true) {
+				const Key *entryKey = table.keys[i].load(std::memory_order_relaxed);
+				if (entryKey == key) {
+					table.handles[i].store(handle.value, std::memory_order_release);
+					return;
+				}
+				if (!entryKey) {
+					// The handle has to be there before anyone can find the key
+					table.handles[i].store(handle.value, std::memory_order_relaxed);
+					table.keys[i].store(key, std::memory_order_release);
+					table.numKeys++;
+					return;
+				}
+				i = (i + 1) & (kTableSize - 1);
+			}
+		}
+
+		// Copies the keys still attached into the other table and switches over to it. nullptr if the other table could still be in use.
+		Table * Rebuild()
+		{
+			int current = m_current.load(std::memory_order_relaxed);
+			Table &from = m_tables[current];
+			Table &to = m_tables[current ^ 1];
+			uint32_t epoch = m_epoch.load(std::memory_order_relaxed);
+			if (epoch - to.retiredEpoch < kFramesBeforeReuse) return nullptr;
+
+			Clear(to);
+			for (uint32_t i = 0; i < kTableSize; i++) {
+				const Key *key = from.keys[i].load(std::memory_order_relaxed);
+				uint32_t handle = from.handles[i].load(std::memory_order_relaxed);
+				if (key && handle) {
+					Insert(to, key, SlotHandle{ handle });
+				}
+			}
+
+			m_current.store(current ^ 1, std::memory_order_release);
+			from.retiredEpoch = epoch;
+			return &to;
+		}
+
+		SlotPool<T, capacity> m_pool;
+		Table m_tables[2];
+		std::atomic<int> m_current{ 0 };
+		std::vector<PendingRelease> m_pendingReleases;
+		// Only the owning thread changes it. Readers count themselves in under its lowest bit.
+		std::atomic<uint32_t> m_epoch{ kFramesBeforeReuse }; // so that both tables start out usable
+		std::atomic<uint32_t> m_numReaders[2] = { { 0 }, { 0 } };
+		int m_numAttached = 0;
+	};
+}
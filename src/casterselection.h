@@ -0,0 +1,33 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+
+namespace MagicCore {
+	// An NPC that could be looked after this frame
+	struct CasterCandidate
+	{
+		uint32_t id; // whatever the caller tells its NPCs apart by
+		float distanceSquared; // from the player
+		bool isTracked; // looked after last frame too
+	};
+
+	// NPCs already being looked after count as this much closer (squared), so that two NPCs about the same distance away don't take turns from frame to frame
+	constexpr float kTrackedCasterDistanceBias = 0.8f * 0.8f;
+
+	// When there are more candidates than maxSelected, moves the maxSelected closest to the front, in no particular order. Returns how many were selected.
+	inline int SelectNearestCasters(CasterCandidate *candidates, int numCandidates, int maxSelected)
+	{
+		if (maxSelected <= 0) return 0;
+		if (numCandidates <= maxSelected) return numCandidates;
+
+		auto getRank = [](const CasterCandidate &candidate) {
+			return candidate.isTracked ? candidate.distanceSquared * kTrackedCasterDistanceBias : candidate.distanceSquared;
+		};
+		std::nth_element(candidates, candidates + maxSelected, candidates + numCandidates, [&](const CasterCandidate &a, const CasterCandidate &b) {
+			return getRank(a) < getRank(b);
+		});
+		return maxSelected;
+	}
+}
@@ -1,101 +1,40 @@
+#include "skse64/NiNodes.h"
+#include "skse64/GameData.h"
+
 #include <chrono>
 #include <filesystem>
+#include <thread>
 
 #include "config.h"
+#include "asynclog.h"
 
 
 namespace Config {
-	// Define extern options
-	Options options;
-
-	bool ReadFloat(const std::string &name, float &val)
-	{
-		if (!GetConfigOptionFloat("Settings", name.c_str(), &val)) {
-			_WARNING("Failed to read float config option: %s", name.c_str());
-			return false;
-		}
-
-		return true;
-	}
-
-	bool ReadDouble(const std::string &name, double &val)
+	bool LoadConfigFile(Options &out, bool &readAll)
 	{
-		if (!GetConfigOptionDouble("Settings", name.c_str(), &val)) {
-			_WARNING("Failed to read double config option: %s", name.c_str());
-			return false;
-		}
-
-		return true;
-	}
+		const std::string &configPath = GetConfigPath();
+		if (configPath.empty()) return false;
 
-	bool ReadBool(const std::string &name, bool &val)
-	{
-		if (!GetConfigOptionBool("Settings", name.c_str(), &val)) {
-			_WARNING("Failed to read bool config option: %s", name.c_str());
+		Ini::File file;
+		if (!file.Load(configPath.c_str())) {
+			AsyncLog::Warning("Failed to open config file: %s", configPath.c_str());
 			return false;
 		}
 
-		return true;
-	}
-
-	bool ReadInt(const std::string &name, int &val)
-	{
-		if (!GetConfigOptionInt("Settings", name.c_str(), &val)) {
-			_WARNING("Failed to read int config option: %s", name.c_str());
-			return false;
-		}
-
-		return true;
-	}
-
-	bool ReadString(const std::string &name, std::string &val)
-	{
-		std::string	data = GetConfigOption("Settings", name.c_str());
-		if (data.empty()) {
-			_WARNING("Failed to read str config option: %s", name.c_str());
-			return false;
-		}
-
-		val = data;
-		return true;
-	}
-
-	bool ReadVector(const std::string &name, NiPoint3 &vec)
-	{
-		if (!ReadFloat(name + "X", vec.x)) return false;
-		if (!ReadFloat(name + "Y", vec.y)) return false;
-		if (!ReadFloat(name + "Z", vec.z)) return false;
-
+		// Start from the defaults rather than the current options, so that a key removed from the file acts the same as it would at startup
+		out = Options();
+		readAll = ReadConfigOptions(file, out);
 		return true;
 	}
 
 	bool ReadConfigOptions()
 	{
-		if (!ReadFloat("dualCastHandsCloseSpellScale", options.dualCastHandsCloseSpellScale)) return false;
-		if (!ReadFloat("dualCastHandsFarSpellScale", options.dualCastHandsFarSpellScale)) return false;
-		if (!ReadFloat("DualCastHandSeparationScalingDistance", options.dualCastHandSeparationScalingDistance)) return false;
-
-		if (!ReadFloat("SpellScaleWhenMagickaEmpty", options.spellScaleWhenMagickaEmpty)) return false;
-		if (!ReadFloat("SpellScaleWhenMagickaFull", options.spellScaleWhenMagickaFull)) return false;
+		Options newOptions;
+		bool readAll;
+		if (!LoadConfigFile(newOptions, readAll)) return false;
 
-		if (!ReadBool("useCastingTimeForMergeTime", options.useCastingTimeForMergeTime)) return false;
-		if (!ReadFloat("spellMergeTime", options.spellMergeTime)) return false;
-		if (!ReadFloat("spellUnMergeTime", options.spellUnMergeTime)) return false;
-
-		if (!ReadFloat("MagicRotationRoll", options.magicRotationRoll)) return false;
-		if (!ReadFloat("MagicRotationYaw", options.magicRotationYaw)) return false;
-
-		if (!ReadInt("numSmoothingFramesNovice", options.numSmoothingFramesNovice)) return false;
-		if (!ReadInt("numSmoothingFramesApprentice", options.numSmoothingFramesApprentice)) return false;
-		if (!ReadInt("numSmoothingFramesAdept", options.numSmoothingFramesAdept)) return false;
-		if (!ReadInt("numSmoothingFramesExpert", options.numSmoothingFramesExpert)) return false;
-		if (!ReadInt("numSmoothingFramesMaster", options.numSmoothingFramesMaster)) return false;
-		if (!ReadFloat("smoothingDualCastMultiplier", options.smoothingDualCastMultiplier)) return false;
-
-		if (!ReadBool("UseOffHandForDualCastAiming", options.useOffHandForDualCastAiming)) return false;
-		if (!ReadBool("UseMainHandForDualCastAiming", options.useMainHandForDualCastAiming)) return false;
-
-		return true;
+		Publish(newOptions);
+		return readAll;
 	}
 
 	const std::string & GetConfigPath()
@@ -107,77 +46,94 @@ namespace Config {
 			if (!runtimePath.empty()) {
 				s_configPath = runtimePath + "Data\\SKSE\\Plugins\\misvr.ini";
 
-				_MESSAGE("config path = %s", s_configPath.c_str());
+				AsyncLog::Message("config path = %s", s_configPath.c_str());
 			}
 		}
 
 		return s_configPath;
 	}
 
-	std::string GetConfigOption(const char *section, const char *key)
+	HANDLE g_reloadEvent = NULL;
+
+	void ConfigWatcherThread()
 	{
-		std::string	result;
+		const std::string &configPath = GetConfigPath();
 
-		const std::string & configPath = GetConfigPath();
+		// The directory is always watched, and ReloadConfigOnChange is only looked at when something changes, so that it can be turned on and off while the game is running
+		HANDLE changeNotification = INVALID_HANDLE_VALUE;
+		std::error_code error;
+		std::filesystem::file_time_type lastWriteTime;
 		if (!configPath.empty()) {
-			char	resultBuf[256];
-			resultBuf[0] = 0;
+			std::filesystem::path directory = std::filesystem::path(configPath).parent_path();
+			changeNotification = FindFirstChangeNotificationA(directory.string().c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE);
+			if (changeNotification == INVALID_HANDLE_VALUE) {
+				AsyncLog::Warning("Failed to watch %s for changes", directory.string().c_str());
+			}
+			lastWriteTime = std::filesystem::last_write_time(configPath, error);
+		}
 
-			UInt32	resultLen = GetPrivateProfileString(section, key, NULL, resultBuf, sizeof(resultBuf), configPath.c_str());
+		HANDLE handles[2] = { g_reloadEvent, changeNotification };
+		DWORD numHandles = changeNotification != INVALID_HANDLE_VALUE ? 2 : 1;
 
-			result = resultBuf;
-		}
+		while (true) {
+			DWORD result = WaitForMultipleObjects(numHandles, handles, FALSE, INFINITE);
 
-		return result;
-	}
+			bool isFileChange = result == WAIT_OBJECT_0 + 1;
+			if (isFileChange) {
+				FindNextChangeNotification(changeNotification);
 
-	bool GetConfigOptionDouble(const char *section, const char *key, double *out)
-	{
-		std::string	data = GetConfigOption(section, key);
-		if (data.empty())
-			return false;
+				// Anything else in the plugins directory changing wakes us up too
+				auto writeTime = std::filesystem::last_write_time(configPath, error);
+				if (error || writeTime == lastWriteTime) continue;
+				lastWriteTime = writeTime;
 
-		*out = std::stod(data);
-		return true;
-	}
+				// Editors tend to write the file in several steps, give them a moment to finish
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+			else if (result != WAIT_OBJECT_0) {
+				AsyncLog::Error("Config watcher failed to wait, stopping");
+				break;
+			}
 
-	bool GetConfigOptionFloat(const char *section, const char *key, float *out)
-	{
-		std::string	data = GetConfigOption(section, key);
-		if (data.empty())
-			return false;
+			Options newOptions;
+			bool readAll;
+			if (!LoadConfigFile(newOptions, readAll)) continue;
 
-		*out = std::stof(data);
-		return true;
-	}
+			// A change to the file is applied if ReloadConfigOnChange was set before it or is set by it, so that saving the file with it turned either way takes effect
+			if (isFileChange && !newOptions.reloadConfigOnChange && !Snapshot()->reloadConfigOnChange) continue;
 
-	bool GetConfigOptionInt(const char *section, const char *key, int *out)
-	{
-		std::string	data = GetConfigOption(section, key);
-		if (data.empty())
-			return false;
+			AsyncLog::Message("Reloading config");
+			Publish(newOptions);
+			if (readAll) {
+				AsyncLog::Message("Successfully reloaded config parameters");
+			}
+			else {
+				AsyncLog::Warning("[WARNING] Failed to read some config options while reloading. Using defaults for those instead.");
+			}
+		}
 
-		*out = std::stoi(data);
-		return true;
+		if (changeNotification != INVALID_HANDLE_VALUE) {
+			FindCloseChangeNotification(changeNotification);
+		}
 	}
 
-	bool GetConfigOptionBool(const char *section, const char *key, bool *out)
+	void StartConfigWatcher()
 	{
-		std::string	data = GetConfigOption(section, key);
-		if (data.empty())
-			return false;
+		if (g_reloadEvent) return;
 
-		int val = std::stoi(data);
-		if (val == 1) {
-			*out = true;
-			return true;
+		g_reloadEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+		if (!g_reloadEvent) {
+			AsyncLog::Error("Failed to create config reload event");
+			return;
 		}
-		else if (val == 0) {
-			*out = false;
-			return true;
-		}
-		else {
-			return false;
+
+		std::thread(ConfigWatcherThread).detach();
+	}
+
+	void RequestConfigReload()
+	{
+		if (g_reloadEvent) {
+			SetEvent(g_reloadEvent);
 		}
 	}
 }
@@ -1,48 +1,23 @@
 #pragma once
 
-#include "skse64/NiNodes.h"
-#include "skse64/GameData.h"
+#include "options.h"
+#include "configsnapshot.h"
+#include "iniparser.h"
 
 
 namespace Config {
-	struct Options {
-		// Add config options for things: left / right / combined hand vectors for dualcast spell direction, min / max scale while dual casting along with hand - hand distance to scale over.
-		float dualCastHandsCloseSpellScale = 1.f;
-		float dualCastHandsFarSpellScale = 2.f;
-		float dualCastHandSeparationScalingDistance = 90.f;
-
-		float spellScaleWhenMagickaEmpty = 0.35f;
-		float spellScaleWhenMagickaFull = 1.f;
-
-		bool useCastingTimeForMergeTime = false;
-		float spellMergeTime = 0.15f;
-		float spellUnMergeTime = 0.1f;
-
-		float magicRotationRoll = 0.f;
-		float magicRotationYaw = 0.f;
-
-		int numSmoothingFramesNovice = 10;
-		int numSmoothingFramesApprentice = 15;
-		int numSmoothingFramesAdept = 20;
-		int numSmoothingFramesExpert = 25;
-		int numSmoothingFramesMaster = 40;
-		float smoothingDualCastMultiplier = 1.25;
-
-		bool useOffHandForDualCastAiming = false;
-		bool useMainHandForDualCastAiming = false;
-	};
-	extern Options options; // global object containing options
-
-
-	// Fills Options struct from INI file
+	// Reads the INI file and publishes the result as the current options snapshot (see configsnapshot.h).
+	// Must not be called while holding a Snapshot.
 	bool ReadConfigOptions();
+	// Fills out from an already loaded INI file, warning about malformed and unknown keys. Missing keys keep whatever out already has.
+	// Every key that can be read is read; returns false if any were malformed.
+	bool ReadConfigOptions(const Ini::File &file, Options &out);
 
 	const std::string & GetConfigPath();
 
-	std::string GetConfigOption(const char * section, const char * key);
-
-	bool GetConfigOptionDouble(const char *section, const char *key, double *out);
-	bool GetConfigOptionFloat(const char *section, const char *key, float *out);
-	bool GetConfigOptionInt(const char *section, const char *key, int *out);
-	bool GetConfigOptionBool(const char *section, const char *key, bool *out);
+	// Starts the thread that re-reads the INI file when asked to, and also whenever the file changes while ReloadConfigOnChange is set.
+	// The setting is checked on every change, not just at startup.
+	void StartConfigWatcher();
+	// Asks the watcher thread to re-read the INI file. Safe to call from anywhere, including the hooks.
+	void RequestConfigReload();
 }
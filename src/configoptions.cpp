@@ -0,0 +1,140 @@
+#include "config.h"
+#include "asynclog.h"
+
+
+// The [Settings] part of the config, which only needs the INI text and so builds without the engine
+namespace Config {
+	enum class OptionType {
+		Float,
+		Int,
+		Bool,
+	};
+
+	struct OptionDescriptor
+	{
+		OptionDescriptor(const char *key, float Options::*member) : key(key), type(OptionType::Float), floatMember(member) {}
+		OptionDescriptor(const char *key, int Options::*member) : key(key), type(OptionType::Int), intMember(member) {}
+		OptionDescriptor(const char *key, bool Options::*member) : key(key), type(OptionType::Bool), boolMember(member) {}
+
+		const char *key;
+		OptionType type;
+		union {
+			float Options::*floatMember;
+			int Options::*intMember;
+			bool Options::*boolMember;
+		};
+	};
+
+	// Every key we read from the [Settings] section, and where it goes
+	const OptionDescriptor g_optionDescriptors[] = {
+		{ "dualCastHandsCloseSpellScale", &Options::dualCastHandsCloseSpellScale },
+		{ "dualCastHandsFarSpellScale", &Options::dualCastHandsFarSpellScale },
+		{ "DualCastHandSeparationScalingDistance", &Options::dualCastHandSeparationScalingDistance },
+
+		{ "SpellScaleWhenMagickaEmpty", &Options::spellScaleWhenMagickaEmpty },
+		{ "SpellScaleWhenMagickaFull", &Options::spellScaleWhenMagickaFull },
+		{ "ParticleScaleMode", &Options::particleScaleMode },
+		{ "ScaleParticleVelocity", &Options::scaleParticleVelocity },
+
+		{ "EnableEmissionLod", &Options::enableEmissionLod },
+		{ "EmissionLodExponent", &Options::emissionLodExponent },
+		{ "MinEmissionScale", &Options::minEmissionScale },
+		{ "EmissionLodParticleBudget", &Options::emissionLodParticleBudget },
+
+		{ "useCastingTimeForMergeTime", &Options::useCastingTimeForMergeTime },
+		{ "spellMergeTime", &Options::spellMergeTime },
+		{ "spellUnMergeTime", &Options::spellUnMergeTime },
+
+		{ "MagicRotationRoll", &Options::magicRotationRoll },
+		{ "MagicRotationYaw", &Options::magicRotationYaw },
+
+		{ "numSmoothingFramesNovice", &Options::numSmoothingFramesNovice },
+		{ "numSmoothingFramesApprentice", &Options::numSmoothingFramesApprentice },
+		{ "numSmoothingFramesAdept", &Options::numSmoothingFramesAdept },
+		{ "numSmoothingFramesExpert", &Options::numSmoothingFramesExpert },
+		{ "numSmoothingFramesMaster", &Options::numSmoothingFramesMaster },
+		{ "smoothingDualCastMultiplier", &Options::smoothingDualCastMultiplier },
+
+		{ "useTimeBasedSmoothing", &Options::useTimeBasedSmoothing },
+		{ "smoothingTimeNovice", &Options::smoothingTimeNovice },
+		{ "smoothingTimeApprentice", &Options::smoothingTimeApprentice },
+		{ "smoothingTimeAdept", &Options::smoothingTimeAdept },
+		{ "smoothingTimeExpert", &Options::smoothingTimeExpert },
+		{ "smoothingTimeMaster", &Options::smoothingTimeMaster },
+
+		{ "EnableAimPrediction", &Options::enableAimPrediction },
+		{ "AimPredictionLeadNovice", &Options::aimPredictionLeadNovice },
+		{ "AimPredictionLeadApprentice", &Options::aimPredictionLeadApprentice },
+		{ "AimPredictionLeadAdept", &Options::aimPredictionLeadAdept },
+		{ "AimPredictionLeadExpert", &Options::aimPredictionLeadExpert },
+		{ "AimPredictionLeadMaster", &Options::aimPredictionLeadMaster },
+		{ "AimPredictionMaxAngle", &Options::aimPredictionMaxAngle },
+		{ "AimPredictionUseAcceleration", &Options::aimPredictionUseAcceleration },
+
+		{ "UseOffHandForDualCastAiming", &Options::useOffHandForDualCastAiming },
+		{ "UseMainHandForDualCastAiming", &Options::useMainHandForDualCastAiming },
+
+		{ "EnableProfiling", &Options::enableProfiling },
+		{ "ProfilingReportInterval", &Options::profilingReportInterval },
+
+		{ "RecordFrameInputs", &Options::recordFrameInputs },
+		{ "LogFrameDiagnostics", &Options::logFrameDiagnostics },
+
+		{ "ReloadConfigOnChange", &Options::reloadConfigOnChange },
+
+		{ "EnableNpcCasters", &Options::enableNpcCasters },
+		{ "MaxNpcCasters", &Options::maxNpcCasters },
+	};
+
+	bool ReadOption(const OptionDescriptor &descriptor, const char *value, Options &out)
+	{
+		switch (descriptor.type) {
+		case OptionType::Float:
+			return Ini::ParseFloat(value, out.*descriptor.floatMember);
+		case OptionType::Int:
+			return Ini::ParseInt(value, out.*descriptor.intMember);
+		case OptionType::Bool:
+			return Ini::ParseBool(value, out.*descriptor.boolMember);
+		}
+		return false;
+	}
+
+	bool ReadConfigOptions(const Ini::File &file, Options &out)
+	{
+		const int kNumDescriptors = int(sizeof(g_optionDescriptors) / sizeof(g_optionDescriptors[0]));
+
+		// One pass over the file, however much else is in it. The last entry for a key wins, like GetPrivateProfileString.
+		const Ini::Entry *entries[kNumDescriptors] = {};
+		for (const Ini::Entry &entry : file.GetEntries()) {
+			if (!Ini::EqualsNoCase(entry.section, "Settings")) continue;
+
+			bool isKnown = false;
+			for (int i = 0; i < kNumDescriptors; i++) {
+				if (Ini::EqualsNoCase(entry.key, g_optionDescriptors[i].key)) {
+					entries[i] = &entry;
+					isKnown = true;
+					break;
+				}
+			}
+			if (!isKnown) {
+				AsyncLog::Warning("Unknown config option on line %d: %s", entry.line, entry.key);
+			}
+		}
+
+		bool readAll = true;
+		for (int i = 0; i < kNumDescriptors; i++) {
+			const OptionDescriptor &descriptor = g_optionDescriptors[i];
+			const Ini::Entry *entry = entries[i];
+			if (!entry) {
+				// Every option has a default, and an INI from an older version just won't have the newer keys
+				AsyncLog::Debug("Config option %s not set, using the default", descriptor.key);
+			}
+			else if (!ReadOption(descriptor, entry->value, out)) {
+				AsyncLog::Warning("Failed to parse config option on line %d: %s = %s", entry->line, entry->key, entry->value);
+				readAll = false;
+			}
+		}
+
+		return readAll;
+	}
+}
@@ -0,0 +1,69 @@
+#include <mutex>
+#include <thread>
+
+#include "configsnapshot.h"
+
+
+namespace Config {
+	namespace {
+		struct PublishedOptions
+		{
+			Options options;
+			uint32_t generation;
+		};
+
+		// The initial snapshot is never freed, so it can be a static and readers are valid before anything is published
+		const PublishedOptions g_defaultOptions = { Options(), 0 };
+
+		std::atomic<const PublishedOptions *> g_current = &g_defaultOptions;
+		uint32_t g_lastGeneration = 0; // guarded by g_publishMutex
+
+		// Readers register in the counter for the current parity. A publish flips the parity, so that new readers go to the other counter,
+		// and then waits for the old counter to drain. Anyone counted there may have loaded the old pointer, nobody counted in the new one can have.
+		std::atomic<uint32_t> g_parity = 0;
+		std::atomic<int32_t> g_numReaders[2] = { 0, 0 };
+
+		std::mutex g_publishMutex;
+	}
+
+	Snapshot::Snapshot()
+	{
+		while (true) {
+			uint32_t parity = g_parity.load();
+			g_numReaders[parity].fetch_add(1);
+			// If a publish flipped the parity in between, it may already have seen this counter at 0 and moved on, so register again under the new one
+			if (g_parity.load() == parity) {
+				m_parity = parity;
+				break;
+			}
+			g_numReaders[parity].fetch_sub(1);
+		}
+		const PublishedOptions *published = g_current.load();
+		m_options = &published->options;
+		m_generation = published->generation;
+	}
+
+	Snapshot::~Snapshot()
+	{
+		g_numReaders[m_parity].fetch_sub(1, std::memory_order_release);
+	}
+
+	void Publish(const Options &newOptions)
+	{
+		std::lock_guard<std::mutex> lock(g_publishMutex);
+
+		const PublishedOptions *published = new PublishedOptions{ newOptions, ++g_lastGeneration };
+		const PublishedOptions *old = g_current.exchange(published);
+
+		uint32_t oldParity = g_parity.load();
+		g_parity.store(oldParity ^ 1);
+
+		while (g_numReaders[oldParity].load(std::memory_order_acquire) != 0) {
+			std::this_thread::yield();
+		}
+
+		if (old != &g_defaultOptions) {
+			delete old;
+		}
+	}
+}
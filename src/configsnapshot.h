@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "options.h"
+
+
+// The current Options are published as an immutable snapshot behind an atomic pointer, so that they can be swapped out while the game is running.
+// Readers pin the snapshot that is current when they start and keep using that one, which costs a couple of atomic adds and never blocks.
+// Publishing waits until nobody can still be reading the old snapshot before freeing it, using two reader counters that alternate between publishes.
+namespace Config {
+	class Snapshot
+	{
+	public:
+		Snapshot();
+		~Snapshot();
+
+		Snapshot(const Snapshot &) = delete;
+		Snapshot & operator=(const Snapshot &) = delete;
+
+		const Options & operator*() const { return *m_options; }
+		const Options * operator->() const { return m_options; }
+
+		// Changes every time new options are published, so anything derived from the options can tell when it needs rebuilding
+		uint32_t GetGeneration() const { return m_generation; }
+
+	private:
+		const Options *m_options;
+		uint32_t m_generation;
+		uint32_t m_parity;
+	};
+
+	// Makes a copy of newOptions the current snapshot. Blocks until every reader of the previous one is done with it, then frees it.
+	// Must not be called while the calling thread holds a Snapshot, or it will wait on itself forever.
+	void Publish(const Options &newOptions);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cmath>
+
+
+// Minimal vector / transform types for the engine-independent code.
+// These have the same layout and semantics as NiPoint3 / NiMatrix33 / NiTransform, so the engine side can convert by copying.
+namespace MagicCore {
+	struct Vec3
+	{
+		float x = 0.f;
+		float y = 0.f;
+		float z = 0.f;
+
+		Vec3 operator-() const { return { -x, -y, -z }; }
+		Vec3 operator+(const Vec3 &v) const { return { x + v.x, y + v.y, z + v.z }; }
+		Vec3 operator-(const Vec3 &v) const { return { x - v.x, y - v.y, z - v.z }; }
+		Vec3 operator*(float s) const { return { x * s, y * s, z * s }; }
+		Vec3 operator/(float s) const { return { x / s, y / s, z / s }; }
+		Vec3 & operator+=(const Vec3 &v) { x += v.x; y += v.y; z += v.z; return *this; }
+		Vec3 & operator-=(const Vec3 &v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+		Vec3 & operator*=(float s) { x *= s; y *= s; z *= s; return *this; }
+	};
+	static_assert(sizeof(Vec3) == 0xC);
+
+	struct Mat33
+	{
+		float data[3][3] = { { 1.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, { 0.f, 0.f, 1.f } };
+
+		Mat33 operator*(const Mat33 &m) const
+		{
+			Mat33 result;
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 3; j++) {
+					result.data[i][j] = data[i][0] * m.data[0][j] + data[i][1] * m.data[1][j] + data[i][2] * m.data[2][j];
+				}
+			}
+			return result;
+		}
+
+		Vec3 operator*(const Vec3 &v) const
+		{
+			return {
+				data[0][0] * v.x + data[0][1] * v.y + data[0][2] * v.z,
+				data[1][0] * v.x + data[1][1] * v.y + data[1][2] * v.z,
+				data[2][0] * v.x + data[2][1] * v.y + data[2][2] * v.z
+			};
+		}
+
+		Mat33 Transpose() const
+		{
+			Mat33 result;
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 3; j++) {
+					result.data[i][j] = data[j][i];
+				}
+			}
+			return result;
+		}
+	};
+	static_assert(sizeof(Mat33) == 0x24);
+
+	struct Transform
+	{
+		Mat33 rot;
+		Vec3 pos;
+		float scale = 1.f;
+
+		Transform operator*(const Transform &t) const
+		{
+			Transform result;
+			result.scale = scale * t.scale;
+			result.rot = rot * t.rot;
+			result.pos = pos + (rot * t.pos) * scale;
+			return result;
+		}
+	};
+	static_assert(sizeof(Transform) == 0x34);
+
+	inline Transform InverseTransform(const Transform &t)
+	{
+		Transform inverse;
+		inverse.rot = t.rot.Transpose();
+		inverse.scale = 1.f / t.scale;
+		inverse.pos = (inverse.rot * -t.pos) * inverse.scale;
+		return inverse;
+	}
+
+	inline float VectorLengthSquared(const Vec3 &vec) { return vec.x*vec.x + vec.y*vec.y + vec.z*vec.z; }
+	inline float VectorLength(const Vec3 &vec) { return sqrtf(VectorLengthSquared(vec)); }
+	inline float lerp(float a, float b, float t) { return a * (1.0f - t) + b * t; }
+	inline Vec3 lerp(const Vec3 &a, const Vec3 &b, float t) { return a * (1.0f - t) + b * t; }
+	inline Vec3 ForwardVector(const Mat33 &r) { return { r.data[0][1], r.data[1][1], r.data[2][1] }; }
+	inline float DotProduct(const Vec3 &vec1, const Vec3 &vec2) { return vec1.x*vec2.x + vec1.y*vec2.y + vec1.z*vec2.z; }
+	inline Vec3 VectorNormalized(const Vec3 &vec) { float length = VectorLength(vec); return length > 0.0f ? vec / length : Vec3(); }
+
+	inline Vec3 CrossProduct(const Vec3 &vec1, const Vec3 &vec2)
+	{
+		return {
+			vec1.y * vec2.z - vec1.z * vec2.y,
+			vec1.z * vec2.x - vec1.x * vec2.z,
+			vec1.x * vec2.y - vec1.y * vec2.x
+		};
+	}
+
+	inline Vec3 RotateVectorByAxisAngle(const Vec3 &vector, const Vec3 &axis, float angle)
+	{
+		// Rodrigues' rotation formula
+		float cosTheta = cosf(angle);
+		return vector * cosTheta + (CrossProduct(axis, vector) * sinf(angle)) + axis * DotProduct(axis, vector) * (1.0f - cosTheta);
+	}
+}
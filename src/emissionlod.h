@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cmath>
+
+#include "options.h"
+
+
+namespace MagicCore {
+	// Fraction of its usual emission rate an effect drawn at spellScale gets.
+	// Only ever turns emission down - effects that dual casting makes bigger keep their usual rate.
+	inline float GetEmissionScale(const Config::Options &options, float spellScale)
+	{
+		if (spellScale >= 1.f) return 1.f;
+
+		float emissionScale = powf(spellScale > 0.f ? spellScale : 0.f, options.emissionLodExponent);
+		float minEmissionScale = options.minEmissionScale < 1.f ? options.minEmissionScale : 1.f;
+		return emissionScale > minEmissionScale ? emissionScale : minEmissionScale;
+	}
+
+	// Keeps the total number of particles across every effect we scale under a budget, by turning emission down evenly everywhere.
+	// Decides each frame's reduction from the particles counted the frame before.
+	class EmissionBudget
+	{
+	public:
+		void BeginFrame(int particleBudget)
+		{
+			m_particlesSavedLastFrame = m_numUnreducedParticles - m_numParticles;
+
+			// Go by how many particles there would have been without any reduction, otherwise the reduction would feed back into itself and oscillate
+			if (particleBudget > 0 && m_numUnreducedParticles > float(particleBudget)) {
+				m_budgetScale = float(particleBudget) / m_numUnreducedParticles;
+			}
+			else {
+				m_budgetScale = 1.f;
+			}
+
+			m_numParticles = 0.f;
+			m_numUnreducedParticles = 0.f;
+		}
+
+		// Applies on top of each effect's own emission scale
+		float GetBudgetScale() const { return m_budgetScale; }
+
+		// emissionScale is what the particle system has been emitting at
+		void AddParticleSystem(int numParticles, float emissionScale)
+		{
+			m_numParticles += float(numParticles);
+			m_numUnreducedParticles += emissionScale > 0.f ? float(numParticles) / emissionScale : float(numParticles);
+		}
+
+		// Rough, since it assumes the number of live particles follows the emission rate
+		float GetParticlesSavedLastFrame() const { return m_particlesSavedLastFrame; }
+
+	private:
+		float m_budgetScale = 1.f;
+		float m_numParticles = 0.f;
+		float m_numUnreducedParticles = 0.f;
+		float m_particlesSavedLastFrame = 0.f;
+	};
+}
@@ -0,0 +1,175 @@
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+
+#include "iniparser.h"
+
+
+namespace Ini {
+	namespace {
+		char * TrimLeft(char *s)
+		{
+			while (*s == ' ' || *s == '\t') s++;
+			return s;
+		}
+
+		// Null-terminates s at the end of its non-whitespace content, where end points one past its last character. Returns the new end.
+		char * TrimRight(char *s, char *end)
+		{
+			while (end > s && (end[-1] == ' ' || end[-1] == '\t')) end--;
+			*end = '\0';
+			return end;
+		}
+	}
+
+	bool File::Load(const char *path)
+	{
+		m_entries.clear();
+		m_buffer.clear();
+
+		std::FILE *file = std::fopen(path, "rb");
+		if (!file) return false;
+
+		std::string text;
+		char chunk[4096];
+		size_t numRead;
+		while ((numRead = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+			text.append(chunk, numRead);
+		}
+		bool isOk = !std::ferror(file);
+		std::fclose(file);
+		if (!isOk) return false;
+
+		Parse(std::move(text));
+		return true;
+	}
+
+	void File::Parse(std::string text)
+	{
+		m_entries.clear();
+		m_buffer = std::move(text);
+
+		char *cursor = m_buffer.data();
+		char *bufferEnd = cursor + m_buffer.size();
+
+		// Skip a UTF-8 BOM
+		if (m_buffer.size() >= 3 && (unsigned char)cursor[0] == 0xEF && (unsigned char)cursor[1] == 0xBB && (unsigned char)cursor[2] == 0xBF) {
+			cursor += 3;
+		}
+
+		const char *section = ""; // for keys before the first section header
+
+		for (int lineNumber = 1; cursor < bufferEnd; lineNumber++) {
+			char *lineEnd = cursor;
+			while (lineEnd < bufferEnd && *lineEnd != '\n') lineEnd++;
+			char *next = lineEnd < bufferEnd ? lineEnd + 1 : bufferEnd;
+			if (lineEnd > cursor && lineEnd[-1] == '\r') lineEnd--;
+			*lineEnd = '\0'; // the buffer always has room for this, std::string keeps a terminator past the end
+
+			char *line = TrimLeft(cursor);
+			cursor = next;
+
+			if (*line == '\0' || *line == ';') continue; // '#' isn't a comment to GetPrivateProfileString, so a '#key' is a key
+
+			if (*line == '[') {
+				char *name = TrimLeft(line + 1);
+				char *close = name;
+				while (*close && *close != ']') close++;
+				if (*close != ']') continue; // malformed header, ignore it like the rest of the garbage
+				TrimRight(name, close);
+				section = name;
+				continue;
+			}
+
+			char *equals = line;
+			while (*equals && *equals != '=') equals++;
+			if (*equals != '=') continue;
+
+			TrimRight(line, equals);
+
+			char *value = TrimLeft(equals + 1);
+			char *valueEnd = value;
+			while (*valueEnd) valueEnd++;
+			valueEnd = TrimRight(value, valueEnd);
+
+			size_t valueLength = valueEnd - value;
+			if (valueLength >= 2 && (value[0] == '"' || value[0] == '\'') && value[valueLength - 1] == value[0]) {
+				value[valueLength - 1] = '\0';
+				value++;
+			}
+
+			if (*line == '\0') continue;
+
+			m_entries.push_back({ section, line, value, lineNumber });
+		}
+	}
+
+	const Entry * File::Find(const char *section, const char *key) const
+	{
+		for (auto it = m_entries.rbegin(); it != m_entries.rend(); ++it) {
+			if (EqualsNoCase(it->key, key) && EqualsNoCase(it->section, section)) {
+				return &*it;
+			}
+		}
+		return nullptr;
+	}
+
+	bool EqualsNoCase(const char *a, const char *b)
+	{
+		for (; *a && *b; a++, b++) {
+			if (std::tolower((unsigned char)*a) != std::tolower((unsigned char)*b)) return false;
+		}
+		return *a == *b;
+	}
+
+	bool ParseFloat(const char *value, float &out)
+	{
+		char *end;
+		errno = 0;
+		float result = std::strtof(value, &end);
+		if (end == value || errno == ERANGE) return false;
+
+		out = result;
+		return true;
+	}
+
+	bool ParseDouble(const char *value, double &out)
+	{
+		char *end;
+		errno = 0;
+		double result = std::strtod(value, &end);
+		if (end == value || errno == ERANGE) return false;
+
+		out = result;
+		return true;
+	}
+
+	bool ParseInt(const char *value, int &out)
+	{
+		char *end;
+		errno = 0;
+		long result = std::strtol(value, &end, 10);
+		if (end == value || errno == ERANGE || result < INT_MIN || result > INT_MAX) return false;
+
+		out = int(result);
+		return true;
+	}
+
+	bool ParseBool(const char *value, bool &out)
+	{
+		int result;
+		if (!ParseInt(value, result)) return false;
+
+		if (result == 1) {
+			out = true;
+			return true;
+		}
+		else if (result == 0) {
+			out = false;
+			return true;
+		}
+		return false;
+	}
+}
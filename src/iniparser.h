@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// Minimal INI reader. The file is read into memory once and split in place, so looking up a key never touches the disk again.
+// Follows GetPrivateProfileString's rules where it matters: section and key names are case-insensitive, whitespace around names and values is ignored,
+// lines starting with ';' are comments, and a value wrapped in matching quotes has them removed.
+// Nothing in here throws; failures are reported through return values.
+namespace Ini {
+	struct Entry
+	{
+		const char *section;
+		const char *key;
+		const char *value;
+		int line;
+	};
+
+	class File
+	{
+	public:
+		File() = default;
+		File(const File &) = delete;
+		File & operator=(const File &) = delete;
+
+		// Reads and parses the whole file, replacing anything loaded before
+		bool Load(const char *path);
+		// Parses text that is already in memory
+		void Parse(std::string text);
+
+		// Returns the last matching entry, like GetPrivateProfileString does for duplicate keys
+		const Entry * Find(const char *section, const char *key) const;
+
+		const std::vector<Entry> & GetEntries() const { return m_entries; }
+
+	private:
+		std::string m_buffer; // entries point into this
+		std::vector<Entry> m_entries;
+	};
+
+	bool EqualsNoCase(const char *a, const char *b);
+
+	// Like std::stof / std::stoi, these parse the leading number and ignore anything after it (such as a trailing comment), but fail instead of throwing
+	bool ParseFloat(const char *value, float &out);
+	bool ParseDouble(const char *value, double &out);
+	bool ParseInt(const char *value, int &out);
+	// Accepts 0 or 1
+	bool ParseBool(const char *value, bool &out);
+}
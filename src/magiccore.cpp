@@ -0,0 +1,432 @@
+#include <algorithm>
+
+#include "magiccore.h"
+#include "simdmath.h"
+#include "profiling.h"
+
+
+namespace MagicCore {
+	bool IsTwoHandedSpell(const Inputs &inputs)
+	{
+		return (inputs.primarySpell.isValid && inputs.primarySpell.isTwoHanded) || (inputs.secondarySpell.isValid && inputs.secondarySpell.isTwoHanded);
+	}
+
+	bool IsDualCasting(const Inputs &inputs)
+	{
+		return inputs.isCastingDual || (IsTwoHandedSpell(inputs) && inputs.isCastingPrimary && inputs.isCastingSecondary);
+	}
+
+	const SpellParams & GetDualCastSpell(const Inputs &inputs)
+	{
+		return inputs.primarySpell.isValid ? inputs.primarySpell : inputs.secondarySpell;
+	}
+
+	int GetNumSmoothingFrames(const Config::Options &options, const SpellParams &spell, bool isDualCasting, float deltaTime)
+	{
+		int numSmoothingFrames;
+		switch (spell.skillLevel) {
+		case SpellSkillLevel::Master:
+			numSmoothingFrames = options.numSmoothingFramesMaster;
+			break;
+		case SpellSkillLevel::Expert:
+			numSmoothingFrames = options.numSmoothingFramesExpert;
+			break;
+		case SpellSkillLevel::Adept:
+			numSmoothingFrames = options.numSmoothingFramesAdept;
+			break;
+		case SpellSkillLevel::Apprentice:
+			numSmoothingFrames = options.numSmoothingFramesApprentice;
+			break;
+		default:
+			numSmoothingFrames = options.numSmoothingFramesNovice;
+		}
+		numSmoothingFrames = spell.overrides.Get(Config::SpellOverrides::kNumSmoothingFrames, &Config::SpellOverrides::numSmoothingFrames, numSmoothingFrames);
+
+		float smoothingMultiplier = 0.011f / deltaTime; // Half the number of frames at 45fps compared to 90fps, etc.
+		if (isDualCasting) {
+			smoothingMultiplier *= options.smoothingDualCastMultiplier;
+		}
+		return int(roundf(float(numSmoothingFrames) * smoothingMultiplier));
+	}
+
+	float GetSmoothingTime(const Config::Options &options, const SpellParams &spell, bool isDualCasting)
+	{
+		float smoothingTime;
+		switch (spell.skillLevel) {
+		case SpellSkillLevel::Master:
+			smoothingTime = options.smoothingTimeMaster;
+			break;
+		case SpellSkillLevel::Expert:
+			smoothingTime = options.smoothingTimeExpert;
+			break;
+		case SpellSkillLevel::Adept:
+			smoothingTime = options.smoothingTimeAdept;
+			break;
+		case SpellSkillLevel::Apprentice:
+			smoothingTime = options.smoothingTimeApprentice;
+			break;
+		default:
+			smoothingTime = options.smoothingTimeNovice;
+		}
+		smoothingTime = spell.overrides.Get(Config::SpellOverrides::kSmoothingTime, &Config::SpellOverrides::smoothingTime, smoothingTime);
+
+		if (isDualCasting) {
+			smoothingTime *= options.smoothingDualCastMultiplier;
+		}
+		return smoothingTime;
+	}
+
+	void Caster::UpdateSmoothing(const Config::Options &options, const Inputs &inputs, bool isDualCasting, float deltaTime)
+	{
+		Profiling::ScopedTimer timer(Profiling::Stage::Smoothing);
+
+		Vec3 secondaryForward = ForwardVector(inputs.secondaryAimWorld.rot);
+		m_secondaryAimHistory.Push(secondaryForward);
+
+		Vec3 primaryForward = ForwardVector(inputs.primaryAimWorld.rot);
+		m_primaryAimHistory.Push(primaryForward);
+
+		if (options.useTimeBasedSmoothing) {
+			// Step the filters with the same time constants that the smoothed directions will be requested with
+			float secondarySmoothingTime, primarySmoothingTime;
+			if (isDualCasting) {
+				const SpellParams &spell = GetDualCastSpell(inputs);
+				secondarySmoothingTime = primarySmoothingTime = GetSmoothingTime(options, spell, true);
+			}
+			else {
+				secondarySmoothingTime = GetSmoothingTime(options, inputs.secondarySpell, false);
+				primarySmoothingTime = GetSmoothingTime(options, inputs.primarySpell, false);
+			}
+
+			m_secondaryAimFilter.Update(secondaryForward, deltaTime, secondarySmoothingTime);
+			m_primaryAimFilter.Update(primaryForward, deltaTime, primarySmoothingTime);
+		}
+	}
+
+	void Caster::ResetSmoothing()
+	{
+		m_primaryAimHistory.Reset();
+		m_secondaryAimHistory.Reset();
+		m_primaryAimFilter.Reset();
+		m_secondaryAimFilter.Reset();
+	}
+
+	Vec3 Caster::GetSmoothedAimSum(const Config::Options &options, const AimHistory &history, const ExponentialAimFilter &filter, const SpellParams &spell, bool isDualCasting, float deltaTime) const
+	{
+		if (options.useTimeBasedSmoothing) {
+			// The filter was already stepped this frame with the time constant for this effect
+			return filter.Get();
+		}
+		return history.GetSum(GetNumSmoothingFrames(options, spell, isDualCasting, deltaTime));
+	}
+
+	float GetAimPredictionLead(const Config::Options &options, SpellSkillLevel spellLevel)
+	{
+		switch (spellLevel) {
+		case SpellSkillLevel::Master: return options.aimPredictionLeadMaster;
+		case SpellSkillLevel::Expert: return options.aimPredictionLeadExpert;
+		case SpellSkillLevel::Adept: return options.aimPredictionLeadAdept;
+		case SpellSkillLevel::Apprentice: return options.aimPredictionLeadApprentice;
+		default: return options.aimPredictionLeadNovice;
+		}
+	}
+
+	void Caster::FinishSmoothedAims(const Config::Options &options, Vec3 (&forwards)[2], const SpellParams &secondarySpell, const SpellParams &primarySpell, bool isDualCasting, float deltaTime) const
+	{
+		Simd::NormalizeVectors(forwards, 2);
+
+		if (!options.enableAimPrediction || deltaTime <= 0.f) return;
+
+		const AimHistory *histories[2] = { &m_secondaryAimHistory, &m_primaryAimHistory };
+		const SpellParams *spells[2] = { &secondarySpell, &primarySpell };
+		float maxAngle = options.aimPredictionMaxAngle * 0.017453292f;
+		for (int i = 0; i < 2; i++) {
+			// Measure the rate of turn over half the smoothing window, long enough to average out the jitter that the smoothing is there to remove
+			int numSmoothingFrames = options.useTimeBasedSmoothing ?
+				int(GetSmoothingTime(options, *spells[i], isDualCasting) / deltaTime) :
+				GetNumSmoothingFrames(options, *spells[i], isDualCasting, deltaTime);
+			float leadFrames = GetAimPredictionLead(options, spells[i]->skillLevel) / deltaTime;
+			forwards[i] = PredictAim(*histories[i], forwards[i], numSmoothingFrames / 2, leadFrames, options.aimPredictionUseAcceleration, maxAngle);
+		}
+	}
+
+	DualCastAimMode GetDualCastAimMode(const Config::Options &options)
+	{
+		if (options.useMainHandForDualCastAiming && !options.useOffHandForDualCastAiming) {
+			return DualCastAimMode::MainHand;
+		}
+		else if (options.useOffHandForDualCastAiming && !options.useMainHandForDualCastAiming) {
+			return DualCastAimMode::OffHand;
+		}
+		return DualCastAimMode::Combined;
+	}
+
+	Caster::StepFunction Caster::GetStepFunction(const Config::Options &options)
+	{
+		static const StepFunction s_variants[3][2] = {
+			{ &Caster::StepVariant<DualCastAimMode::Combined, false>, &Caster::StepVariant<DualCastAimMode::Combined, true> },
+			{ &Caster::StepVariant<DualCastAimMode::MainHand, false>, &Caster::StepVariant<DualCastAimMode::MainHand, true> },
+			{ &Caster::StepVariant<DualCastAimMode::OffHand, false>, &Caster::StepVariant<DualCastAimMode::OffHand, true> },
+		};
+		return s_variants[int(GetDualCastAimMode(options))][options.useCastingTimeForMergeTime ? 1 : 0];
+	}
+
+	bool DualCastMerger::UpdateDualCastState(const Config::Options &options, const Inputs &inputs, bool isDualCasting)
+	{
+		bool wasIdle = m_state == DualCastState::Idle;
+
+		if (m_state == DualCastState::Idle) {
+			if (isDualCasting) {
+				m_savedMergeState.primaryMagicOffsetNodeLocalTransform = inputs.primaryOffsetLocal;
+				m_savedMergeState.secondaryMagicOffsetNodeLocalTransform = inputs.secondaryOffsetLocal;
+				m_mergeState = HandMergeState::PreMerge;
+
+				m_currentDualCastScale = 1.f;
+				m_state = DualCastState::Cast;
+			}
+		}
+		if (m_state == DualCastState::Cast) {
+			if (!isDualCasting) {
+				if (m_mergeState == HandMergeState::Merging || m_mergeState == HandMergeState::Merged) {
+					// Start un-merging the effects. The spell may well be unequipped by the time this finishes, so take its unmerge time now.
+					m_savedMergeState.mergeTimeElapsed = 0.f;
+					m_savedMergeState.mergeTimeTotal = GetDualCastSpell(inputs).overrides.Get(Config::SpellOverrides::kSpellUnMergeTime, &Config::SpellOverrides::spellUnMergeTime, options.spellUnMergeTime);
+					m_mergeState = HandMergeState::Unmerging;
+				}
+				else {
+					m_mergeState = HandMergeState::None;
+				}
+
+				m_state = DualCastState::Idle;
+			}
+			else { // Dual casting
+				const Config::SpellOverrides &overrides = GetDualCastSpell(inputs).overrides;
+				float distanceBetweenHands = VectorLength(inputs.secondaryOffsetWorld.pos - inputs.primaryOffsetWorld.pos);
+				float closeScale = overrides.Get(Config::SpellOverrides::kDualCastHandsCloseSpellScale, &Config::SpellOverrides::dualCastHandsCloseSpellScale, options.dualCastHandsCloseSpellScale);
+				float farScale = overrides.Get(Config::SpellOverrides::kDualCastHandsFarSpellScale, &Config::SpellOverrides::dualCastHandsFarSpellScale, options.dualCastHandsFarSpellScale);
+				float minScale = (std::min)(closeScale, farScale);
+				float maxScale = (std::max)(closeScale, farScale);
+				float scale = std::clamp(lerp(closeScale, farScale, distanceBetweenHands / options.dualCastHandSeparationScalingDistance), minScale, maxScale);
+				m_currentDualCastScale = scale;
+			}
+		}
+
+		return wasIdle;
+	}
+
+	template <bool useCastingTimeForMergeTime>
+	void DualCastMerger::UpdateMerge(const Config::Options &options, const Inputs &inputs, float deltaTime, Outputs &outputs)
+	{
+		Vec3 midpoint = lerp(inputs.secondaryOffsetWorld.pos, inputs.primaryOffsetWorld.pos, 0.5f);
+		bool isTwoHandedSpell = IsTwoHandedSpell(inputs);
+
+		Transform primaryOffsetTransform = inputs.primaryOffsetWorld;
+		Transform secondaryOffsetTransform = inputs.secondaryOffsetWorld;
+
+		if (inputs.hasDualCaster) { // left caster is used for dualcasting / ritual spells
+			CastingState castingState = inputs.dualCasterState;
+
+			const SpellParams &spell = GetDualCastSpell(inputs);
+			float spellMergeTime = spell.overrides.Get(Config::SpellOverrides::kSpellMergeTime, &Config::SpellOverrides::spellMergeTime, options.spellMergeTime);
+
+			if (m_mergeState == HandMergeState::PreMerge) {
+				if (isTwoHandedSpell) {
+					// Two-handed spell -> ritual/master spell
+					if ((castingState == CastingState::Concentrating || castingState == CastingState::Charged) && spell.isTwoHandedEffectMergeable) {
+						// Merge the two-handed spell once it's charged and should be merged
+						m_savedMergeState.mergeTimeElapsed = 0.f;
+						m_savedMergeState.mergeTimeTotal = spellMergeTime;
+						m_mergeState = HandMergeState::Merging;
+					}
+					else {
+						// offset nodes stay where they should be - no change
+					}
+				}
+				else {
+					// Not a two-handed spell -> regular dual-cast
+					m_savedMergeState.mergeTimeElapsed = 0.f;
+					if constexpr (useCastingTimeForMergeTime) {
+						float castingTime = spell.castingTime;
+						m_savedMergeState.mergeTimeTotal = castingTime > 0.f ? castingTime : spellMergeTime;
+					}
+					else {
+						m_savedMergeState.mergeTimeTotal = spellMergeTime;
+					}
+					m_mergeState = HandMergeState::Merging;
+				}
+			}
+			if (m_mergeState == HandMergeState::Merging) {
+				m_savedMergeState.mergeTimeElapsed += deltaTime; // slows properly with different sgtm values
+
+				float lerpAmount = m_savedMergeState.mergeTimeElapsed / m_savedMergeState.mergeTimeTotal;
+				if (lerpAmount >= 1.f) {
+					// Done merging
+					m_mergeState = HandMergeState::Merged;
+				}
+				else {
+					// lerp offset nodes from their regular positions to the midpoint
+					Transform normalSecondaryTransform = Simd::Multiply(inputs.secondaryOffsetParentWorld, m_savedMergeState.secondaryMagicOffsetNodeLocalTransform);
+					secondaryOffsetTransform.pos = lerp(normalSecondaryTransform.pos, midpoint, lerpAmount);
+
+					primaryOffsetTransform.pos = lerp(primaryOffsetTransform.pos, midpoint, lerpAmount);
+				}
+			}
+			if (m_mergeState == HandMergeState::Merged) {
+				// offset nodes go to the midpoint
+				secondaryOffsetTransform.pos = midpoint;
+				primaryOffsetTransform.pos = midpoint;
+			}
+			if (m_mergeState == HandMergeState::Unmerging) {
+				m_savedMergeState.mergeTimeElapsed += deltaTime; // slows properly with different sgtm values
+
+				float lerpAmount = m_savedMergeState.mergeTimeElapsed / m_savedMergeState.mergeTimeTotal;
+				if (lerpAmount >= 1.f) {
+					// Done unmerging - restore original transforms
+					outputs.hasOffsetLocalTransforms = true;
+					outputs.primaryOffsetLocal = m_savedMergeState.primaryMagicOffsetNodeLocalTransform;
+					outputs.secondaryOffsetLocal = m_savedMergeState.secondaryMagicOffsetNodeLocalTransform;
+
+					m_mergeState = HandMergeState::None;
+				}
+				else {
+					// lerp offset nodes from their merged position back to their regular position
+					Transform normalSecondaryTransform = Simd::Multiply(inputs.secondaryOffsetParentWorld, m_savedMergeState.secondaryMagicOffsetNodeLocalTransform);
+					Transform mergedSecondaryTransform = Simd::Multiply(inputs.secondaryOffsetParentWorld, m_savedMergeState.mergedSecondaryMagicOffsetNodeLocalTransform);
+					secondaryOffsetTransform.pos = lerp(mergedSecondaryTransform.pos, normalSecondaryTransform.pos, lerpAmount);
+
+					Transform mergedPrimaryTransform = Simd::Multiply(inputs.primaryOffsetParentWorld, m_savedMergeState.mergedPrimaryMagicOffsetNodeLocalTransform);
+					primaryOffsetTransform.pos = lerp(mergedPrimaryTransform.pos, primaryOffsetTransform.pos, lerpAmount);
+				}
+			}
+		}
+		else {
+			secondaryOffsetTransform.pos = midpoint;
+			primaryOffsetTransform.pos = midpoint;
+		}
+
+		if (m_mergeState == HandMergeState::Merging || m_mergeState == HandMergeState::Merged || m_mergeState == HandMergeState::Unmerging) {
+			outputs.hasOffsetWorldTransforms = true;
+			outputs.secondaryOffsetWorld = secondaryOffsetTransform;
+			outputs.primaryOffsetWorld = primaryOffsetTransform;
+
+			if (m_mergeState == HandMergeState::Merging || m_mergeState == HandMergeState::Merged) {
+				// Save these for when we unmerge, so that we have transforms to unmerge from.
+				// These are the local transforms that the engine side will end up setting to reach the world transforms above.
+				m_savedMergeState.mergedSecondaryMagicOffsetNodeLocalTransform = Simd::Multiply(Simd::Inverse(inputs.secondaryOffsetParentWorld), secondaryOffsetTransform);
+				m_savedMergeState.mergedPrimaryMagicOffsetNodeLocalTransform = Simd::Multiply(Simd::Inverse(inputs.primaryOffsetParentWorld), primaryOffsetTransform);
+			}
+		}
+	}
+
+	template <bool useCastingTimeForMergeTime>
+	Outputs DualCastMerger::StepVariant(const Config::Options &options, const Inputs &inputs, float deltaTime)
+	{
+		Outputs outputs;
+		UpdateDualCastState(options, inputs, IsDualCasting(inputs));
+		UpdateMerge<useCastingTimeForMergeTime>(options, inputs, deltaTime, outputs);
+		return outputs;
+	}
+
+	Outputs DualCastMerger::Step(const Config::Options &options, const Inputs &inputs, float deltaTime)
+	{
+		if (options.useCastingTimeForMergeTime) {
+			return StepVariant<true>(options, inputs, deltaTime);
+		}
+		return StepVariant<false>(options, inputs, deltaTime);
+	}
+
+	bool DualCastMerger::GetUnmergedLocalTransforms(Transform &primaryLocal, Transform &secondaryLocal) const
+	{
+		// Same states that Step() outputs world transforms in
+		if (m_mergeState != HandMergeState::Merging && m_mergeState != HandMergeState::Merged && m_mergeState != HandMergeState::Unmerging) return false;
+
+		primaryLocal = m_savedMergeState.primaryMagicOffsetNodeLocalTransform;
+		secondaryLocal = m_savedMergeState.secondaryMagicOffsetNodeLocalTransform;
+		return true;
+	}
+
+	float DualCastMerger::GetSpellScale(const Config::Options &options, const SpellParams &spell, float magickaPercentage) const
+	{
+		float emptyScale = spell.overrides.Get(Config::SpellOverrides::kSpellScaleWhenMagickaEmpty, &Config::SpellOverrides::spellScaleWhenMagickaEmpty, options.spellScaleWhenMagickaEmpty);
+		float fullScale = spell.overrides.Get(Config::SpellOverrides::kSpellScaleWhenMagickaFull, &Config::SpellOverrides::spellScaleWhenMagickaFull, options.spellScaleWhenMagickaFull);
+		float magickaScale = lerp(emptyScale, fullScale, magickaPercentage);
+		if (m_state == DualCastState::Cast) {
+			return magickaScale * m_currentDualCastScale;
+		}
+		return magickaScale;
+	}
+
+	template <DualCastAimMode aimMode, bool useCastingTimeForMergeTime>
+	Outputs Caster::StepVariant(const Config::Options &options, const Inputs &inputs, float deltaTime)
+	{
+		Outputs outputs;
+
+		Vec3 midpoint = lerp(inputs.secondaryOffsetWorld.pos, inputs.primaryOffsetWorld.pos, 0.5f);
+
+		bool isDualCasting = IsDualCasting(inputs);
+
+		// Update stored aiming directions for this frame
+		UpdateSmoothing(options, inputs, isDualCasting, deltaTime);
+
+		Profiling::ScopedTimer stateMachineTimer(Profiling::Stage::StateMachine);
+
+		// Dualcast state updates
+		bool wasIdle = m_merger.UpdateDualCastState(options, inputs, isDualCasting);
+
+		if (wasIdle && !isDualCasting) {
+			// Aim node updates with smoothed directions. Both are finished together, whether or not they end up being used.
+			Vec3 forwards[2] = {
+				GetSmoothedAimSum(options, m_secondaryAimHistory, m_secondaryAimFilter, inputs.secondarySpell, false, deltaTime),
+				GetSmoothedAimSum(options, m_primaryAimHistory, m_primaryAimFilter, inputs.primarySpell, false, deltaTime)
+			};
+			FinishSmoothedAims(options, forwards, inputs.secondarySpell, inputs.primarySpell, false, deltaTime);
+
+			if (inputs.secondarySpell.isValid) {
+				outputs.hasSecondaryAimForward = true;
+				outputs.secondaryAimForward = forwards[0];
+			}
+
+			if (inputs.primarySpell.isValid) {
+				outputs.hasPrimaryAimForward = true;
+				outputs.primaryAimForward = forwards[1];
+			}
+		}
+		else if (isDualCasting) { // Dual cast aim node update
+			const SpellParams &spell = GetDualCastSpell(inputs);
+			Vec3 forwards[2] = {
+				GetSmoothedAimSum(options, m_secondaryAimHistory, m_secondaryAimFilter, spell, true, deltaTime),
+				GetSmoothedAimSum(options, m_primaryAimHistory, m_primaryAimFilter, spell, true, deltaTime)
+			};
+			FinishSmoothedAims(options, forwards, spell, spell, true, deltaTime);
+			Vec3 secondaryForward = forwards[0];
+			Vec3 primaryForward = forwards[1];
+
+			Vec3 forward;
+			if constexpr (aimMode == DualCastAimMode::MainHand) {
+				// Main hand only
+				forward = secondaryForward;
+			}
+			else if constexpr (aimMode == DualCastAimMode::OffHand) {
+				// Offhand only
+				forward = primaryForward;
+			}
+			else {
+				// Combine both hands
+
+				float angle = acosf(std::clamp(DotProduct(primaryForward, secondaryForward), -1.f, 1.f)); // clamp input of acos to be safe
+				Vec3 axis = VectorNormalized(CrossProduct(primaryForward, secondaryForward));
+
+				forward = RotateVectorByAxisAngle(primaryForward, axis, angle * 0.5f);
+			}
+
+			outputs.hasSecondaryAimForward = true;
+			outputs.secondaryAimForward = forward;
+			outputs.hasSecondaryAimPosition = true;
+			outputs.secondaryAimPosition = midpoint;
+		}
+
+		m_merger.UpdateMerge<useCastingTimeForMergeTime>(options, inputs, deltaTime, outputs);
+
+		return outputs;
+	}
+}
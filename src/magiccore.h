@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstdint>
+
+#include "coremath.h"
+#include "options.h"
+#include "smoothing.h"
+
+
+// The dual-cast / hand merge state machine and aim smoothing, independent of the engine.
+// Everything it needs for a frame comes in through Inputs and everything it wants done to the scene graph goes out through Outputs.
+// It never allocates, so a Caster can be stepped as often as needed outside of the game.
+namespace MagicCore {
+	enum class SpellSkillLevel : uint8_t {
+		Novice,
+		Apprentice,
+		Adept,
+		Expert,
+		Master,
+	};
+
+	// Same values as MagicCaster::State
+	enum class CastingState : uint8_t {
+		None = 0,
+		CastStart = 1,
+		Charging = 2,
+		Charged = 3,
+		Released = 4,
+		Concentrating = 6,
+	};
+
+	struct SpellParams
+	{
+		bool isValid = false; // false if no spell is equipped
+		SpellSkillLevel skillLevel = SpellSkillLevel::Novice;
+		bool isTwoHanded = false;
+		bool isTwoHandedEffectMergeable = false;
+		float castingTime = 0.f;
+		Config::SpellOverrides overrides;
+	};
+
+	struct Inputs
+	{
+		// Aim node world transforms after any extra roll / yaw has been applied
+		Transform primaryAimWorld;
+		Transform secondaryAimWorld;
+
+		Transform primaryOffsetWorld;
+		Transform primaryOffsetLocal;
+		Transform primaryOffsetParentWorld; // identity if there is no parent
+		Transform secondaryOffsetWorld;
+		Transform secondaryOffsetLocal;
+		Transform secondaryOffsetParentWorld;
+
+		SpellParams primarySpell;
+		SpellParams secondarySpell;
+
+		// Anim vars, in terms of the primary / secondary hands
+		bool isCastingPrimary = false;
+		bool isCastingSecondary = false;
+		bool isCastingDual = false;
+
+		bool hasDualCaster = false;
+		CastingState dualCasterState = CastingState::None;
+	};
+
+	struct Outputs
+	{
+		// New aim directions. The engine side builds the rotation from these and keeps the nodes' current positions unless told otherwise.
+		bool hasPrimaryAimForward = false;
+		Vec3 primaryAimForward;
+		bool hasSecondaryAimForward = false;
+		Vec3 secondaryAimForward;
+		bool hasSecondaryAimPosition = false;
+		Vec3 secondaryAimPosition;
+
+		// New offset node world transforms, while merging / merged / unmerging
+		bool hasOffsetWorldTransforms = false;
+		Transform primaryOffsetWorld;
+		Transform secondaryOffsetWorld;
+
+		// Offset node local transforms to restore once unmerging is done
+		bool hasOffsetLocalTransforms = false;
+		Transform primaryOffsetLocal;
+		Transform secondaryOffsetLocal;
+	};
+
+	enum class DualCastState : uint8_t {
+		Idle,
+		Cast,
+	};
+
+	enum class HandMergeState : uint8_t {
+		None,
+		PreMerge,
+		Merging,
+		Merged,
+		Unmerging,
+	};
+
+	struct SavedMergeState
+	{
+		Transform primaryMagicOffsetNodeLocalTransform;
+		Transform secondaryMagicOffsetNodeLocalTransform;
+		Transform mergedPrimaryMagicOffsetNodeLocalTransform;
+		Transform mergedSecondaryMagicOffsetNodeLocalTransform;
+		float mergeTimeElapsed = 0.f;
+		float mergeTimeTotal = 0.f;
+	};
+
+	// Which hands' aim directions make up the dual cast aim direction
+	enum class DualCastAimMode : uint8_t {
+		Combined,
+		MainHand,
+		OffHand,
+	};
+	DualCastAimMode GetDualCastAimMode(const Config::Options &options);
+
+	bool IsTwoHandedSpell(const Inputs &inputs);
+	bool IsDualCasting(const Inputs &inputs);
+	// The spell whose settings a dual cast goes by
+	const SpellParams & GetDualCastSpell(const Inputs &inputs);
+
+	int GetNumSmoothingFrames(const Config::Options &options, const SpellParams &spell, bool isDualCasting, float deltaTime);
+	float GetSmoothingTime(const Config::Options &options, const SpellParams &spell, bool isDualCasting);
+	float GetAimPredictionLead(const Config::Options &options, SpellSkillLevel spellLevel);
+
+	// The dual cast and hand merge part of a caster, without any aim smoothing. Small enough to keep one for every actor we look after.
+	class DualCastMerger
+	{
+	public:
+		// Only fills in the offset node outputs
+		Outputs Step(const Config::Options &options, const Inputs &inputs, float deltaTime);
+
+		// Scale to apply to the effects of spell, given the caster's current magicka
+		float GetSpellScale(const Config::Options &options, const SpellParams &spell, float magickaPercentage) const;
+
+		DualCastState GetDualCastState() const { return m_state; }
+		HandMergeState GetMergeState() const { return m_mergeState; }
+		float GetDualCastScale() const { return m_currentDualCastScale; }
+		// Not dual casting, and done putting the hands back where they were
+		bool IsIdle() const { return m_state == DualCastState::Idle && m_mergeState == HandMergeState::None; }
+
+		// Whether the offset nodes are currently moved away from their own local transforms, and if so what those were.
+		// For putting them back when a caster is dropped partway through a merge.
+		bool GetUnmergedLocalTransforms(Transform &primaryLocal, Transform &secondaryLocal) const;
+
+	private:
+		friend class Caster; // does more in between the two halves of Step()
+
+		// Returns whether the caster was idle coming into this frame
+		bool UpdateDualCastState(const Config::Options &options, const Inputs &inputs, bool isDualCasting);
+		template <bool useCastingTimeForMergeTime>
+		void UpdateMerge(const Config::Options &options, const Inputs &inputs, float deltaTime, Outputs &outputs);
+
+		template <bool useCastingTimeForMergeTime>
+		Outputs StepVariant(const Config::Options &options, const Inputs &inputs, float deltaTime);
+
+		DualCastState m_state = DualCastState::Idle;
+		HandMergeState m_mergeState = HandMergeState::None;
+		SavedMergeState m_savedMergeState;
+		float m_currentDualCastScale = 1.f;
+	};
+
+	// A DualCastMerger plus aim smoothing, for the player
+	class Caster
+	{
+	public:
+		// Step() built for one combination of the options that hardly ever change, so that it doesn't have to check them every frame.
+		// Only valid to call with options that GetStepFunction() would also have returned it for.
+		typedef Outputs(Caster::*StepFunction)(const Config::Options &options, const Inputs &inputs, float deltaTime);
+		static StepFunction GetStepFunction(const Config::Options &options);
+
+		Outputs Step(const Config::Options &options, const Inputs &inputs, float deltaTime) { return (this->*GetStepFunction(options))(options, inputs, deltaTime); }
+
+		float GetSpellScale(const Config::Options &options, const SpellParams &spell, float magickaPercentage) const { return m_merger.GetSpellScale(options, spell, magickaPercentage); }
+
+		DualCastState GetDualCastState() const { return m_merger.GetDualCastState(); }
+		HandMergeState GetMergeState() const { return m_merger.GetMergeState(); }
+		float GetDualCastScale() const { return m_merger.GetDualCastScale(); }
+		bool IsIdle() const { return m_merger.IsIdle(); }
+
+		// Forgets the aim history, so that aim after a break (e.g. after the weapon was sheathed) isn't smoothed towards where it was before
+		void ResetSmoothing();
+
+	private:
+		template <DualCastAimMode aimMode, bool useCastingTimeForMergeTime>
+		Outputs StepVariant(const Config::Options &options, const Inputs &inputs, float deltaTime);
+
+		void UpdateSmoothing(const Config::Options &options, const Inputs &inputs, bool isDualCasting, float deltaTime);
+		Vec3 GetSmoothedAimSum(const Config::Options &options, const AimHistory &history, const ExponentialAimFilter &filter, const SpellParams &spell, bool isDualCasting, float deltaTime) const;
+		// Normalizes the smoothed aim directions, and leads them by the prediction if that's enabled
+		void FinishSmoothedAims(const Config::Options &options, Vec3 (&forwards)[2], const SpellParams &secondarySpell, const SpellParams &primarySpell, bool isDualCasting, float deltaTime) const;
+
+		DualCastMerger m_merger;
+
+		AimHistory m_primaryAimHistory;
+		AimHistory m_secondaryAimHistory;
+		ExponentialAimFilter m_primaryAimFilter;
+		ExponentialAimFilter m_secondaryAimFilter;
+	};
+}
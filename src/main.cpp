@@ -1,16 +1,26 @@
 ﻿#include "common/IDebugLog.h"  // IDebugLog
 #include "skse64_common/skse_version.h"  // RUNTIME_VERSION
 #include "skse64/PluginAPI.h"  // SKSEInterface, PluginInfo
+#include "skse64/NiNodes.h"
+#include "skse64/GameData.h"
+#include "skse64/GameEvents.h"
 #include "xbyak/xbyak.h"
 #include "skse64_common/BranchTrampoline.h"
 
 #include <ShlObj.h>  // CSIDL_MYDOCUMENTS
-#include <deque>
 
 #include "version.h"
 #include "config.h"
 #include "RE.h"
 #include "utils.h"
+#include "magiccore.h"
+#include "npccasters.h"
+#include "scalemodifiers.h"
+#include "profiling.h"
+#include "asynclog.h"
+#include "replay.h"
+#include "spelloverrides.h"
+#include "pluginapi.h"
 
 
 // SKSE globals
@@ -23,6 +33,7 @@ SKSETrampolineInterface *g_trampoline = nullptr;
 uintptr_t postMagicNodeUpdateHookedFuncAddr = 0;
 uintptr_t postWandUpdateHookedFuncAddr = 0;
 
+// Offsets in the 1.4.15 exe. Addresses::Resolve() (addressresolver.h) can find them in other builds once there are verified signatures for them.
 auto postMagicNodeUpdateHookLoc = RelocAddr<uintptr_t>(0x6AC035);
 auto postMagicNodeUpdateHookedFunc = RelocAddr<uintptr_t>(0x398940);
 
@@ -33,9 +44,6 @@ auto postWandUpdateHookedFunc = RelocAddr<uintptr_t>(0xDCF900);
 typedef NiMatrix33 * (*_MatrixFromForwardVector)(NiMatrix33 *matOut, NiPoint3 *forward, NiPoint3 *world);
 RelocAddr<_MatrixFromForwardVector> MatrixFromForwardVector(0xC4C1E0);
 
-typedef float(*_Actor_GetActorValuePercentage)(Actor *_this, UInt32 actorValue);
-RelocAddr<_Actor_GetActorValuePercentage> Actor_GetActorValuePercentage(0x5DEB30);
-
 typedef NiMatrix33 * (*_EulerToNiMatrix)(NiMatrix33 *out, float pitch, float roll, float yaw);
 RelocAddr<_EulerToNiMatrix> EulerToNiMatrix(0xC995A0);
 inline NiMatrix33 EulerToMatrix(float pitch, float roll, float yaw) { NiMatrix33 out; EulerToNiMatrix(&out, pitch, roll, yaw); return out; }
@@ -44,408 +52,496 @@ RelocPtr<float> g_deltaTime(0x30C3A08);
 
 RelocPtr<float> fMagicRotationPitch(0x1EAEB00);
 
+// The runtime version alone doesn't say whether the exe has been patched, so this makes sure a call we're about to replace goes where we expect it to
+bool IsCallTo(uintptr_t callAddr, uintptr_t expectedTarget)
+{
+	const UInt8 *call = (const UInt8 *)callAddr;
+	if (call[0] != 0xE8) return false;
 
-enum class DualCastState {
-	Idle,
-	Cast,
-};
-DualCastState state = DualCastState::Idle;
+	SInt32 displacement;
+	memcpy(&displacement, call + 1, sizeof(displacement));
+	return callAddr + 5 + displacement == expectedTarget;
+}
 
-struct SavedState {
-	float currentDualCastScale;
-};
-SavedState savedState;
-
-enum class HandMergeState {
-	None,
-	PreMerge,
-	Merging,
-	Merged,
-	Unmerging,
-};
-HandMergeState mergeState = HandMergeState::None;
 
-struct SavedMergeState
+// Engine-independent dual-cast / merge state for the player
+MagicCore::Caster g_playerCaster;
+
+// Whether the player could be casting at all, so that the hooks can skip everything else when they can't.
+// Knowing whether a spell is equipped means polling both hands, so that part is only rechecked when an equip event says something changed,
+// when the weapon is drawn, and every kEquipmentPollInterval frames regardless, in case something changed the equipment without an event we saw.
+// There are no sinks for the draw / sheathe / cast animation events: whether the weapon is drawn is a bit on the actor state that is read every frame,
+// and the casting anim vars are only read while active. That's cheaper than handling the events, and can't miss one.
+struct Activation
 {
-	NiTransform primaryMagicOffsetNodeLocalTransform;
-	NiTransform secondaryMagicOffsetNodeLocalTransform;
-	NiTransform mergedPrimaryMagicOffsetNodeLocalTransform;
-	NiTransform mergedSecondaryMagicOffsetNodeLocalTransform;
-	float mergeTimeElapsed;
-	float mergeTimeTotal;
+	std::atomic<bool> isEquipmentDirty{ true };
+	bool hasSpellEquipped = false;
+	bool wasWeaponDrawn = false;
+	int framesSinceEquipmentPoll = 0;
+	bool isActive = false;
 };
-SavedMergeState g_savedMergeState;
+Activation g_activation;
+
+constexpr int kEquipmentPollInterval = 90;
 
-std::deque<NiPoint3> g_primaryAimVectors{ 500, NiPoint3() };
-std::deque<NiPoint3> g_secondaryAimVectors{ 500, NiPoint3() };
-NiPoint3 GetSmoothedVector(std::deque<NiPoint3> &vectors, int numFrames)
+class EquipEventHandler : public BSTEventSink<TESEquipEvent>
 {
-	NiPoint3 smoothedVector = NiPoint3();
+public:
+	virtual EventResult ReceiveEvent(TESEquipEvent *evn, EventDispatcher<TESEquipEvent> *dispatcher) override
+	{
+		if (!evn || !evn->actor) return kEvent_Continue;
 
-	int i = 0;
-	for (NiPoint3 &vector : vectors) {
-		smoothedVector += vector;
-		if (++i >= numFrames) {
-			break;
+		if (evn->actor == *g_thePlayer) {
+			g_activation.isEquipmentDirty.store(true, std::memory_order_relaxed);
 		}
+		else if (evn->actor->formType == kFormType_Character) {
+			// How NPCs come to our attention, besides being in the player's cell with a spell in hand. Sent when they ready spells for combat, which is what we're after.
+			NpcCasters::OnEquip(evn->actor);
+		}
+		return kEvent_Continue;
 	}
+};
+EquipEventHandler g_equipEventHandler;
+
+Replay::Recorder g_recorder;
 
-	return VectorNormalized(smoothedVector);
+bool UpdateActivation(PlayerCharacter *player)
+{
+	bool isWeaponDrawn = player->actorState.IsWeaponDrawn();
+	bool wasWeaponJustDrawn = isWeaponDrawn && !g_activation.wasWeaponDrawn;
+	g_activation.wasWeaponDrawn = isWeaponDrawn;
+
+	bool isEquipmentDirty = g_activation.isEquipmentDirty.exchange(false, std::memory_order_relaxed);
+	if (isEquipmentDirty || wasWeaponJustDrawn || ++g_activation.framesSinceEquipmentPoll >= kEquipmentPollInterval) {
+		g_activation.hasSpellEquipped = GetEquippedSpell(player, false) || GetEquippedSpell(player, true);
+		g_activation.framesSinceEquipmentPoll = 0;
+	}
+
+	// Stay active until any dual cast merge has been undone, so the offset nodes don't get left where the merge put them
+	bool isActive = (g_activation.hasSpellEquipped && isWeaponDrawn) || !g_playerCaster.IsIdle();
+	if (isActive && !g_activation.isActive) {
+		// Whatever is in the aim history is from before the break
+		g_playerCaster.ResetSmoothing();
+		if (g_recorder.IsOpen()) g_recorder.AddResetSmoothing();
+	}
+	g_activation.isActive = isActive;
+	return isActive;
 }
 
-int GetNumSmoothingFramesForEffect(EffectSetting *effect, bool isDualCasting)
+// Everything the hooks need from the engine for one frame, gathered in a single pass.
+// The post magic node update hook gathers it at the start of the frame, and the post wand update hook reuses it later in the same frame.
+struct FrameSnapshot
 {
-	int numSmoothingFrames;
-	SpellSkillLevel spellLevel = GetEffectSkillLevel(effect);
-	switch (spellLevel) {
-	case SpellSkillLevel::Master:
-		numSmoothingFrames = Config::options.numSmoothingFramesMaster;
-		break;
-	case SpellSkillLevel::Expert:
-		numSmoothingFrames = Config::options.numSmoothingFramesExpert;
-		break;
-	case SpellSkillLevel::Adept:
-		numSmoothingFrames = Config::options.numSmoothingFramesAdept;
-		break;
-	case SpellSkillLevel::Apprentice:
-		numSmoothingFrames = Config::options.numSmoothingFramesApprentice;
-		break;
-	default:
-		numSmoothingFrames = Config::options.numSmoothingFramesNovice;
-	}
-
-	float smoothingMultiplier = 0.011f / *g_deltaTime; // Half the number of frames at 45fps compared to 90fps, etc.
-	if (isDualCasting) {
-		smoothingMultiplier *= Config::options.smoothingDualCastMultiplier;
+	bool isValid = false;
+
+	NiPointer<NiAVObject> secondaryMagicAimNode;
+	NiPointer<NiAVObject> primaryMagicAimNode;
+	NiPointer<NiAVObject> secondaryMagicOffsetNode;
+	NiPointer<NiAVObject> primaryMagicOffsetNode;
+
+	bool isLeftHanded = false;
+	bool isWeaponDrawn = false;
+
+	// Anim vars. These are in terms of the primary / secondary hands, not left / right.
+	bool isCastingPrimary = false;
+	bool isCastingSecondary = false;
+	bool isCastingDual = false;
+
+	const SpellInfo *primarySpell = nullptr;
+	const SpellInfo *secondarySpell = nullptr;
+
+	bool hasDualCaster = false; // left caster is used for dualcasting / ritual spells
+	MagicCaster::State dualCasterState = MagicCaster::State::kNone;
+
+	float magickaPercentage = 0.f;
+	float deltaTime = 0.f;
+	float magicRotationPitch = 0.f;
+
+	void Release()
+	{
+		// Don't hold on to the nodes past the end of the frame
+		*this = FrameSnapshot();
 	}
-	return round(float(numSmoothingFrames) * smoothingMultiplier);
+};
+FrameSnapshot g_frameSnapshot;
+
+NodeUpdateBatch g_nodeUpdateBatch;
+
+bool GatherFrameSnapshot(PlayerCharacter *player, FrameSnapshot &snapshot)
+{
+	snapshot.isValid = false;
+
+	if (!player->GetNiNode()) return false;
+
+	snapshot.secondaryMagicAimNode = player->unk3F0[PlayerCharacter::Node::kNode_SecondaryMagicAimNode];
+	snapshot.primaryMagicAimNode = player->unk3F0[PlayerCharacter::Node::kNode_PrimaryMagicAimNode];
+	snapshot.secondaryMagicOffsetNode = player->unk3F0[PlayerCharacter::Node::kNode_SecondaryMagicOffsetNode];
+	snapshot.primaryMagicOffsetNode = player->unk3F0[PlayerCharacter::Node::kNode_PrimaryMagicOffsetNode];
+
+	if (!snapshot.secondaryMagicOffsetNode || !snapshot.primaryMagicOffsetNode || !snapshot.secondaryMagicAimNode || !snapshot.primaryMagicAimNode) return false;
+
+	snapshot.isLeftHanded = *g_leftHandedMode;
+	snapshot.isWeaponDrawn = player->actorState.IsWeaponDrawn();
+
+	snapshot.isCastingPrimary = IsCastingRight(player);
+	snapshot.isCastingSecondary = IsCastingLeft(player);
+	snapshot.isCastingDual = IsDualCasting(player);
+
+	snapshot.primarySpell = GetSpellInfo(GetEquippedSpell(player, false));
+	snapshot.secondarySpell = GetSpellInfo(GetEquippedSpell(player, true));
+
+	MagicCaster *caster = GetMagicCaster(player, true);
+	snapshot.hasDualCaster = caster != nullptr;
+	snapshot.dualCasterState = caster ? MagicCaster::State(caster->state) : MagicCaster::State::kNone;
+
+	// ActorValue ids:
+	// - health is 24
+	// - magicka is 25
+	// - stamina is 26
+	snapshot.magickaPercentage = Actor_GetActorValuePercentage(player, 25);
+	snapshot.deltaTime = *g_deltaTime;
+	snapshot.magicRotationPitch = *fMagicRotationPitch;
+
+	snapshot.isValid = true;
+	return true;
 }
 
-void PostMagicNodeUpdateHook()
+void RecordFrame(const FrameSnapshot &snapshot, const MagicCore::Inputs &inputs, const MagicCore::Outputs &outputs)
 {
-	// Do state updates + pos/rot updates in this hook right after the magic nodes get updated, but before vrik so that vrik can apply head bobbing on top.
+	Replay::FrameRecord record{};
 
-	PlayerCharacter *player = *g_thePlayer;
-	if (!player->GetNiNode()) return;
+	record.primarySpellFormId = snapshot.primarySpell ? snapshot.primarySpell->spell->formID : 0;
+	record.secondarySpellFormId = snapshot.secondarySpell ? snapshot.secondarySpell->spell->formID : 0;
 
-	NiPointer<NiAVObject> secondaryMagicAimNode = player->unk3F0[PlayerCharacter::Node::kNode_SecondaryMagicAimNode];
-	NiPointer<NiAVObject> primaryMagicAimNode = player->unk3F0[PlayerCharacter::Node::kNode_PrimaryMagicAimNode];
-	NiPointer<NiAVObject> secondaryMagicOffsetNode = player->unk3F0[PlayerCharacter::Node::kNode_SecondaryMagicOffsetNode];
-	NiPointer<NiAVObject> primaryMagicOffsetNode = player->unk3F0[PlayerCharacter::Node::kNode_PrimaryMagicOffsetNode];
+	record.magickaPercentage = snapshot.magickaPercentage;
+	record.deltaTime = snapshot.deltaTime;
+	record.magicRotationPitch = snapshot.magicRotationPitch;
 
-	if (!secondaryMagicOffsetNode || !primaryMagicOffsetNode || !secondaryMagicAimNode || !primaryMagicAimNode) return;
+	if (snapshot.isLeftHanded) record.flags |= Replay::FrameRecord::kFlag_IsLeftHanded;
+	if (snapshot.isWeaponDrawn) record.flags |= Replay::FrameRecord::kFlag_IsWeaponDrawn;
+	Replay::FromInputs(inputs, record);
 
-	NiPoint3 midpoint = lerp(secondaryMagicOffsetNode->m_worldTransform.pos, primaryMagicOffsetNode->m_worldTransform.pos, 0.5f);
+	g_recorder.WriteFrame(record, inputs, outputs);
+}
 
-	bool isLeftHanded = *g_leftHandedMode;
+MagicCore::Inputs GatherCoreInputs(const FrameSnapshot &snapshot)
+{
+	MagicCore::Inputs inputs;
 
-	NiAVObject *leftAimNode = isLeftHanded ? primaryMagicAimNode : secondaryMagicAimNode;
-	NiAVObject *rightAimNode = isLeftHanded ? secondaryMagicAimNode : primaryMagicAimNode;
+	NiAVObject *secondaryMagicOffsetNode = snapshot.secondaryMagicOffsetNode;
+	NiAVObject *primaryMagicOffsetNode = snapshot.primaryMagicOffsetNode;
 
-	bool isCastingPrimary = IsCastingRight(player);
-	bool isCastingSecondary = IsCastingLeft(player);
-	bool isCastingLeft = isLeftHanded ? isCastingPrimary : isCastingSecondary;
-	bool isCastingRight = isLeftHanded ? isCastingSecondary : isCastingPrimary;
+	// The aim node transforms are filled in by the caller once it has applied roll / yaw to them
+	inputs.primaryOffsetWorld = ToCore(primaryMagicOffsetNode->m_worldTransform);
+	inputs.primaryOffsetLocal = ToCore(primaryMagicOffsetNode->m_localTransform);
+	inputs.primaryOffsetParentWorld = GetParentWorldTransform(primaryMagicOffsetNode);
+	inputs.secondaryOffsetWorld = ToCore(secondaryMagicOffsetNode->m_worldTransform);
+	inputs.secondaryOffsetLocal = ToCore(secondaryMagicOffsetNode->m_localTransform);
+	inputs.secondaryOffsetParentWorld = GetParentWorldTransform(secondaryMagicOffsetNode);
 
-	SpellItem* primarySpell = GetEquippedSpell(player, false);
-	SpellItem* secondarySpell = GetEquippedSpell(player, true);
-	bool isTwoHandedSpell = (primarySpell && get_vfunc<_SpellItem_IsTwoHanded>(primarySpell, 0x67)(primarySpell)) || (secondarySpell && get_vfunc<_SpellItem_IsTwoHanded>(secondarySpell, 0x67)(secondarySpell));
+	inputs.primarySpell = ToSpellParams(snapshot.primarySpell);
+	inputs.secondarySpell = ToSpellParams(snapshot.secondarySpell);
 
-	bool isDualCasting = IsDualCasting(player) || (isTwoHandedSpell && isCastingRight && isCastingLeft);
+	inputs.isCastingPrimary = snapshot.isCastingPrimary;
+	inputs.isCastingSecondary = snapshot.isCastingSecondary;
+	inputs.isCastingDual = snapshot.isCastingDual;
 
-	// First, apply user-supplied roll/yaw aim values while casting, as the base game does not support these.
+	inputs.hasDualCaster = snapshot.hasDualCaster;
+	inputs.dualCasterState = MagicCore::CastingState(snapshot.dualCasterState);
 
-	{ // Update right magic aim node with additional rotation values
-		NiPoint3 euler = { *fMagicRotationPitch, 0.f, 0.f };
-		if (isCastingRight || isDualCasting) {
-			 euler.y = Config::options.magicRotationRoll;
-			 euler.z = Config::options.magicRotationYaw;
-		}
-		euler *= 0.017453292;
-		rightAimNode->m_localTransform.rot = EulerToMatrix(euler.x, euler.y, euler.z);
-		NiAVObject::ControllerUpdateContext ctx{ 0, 0 };
-		CALL_MEMBER_FN(rightAimNode, UpdateNode)(&ctx);
+	return inputs;
+}
+
+void SetAimNodeForward(NiAVObject *aimNode, const MagicCore::Vec3 &forward, const MagicCore::Vec3 *position)
+{
+	NiPoint3 niForward = FromCore(forward);
+	NiPoint3 worldUp = { 0, 0, 1 };
+	NiMatrix33 rot; MatrixFromForwardVector(&rot, &niForward, &worldUp);
+	NiTransform transform = aimNode->m_worldTransform;
+	transform.rot = rot;
+	if (position) {
+		transform.pos = FromCore(*position);
 	}
 
-	{ // Update left magic aim node with additional rotation values
-		NiPoint3 euler = { *fMagicRotationPitch, 0.f, 0.f };
-		if (isCastingLeft || isDualCasting) {
-			euler.y = -Config::options.magicRotationRoll;
-			euler.z = -Config::options.magicRotationYaw;
-		}
-		euler *= 0.017453292;
-		leftAimNode->m_localTransform.rot = EulerToMatrix(euler.x, euler.y, euler.z);
-		NiAVObject::ControllerUpdateContext ctx{ 0, 0 };
-		CALL_MEMBER_FN(leftAimNode, UpdateNode)(&ctx);
+	UpdateNodeTransformLocal(aimNode, transform);
+	g_nodeUpdateBatch.MarkDirty(aimNode);
+}
+
+void ApplyCoreOutputs(const FrameSnapshot &snapshot, const MagicCore::Outputs &outputs)
+{
+	NiAVObject *secondaryMagicAimNode = snapshot.secondaryMagicAimNode;
+	NiAVObject *primaryMagicAimNode = snapshot.primaryMagicAimNode;
+	NiAVObject *secondaryMagicOffsetNode = snapshot.secondaryMagicOffsetNode;
+	NiAVObject *primaryMagicOffsetNode = snapshot.primaryMagicOffsetNode;
+
+	if (outputs.hasSecondaryAimForward) {
+		SetAimNodeForward(secondaryMagicAimNode, outputs.secondaryAimForward, outputs.hasSecondaryAimPosition ? &outputs.secondaryAimPosition : nullptr);
+	}
+	if (outputs.hasPrimaryAimForward) {
+		SetAimNodeForward(primaryMagicAimNode, outputs.primaryAimForward, nullptr);
 	}
 
-	{ // Update stored aiming directions for this frame after updating them
-		NiPoint3 secondaryForward = ForwardVector(secondaryMagicAimNode->m_worldTransform.rot);
-		g_secondaryAimVectors.pop_back();
-		g_secondaryAimVectors.push_front(secondaryForward);
+	if (outputs.hasOffsetWorldTransforms) {
+		UpdateNodeTransformLocal(secondaryMagicOffsetNode, FromCore(outputs.secondaryOffsetWorld));
+		g_nodeUpdateBatch.MarkDirty(secondaryMagicOffsetNode);
 
-		NiPoint3 primaryForward = ForwardVector(primaryMagicAimNode->m_worldTransform.rot);
-		g_primaryAimVectors.pop_back();
-		g_primaryAimVectors.push_front(primaryForward);
+		UpdateNodeTransformLocal(primaryMagicOffsetNode, FromCore(outputs.primaryOffsetWorld));
+		g_nodeUpdateBatch.MarkDirty(primaryMagicOffsetNode);
 	}
 
-	// Dualcast state updates
-	if (state == DualCastState::Idle) {
-		if (!isDualCasting) {
-			NiAVObject::ControllerUpdateContext ctx{ 0, 0 };
+	if (outputs.hasOffsetLocalTransforms) {
+		primaryMagicOffsetNode->m_localTransform = FromCore(outputs.primaryOffsetLocal);
+		g_nodeUpdateBatch.MarkDirty(primaryMagicOffsetNode);
+		secondaryMagicOffsetNode->m_localTransform = FromCore(outputs.secondaryOffsetLocal);
+		g_nodeUpdateBatch.MarkDirty(secondaryMagicOffsetNode);
+	}
+}
 
-			if (secondarySpell) { // Secondary aim node update with smoothed direction
-				EffectSetting *secondaryEffect = GetCostliestEffect(secondarySpell);
-				NiPoint3 forward = GetSmoothedVector(g_secondaryAimVectors, GetNumSmoothingFramesForEffect(secondaryEffect, false));
+template <bool isLeftHanded, bool hasRollYaw>
+void UpdateMagicNodes(const Config::Options &options, FrameSnapshot &snapshot, MagicCore::Caster::StepFunction step)
+{
+	NiAVObject *secondaryMagicAimNode = snapshot.secondaryMagicAimNode;
+	NiAVObject *primaryMagicAimNode = snapshot.primaryMagicAimNode;
 
-				NiPoint3 worldUp = { 0, 0, 1 };
-				NiMatrix33 rot; MatrixFromForwardVector(&rot, &forward, &worldUp);
-				NiTransform transform = secondaryMagicAimNode->m_worldTransform;
-				transform.rot = rot;
+	NiAVObject *leftAimNode = isLeftHanded ? primaryMagicAimNode : secondaryMagicAimNode;
+	NiAVObject *rightAimNode = isLeftHanded ? secondaryMagicAimNode : primaryMagicAimNode;
 
-				UpdateNodeTransformLocal(secondaryMagicAimNode, transform);
-				CALL_MEMBER_FN(secondaryMagicAimNode, UpdateNode)(&ctx);
-			}
+	MagicCore::Inputs inputs = GatherCoreInputs(snapshot);
 
-			if (primarySpell) { // Primary aim node update with smoothed direction
-				EffectSetting *primaryEffect = GetCostliestEffect(primarySpell);
-				NiPoint3 forward = GetSmoothedVector(g_primaryAimVectors, GetNumSmoothingFramesForEffect(primaryEffect, false));
+	// First, apply user-supplied roll/yaw aim values while casting, as the base game does not support these.
 
-				NiPoint3 worldUp = { 0, 0, 1 };
-				NiMatrix33 rot; MatrixFromForwardVector(&rot, &forward, &worldUp);
-				NiTransform transform = primaryMagicAimNode->m_worldTransform;
-				transform.rot = rot;
+	if constexpr (hasRollYaw) {
+		bool isCastingLeft = isLeftHanded ? snapshot.isCastingPrimary : snapshot.isCastingSecondary;
+		bool isCastingRight = isLeftHanded ? snapshot.isCastingSecondary : snapshot.isCastingPrimary;
+		bool isDualCasting = MagicCore::IsDualCasting(inputs);
 
-				UpdateNodeTransformLocal(primaryMagicAimNode, transform);
-				CALL_MEMBER_FN(primaryMagicAimNode, UpdateNode)(&ctx);
+		{ // Update right magic aim node with additional rotation values
+			NiPoint3 euler = { snapshot.magicRotationPitch, 0.f, 0.f };
+			if (isCastingRight || isDualCasting) {
+				 euler.y = options.magicRotationRoll;
+				 euler.z = options.magicRotationYaw;
 			}
+			euler *= 0.017453292;
+			rightAimNode->m_localTransform.rot = EulerToMatrix(euler.x, euler.y, euler.z);
 		}
-		else { // Dual casting
-			g_savedMergeState.primaryMagicOffsetNodeLocalTransform = primaryMagicOffsetNode->m_localTransform;
-			g_savedMergeState.secondaryMagicOffsetNodeLocalTransform = secondaryMagicOffsetNode->m_localTransform;
-			mergeState = HandMergeState::PreMerge;
-			
-			savedState.currentDualCastScale = 1.f;
-			state = DualCastState::Cast;
+
+		{ // Update left magic aim node with additional rotation values
+			NiPoint3 euler = { snapshot.magicRotationPitch, 0.f, 0.f };
+			if (isCastingLeft || isDualCasting) {
+				euler.y = -options.magicRotationRoll;
+				euler.z = -options.magicRotationYaw;
+			}
+			euler *= 0.017453292;
+			leftAimNode->m_localTransform.rot = EulerToMatrix(euler.x, euler.y, euler.z);
 		}
 	}
-	if (state == DualCastState::Cast) {
-		if (!isDualCasting) {
-			if (mergeState == HandMergeState::Merging || mergeState == HandMergeState::Merged) {
-				// Start un-merging the effects
-				g_savedMergeState.mergeTimeElapsed = 0.f;
-				mergeState = HandMergeState::Unmerging;
-			}
-			else {
-				mergeState = HandMergeState::None;
-			}
+	else {
+		// With no roll / yaw, both hands end up with the same pitch-only rotation whether they're casting or not
+		NiMatrix33 rot = EulerToMatrix(snapshot.magicRotationPitch * 0.017453292f, 0.f, 0.f);
+		rightAimNode->m_localTransform.rot = rot;
+		leftAimNode->m_localTransform.rot = rot;
+	}
 
-			state = DualCastState::Idle;
-		}
-		else { // Dual casting
-			{
-				float distanceBetweenHands = VectorLength(secondaryMagicOffsetNode->m_worldTransform.pos - primaryMagicOffsetNode->m_worldTransform.pos);
-				float closeScale = Config::options.dualCastHandsCloseSpellScale;
-				float farScale = Config::options.dualCastHandsFarSpellScale;
-				float minScale = min(closeScale, farScale);
-				float maxScale = max(closeScale, farScale);
-				float scale = std::clamp(lerp(closeScale, farScale, distanceBetweenHands / Config::options.dualCastHandSeparationScalingDistance), minScale, maxScale);
-				savedState.currentDualCastScale = scale;
-			}
+	UpdateNodeTransformWorld(rightAimNode); // we only need the world rotation below, the full update happens in the flush
+	g_nodeUpdateBatch.MarkDirty(rightAimNode);
+	UpdateNodeTransformWorld(leftAimNode);
+	g_nodeUpdateBatch.MarkDirty(leftAimNode);
 
-			// Aim node update
-			{
-				SpellItem *spell = primarySpell ? primarySpell : secondarySpell;
-				EffectSetting *effect = GetCostliestEffect(spell);
-				int numSmoothingFrames = GetNumSmoothingFramesForEffect(effect, true);
-				NiPoint3 secondaryForward = GetSmoothedVector(g_secondaryAimVectors, numSmoothingFrames);
-				NiPoint3 primaryForward = GetSmoothedVector(g_primaryAimVectors, numSmoothingFrames);
-
-				NiPoint3 forward;
-				if (Config::options.useMainHandForDualCastAiming && !Config::options.useOffHandForDualCastAiming) {
-					// Main hand only
-					forward = secondaryForward;
-				}
-				else if (Config::options.useOffHandForDualCastAiming && !Config::options.useMainHandForDualCastAiming) {
-					// Offhand only
-					forward = primaryForward;
-				}
-				else {
-					// Combine both hands
+	// Then hand everything else over to the core, with the aim directions we just changed
+	inputs.primaryAimWorld = ToCore(primaryMagicAimNode->m_worldTransform);
+	inputs.secondaryAimWorld = ToCore(secondaryMagicAimNode->m_worldTransform);
 
-					float angle = acosf(std::clamp(DotProduct(primaryForward, secondaryForward), -1.f, 1.f)); // clamp input of acos to be safe
-					NiPoint3 axis = VectorNormalized(CrossProduct(primaryForward, secondaryForward));
+	MagicCore::Outputs outputs = (g_playerCaster.*step)(options, inputs, snapshot.deltaTime);
 
-					forward = RotateVectorByAxisAngle(primaryForward, axis, angle * 0.5f);
-				}
+	if (g_recorder.IsOpen()) {
+		RecordFrame(snapshot, inputs, outputs);
+	}
 
-				NiMatrix33 rot;
-				NiPoint3 worldUp = { 0, 0, 1 };
-				MatrixFromForwardVector(&rot, &forward, &worldUp);
-				NiTransform transform = secondaryMagicAimNode->m_worldTransform;
-				transform.rot = rot;
+	ApplyCoreOutputs(snapshot, outputs);
+}
 
-				transform.pos = midpoint;
+// UpdateMagicNodes() for every combination of its template parameters, by [hasRollYaw][isLeftHanded]
+typedef void(*UpdateMagicNodesFunction)(const Config::Options &options, FrameSnapshot &snapshot, MagicCore::Caster::StepFunction step);
+const UpdateMagicNodesFunction g_updateMagicNodesVariants[2][2] = {
+	{ UpdateMagicNodes<false, false>, UpdateMagicNodes<true, false> },
+	{ UpdateMagicNodes<false, true>, UpdateMagicNodes<true, true> },
+};
 
-				UpdateNodeTransformLocal(secondaryMagicAimNode, transform);
-				NiAVObject::ControllerUpdateContext ctx{ 0, 0 };
-				CALL_MEMBER_FN(secondaryMagicAimNode, UpdateNode)(&ctx);
-			}
-		}
-	}
+// The variants picked for the current config. Left-handed mode is a game setting that can change at any time, so that one is still picked every frame.
+struct HookVariants
+{
+	bool isValid = false;
+	uint32_t configGeneration = 0;
+	const UpdateMagicNodesFunction *updateMagicNodes = nullptr; // indexed by isLeftHanded
+	MagicCore::Caster::StepFunction step = nullptr;
+};
+HookVariants g_hookVariants;
 
-	{
-		NiTransform primaryOffsetTransform = primaryMagicOffsetNode->m_worldTransform;
-		NiTransform secondaryOffsetTransform = secondaryMagicOffsetNode->m_worldTransform;
-
-		if (MagicCaster* caster = GetMagicCaster(player, true)) { // left caster is used for dualcasting / ritual spells
-			MagicCaster::State castingState = MagicCaster::State(caster->state);
-
-			SpellItem *spell = primarySpell ? primarySpell : secondarySpell;
-			EffectSetting *effect = GetCostliestEffect(spell);
-
-			if (mergeState == HandMergeState::PreMerge) {
-				if (isTwoHandedSpell) {
-					// Two-handed spell -> ritual/master spell
-					if ((castingState == MagicCaster::State::kConcentrating || castingState == MagicCaster::State::kCharged) && IsTwoHandedEffectMergeable(effect)) {
-						// Merge the two-handed spell once it's charged and should be merged
-						g_savedMergeState.mergeTimeElapsed = 0.f;
-						g_savedMergeState.mergeTimeTotal = Config::options.spellMergeTime;
-						mergeState = HandMergeState::Merging;
-					}
-					else {
-						// offset nodes stay where they should be - no change
-					}
-				}
-				else {
-					// Not a two-handed spell -> regular dual-cast
-					g_savedMergeState.mergeTimeElapsed = 0.f;
-					if (Config::options.useCastingTimeForMergeTime) {
-						float castingTime = effect ? effect->properties.castingTime : 0.f;
-						g_savedMergeState.mergeTimeTotal = castingTime > 0.f ? castingTime : Config::options.spellMergeTime;
-					}
-					else {
-						g_savedMergeState.mergeTimeTotal = Config::options.spellMergeTime;
-					}
-					mergeState = HandMergeState::Merging;
-				}
-			}
-			if (mergeState == HandMergeState::Merging) {
-				g_savedMergeState.mergeTimeElapsed += *g_deltaTime; // slows properly with different sgtm values
+const HookVariants & GetHookVariants(const Config::Snapshot &options)
+{
+	if (!g_hookVariants.isValid || g_hookVariants.configGeneration != options.GetGeneration()) {
+		// Config was (re)loaded since we last looked
+		bool hasRollYaw = options->magicRotationRoll != 0.f || options->magicRotationYaw != 0.f;
+		g_hookVariants.updateMagicNodes = g_updateMagicNodesVariants[hasRollYaw ? 1 : 0];
+		g_hookVariants.step = MagicCore::Caster::GetStepFunction(*options);
+		g_hookVariants.configGeneration = options.GetGeneration();
+		g_hookVariants.isValid = true;
+	}
+	return g_hookVariants;
+}
 
-				float lerpAmount = g_savedMergeState.mergeTimeElapsed / g_savedMergeState.mergeTimeTotal;
-				if (lerpAmount >= 1.f) {
-					// Done merging
-					mergeState = HandMergeState::Merged;
-				}
-				else {
-					// lerp offset nodes from their regular positions to the midpoint
-					NiTransform normalSecondaryTransform = secondaryMagicOffsetNode->m_parent->m_worldTransform * g_savedMergeState.secondaryMagicOffsetNodeLocalTransform;
-					secondaryOffsetTransform.pos = lerp(normalSecondaryTransform.pos, midpoint, lerpAmount);
+// Returns whether the magic nodes were updated
+bool UpdatePlayerMagicNodes(const Config::Snapshot &options, FrameSnapshot &snapshot)
+{
+	if (!UpdateActivation(*g_thePlayer)) {
+		// No spell to cast, or nothing drawn to cast it with
+		Profiling::AddToCounter(Profiling::Counter::InactiveFramesSkipped, 1);
+		if (g_recorder.IsOpen()) g_recorder.AddInactiveFrame();
+		return false;
+	}
 
-					NiTransform normalPrimaryTransform = primaryMagicOffsetNode->m_parent->m_worldTransform * g_savedMergeState.primaryMagicOffsetNodeLocalTransform;
-					primaryOffsetTransform.pos = lerp(primaryOffsetTransform.pos, midpoint, lerpAmount);
-				}
-			}
-			if (mergeState == HandMergeState::Merged) {
-				// offset nodes go to the midpoint
-				secondaryOffsetTransform.pos = midpoint;
-				primaryOffsetTransform.pos = midpoint;
-			}
-			if (mergeState == HandMergeState::Unmerging) {
-				g_savedMergeState.mergeTimeElapsed += *g_deltaTime; // slows properly with different sgtm values
-
-				float lerpAmount = g_savedMergeState.mergeTimeElapsed / Config::options.spellUnMergeTime;
-				if (lerpAmount >= 1.f) {
-					// Done unmerging - restore original transforms
-					NiAVObject::ControllerUpdateContext ctx{ 0, 0 };
-					primaryMagicOffsetNode->m_localTransform = g_savedMergeState.primaryMagicOffsetNodeLocalTransform;
-					CALL_MEMBER_FN(primaryMagicOffsetNode, UpdateNode)(&ctx);
-					secondaryMagicOffsetNode->m_localTransform = g_savedMergeState.secondaryMagicOffsetNodeLocalTransform;
-					CALL_MEMBER_FN(secondaryMagicOffsetNode, UpdateNode)(&ctx);
-
-					mergeState = HandMergeState::None;
-				}
-				else {
-					// lerp offset nodes from their merged position back to their regular position
-					NiTransform normalSecondaryTransform = secondaryMagicOffsetNode->m_parent->m_worldTransform * g_savedMergeState.secondaryMagicOffsetNodeLocalTransform;
-					NiTransform mergedSecondaryTransform = secondaryMagicOffsetNode->m_parent->m_worldTransform * g_savedMergeState.mergedSecondaryMagicOffsetNodeLocalTransform;
-					secondaryOffsetTransform.pos = lerp(mergedSecondaryTransform.pos, normalSecondaryTransform.pos, lerpAmount);
-
-					NiTransform normalPrimaryTransform = primaryMagicOffsetNode->m_parent->m_worldTransform * g_savedMergeState.primaryMagicOffsetNodeLocalTransform;
-					NiTransform mergedPrimaryTransform = primaryMagicOffsetNode->m_parent->m_worldTransform * g_savedMergeState.mergedPrimaryMagicOffsetNodeLocalTransform;
-					primaryOffsetTransform.pos = lerp(mergedPrimaryTransform.pos, primaryOffsetTransform.pos, lerpAmount);
-				}
-			}
-		}
-		else {
-			secondaryOffsetTransform.pos = midpoint;
-			primaryOffsetTransform.pos = midpoint;
+	{
+		Profiling::ScopedTimer timer(Profiling::Stage::Snapshot);
+		if (!GatherFrameSnapshot(*g_thePlayer, snapshot)) {
+			if (g_recorder.IsOpen()) g_recorder.AddInactiveFrame();
+			return false;
 		}
+	}
 
-		if (mergeState == HandMergeState::Merging || mergeState == HandMergeState::Merged || mergeState == HandMergeState::Unmerging) {
-			// Secondary offset node update
-			{
-				UpdateNodeTransformLocal(secondaryMagicOffsetNode, secondaryOffsetTransform);
-				NiAVObject::ControllerUpdateContext ctx{ 0, 0 };
-				CALL_MEMBER_FN(secondaryMagicOffsetNode, UpdateNode)(&ctx);
-			}
+	const HookVariants &variants = GetHookVariants(options);
+	variants.updateMagicNodes[snapshot.isLeftHanded ? 1 : 0](*options, snapshot, variants.step);
 
-			// Primary offset node update
-			{
-				UpdateNodeTransformLocal(primaryMagicOffsetNode, primaryOffsetTransform);
-				NiAVObject::ControllerUpdateContext ctx{ 0, 0 };
-				CALL_MEMBER_FN(primaryMagicOffsetNode, UpdateNode)(&ctx);
-			}
+	{ // Finally, actually update every node we touched, once each
+		Profiling::ScopedTimer timer(Profiling::Stage::NodeUpdates);
+		g_nodeUpdateBatch.Flush();
+	}
+	return true;
+}
 
-			if (mergeState == HandMergeState::Merging || mergeState == HandMergeState::Merged) {
-				// Save these for when we unmerge, so that we have transforms to unmerge from
-				g_savedMergeState.mergedSecondaryMagicOffsetNodeLocalTransform = secondaryMagicOffsetNode->m_localTransform;
-				g_savedMergeState.mergedPrimaryMagicOffsetNodeLocalTransform = primaryMagicOffsetNode->m_localTransform;
-			}
-		}
+void GetAimNodeForward(NiAVObject *aimNode, float (&forward)[3])
+{
+	// Forward is +y, i.e. the rotation's second column
+	const NiMatrix33 &rot = aimNode->m_worldTransform.rot;
+	forward[0] = rot.data[0][1];
+	forward[1] = rot.data[1][1];
+	forward[2] = rot.data[2][1];
+}
+
+// What we did to the player this frame, for other plugins
+void FillFrameData(const Config::Options &options, const FrameSnapshot &snapshot, bool isActive, MisvrPluginAPI::FrameData &frame)
+{
+	using namespace MisvrPluginAPI;
+
+	frame.flags = 0;
+	frame.dualCastState = uint8_t(g_playerCaster.GetDualCastState());
+	frame.mergeState = uint8_t(g_playerCaster.GetMergeState());
+	frame.dualCastScale = g_playerCaster.GetDualCastScale();
+	if (!isActive) return;
+
+	bool isDualCasting = g_playerCaster.GetDualCastState() == MagicCore::DualCastState::Cast;
+	frame.flags |= kFrameFlag_IsActive;
+	if (snapshot.isLeftHanded) frame.flags |= kFrameFlag_IsLeftHanded;
+	if (isDualCasting) frame.flags |= kFrameFlag_IsDualCasting;
+	if (snapshot.primarySpell) frame.flags |= kFrameFlag_HasPrimaryAim;
+	if (snapshot.secondarySpell || isDualCasting) frame.flags |= kFrameFlag_HasSecondaryAim;
+
+	GetAimNodeForward(snapshot.primaryMagicAimNode, frame.primaryAimForward);
+	GetAimNodeForward(snapshot.secondaryMagicAimNode, frame.secondaryAimForward);
+	if (isDualCasting) {
+		// The dual cast aim goes on the secondary aim node
+		memcpy(frame.dualCastAimForward, frame.secondaryAimForward, sizeof(frame.dualCastAimForward));
 	}
+
+	frame.primarySpellScale = g_playerCaster.GetSpellScale(options, ToSpellParams(snapshot.primarySpell), snapshot.magickaPercentage);
+	frame.secondarySpellScale = g_playerCaster.GetSpellScale(options, ToSpellParams(snapshot.secondarySpell), snapshot.magickaPercentage);
 }
 
+UInt32 g_frameNumber = 0;
+
+void PostMagicNodeUpdateHook()
+{
+	// Do state updates + pos/rot updates in this hook right after the magic nodes get updated, but before vrik so that vrik can apply head bobbing on top.
+
+	// Use the same options for the whole hook, even if the config is reloaded in the middle of it
+	const Config::Snapshot options;
+	Profiling::g_isEnabled = options->enableProfiling;
+
+	Profiling::ScopedTimer hookTimer(Profiling::Stage::PostMagicNodeUpdateHook);
+
+	FrameSnapshot &snapshot = g_frameSnapshot;
+	bool isActive = UpdatePlayerMagicNodes(options, snapshot);
+
+	// Other plugins get a frame whether or not we did anything in it, so they can tell the difference between that and us not running
+	MisvrPluginAPI::FrameData frame = {};
+	frame.frameNumber = ++g_frameNumber;
+	FillFrameData(*options, snapshot, isActive, frame);
+	PluginApi::PublishFrame(frame);
+
+	hookTimer.Stop(); // other plugins' callbacks aren't ours to time
+	PluginApi::RunPostMagicNodeUpdateCallbacks(frame);
+}
+
+
+ParticleScaleCache g_primaryParticleCache;
+ParticleScaleCache g_secondaryParticleCache;
 
 void PostWandUpdateHook()
 {
 	// Do scale overrides in this hook, which is after the last time the wand nodes have their world transforms updated.
 	// This allows us to set the scale of the magic offset node world transforms without them getting overwritten.
 
-	PlayerCharacter *player = *g_thePlayer;
-	if (!player->GetNiNode()) return;
-	
-	if (!player->actorState.IsWeaponDrawn()) {
-		// Just don't mess with anything while sheathed
-		return;
+	const Config::Snapshot options;
+
+	if (Profiling::g_isEnabled) {
+		// Report before starting the timer, so the report itself never shows up in the timings
+		Profiling::ReportIfDue(options->profilingReportInterval);
 	}
 
-	NiPointer<NiAVObject> secondaryMagicOffsetNode = player->unk3F0[PlayerCharacter::Node::kNode_SecondaryMagicOffsetNode];
-	NiPointer<NiAVObject> primaryMagicOffsetNode = player->unk3F0[PlayerCharacter::Node::kNode_PrimaryMagicOffsetNode];
+	Profiling::ScopedTimer hookTimer(Profiling::Stage::PostWandUpdateHook);
 
-	if (!secondaryMagicOffsetNode || !primaryMagicOffsetNode) return;
+	ScaleModifiers::CollectGarbage();
 
-	float minScale = Config::options.spellScaleWhenMagickaEmpty;
-	float maxScale = Config::options.spellScaleWhenMagickaFull;
+	if (options->enableEmissionLod) {
+		g_emissionBudget.BeginFrame(options->emissionLodParticleBudget);
+		// Summed over every frame, so this counts particle-frames rather than particles
+		Profiling::AddToCounter(Profiling::Counter::EmissionLodParticlesSaved, UInt64(g_emissionBudget.GetParticlesSavedLastFrame()));
+	}
 
-	// ActorValue ids:
-	// - health is 24
-	// - magicka is 25
-	// - stamina is 26
-	float magickaPercentage = Actor_GetActorValuePercentage(player, 25);
-	//_MESSAGE("Magicka percent: %.2f", magickaPercentage);
-	float magickaScale = lerp(minScale, maxScale, magickaPercentage);
+	{ // NPCs don't depend on anything the player is doing
+		Profiling::ScopedTimer timer(Profiling::Stage::NpcCasters);
+		NpcCasters::Update(*options, *g_deltaTime);
+	}
 
-	if (state == DualCastState::Idle) {
-		SetParticleScaleDownstream(secondaryMagicOffsetNode, magickaScale);
-		SetParticleScaleDownstream(primaryMagicOffsetNode, magickaScale);
+	FrameSnapshot &snapshot = g_frameSnapshot;
+	if (g_activation.isActive && !snapshot.isValid) {
+		// The post magic node update hook didn't run (or bailed) this frame
+		GatherFrameSnapshot(*g_thePlayer, snapshot);
 	}
-	if (state == DualCastState::Cast) {
-		float scale = magickaScale * savedState.currentDualCastScale;
-		SetParticleScaleDownstream(secondaryMagicOffsetNode, scale);
-		SetParticleScaleDownstream(primaryMagicOffsetNode, scale);
+
+	if (!g_activation.isActive || !snapshot.isValid || !snapshot.isWeaponDrawn) {
+		// Just don't mess with anything while sheathed, and don't keep the spell effects alive through the caches either
+		g_secondaryParticleCache.Clear();
+		g_primaryParticleCache.Clear();
+		snapshot.Release();
+		return;
 	}
+
+	if (options->logFrameDiagnostics) {
+		AsyncLog::Message("Magicka percent: %.2f", snapshot.magickaPercentage);
+	}
+	// Per hand, since each spell can have its own magicka scaling
+	float secondaryScale = g_playerCaster.GetSpellScale(*options, ToSpellParams(snapshot.secondarySpell), snapshot.magickaPercentage);
+	float primaryScale = g_playerCaster.GetSpellScale(*options, ToSpellParams(snapshot.primarySpell), snapshot.magickaPercentage);
+
+	Profiling::ScopedTimer particleTimer(Profiling::Stage::ParticleScaling);
+
+	SetParticleScaleDownstream(*options, g_secondaryParticleCache, snapshot.secondaryMagicOffsetNode, secondaryScale);
+	SetParticleScaleDownstream(*options, g_primaryParticleCache, snapshot.primaryMagicOffsetNode, primaryScale);
+
+	particleTimer.Stop();
+
+	// This is the last thing we do in the frame
+	snapshot.Release();
 }
 
 
@@ -488,7 +584,7 @@ void PerformHooks()
 
 		g_branchTrampoline.Write5Branch(postMagicNodeUpdateHookLoc.GetUIntPtr(), uintptr_t(code.getCode()));
 
-		_MESSAGE("Post magic node update hook complete");
+		AsyncLog::Message("Post magic node update hook complete");
 	}
 
 	{
@@ -529,7 +625,7 @@ void PerformHooks()
 
 		g_branchTrampoline.Write5Branch(postWandUpdateHookLoc.GetUIntPtr(), uintptr_t(code.getCode()));
 
-		_MESSAGE("Post Wand Update hook complete");
+		AsyncLog::Message("Post Wand Update hook complete");
 	}
 }
 
@@ -542,7 +638,7 @@ bool TryHook()
 	if (g_trampoline) {
 		void* branch = g_trampoline->AllocateFromBranchPool(g_pluginHandle, TRAMPOLINE_SIZE);
 		if (!branch) {
-			_ERROR("couldn't acquire branch trampoline from SKSE. this is fatal. skipping remainder of init process.");
+			AsyncLog::Error("couldn't acquire branch trampoline from SKSE. this is fatal. skipping remainder of init process.");
 			return false;
 		}
 
@@ -550,7 +646,7 @@ bool TryHook()
 
 		void* local = g_trampoline->AllocateFromLocalPool(g_pluginHandle, TRAMPOLINE_SIZE);
 		if (!local) {
-			_ERROR("couldn't acquire codegen buffer from SKSE. this is fatal. skipping remainder of init process.");
+			AsyncLog::Error("couldn't acquire codegen buffer from SKSE. this is fatal. skipping remainder of init process.");
 			return false;
 		}
 
@@ -558,12 +654,12 @@ bool TryHook()
 	}
 	else {
 		if (!g_branchTrampoline.Create(TRAMPOLINE_SIZE)) {
-			_ERROR("couldn't create branch trampoline. this is fatal. skipping remainder of init process.");
+			AsyncLog::Error("couldn't create branch trampoline. this is fatal. skipping remainder of init process.");
 			return false;
 		}
 		if (!g_localTrampoline.Create(TRAMPOLINE_SIZE, nullptr))
 		{
-			_ERROR("couldn't create codegen buffer. this is fatal. skipping remainder of init process.");
+			AsyncLog::Error("couldn't create codegen buffer. this is fatal. skipping remainder of init process.");
 			return false;
 		}
 	}
@@ -576,6 +672,14 @@ bool TryHook()
 extern "C" {
 	void OnDataLoaded()
 	{
+		// unk4D0 is the TESEquipEvent dispatcher
+		auto equipDispatcher = (EventDispatcher<TESEquipEvent> *)(&GetEventDispatcherList()->unk4D0);
+		equipDispatcher->AddEventSink(&g_equipEventHandler);
+		AsyncLog::Message("Registered for equip events");
+
+		if (!SpellOverrideTable::Load()) {
+			AsyncLog::Warning("[WARNING] Failed to read some spell overrides. Those are ignored.");
+		}
 	}
 
 	void OnInputLoaded()
@@ -595,6 +699,12 @@ extern "C" {
 			else if (msg->type == SKSEMessagingInterface::kMessage_PostLoad) {
 				
 			}
+			else if (msg->type == SKSEMessagingInterface::kMessage_PostLoadGame || msg->type == SKSEMessagingInterface::kMessage_NewGame) {
+				// Loading doesn't send equip events for what the player already had equipped
+				g_activation.isEquipmentDirty.store(true, std::memory_order_relaxed);
+				// Whoever we knew about is from the game we were in before
+				NpcCasters::Clear();
+			}
 		}
 	}
 
@@ -621,6 +731,10 @@ extern "C" {
 			return false;
 		}
 
+		if (!IsCallTo(postMagicNodeUpdateHookLoc, postMagicNodeUpdateHookedFunc) || !IsCallTo(postWandUpdateHookLoc, postWandUpdateHookedFunc)) {
+			_WARNING("[WARNING] The calls we hook are not where they should be. The exe may be modified, or another plugin may have hooked them first.");
+		}
+
 		return true;
 	}
 
@@ -628,23 +742,59 @@ extern "C" {
 	{	// Called by SKSE to load this plugin
 		_MESSAGE("MISVR loaded");
 
+		// From here on only the log's writer thread writes to the log file, since IDebugLog isn't known to be safe to use from more than one thread
+		AsyncLog::Start([](AsyncLog::Level level, const char *line) {
+			if (level == AsyncLog::Level::Error) {
+				_ERROR("%s", line);
+			}
+			else if (level == AsyncLog::Level::Warning) {
+				_WARNING("%s", line);
+			}
+			else if (level == AsyncLog::Level::Debug) {
+				_DMESSAGE("%s", line);
+			}
+			else {
+				_MESSAGE("%s", line);
+			}
+		});
+
 		if (Config::ReadConfigOptions()) {
-			_MESSAGE("Successfully read config parameters");
+			AsyncLog::Message("Successfully read config parameters");
 		}
 		else {
-			_WARNING("[WARNING] Failed to read config options. Using defaults instead.");
+			AsyncLog::Warning("[WARNING] Failed to read some config options. Using defaults for those instead.");
+		}
+		Config::StartConfigWatcher();
+
+		{
+			const Config::Snapshot options;
+			Profiling::g_isEnabled = options->enableProfiling;
+
+			if (options->recordFrameInputs) {
+				char path[MAX_PATH];
+				if (SUCCEEDED(SHGetFolderPath(NULL, CSIDL_MYDOCUMENTS | CSIDL_FLAG_CREATE, NULL, SHGFP_TYPE_CURRENT, path))) {
+					strcat_s(path, sizeof(path), "\\My Games\\Skyrim VR\\SKSE\\misvr_frames.bin");
+					if (g_recorder.Open(path)) {
+						AsyncLog::Message("Recording frame inputs to %s", path);
+					}
+					else {
+						AsyncLog::Warning("[WARNING] Failed to open %s for recording frame inputs", path);
+					}
+				}
+			}
 		}
 
-		_MESSAGE("Registering for SKSE messages");
+		AsyncLog::Message("Registering for SKSE messages");
 		g_messaging = (SKSEMessagingInterface*)skse->QueryInterface(kInterface_Messaging);
 		g_messaging->RegisterListener(g_pluginHandle, "SKSE", OnSKSEMessage);
+		g_messaging->RegisterListener(g_pluginHandle, nullptr, PluginApi::OnMessage); // other plugins asking for the interface
 
 		g_trampoline = (SKSETrampolineInterface *)skse->QueryInterface(kInterface_Trampoline);
 		if (!g_trampoline) {
-			_WARNING("Couldn't get trampoline interface");
+			AsyncLog::Warning("Couldn't get trampoline interface");
 		}
 		if (!TryHook()) {
-			_ERROR("[CRITICAL] Failed to perform hooks");
+			AsyncLog::Error("[CRITICAL] Failed to perform hooks");
 			return false;
 		}
 
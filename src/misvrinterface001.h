@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "skse64/PluginAPI.h"
+
+
+// Interface for other plugins to get at what MISVR works out every frame - the smoothed aim directions, dual cast and merge state and spell scale -
+// instead of working it out again themselves, and to run code in MISVR's own post magic node update hook instead of hooking the same spot.
+// This header is meant to be copied into other plugins as is. Nothing in it may change once released; new things go into a new interface revision.
+//
+// Usage: once SKSE sends kMessage_PostPostLoad (or any time after), call GetMisvrInterface001() and keep the result. It's nullptr if MISVR isn't installed.
+namespace MisvrPluginAPI {
+	// Flags in FrameData::flags
+	enum FrameFlags : uint32_t {
+		kFrameFlag_IsActive = 1 << 0, // a spell is equipped and drawn, or the hands are still unmerging. Nothing else in the frame is meaningful without this.
+		kFrameFlag_IsLeftHanded = 1 << 1,
+		kFrameFlag_IsDualCasting = 1 << 2,
+		kFrameFlag_HasPrimaryAim = 1 << 3,
+		kFrameFlag_HasSecondaryAim = 1 << 4,
+	};
+
+	// Same values as MISVR's own states
+	enum DualCastState : uint8_t {
+		kDualCastState_Idle = 0,
+		kDualCastState_Cast = 1,
+	};
+
+	enum MergeState : uint8_t {
+		kMergeState_None = 0,
+		kMergeState_PreMerge = 1,
+		kMergeState_Merging = 2,
+		kMergeState_Merged = 3,
+		kMergeState_Unmerging = 4,
+	};
+
+	// Everything MISVR decided for the player in one frame. Published once per frame at the end of the post magic node update hook.
+	// Primary / secondary are the main hand and the off hand, so they swap sides in left-handed mode. Directions are normalized, in world space.
+	struct FrameData
+	{
+		uint32_t frameNumber; // counts every frame the hook ran, active or not
+		uint32_t flags;
+
+		float primaryAimForward[3]; // the primary magic aim node's forward direction
+		float secondaryAimForward[3];
+		float dualCastAimForward[3]; // only set while dual casting, when it's also what the secondary aim node points along
+
+		float dualCastScale; // from the distance between the hands while dual casting, 1 otherwise
+		float primarySpellScale; // everything applied to the primary spell's effects: the magicka scale times dualCastScale
+		float secondarySpellScale;
+
+		uint8_t dualCastState; // DualCastState
+		uint8_t mergeState; // MergeState
+		uint8_t pad[2];
+	};
+	static_assert(sizeof(FrameData) == 60, "FrameData layout is part of the interface");
+	static_assert(offsetof(FrameData, primaryAimForward) == 8 && offsetof(FrameData, dualCastScale) == 44 && offsetof(FrameData, dualCastState) == 56, "FrameData layout is part of the interface");
+
+	// Called on the main thread inside MISVR's post magic node update hook, every frame, after MISVR has updated the magic nodes (if it did anything)
+	// and published frame. This is before VRIK and the like apply their own changes.
+	typedef void(*PostMagicNodeUpdateCallback)(const FrameData *frame);
+
+	class IMisvrInterface001
+	{
+	public:
+		virtual unsigned int GetBuildNumber() = 0;
+
+		// Copies the latest published frame. Safe to call from any thread, and never blocks.
+		// Returns false if nothing could be read, which only happens if the calling thread stalled for most of a frame in the middle of reading.
+		virtual bool GetFrameData(FrameData *out) = 0;
+
+		// Returns false if there are already too many callbacks. There is no way to remove one, so it has to stay valid for the rest of the session.
+		virtual bool AddPostMagicNodeUpdateCallback(PostMagicNodeUpdateCallback callback) = 0;
+
+		// Asks MISVR to re-read its config file on its own thread. The new settings take effect within a frame or so of that finishing.
+		virtual void RequestConfigReload() = 0;
+	};
+
+	// Sent by other plugins to MISVR to get the interface
+	struct MisvrMessage
+	{
+		enum : uint32_t { kMessage_GetInterface = 0x4D495356 }; // "MISV"
+		void * (*getApiFunction)(unsigned int revisionNumber) = nullptr;
+	};
+
+	inline IMisvrInterface001 * GetMisvrInterface001(PluginHandle pluginHandle, SKSEMessagingInterface *messagingInterface)
+	{
+		MisvrMessage message;
+		messagingInterface->Dispatch(pluginHandle, MisvrMessage::kMessage_GetInterface, (void *)&message, sizeof(MisvrMessage), "MISVR");
+		if (!message.getApiFunction) return nullptr;
+
+		return (IMisvrInterface001 *)message.getApiFunction(1);
+	}
+}
@@ -0,0 +1,306 @@
+#include "skse64/GameReferences.h"
+#include "skse64/GameForms.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "npccasters.h"
+#include "magiccore.h"
+#include "casterselection.h"
+#include "slotpool.h"
+#include "utils.h"
+#include "profiling.h"
+#include "RE.h"
+
+
+namespace NpcCasters {
+	// Everything we keep per NPC we're looking after, from one frame to the next
+	struct CasterRecord
+	{
+		NiNode *root = nullptr; // only compared against, to notice the actor's 3D being reloaded
+		NiPointer<NiAVObject> leftMagicNode;
+		NiPointer<NiAVObject> rightMagicNode;
+		MagicCore::DualCastMerger merger;
+		ParticleScaleCache leftParticleCache;
+		ParticleScaleCache rightParticleCache;
+
+		// Records get reused by whichever NPC comes along next, so hang on to the particle caches' allocations
+		void Reset()
+		{
+			// Don't leave the nodes wherever a merge had them
+			MagicCore::Transform primaryLocal, secondaryLocal;
+			if (leftMagicNode && rightMagicNode && merger.GetUnmergedLocalTransforms(primaryLocal, secondaryLocal)) {
+				// NPCs are never left-handed, so the right hand is always the primary one
+				rightMagicNode->m_localTransform = FromCore(primaryLocal);
+				leftMagicNode->m_localTransform = FromCore(secondaryLocal);
+			}
+
+			root = nullptr;
+			leftMagicNode = nullptr;
+			rightMagicNode = nullptr;
+			merger = MagicCore::DualCastMerger();
+			leftParticleCache.Clear();
+			rightParticleCache.Clear();
+		}
+	};
+
+	// An NPC that has equipped something, and may be casting
+	struct Candidate
+	{
+		UInt32 actorHandle;
+		MagicCore::SlotHandle record; // invalid unless we're looking after them
+		UInt32 lastSelectedFrame;
+		NiPointer<TESObjectREFR> refr; // only held during Update()
+	};
+
+	constexpr int kMaxCasters = 64;
+	// NPCs with a spell equipped in the loaded area. Equip events for any more than this are ignored until some go away.
+	constexpr size_t kMaxCandidates = 512;
+
+	MagicCore::SlotPool<CasterRecord, kMaxCasters> g_records;
+	std::vector<Candidate> g_candidates;
+	std::vector<MagicCore::CasterCandidate> g_ranking; // this frame's candidates that have their hands out, by index into g_candidates
+
+	// Handed over from the equip event sink
+	std::mutex g_equippedMutex;
+	std::vector<UInt32> g_equippedHandles;
+
+	UInt32 g_frame = 0;
+
+	// The cell the candidates were last seeded from, null when they need seeding again
+	TESObjectCELL *g_seededCell = nullptr;
+
+	NodeUpdateBatch g_nodeUpdateBatch;
+
+	void OnEquip(TESObjectREFR *actor)
+	{
+		UInt32 handle = actor->CreateRefHandle();
+		if (!handle || handle == *g_invalidRefHandle) return;
+
+		std::lock_guard<std::mutex> lock(g_equippedMutex);
+		g_equippedHandles.push_back(handle);
+	}
+
+	void AddCandidate(UInt32 handle)
+	{
+		if (g_candidates.size() >= kMaxCandidates) return;
+
+		bool isCandidate = std::any_of(g_candidates.begin(), g_candidates.end(), [handle](const Candidate &candidate) { return candidate.actorHandle == handle; });
+		if (!isCandidate) {
+			g_candidates.push_back({ handle, MagicCore::SlotHandle(), 0, nullptr });
+		}
+	}
+
+	void AddEquippedCandidates()
+	{
+		std::lock_guard<std::mutex> lock(g_equippedMutex);
+		for (UInt32 handle : g_equippedHandles) {
+			AddCandidate(handle);
+		}
+		g_equippedHandles.clear();
+	}
+
+	// NPCs that were loaded with a spell already in hand never send an equip event, so look through the player's cell for them.
+	// Done when the feature turns on, after a Clear() and whenever the player moves to another cell.
+	// Only the player's own cell is walked, so in exteriors NPCs in the neighbouring loaded cells are found once the player crosses into theirs or they equip something.
+	void SeedCandidates(PlayerCharacter *player)
+	{
+		TESObjectCELL *cell = player->parentCell;
+		if (cell == g_seededCell) return;
+		g_seededCell = cell;
+		if (!cell) return;
+
+		for (UInt32 i = 0; i < cell->objectList.count; i++) {
+			TESObjectREFR *refr = nullptr;
+			if (!cell->objectList.GetNthItem(i, refr) || !refr || refr == player || refr->formType != kFormType_Character) continue;
+
+			Actor *actor = static_cast<Actor *>(refr);
+			if (!GetEquippedSpell(actor, false) && !GetEquippedSpell(actor, true)) continue;
+
+			UInt32 handle = refr->CreateRefHandle();
+			if (!handle || handle == *g_invalidRefHandle) continue;
+
+			AddCandidate(handle);
+		}
+	}
+
+	bool StartTracking(Candidate &candidate)
+	{
+		candidate.record = g_records.Allocate();
+		if (!candidate.record) return false;
+
+		g_records.Get(candidate.record)->Reset();
+		return true;
+	}
+
+	void StopTracking(Candidate &candidate)
+	{
+		if (CasterRecord *record = g_records.Get(candidate.record)) {
+			// Put the nodes back and let go of them now rather than whenever the slot gets reused
+			record->Reset();
+		}
+		g_records.Release(candidate.record);
+		candidate.record = MagicCore::SlotHandle();
+	}
+
+	void StopTrackingAll()
+	{
+		for (Candidate &candidate : g_candidates) {
+			StopTracking(candidate);
+		}
+	}
+
+	void FindMagicNodes(CasterRecord &record, NiNode *root)
+	{
+		static BSFixedString leftMagicNodeName("NPC L MagicNode [LMag]");
+		static BSFixedString rightMagicNodeName("NPC R MagicNode [RMag]");
+
+		record.root = root;
+		record.leftMagicNode = root->GetObjectByName(&leftMagicNodeName.data);
+		record.rightMagicNode = root->GetObjectByName(&rightMagicNodeName.data);
+	}
+
+	void UpdateCaster(const Config::Options &options, Actor *actor, CasterRecord &record, const SpellInfo *rightSpell, const SpellInfo *leftSpell, float deltaTime)
+	{
+		// NPCs are never left-handed, so the right hand is always the primary one
+		NiAVObject *primaryNode = record.rightMagicNode;
+		NiAVObject *secondaryNode = record.leftMagicNode;
+
+		MagicCore::Inputs inputs;
+		inputs.primaryOffsetWorld = ToCore(primaryNode->m_worldTransform);
+		inputs.primaryOffsetLocal = ToCore(primaryNode->m_localTransform);
+		inputs.primaryOffsetParentWorld = GetParentWorldTransform(primaryNode);
+		inputs.secondaryOffsetWorld = ToCore(secondaryNode->m_worldTransform);
+		inputs.secondaryOffsetLocal = ToCore(secondaryNode->m_localTransform);
+		inputs.secondaryOffsetParentWorld = GetParentWorldTransform(secondaryNode);
+
+		inputs.primarySpell = ToSpellParams(rightSpell);
+		inputs.secondarySpell = ToSpellParams(leftSpell);
+
+		inputs.isCastingPrimary = IsCastingRight(actor);
+		inputs.isCastingSecondary = IsCastingLeft(actor);
+		inputs.isCastingDual = IsDualCasting(actor);
+
+		MagicCaster *dualCaster = GetMagicCaster(actor, true);
+		inputs.hasDualCaster = dualCaster != nullptr;
+		inputs.dualCasterState = dualCaster ? MagicCore::CastingState(dualCaster->state) : MagicCore::CastingState::None;
+
+		MagicCore::Outputs outputs = record.merger.Step(options, inputs, deltaTime);
+
+		if (outputs.hasOffsetWorldTransforms) {
+			UpdateNodeTransformLocal(primaryNode, FromCore(outputs.primaryOffsetWorld));
+			g_nodeUpdateBatch.MarkDirty(primaryNode);
+			UpdateNodeTransformLocal(secondaryNode, FromCore(outputs.secondaryOffsetWorld));
+			g_nodeUpdateBatch.MarkDirty(secondaryNode);
+		}
+		if (outputs.hasOffsetLocalTransforms) {
+			primaryNode->m_localTransform = FromCore(outputs.primaryOffsetLocal);
+			g_nodeUpdateBatch.MarkDirty(primaryNode);
+			secondaryNode->m_localTransform = FromCore(outputs.secondaryOffsetLocal);
+			g_nodeUpdateBatch.MarkDirty(secondaryNode);
+		}
+		g_nodeUpdateBatch.Flush();
+
+		// Scale has to go on after the node updates, same as for the player
+		float magickaPercentage = Actor_GetActorValuePercentage(actor, 25); // 25 is magicka
+		SetParticleScaleDownstream(options, record.rightParticleCache, primaryNode, record.merger.GetSpellScale(options, inputs.primarySpell, magickaPercentage));
+		SetParticleScaleDownstream(options, record.leftParticleCache, secondaryNode, record.merger.GetSpellScale(options, inputs.secondarySpell, magickaPercentage));
+	}
+
+	void Update(const Config::Options &options, float deltaTime)
+	{
+		AddEquippedCandidates();
+
+		if (!options.enableNpcCasters) {
+			if (g_records.GetNumAllocated() > 0) {
+				StopTrackingAll();
+			}
+			g_seededCell = nullptr;
+			return;
+		}
+
+		PlayerCharacter *player = *g_thePlayer;
+		if (!player) return;
+
+		SeedCandidates(player);
+
+		g_frame++;
+
+		// Drop whoever is gone or has nothing to cast with anymore - equipping a spell again brings them back. Rank the rest that have their hands out.
+		g_ranking.clear();
+		for (size_t i = 0; i < g_candidates.size();) {
+			Candidate &candidate = g_candidates[i];
+			if (!LookupREFRByHandle(candidate.actorHandle, candidate.refr) || !candidate.refr || candidate.refr->formType != kFormType_Character || (TESObjectREFR *)candidate.refr == player) {
+				candidate.refr = nullptr;
+			}
+			Actor *actor = static_cast<Actor *>((TESObjectREFR *)candidate.refr);
+			if (!actor || (!GetEquippedSpell(actor, false) && !GetEquippedSpell(actor, true))) {
+				StopTracking(candidate);
+				g_candidates[i] = std::move(g_candidates.back());
+				g_candidates.pop_back();
+				continue;
+			}
+
+			if (actor->actorState.IsWeaponDrawn() && actor->GetNiNode()) {
+				float dx = actor->pos.x - player->pos.x;
+				float dy = actor->pos.y - player->pos.y;
+				float dz = actor->pos.z - player->pos.z;
+				g_ranking.push_back({ UInt32(i), dx * dx + dy * dy + dz * dz, g_records.IsValid(candidate.record) });
+			}
+			i++;
+		}
+
+		// When there are more than we can look after, look after the closest
+		int maxCasters = std::min(options.maxNpcCasters, kMaxCasters);
+		int numSelected = MagicCore::SelectNearestCasters(g_ranking.data(), int(g_ranking.size()), maxCasters);
+
+		// Let go of whoever isn't selected first, so that their records are free for whoever took their place
+		for (int i = numSelected; i < int(g_ranking.size()); i++) {
+			StopTracking(g_candidates[g_ranking[i].id]);
+		}
+
+		for (int i = 0; i < numSelected; i++) {
+			Candidate &candidate = g_candidates[g_ranking[i].id];
+			if (!g_records.IsValid(candidate.record) && !StartTracking(candidate)) continue;
+			candidate.lastSelectedFrame = g_frame;
+
+			Actor *actor = static_cast<Actor *>((TESObjectREFR *)candidate.refr);
+			CasterRecord &record = *g_records.Get(candidate.record);
+			NiNode *root = actor->GetNiNode();
+			if (record.root != root) {
+				// New to us, or its 3D was reloaded - start over
+				record.Reset();
+				FindMagicNodes(record, root);
+			}
+
+			if (!record.leftMagicNode || !record.rightMagicNode) continue; // some creature that casts without hands
+
+			const SpellInfo *rightSpell = GetSpellInfo(GetEquippedSpell(actor, false));
+			const SpellInfo *leftSpell = GetSpellInfo(GetEquippedSpell(actor, true));
+			UpdateCaster(options, actor, record, rightSpell, leftSpell, deltaTime);
+		}
+
+		// Anyone we were looking after that sheathed or unloaded, so we don't keep their nodes alive
+		for (Candidate &candidate : g_candidates) {
+			if (candidate.lastSelectedFrame != g_frame && g_records.IsValid(candidate.record)) {
+				StopTracking(candidate);
+			}
+			candidate.refr = nullptr;
+		}
+
+		Profiling::SetGauge(Profiling::Gauge::NpcCastersTracked, g_records.GetNumAllocated());
+	}
+
+	void Clear()
+	{
+		StopTrackingAll();
+		g_candidates.clear();
+		g_seededCell = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(g_equippedMutex);
+			g_equippedHandles.clear();
+		}
+		Profiling::SetGauge(Profiling::Gauge::NpcCastersTracked, 0);
+	}
+}
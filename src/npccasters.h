@@ -0,0 +1,22 @@
+#pragma once
+
+#include "config.h"
+
+
+class TESObjectREFR;
+
+// Magicka scaling and dual cast merging for NPCs, using the same DualCastMerger as the player minus the aim smoothing.
+// NPCs aim through their AI rather than through their magic nodes, so there is nothing to smooth.
+// NPCs become candidates by equipping something (see OnEquip()), or by having a spell equipped in the player's cell when we first look through it,
+// and stay candidates for as long as they have a spell equipped.
+// Each frame the closest ones with their hands out, up to options.maxNpcCasters, get looked after.
+// Everything runs from the post wand update hook, after the NPCs' skeletons have been animated and updated for the frame.
+namespace NpcCasters {
+	void Update(const Config::Options &options, float deltaTime);
+
+	// From the equip event sink, on whichever thread the event is sent from
+	void OnEquip(TESObjectREFR *actor);
+
+	// Forgets every NPC, candidates included, putting their magic nodes back and releasing them. For when a game is loaded.
+	void Clear();
+}
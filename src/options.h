@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Plain config values, kept free of any engine types so that the engine-independent code can use them too
+namespace Config {
+	struct Options {
+		// Add config options for things: left / right / combined hand vectors for dualcast spell direction, min / max scale while dual casting along with hand - hand distance to scale over.
+		float dualCastHandsCloseSpellScale = 1.f;
+		float dualCastHandsFarSpellScale = 2.f;
+		float dualCastHandSeparationScalingDistance = 90.f;
+
+		float spellScaleWhenMagickaEmpty = 0.35f;
+		float spellScaleWhenMagickaFull = 1.f;
+		int particleScaleMode = 0; // 0: scale each particle system as a whole, 1: scale the particles' own sizes, 2: same as 1 but from inside the engine's particle update
+		bool scaleParticleVelocity = false; // only with particleScaleMode 1 or 2
+
+		bool enableEmissionLod = false; // emit fewer particles from effects that low magicka makes smaller
+		float emissionLodExponent = 1.f; // emission rate follows the spell scale raised to this
+		float minEmissionScale = 0.25f;
+		int emissionLodParticleBudget = 0; // turn emission down everywhere once our effects add up to more particles than this, 0 for no limit
+
+		bool useCastingTimeForMergeTime = false;
+		float spellMergeTime = 0.15f;
+		float spellUnMergeTime = 0.1f;
+
+		float magicRotationRoll = 0.f;
+		float magicRotationYaw = 0.f;
+
+		int numSmoothingFramesNovice = 10;
+		int numSmoothingFramesApprentice = 15;
+		int numSmoothingFramesAdept = 20;
+		int numSmoothingFramesExpert = 25;
+		int numSmoothingFramesMaster = 40;
+		float smoothingDualCastMultiplier = 1.25;
+
+		bool useTimeBasedSmoothing = false;
+		float smoothingTimeNovice = 0.05f;
+		float smoothingTimeApprentice = 0.075f;
+		float smoothingTimeAdept = 0.1f;
+		float smoothingTimeExpert = 0.13f;
+		float smoothingTimeMaster = 0.2f;
+
+		bool enableAimPrediction = false;
+		float aimPredictionLeadNovice = 0.025f; // seconds
+		float aimPredictionLeadApprentice = 0.035f;
+		float aimPredictionLeadAdept = 0.05f;
+		float aimPredictionLeadExpert = 0.065f;
+		float aimPredictionLeadMaster = 0.1f;
+		float aimPredictionMaxAngle = 10.f; // degrees
+		bool aimPredictionUseAcceleration = false;
+
+		bool useOffHandForDualCastAiming = false;
+		bool useMainHandForDualCastAiming = false;
+
+		bool enableProfiling = false;
+		float profilingReportInterval = 10.f;
+
+		bool recordFrameInputs = false;
+		bool logFrameDiagnostics = false; // per-frame values, through the async log
+
+		bool reloadConfigOnChange = false;
+
+		bool enableNpcCasters = false;
+		int maxNpcCasters = 16; // most NPCs looked after at once, the closest to the player first. Up to 64.
+	};
+
+	// Per-spell replacements for some of the options above, from the spell override file. Only the fields flagged in `fields` replace anything.
+	struct SpellOverrides {
+		enum Field : uint16_t {
+			kNumSmoothingFrames = 1 << 0,
+			kSmoothingTime = 1 << 1,
+			kSpellMergeTime = 1 << 2,
+			kSpellUnMergeTime = 1 << 3,
+			kSpellScaleWhenMagickaEmpty = 1 << 4,
+			kSpellScaleWhenMagickaFull = 1 << 5,
+			kDualCastHandsCloseSpellScale = 1 << 6,
+			kDualCastHandsFarSpellScale = 1 << 7,
+		};
+		uint16_t fields = 0;
+
+		int numSmoothingFrames = 0; // replaces the skill level's numSmoothingFrames*
+		float smoothingTime = 0.f; // replaces the skill level's smoothingTime*
+		float spellMergeTime = 0.f;
+		float spellUnMergeTime = 0.f;
+		float spellScaleWhenMagickaEmpty = 0.f;
+		float spellScaleWhenMagickaFull = 0.f;
+		float dualCastHandsCloseSpellScale = 0.f;
+		float dualCastHandsFarSpellScale = 0.f;
+
+		bool Has(Field field) const { return (fields & field) != 0; }
+
+		// The override if there is one, otherwise the option
+		template <typename T>
+		T Get(Field field, T SpellOverrides::*member, T option) const { return Has(field) ? this->*member : option; }
+	};
+}
@@ -0,0 +1,82 @@
+#include <algorithm>
+
+#include "overridetable.h"
+
+
+namespace Config {
+	namespace {
+		template <typename T>
+		void MergeField(SpellOverrides &merged, const SpellOverrides &later, SpellOverrides::Field field, T SpellOverrides::*member)
+		{
+			if (later.Has(field)) merged.*member = later.*member;
+		}
+
+		void Merge(SpellOverrides &merged, const SpellOverrides &later)
+		{
+			MergeField(merged, later, SpellOverrides::kNumSmoothingFrames, &SpellOverrides::numSmoothingFrames);
+			MergeField(merged, later, SpellOverrides::kSmoothingTime, &SpellOverrides::smoothingTime);
+			MergeField(merged, later, SpellOverrides::kSpellMergeTime, &SpellOverrides::spellMergeTime);
+			MergeField(merged, later, SpellOverrides::kSpellUnMergeTime, &SpellOverrides::spellUnMergeTime);
+			MergeField(merged, later, SpellOverrides::kSpellScaleWhenMagickaEmpty, &SpellOverrides::spellScaleWhenMagickaEmpty);
+			MergeField(merged, later, SpellOverrides::kSpellScaleWhenMagickaFull, &SpellOverrides::spellScaleWhenMagickaFull);
+			MergeField(merged, later, SpellOverrides::kDualCastHandsCloseSpellScale, &SpellOverrides::dualCastHandsCloseSpellScale);
+			MergeField(merged, later, SpellOverrides::kDualCastHandsFarSpellScale, &SpellOverrides::dualCastHandsFarSpellScale);
+			merged.fields |= later.fields;
+		}
+	}
+
+	SpellOverrides & SpellOverrideTable::Add(uint32_t formId)
+	{
+		m_entries.push_back({ formId, {} });
+		return m_entries.back().overrides;
+	}
+
+	void SpellOverrideTable::Build()
+	{
+		// Stable, so that entries for the same form stay in the order they were added
+		std::stable_sort(m_entries.begin(), m_entries.end());
+
+		size_t numUnique = 0;
+		for (size_t i = 0; i < m_entries.size(); i++) {
+			if (numUnique > 0 && m_entries[numUnique - 1].formId == m_entries[i].formId) {
+				Merge(m_entries[numUnique - 1].overrides, m_entries[i].overrides);
+			}
+			else {
+				m_entries[numUnique++] = m_entries[i];
+			}
+		}
+		m_entries.resize(numUnique);
+		m_entries.shrink_to_fit();
+
+		// A power of two at least twice the number of entries, so that probes stay short
+		uint32_t numSlotBits = 1;
+		while ((size_t(1) << numSlotBits) < m_entries.size() * 2) numSlotBits++;
+		m_shift = 32 - numSlotBits;
+		m_slots.assign(size_t(1) << numSlotBits, Slot{ 0, 0 });
+
+		uint32_t mask = uint32_t(m_slots.size() - 1);
+		for (size_t i = 0; i < m_entries.size(); i++) {
+			uint32_t slot = GetSlot(m_entries[i].formId);
+			while (m_slots[slot].entry) slot = (slot + 1) & mask;
+			m_slots[slot] = { m_entries[i].formId, uint32_t(i + 1) };
+		}
+	}
+
+	void SpellOverrideTable::Clear()
+	{
+		m_entries.clear();
+		m_slots.clear();
+		m_shift = 32;
+	}
+
+	const SpellOverrides * SpellOverrideTable::Find(uint32_t formId) const
+	{
+		if (m_slots.empty()) return nullptr;
+
+		uint32_t mask = uint32_t(m_slots.size() - 1);
+		for (uint32_t slot = GetSlot(formId); m_slots[slot].entry; slot = (slot + 1) & mask) {
+			if (m_slots[slot].formId == formId) return &m_entries[m_slots[slot].entry - 1].overrides;
+		}
+		return nullptr;
+	}
+}
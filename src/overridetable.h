@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "options.h"
+
+
+namespace Config {
+	// Spell overrides by form id, compiled once everything has been added into a flat array sorted by form id, plus an open addressed index into it
+	// that's at most half full. A lookup is a hash and usually a single probe, and never allocates. A binary search over the array alone was ~10 times
+	// slower from a thousand entries up, see bench_overridetable.
+	// Filled in and built by one thread; once built, Find() can be called from any number of threads.
+	class SpellOverrideTable
+	{
+	public:
+		// Overrides for formId, to be filled in. Valid until the next Add(). Adding the same form more than once is fine, see Build().
+		SpellOverrides & Add(uint32_t formId);
+
+		// Sorts the table and merges the entries for the same form, the fields set by later ones replacing those set by earlier ones
+		void Build();
+
+		// Only after Build(). Returns nullptr if the form has no overrides.
+		const SpellOverrides * Find(uint32_t formId) const;
+
+		int GetNumEntries() const { return int(m_entries.size()); }
+		void Clear();
+
+	private:
+		struct Entry
+		{
+			uint32_t formId;
+			SpellOverrides overrides;
+
+			bool operator<(const Entry &other) const { return formId < other.formId; }
+		};
+
+		struct Slot
+		{
+			uint32_t formId;
+			uint32_t entry; // index into m_entries plus one, 0 for an empty slot
+		};
+
+		uint32_t GetSlot(uint32_t formId) const { return (formId * 0x9E3779B1u) >> m_shift; }
+
+		std::vector<Entry> m_entries;
+		std::vector<Slot> m_slots;
+		uint32_t m_shift = 32;
+	};
+}
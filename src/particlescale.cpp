@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "particlescale.h"
+#include "simdmath.h"
+
+#if MAGICCORE_SIMD && (defined(_M_X64) || defined(__x86_64__))
+#define MAGICCORE_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MAGICCORE_TARGET_AVX2
+#else
+#define MAGICCORE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define MAGICCORE_AVX2 0
+#endif
+
+
+namespace MagicCore {
+	namespace {
+		// A particle's age moves on by one update's worth at a time, and never back. Anything else is a different particle.
+		constexpr float kMaxAgeStep = 0.5f;
+		// Candidates with the same lifeSpan and a close age to look at before settling for the best so far. Only matters when lifeSpans aren't randomized.
+		constexpr int kMaxCandidatesCompared = 16;
+
+		uint32_t FloatBits(float f)
+		{
+			uint32_t bits;
+			memcpy(&bits, &f, sizeof(bits));
+			return bits;
+		}
+
+		bool IsSameAge(float age, float lastAge)
+		{
+			return age >= lastAge && age - lastAge <= kMaxAgeStep;
+		}
+
+		// Reference for the vectorized versions below
+		void ScaleSizesScalar(float *sizes, float *baseSizes, float *writtenSizes, int count, float scale)
+		{
+			for (int i = 0; i < count; i++) {
+				if (sizes[i] != writtenSizes[i]) {
+					baseSizes[i] = sizes[i];
+				}
+				sizes[i] = writtenSizes[i] = baseSizes[i] * scale;
+			}
+		}
+
+		void ScaleVelocitiesScalar(ParticleInfo *infos, float *baseVelocities, float *writtenVelocities, int count, float scale)
+		{
+			for (int i = 0; i < count; i++) {
+				float *velocity = &infos[i].velocity.x;
+				float *base = baseVelocities + i * 4;
+				float *written = writtenVelocities + i * 4;
+				for (int j = 0; j < 3; j++) {
+					base[j] += velocity[j] - written[j];
+					velocity[j] = written[j] = base[j] * scale;
+				}
+			}
+		}
+
+#if MAGICCORE_SIMD
+		void ScaleSizesSse2(float *sizes, float *baseSizes, float *writtenSizes, int count, float scale)
+		{
+			__m128 scale4 = _mm_set1_ps(scale);
+			int i = 0;
+			for (; i + 4 <= count; i += 4) {
+				__m128 size = _mm_loadu_ps(sizes + i);
+				__m128 isUnchanged = _mm_cmpeq_ps(size, _mm_loadu_ps(writtenSizes + i));
+				__m128 base = _mm_or_ps(_mm_and_ps(isUnchanged, _mm_loadu_ps(baseSizes + i)), _mm_andnot_ps(isUnchanged, size));
+				__m128 result = _mm_mul_ps(base, scale4);
+				_mm_storeu_ps(baseSizes + i, base);
+				_mm_storeu_ps(sizes + i, result);
+				_mm_storeu_ps(writtenSizes + i, result);
+			}
+			ScaleSizesScalar(sizes + i, baseSizes + i, writtenSizes + i, count - i, scale);
+		}
+
+		// One particle per register. The load of a velocity also picks up the age after it, which gets masked off and is never written back.
+		void ScaleVelocitiesSse2(ParticleInfo *infos, float *baseVelocities, float *writtenVelocities, int count, float scale)
+		{
+			__m128 scale4 = _mm_set1_ps(scale);
+			__m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+			for (int i = 0; i < count; i++) {
+				float *velocity = &infos[i].velocity.x;
+				__m128 v = _mm_and_ps(_mm_loadu_ps(velocity), xyzMask);
+				__m128 base = _mm_add_ps(_mm_loadu_ps(baseVelocities + i * 4), _mm_sub_ps(v, _mm_loadu_ps(writtenVelocities + i * 4)));
+				__m128 result = _mm_mul_ps(base, scale4);
+				_mm_storeu_ps(baseVelocities + i * 4, base);
+				_mm_storeu_ps(writtenVelocities + i * 4, result);
+				Simd::StoreVec3(velocity, result);
+			}
+		}
+#endif
+
+#if MAGICCORE_AVX2
+		MAGICCORE_TARGET_AVX2 void ScaleSizesAvx2(float *sizes, float *baseSizes, float *writtenSizes, int count, float scale)
+		{
+			__m256 scale8 = _mm256_set1_ps(scale);
+			int i = 0;
+			for (; i + 8 <= count; i += 8) {
+				__m256 size = _mm256_loadu_ps(sizes + i);
+				__m256 isUnchanged = _mm256_cmp_ps(size, _mm256_loadu_ps(writtenSizes + i), _CMP_EQ_OQ);
+				__m256 base = _mm256_blendv_ps(size, _mm256_loadu_ps(baseSizes + i), isUnchanged);
+				__m256 result = _mm256_mul_ps(base, scale8);
+				_mm256_storeu_ps(baseSizes + i, base);
+				_mm256_storeu_ps(sizes + i, result);
+				_mm256_storeu_ps(writtenSizes + i, result);
+			}
+			ScaleSizesSse2(sizes + i, baseSizes + i, writtenSizes + i, count - i, scale);
+		}
+
+		// Two particles per register, one in each half. A ParticleInfo is 8 floats, so the two velocities are 8 floats apart.
+		MAGICCORE_TARGET_AVX2 void ScaleVelocitiesAvx2(ParticleInfo *infos, float *baseVelocities, float *writtenVelocities, int count, float scale)
+		{
+			__m256 scale8 = _mm256_set1_ps(scale);
+			__m256 xyzMask = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0));
+			int i = 0;
+			for (; i + 2 <= count; i += 2) {
+				float *velocity0 = &infos[i].velocity.x;
+				float *velocity1 = &infos[i + 1].velocity.x;
+				__m256 v = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(velocity0)), _mm_loadu_ps(velocity1), 1);
+				v = _mm256_and_ps(v, xyzMask);
+				__m256 base = _mm256_add_ps(_mm256_loadu_ps(baseVelocities + i * 4), _mm256_sub_ps(v, _mm256_loadu_ps(writtenVelocities + i * 4)));
+				__m256 result = _mm256_mul_ps(base, scale8);
+				_mm256_storeu_ps(baseVelocities + i * 4, base);
+				_mm256_storeu_ps(writtenVelocities + i * 4, result);
+				Simd::StoreVec3(velocity0, _mm256_castps256_ps128(result));
+				Simd::StoreVec3(velocity1, _mm256_extractf128_ps(result, 1));
+			}
+			ScaleVelocitiesSse2(infos + i, baseVelocities + i * 4, writtenVelocities + i * 4, count - i, scale);
+		}
+
+		SimdLevel DetectSimdLevel()
+		{
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return SimdLevel::Sse2;
+
+			// AVX needs the OS to save the upper halves of the registers too
+			__cpuid(info, 1);
+			bool hasAvx = (info[2] & (1 << 28)) != 0;
+			bool hasOsXsave = (info[2] & (1 << 27)) != 0;
+			if (!hasAvx || !hasOsXsave || (_xgetbv(0) & 6) != 6) return SimdLevel::Sse2;
+
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) ? SimdLevel::Avx2 : SimdLevel::Sse2;
+#else
+			return __builtin_cpu_supports("avx2") ? SimdLevel::Avx2 : SimdLevel::Sse2;
+#endif
+		}
+#endif
+	}
+
+	SimdLevel GetSupportedSimdLevel()
+	{
+#if MAGICCORE_AVX2
+		static const SimdLevel s_level = DetectSimdLevel();
+		return s_level;
+#elif MAGICCORE_SIMD
+		return SimdLevel::Sse2;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	ParticleScaler::ParticleScaler() : m_simdLevel(GetSupportedSimdLevel())
+	{
+	}
+
+	void ParticleScaler::SetSimdLevel(SimdLevel level)
+	{
+		m_simdLevel = int(level) <= int(GetSupportedSimdLevel()) ? level : GetSupportedSimdLevel();
+	}
+
+	void ParticleScaler::Reset()
+	{
+		// Keep the allocations, the next particle system will most likely need about as many
+		m_numParticles = 0;
+		m_wasScalingVelocity = false;
+	}
+
+	void ParticleScaler::Grow(int count)
+	{
+		if (int(m_baseSizes.size()) >= count) return;
+
+		m_lifeSpanBits.resize(count);
+		m_ages.resize(count);
+		m_baseSizes.resize(count);
+		m_writtenSizes.resize(count);
+		m_baseVelocities.resize(count * 4);
+		m_writtenVelocities.resize(count * 4);
+	}
+
+	void ParticleScaler::LoadRecord(int slot, Record &record) const
+	{
+		record.baseSize = m_baseSizes[slot];
+		record.writtenSize = m_writtenSizes[slot];
+		memcpy(record.baseVelocity, &m_baseVelocities[slot * 4], sizeof(record.baseVelocity));
+		memcpy(record.writtenVelocity, &m_writtenVelocities[slot * 4], sizeof(record.writtenVelocity));
+	}
+
+	void ParticleScaler::StoreRecord(int slot, const Record &record)
+	{
+		m_baseSizes[slot] = record.baseSize;
+		m_writtenSizes[slot] = record.writtenSize;
+		memcpy(&m_baseVelocities[slot * 4], record.baseVelocity, sizeof(record.baseVelocity));
+		memcpy(&m_writtenVelocities[slot * 4], record.writtenVelocity, sizeof(record.writtenVelocity));
+	}
+
+	void ParticleScaler::StartSize(int slot)
+	{
+		// Never matches a real size, so the size pass takes whatever the particle has now as its unscaled size
+		m_writtenSizes[slot] = -1.f;
+		m_baseSizes[slot] = 0.f;
+	}
+
+	void ParticleScaler::StartVelocity(int slot, const ParticleInfo &info)
+	{
+		// Counts as no change since our last write, so the unscaled velocity is the one it has now
+		float *base = &m_baseVelocities[slot * 4];
+		float *written = &m_writtenVelocities[slot * 4];
+		base[0] = written[0] = info.velocity.x;
+		base[1] = written[1] = info.velocity.y;
+		base[2] = written[2] = info.velocity.z;
+		base[3] = written[3] = 0.f;
+	}
+
+	void ParticleScaler::MatchParticles(const ParticleInfo *infos, int count)
+	{
+		m_unmatchedSlots.clear();
+		m_candidates.clear();
+		m_candidateRecords.clear();
+
+		auto addCandidate = [this](int slot) {
+			m_candidates.push_back({ m_lifeSpanBits[slot], m_ages[slot], int(m_candidateRecords.size()), false });
+			m_candidateRecords.emplace_back();
+			LoadRecord(slot, m_candidateRecords.back());
+		};
+
+		for (int i = 0; i < count; i++) {
+			const ParticleInfo &info = infos[i];
+			if (i < m_numParticles && FloatBits(info.lifeSpan) == m_lifeSpanBits[i] && IsSameAge(info.age, m_ages[i])) {
+				// Still the same particle
+				m_ages[i] = info.age;
+				continue;
+			}
+
+			m_unmatchedSlots.push_back(i);
+			if (i < m_numParticles) {
+				// Whatever was here before may have been moved somewhere else, if it was last
+				addCandidate(i);
+			}
+		}
+		if (m_unmatchedSlots.empty()) return;
+
+		// Slots past the end are where the particles that were moved into the gaps came from
+		for (int i = count; i < m_numParticles; i++) {
+			addCandidate(i);
+		}
+
+		std::sort(m_candidates.begin(), m_candidates.end(), [](const Candidate &a, const Candidate &b) {
+			return a.lifeSpanBits != b.lifeSpanBits ? a.lifeSpanBits < b.lifeSpanBits : a.age < b.age;
+		});
+
+		for (int slot : m_unmatchedSlots) {
+			const ParticleInfo &info = infos[slot];
+			uint32_t lifeSpanBits = FloatBits(info.lifeSpan);
+
+			// The unclaimed candidate with the same lifeSpan and the closest age not past this one, if any is close enough
+			Candidate key = { lifeSpanBits, info.age - kMaxAgeStep, 0, false };
+			auto it = std::lower_bound(m_candidates.begin(), m_candidates.end(), key, [](const Candidate &a, const Candidate &b) {
+				return a.lifeSpanBits != b.lifeSpanBits ? a.lifeSpanBits < b.lifeSpanBits : a.age < b.age;
+			});
+			Candidate *best = nullptr;
+			float bestAgeDifference = kMaxAgeStep;
+			for (int numCompared = 0; it != m_candidates.end() && it->lifeSpanBits == lifeSpanBits && it->age <= info.age && numCompared < kMaxCandidatesCompared; ++it) {
+				if (it->isClaimed) continue;
+				numCompared++;
+				float ageDifference = info.age - it->age;
+				if (ageDifference <= bestAgeDifference) {
+					best = &*it;
+					bestAgeDifference = ageDifference;
+				}
+			}
+
+			if (best) {
+				best->isClaimed = true;
+				StoreRecord(slot, m_candidateRecords[best->record]);
+			}
+			else {
+				StartSize(slot);
+				StartVelocity(slot, info);
+			}
+			m_lifeSpanBits[slot] = lifeSpanBits;
+			m_ages[slot] = info.age;
+		}
+	}
+
+	void ParticleScaler::RestoreVelocities(ParticleInfo *infos, int count)
+	{
+		// Back to unscaled, keeping whatever the game did to them since our last write
+		for (int i = 0; i < count; i++) {
+			float *velocity = &infos[i].velocity.x;
+			const float *base = &m_baseVelocities[i * 4];
+			const float *written = &m_writtenVelocities[i * 4];
+			for (int j = 0; j < 3; j++) {
+				velocity[j] = base[j] + (velocity[j] - written[j]);
+			}
+		}
+	}
+
+	void ParticleScaler::Apply(float *sizes, ParticleInfo *infos, int count, float scale, bool scaleVelocity)
+	{
+		if (count <= 0 || !sizes) {
+			m_numParticles = 0;
+			return;
+		}
+
+		Grow(count);
+		if (infos) {
+			MatchParticles(infos, count);
+		}
+		else {
+			// Can't tell particles apart, so anything new is taken as a new particle in a new slot
+			for (int i = m_numParticles; i < count; i++) {
+				StartSize(i);
+			}
+		}
+		m_numParticles = count;
+
+		switch (m_simdLevel) {
+#if MAGICCORE_AVX2
+		case SimdLevel::Avx2:
+			ScaleSizesAvx2(sizes, m_baseSizes.data(), m_writtenSizes.data(), count, scale);
+			break;
+#endif
+#if MAGICCORE_SIMD
+		case SimdLevel::Sse2:
+			ScaleSizesSse2(sizes, m_baseSizes.data(), m_writtenSizes.data(), count, scale);
+			break;
+#endif
+		default:
+			ScaleSizesScalar(sizes, m_baseSizes.data(), m_writtenSizes.data(), count, scale);
+		}
+
+		if (!infos) return;
+
+		if (scaleVelocity) {
+			if (!m_wasScalingVelocity) {
+				// The velocities weren't being kept track of, so take them as they are now
+				for (int i = 0; i < count; i++) {
+					StartVelocity(i, infos[i]);
+				}
+			}
+
+			switch (m_simdLevel) {
+#if MAGICCORE_AVX2
+			case SimdLevel::Avx2:
+				ScaleVelocitiesAvx2(infos, m_baseVelocities.data(), m_writtenVelocities.data(), count, scale);
+				break;
+#endif
+#if MAGICCORE_SIMD
+			case SimdLevel::Sse2:
+				ScaleVelocitiesSse2(infos, m_baseVelocities.data(), m_writtenVelocities.data(), count, scale);
+				break;
+#endif
+			default:
+				ScaleVelocitiesScalar(infos, m_baseVelocities.data(), m_writtenVelocities.data(), count, scale);
+			}
+		}
+		else if (m_wasScalingVelocity) {
+			// Just turned off in the config
+			RestoreVelocities(infos, count);
+		}
+		m_wasScalingVelocity = scaleVelocity;
+	}
+}
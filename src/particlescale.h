@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "coremath.h"
+
+
+namespace MagicCore {
+	// Same layout as the engine's NiParticleInfo
+	struct ParticleInfo
+	{
+		Vec3 velocity;
+		float age;
+		float lifeSpan; // picked when the particle is spawned and never changed after
+		float lastUpdate;
+		uint32_t unk18;
+		uint16_t unk1C;
+		uint16_t unk1E;
+	};
+	static_assert(sizeof(ParticleInfo) == 0x20, "ParticleInfo has to match NiParticleInfo");
+
+	enum class SimdLevel
+	{
+		Scalar,
+		Sse2,
+		Avx2
+	};
+
+	// The best the CPU we're running on can do
+	SimdLevel GetSupportedSimdLevel();
+
+	// Scales every particle of one particle system by a scale that can change from frame to frame.
+	// The unscaled size and velocity of each particle are kept alongside it, so the scale is always applied to those rather than on top of last frame's result:
+	//  - a size that still holds what we wrote last frame hasn't been touched by the game since, so it keeps its unscaled size. Anything else is a new unscaled size.
+	//  - velocities are carried from frame to frame by the game, so whatever it changed since our write (gravity, drag, ...) is added to the unscaled velocity.
+	// The particle systems remove dead particles by moving the last particle into their slot, so a slot doesn't always hold the same particle from one frame to the next.
+	// Particles are told apart by their lifeSpan, which is fixed (and usually randomized) per particle, and by their age only ever moving on a little per update.
+	class ParticleScaler
+	{
+	public:
+		ParticleScaler();
+
+		// sizes and infos are the particle system's arrays of count particles. Without infos, velocities aren't scaled and each slot is taken to keep its particle.
+		void Apply(float *sizes, ParticleInfo *infos, int count, float scale, bool scaleVelocity);
+
+		// Forget every particle, e.g. when the particle system is replaced
+		void Reset();
+
+		// For comparing the kernels. Defaults to, and never goes above, GetSupportedSimdLevel().
+		void SetSimdLevel(SimdLevel level);
+
+	private:
+		struct Candidate
+		{
+			uint32_t lifeSpanBits;
+			float age;
+			int record; // index into m_candidateRecords
+			bool isClaimed;
+		};
+
+		struct Record
+		{
+			float baseSize;
+			float writtenSize;
+			float baseVelocity[4];
+			float writtenVelocity[4];
+		};
+
+		void Grow(int count);
+		void MatchParticles(const ParticleInfo *infos, int count);
+		void LoadRecord(int slot, Record &record) const;
+		void StoreRecord(int slot, const Record &record);
+		void StartSize(int slot);
+		void StartVelocity(int slot, const ParticleInfo &info);
+		void RestoreVelocities(ParticleInfo *infos, int count);
+
+		SimdLevel m_simdLevel;
+		int m_numParticles = 0; // as of the last Apply()
+		bool m_wasScalingVelocity = false;
+
+		// Per slot. The velocities are padded out to 4 floats.
+		std::vector<uint32_t> m_lifeSpanBits;
+		std::vector<float> m_ages;
+		std::vector<float> m_baseSizes;
+		std::vector<float> m_writtenSizes;
+		std::vector<float> m_baseVelocities;
+		std::vector<float> m_writtenVelocities;
+
+		// Scratch for MatchParticles(), kept to save reallocating
+		std::vector<int> m_unmatchedSlots;
+		std::vector<Candidate> m_candidates;
+		std::vector<Record> m_candidateRecords;
+	};
+}
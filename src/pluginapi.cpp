@@ -0,0 +1,91 @@
+#include <atomic>
+#include <mutex>
+
+#include "pluginapi.h"
+#include "asynclog.h"
+#include "config.h"
+#include "seqlock.h"
+#include "version.h"
+
+
+namespace PluginApi {
+	using namespace MisvrPluginAPI;
+
+	constexpr int kMaxCallbacks = 32;
+
+	MagicCore::SeqlockDoubleBuffer<FrameData> g_frames;
+
+	// Callbacks are only ever added, so the hook can run them without taking the lock: a slot is filled in before the count that covers it is published
+	std::atomic<PostMagicNodeUpdateCallback> g_callbacks[kMaxCallbacks];
+	std::atomic<int> g_numCallbacks{ 0 };
+	std::mutex g_callbacksLock;
+
+	class MisvrInterface001 : public IMisvrInterface001
+	{
+	public:
+		virtual unsigned int GetBuildNumber() override
+		{
+			return (MISVR_VERSION_MAJOR << 16) | (MISVR_VERSION_MINOR << 8) | MISVR_VERSION_PATCH;
+		}
+
+		virtual bool GetFrameData(FrameData *out) override
+		{
+			if (!out) return false;
+			return g_frames.Read(*out);
+		}
+
+		virtual bool AddPostMagicNodeUpdateCallback(PostMagicNodeUpdateCallback callback) override
+		{
+			if (!callback) return false;
+
+			std::lock_guard<std::mutex> lock(g_callbacksLock);
+			int numCallbacks = g_numCallbacks.load(std::memory_order_relaxed);
+			if (numCallbacks >= kMaxCallbacks) {
+				AsyncLog::Warning("Too many post magic node update callbacks, not adding another");
+				return false;
+			}
+			g_callbacks[numCallbacks].store(callback, std::memory_order_relaxed);
+			g_numCallbacks.store(numCallbacks + 1, std::memory_order_release);
+			return true;
+		}
+
+		virtual void RequestConfigReload() override
+		{
+			Config::RequestConfigReload();
+		}
+	};
+
+	MisvrInterface001 g_interface001;
+
+	void * GetApi(unsigned int revisionNumber)
+	{
+		if (revisionNumber == 1) {
+			AsyncLog::Message("Interface revision 1 requested");
+			return &g_interface001;
+		}
+		AsyncLog::Warning("Unknown interface revision %u requested", revisionNumber);
+		return nullptr;
+	}
+
+	void OnMessage(SKSEMessagingInterface::Message *msg)
+	{
+		if (!msg || msg->type != MisvrMessage::kMessage_GetInterface || !msg->data) return;
+
+		MisvrMessage *message = (MisvrMessage *)msg->data;
+		message->getApiFunction = GetApi;
+		AsyncLog::Message("Provided interface to %s", msg->sender ? msg->sender : "an unnamed plugin");
+	}
+
+	void PublishFrame(const FrameData &frame)
+	{
+		g_frames.Publish(frame);
+	}
+
+	void RunPostMagicNodeUpdateCallbacks(const FrameData &frame)
+	{
+		int numCallbacks = g_numCallbacks.load(std::memory_order_acquire);
+		for (int i = 0; i < numCallbacks; i++) {
+			g_callbacks[i].load(std::memory_order_relaxed)(&frame);
+		}
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "misvrinterface001.h"
+
+
+// MISVR's side of misvrinterface001.h
+namespace PluginApi {
+	// Listener for messages from other plugins, which is how they ask for the interface
+	void OnMessage(SKSEMessagingInterface::Message *msg);
+
+	// Main thread only. Call once per frame from the post magic node update hook, publishing first so the callbacks see the same frame as GetFrameData().
+	void PublishFrame(const MisvrPluginAPI::FrameData &frame);
+	void RunPostMagicNodeUpdateCallbacks(const MisvrPluginAPI::FrameData &frame);
+}
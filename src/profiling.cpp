@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cmath>
+
+#include "profiling.h"
+#include "asynclog.h"
+
+
+namespace Profiling {
+	bool g_isEnabled = false;
+	Histogram g_histograms[int(Stage::Count)];
+	std::atomic<uint64_t> g_counters[int(Counter::Count)]{};
+	std::atomic<int64_t> g_gauges[int(Gauge::Count)]{};
+
+	const char * GetStageName(Stage stage)
+	{
+		switch (stage) {
+		case Stage::PostMagicNodeUpdateHook: return "PostMagicNodeUpdateHook";
+		case Stage::PostWandUpdateHook: return "PostWandUpdateHook";
+		case Stage::Snapshot: return "  Snapshot";
+		case Stage::Smoothing: return "  Smoothing";
+		case Stage::StateMachine: return "  StateMachine";
+		case Stage::NodeUpdates: return "  NodeUpdates";
+		case Stage::ParticleScaling: return "  ParticleScaling";
+		case Stage::NpcCasters: return "  NpcCasters";
+		default: return "Unknown";
+		}
+	}
+
+	const char * GetCounterName(Counter counter)
+	{
+		switch (counter) {
+		case Counter::EmissionLodParticlesSaved: return "EmissionLodParticlesSaved";
+		case Counter::InactiveFramesSkipped: return "InactiveFramesSkipped";
+		case Counter::NodeUpdatesSaved: return "NodeUpdatesSaved";
+		default: return "Unknown";
+		}
+	}
+
+	const char * GetGaugeName(Gauge gauge)
+	{
+		switch (gauge) {
+		case Gauge::ScaleModifiersAttached: return "ScaleModifiersAttached";
+		case Gauge::NpcCastersTracked: return "NpcCastersTracked";
+		default: return "Unknown";
+		}
+	}
+
+	int GetHighestBit(uint64_t value)
+	{
+		int bit = 0;
+		while (value >>= 1) {
+			bit++;
+		}
+		return bit;
+	}
+
+	int Histogram::GetBucketIndex(uint64_t nanoseconds)
+	{
+		if (nanoseconds < kNumSubBuckets) {
+			// Exact below the first power of two that has sub-buckets
+			return int(nanoseconds);
+		}
+
+		int exponent = GetHighestBit(nanoseconds);
+		int subBucket = int(nanoseconds >> (exponent - kNumSubBucketBits)) & (kNumSubBuckets - 1);
+		return (exponent - kNumSubBucketBits + 1) * kNumSubBuckets + subBucket;
+	}
+
+	uint64_t Histogram::GetBucketValue(int index)
+	{
+		if (index < kNumSubBuckets) {
+			return uint64_t(index);
+		}
+
+		int exponent = index / kNumSubBuckets + kNumSubBucketBits - 1;
+		int subBucket = index % kNumSubBuckets;
+		int shift = exponent - kNumSubBucketBits;
+		uint64_t lower = uint64_t(kNumSubBuckets + subBucket) << shift;
+		uint64_t width = uint64_t(1) << shift;
+		return lower + width / 2;
+	}
+
+	void Histogram::Record(uint64_t nanoseconds)
+	{
+		m_counts[GetBucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+
+		uint64_t max = m_max.load(std::memory_order_relaxed);
+		while (nanoseconds > max && !m_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {}
+	}
+
+	void Histogram::Reset()
+	{
+		for (std::atomic<uint32_t> &count : m_counts) {
+			count.store(0, std::memory_order_relaxed);
+		}
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	Histogram::Summary Histogram::Summarize() const
+	{
+		uint32_t counts[kNumBuckets];
+		uint64_t total = 0;
+		for (int i = 0; i < kNumBuckets; i++) {
+			counts[i] = m_counts[i].load(std::memory_order_relaxed);
+			total += counts[i];
+		}
+
+		Summary summary{};
+		summary.count = total;
+		summary.max = m_max.load(std::memory_order_relaxed);
+		if (total == 0) return summary;
+
+		const double percentiles[] = { 0.5, 0.95, 0.99 };
+		uint64_t *results[] = { &summary.p50, &summary.p95, &summary.p99 };
+
+		uint64_t seen = 0;
+		int p = 0;
+		for (int i = 0; i < kNumBuckets && p < 3; i++) {
+			seen += counts[i];
+			// Rounding p * total down could make the threshold 0, which even an empty first bucket meets
+			while (p < 3 && seen >= std::max<uint64_t>(1, uint64_t(std::ceil(percentiles[p] * double(total))))) {
+				// The bucket midpoint can overshoot what was actually recorded
+				uint64_t value = GetBucketValue(i);
+				*results[p++] = value < summary.max ? value : summary.max;
+			}
+		}
+		return summary;
+	}
+
+	void ReportIfDue(float reportInterval)
+	{
+		static std::chrono::steady_clock::time_point s_lastReportTime = std::chrono::steady_clock::now();
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (std::chrono::duration<float>(now - s_lastReportTime).count() < reportInterval) return;
+		s_lastReportTime = now;
+
+		AsyncLog::Message("Timings over the last %.0f seconds (microseconds):", reportInterval);
+		for (int i = 0; i < int(Stage::Count); i++) {
+			Histogram &histogram = g_histograms[i];
+			Histogram::Summary summary = histogram.Summarize();
+			histogram.Reset();
+
+			AsyncLog::Message("%-26s n=%-7llu p50=%8.2f p95=%8.2f p99=%8.2f max=%8.2f", GetStageName(Stage(i)), (unsigned long long)summary.count,
+				summary.p50 / 1000.0, summary.p95 / 1000.0, summary.p99 / 1000.0, summary.max / 1000.0);
+		}
+		for (int i = 0; i < int(Counter::Count); i++) {
+			AsyncLog::Message("%-26s %llu", GetCounterName(Counter(i)), (unsigned long long)g_counters[i].exchange(0, std::memory_order_relaxed));
+		}
+		for (int i = 0; i < int(Gauge::Count); i++) {
+			AsyncLog::Message("%-26s %lld", GetGaugeName(Gauge(i)), (long long)g_gauges[i].load(std::memory_order_relaxed));
+		}
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+namespace Profiling {
+	enum class Stage {
+		PostMagicNodeUpdateHook,
+		PostWandUpdateHook,
+		Snapshot,
+		Smoothing,
+		StateMachine,
+		NodeUpdates,
+		ParticleScaling,
+		NpcCasters,
+
+		Count
+	};
+	const char * GetStageName(Stage stage);
+
+	// Running totals that aren't timings, reported and reset alongside them
+	enum class Counter {
+		EmissionLodParticlesSaved,
+		InactiveFramesSkipped,
+		NodeUpdatesSaved,
+
+		Count
+	};
+	const char * GetCounterName(Counter counter);
+
+	extern std::atomic<uint64_t> g_counters[int(Counter::Count)];
+	inline void AddToCounter(Counter counter, uint64_t amount) { g_counters[int(counter)].fetch_add(amount, std::memory_order_relaxed); }
+
+	// How many of something there are right now. Reported alongside the timings, but never reset.
+	enum class Gauge {
+		ScaleModifiersAttached,
+		NpcCastersTracked,
+
+		Count
+	};
+	const char * GetGaugeName(Gauge gauge);
+
+	extern std::atomic<int64_t> g_gauges[int(Gauge::Count)];
+	inline void SetGauge(Gauge gauge, int64_t value) { g_gauges[int(gauge)].store(value, std::memory_order_relaxed); }
+
+	// Histogram of durations in nanoseconds with logarithmic buckets: 8 sub-buckets per power of two, so any reported value is within ~6% of the real one.
+	// Recording is a single relaxed atomic increment (plus a max update), so it never blocks.
+	class Histogram
+	{
+	public:
+		static constexpr int kNumSubBucketBits = 3;
+		static constexpr int kNumSubBuckets = 1 << kNumSubBucketBits;
+		static constexpr int kNumBuckets = (64 - kNumSubBucketBits + 1) * kNumSubBuckets;
+
+		static int GetBucketIndex(uint64_t nanoseconds);
+		static uint64_t GetBucketValue(int index); // midpoint of the range covered by the bucket
+
+		void Record(uint64_t nanoseconds);
+		void Reset();
+
+		struct Summary
+		{
+			uint64_t count;
+			uint64_t p50, p95, p99, max;
+		};
+		Summary Summarize() const;
+
+	private:
+		std::atomic<uint32_t> m_counts[kNumBuckets]{};
+		std::atomic<uint64_t> m_max{ 0 };
+	};
+
+	extern bool g_isEnabled;
+	extern Histogram g_histograms[int(Stage::Count)];
+
+	// Times from construction until Stop() or destruction, whichever comes first. Does nothing at all if profiling is disabled.
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(Stage stage) : m_stage(stage), m_isRunning(g_isEnabled)
+		{
+			if (m_isRunning) {
+				m_start = std::chrono::steady_clock::now();
+			}
+		}
+
+		~ScopedTimer() { Stop(); }
+
+		void Stop()
+		{
+			if (m_isRunning) {
+				m_isRunning = false;
+				auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start);
+				g_histograms[int(m_stage)].Record(uint64_t(elapsed.count()));
+			}
+		}
+
+	private:
+		std::chrono::steady_clock::time_point m_start;
+		Stage m_stage;
+		bool m_isRunning;
+	};
+
+	// Writes p50 / p95 / p99 / max for every stage to the log and starts over, once every reportInterval seconds
+	void ReportIfDue(float reportInterval);
+}
@@ -0,0 +1,382 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "replay.h"
+
+
+namespace Replay {
+	namespace {
+		bool IsSameSpell(const MagicCore::SpellParams &a, const MagicCore::SpellParams &b)
+		{
+			const Config::SpellOverrides &x = a.overrides;
+			const Config::SpellOverrides &y = b.overrides;
+			return a.isValid == b.isValid && a.skillLevel == b.skillLevel && a.isTwoHanded == b.isTwoHanded && a.isTwoHandedEffectMergeable == b.isTwoHandedEffectMergeable &&
+				a.castingTime == b.castingTime && x.fields == y.fields && x.numSmoothingFrames == y.numSmoothingFrames && x.smoothingTime == y.smoothingTime &&
+				x.spellMergeTime == y.spellMergeTime && x.spellUnMergeTime == y.spellUnMergeTime &&
+				x.spellScaleWhenMagickaEmpty == y.spellScaleWhenMagickaEmpty && x.spellScaleWhenMagickaFull == y.spellScaleWhenMagickaFull &&
+				x.dualCastHandsCloseSpellScale == y.dualCastHandsCloseSpellScale && x.dualCastHandsFarSpellScale == y.dualCastHandsFarSpellScale;
+		}
+
+		template <typename T>
+		bool ReadValue(std::FILE *file, T &value)
+		{
+			return std::fread(&value, sizeof(value), 1, file) == 1;
+		}
+
+		float GetDifference(const MagicCore::Vec3 &a, const MagicCore::Vec3 &b)
+		{
+			return std::fmax(std::fabs(a.x - b.x), std::fmax(std::fabs(a.y - b.y), std::fabs(a.z - b.z)));
+		}
+
+		float GetDifference(const MagicCore::Transform &a, const MagicCore::Transform &b)
+		{
+			float difference = std::fmax(GetDifference(a.pos, b.pos), std::fabs(a.scale - b.scale));
+			for (int i = 0; i < 3; i++) {
+				for (int j = 0; j < 3; j++) {
+					difference = std::fmax(difference, std::fabs(a.rot.data[i][j] - b.rot.data[i][j]));
+				}
+			}
+			return difference;
+		}
+	}
+
+	MagicCore::Inputs ToInputs(const FrameRecord &record, const MagicCore::SpellParams &primarySpell, const MagicCore::SpellParams &secondarySpell)
+	{
+		MagicCore::Inputs inputs;
+		inputs.primaryAimWorld = record.primaryAimWorld;
+		inputs.secondaryAimWorld = record.secondaryAimWorld;
+		inputs.primaryOffsetWorld = record.primaryOffsetWorld;
+		inputs.primaryOffsetLocal = record.primaryOffsetLocal;
+		inputs.primaryOffsetParentWorld = record.primaryOffsetParentWorld;
+		inputs.secondaryOffsetWorld = record.secondaryOffsetWorld;
+		inputs.secondaryOffsetLocal = record.secondaryOffsetLocal;
+		inputs.secondaryOffsetParentWorld = record.secondaryOffsetParentWorld;
+
+		inputs.primarySpell = primarySpell;
+		inputs.secondarySpell = secondarySpell;
+
+		inputs.isCastingPrimary = (record.flags & FrameRecord::kFlag_IsCastingPrimary) != 0;
+		inputs.isCastingSecondary = (record.flags & FrameRecord::kFlag_IsCastingSecondary) != 0;
+		inputs.isCastingDual = (record.flags & FrameRecord::kFlag_IsCastingDual) != 0;
+		inputs.hasDualCaster = (record.flags & FrameRecord::kFlag_HasDualCaster) != 0;
+		inputs.dualCasterState = MagicCore::CastingState(record.dualCasterState);
+		return inputs;
+	}
+
+	void FromInputs(const MagicCore::Inputs &inputs, FrameRecord &record)
+	{
+		record.primaryAimWorld = inputs.primaryAimWorld;
+		record.secondaryAimWorld = inputs.secondaryAimWorld;
+		record.primaryOffsetWorld = inputs.primaryOffsetWorld;
+		record.primaryOffsetLocal = inputs.primaryOffsetLocal;
+		record.primaryOffsetParentWorld = inputs.primaryOffsetParentWorld;
+		record.secondaryOffsetWorld = inputs.secondaryOffsetWorld;
+		record.secondaryOffsetLocal = inputs.secondaryOffsetLocal;
+		record.secondaryOffsetParentWorld = inputs.secondaryOffsetParentWorld;
+
+		uint16_t flags = record.flags & (FrameRecord::kFlag_IsLeftHanded | FrameRecord::kFlag_IsWeaponDrawn);
+		if (inputs.isCastingPrimary) flags |= FrameRecord::kFlag_IsCastingPrimary;
+		if (inputs.isCastingSecondary) flags |= FrameRecord::kFlag_IsCastingSecondary;
+		if (inputs.isCastingDual) flags |= FrameRecord::kFlag_IsCastingDual;
+		if (inputs.hasDualCaster) flags |= FrameRecord::kFlag_HasDualCaster;
+		record.flags = flags;
+		record.dualCasterState = uint8_t(inputs.dualCasterState);
+	}
+
+	void Recorder::Chunk::Append(const void *bytes, size_t numBytes)
+	{
+		memcpy(data + size, bytes, numBytes);
+		size = uint16_t(size + numBytes);
+	}
+
+	Recorder::Recorder() : m_ring(new Ring())
+	{
+	}
+
+	bool Recorder::Open(const char *path)
+	{
+		Close();
+
+		m_file = std::fopen(path, "wb");
+		if (!m_file) return false;
+
+		FileHeader header;
+		if (std::fwrite(&header, sizeof(header), 1, m_file) != 1) {
+			Close();
+			return false;
+		}
+		std::fflush(m_file);
+
+		m_isClosing.store(false, std::memory_order_relaxed);
+		m_writerThread = std::thread(&Recorder::WriterThread, this);
+		return true;
+	}
+
+	void Recorder::Close()
+	{
+		if (m_writerThread.joinable()) {
+			m_isClosing.store(true, std::memory_order_release);
+			m_writerThread.join();
+		}
+		if (m_file) {
+			std::fclose(m_file);
+			m_file = nullptr;
+		}
+		m_writtenSpells.clear();
+		m_gap = {};
+		m_isSmoothingReset = false;
+		m_numPushed = 0;
+		m_numWritten.store(0, std::memory_order_relaxed);
+	}
+
+	bool Recorder::IsSpellNew(uint32_t formId, const MagicCore::SpellParams &params) const
+	{
+		if (!formId) return false;
+
+		for (const SpellRecord &spell : m_writtenSpells) {
+			if (spell.formId == formId) return !IsSameSpell(spell.params, params);
+		}
+		return true;
+	}
+
+	bool Recorder::WriteSpell(uint32_t formId, const MagicCore::SpellParams &params)
+	{
+		if (!IsSpellNew(formId, params)) return true;
+
+		Chunk chunk;
+		chunk.size = 0;
+		ChunkType type = ChunkType::Spell;
+		SpellRecord spell = { formId, params };
+		chunk.Append(&type, sizeof(type));
+		chunk.Append(&spell, sizeof(spell));
+		if (!Push(chunk)) return false;
+
+		for (SpellRecord &written : m_writtenSpells) {
+			if (written.formId == formId) {
+				written.params = params;
+				return true;
+			}
+		}
+		m_writtenSpells.push_back(spell);
+		return true;
+	}
+
+	void Recorder::WriteFrame(const FrameRecord &record, const MagicCore::Inputs &inputs, const MagicCore::Outputs &outputs)
+	{
+		if (!m_file) return;
+
+		// A frame that refers to a spell the file doesn't have is no use, so it goes if the spell does
+		if (!WriteSpell(record.primarySpellFormId, inputs.primarySpell) || !WriteSpell(record.secondarySpellFormId, inputs.secondarySpell)) {
+			m_gap.numDroppedFrames++;
+			m_numDropped++;
+			return;
+		}
+
+		Chunk chunk;
+		chunk.size = 0;
+		if (m_gap.numInactiveFrames || m_gap.numDroppedFrames) {
+			ChunkType type = ChunkType::Gap;
+			chunk.Append(&type, sizeof(type));
+			chunk.Append(&m_gap, sizeof(m_gap));
+		}
+
+		ChunkType type = ChunkType::Frame;
+		chunk.Append(&type, sizeof(type));
+		FrameRecord frame = record;
+		if (m_isSmoothingReset) frame.flags |= FrameRecord::kFlag_ResetSmoothing;
+		chunk.Append(&frame, sizeof(frame));
+
+		uint8_t parts = 0;
+		if (outputs.hasPrimaryAimForward) parts |= kOutput_PrimaryAimForward;
+		if (outputs.hasSecondaryAimForward) parts |= kOutput_SecondaryAimForward;
+		if (outputs.hasSecondaryAimPosition) parts |= kOutput_SecondaryAimPosition;
+		if (outputs.hasOffsetWorldTransforms) parts |= kOutput_OffsetWorldTransforms;
+		if (outputs.hasOffsetLocalTransforms) parts |= kOutput_OffsetLocalTransforms;
+		chunk.Append(&parts, sizeof(parts));
+		if (outputs.hasPrimaryAimForward) chunk.Append(&outputs.primaryAimForward, sizeof(MagicCore::Vec3));
+		if (outputs.hasSecondaryAimForward) chunk.Append(&outputs.secondaryAimForward, sizeof(MagicCore::Vec3));
+		if (outputs.hasSecondaryAimPosition) chunk.Append(&outputs.secondaryAimPosition, sizeof(MagicCore::Vec3));
+		if (outputs.hasOffsetWorldTransforms) {
+			chunk.Append(&outputs.primaryOffsetWorld, sizeof(MagicCore::Transform));
+			chunk.Append(&outputs.secondaryOffsetWorld, sizeof(MagicCore::Transform));
+		}
+		if (outputs.hasOffsetLocalTransforms) {
+			chunk.Append(&outputs.primaryOffsetLocal, sizeof(MagicCore::Transform));
+			chunk.Append(&outputs.secondaryOffsetLocal, sizeof(MagicCore::Transform));
+		}
+
+		if (!Push(chunk)) {
+			m_gap.numDroppedFrames++;
+			m_numDropped++;
+			return;
+		}
+		m_gap = {};
+		m_isSmoothingReset = false;
+	}
+
+	bool Recorder::Push(const Chunk &chunk)
+	{
+		if (!m_ring->TryPush(chunk)) return false;
+		m_numPushed++;
+		return true;
+	}
+
+	void Recorder::Flush()
+	{
+		if (!m_writerThread.joinable()) return;
+
+		while (m_numWritten.load(std::memory_order_acquire) < m_numPushed) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	bool Recorder::Drain()
+	{
+		uint64_t numWritten = 0;
+		Chunk chunk;
+		while (m_ring->TryPop(chunk)) {
+			std::fwrite(chunk.data, chunk.size, 1, m_file);
+			numWritten++;
+		}
+		if (!numWritten) return false;
+
+		// There's no shutdown notification to close the file on, so make sure not much is ever lost
+		std::fflush(m_file);
+		m_numWritten.fetch_add(numWritten, std::memory_order_release);
+		return true;
+	}
+
+	void Recorder::WriterThread()
+	{
+		while (!m_isClosing.load(std::memory_order_acquire)) {
+			if (!Drain()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+		}
+		// Whatever was pushed before Close()
+		Drain();
+	}
+
+	bool Reader::Open(const char *path)
+	{
+		Close();
+
+		m_file = std::fopen(path, "rb");
+		if (!m_file) return false;
+
+		FileHeader header;
+		if (!ReadValue(m_file, header) || header.magic != FileHeader::kMagic || header.version != FileHeader::kVersion ||
+			header.frameRecordSize != sizeof(FrameRecord) || header.spellRecordSize != sizeof(SpellRecord))
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Reader::Close()
+	{
+		if (m_file) {
+			std::fclose(m_file);
+			m_file = nullptr;
+		}
+		m_spells.clear();
+	}
+
+	const MagicCore::SpellParams & Reader::GetSpell(uint32_t formId) const
+	{
+		static const MagicCore::SpellParams s_noSpell;
+		if (!formId) return s_noSpell;
+
+		for (const SpellRecord &spell : m_spells) {
+			if (spell.formId == formId) return spell.params;
+		}
+		return s_noSpell;
+	}
+
+	bool Reader::Read(Frame &frame)
+	{
+		if (!m_file) return false;
+
+		frame.gapBefore = {};
+		ChunkType type;
+		while (ReadValue(m_file, type)) {
+			switch (type) {
+			case ChunkType::Spell:
+			{
+				SpellRecord spell;
+				if (!ReadValue(m_file, spell)) return false;
+				bool isKnown = false;
+				for (SpellRecord &known : m_spells) {
+					if (known.formId == spell.formId) {
+						known.params = spell.params;
+						isKnown = true;
+					}
+				}
+				if (!isKnown) m_spells.push_back(spell);
+				break;
+			}
+			case ChunkType::Gap:
+				if (!ReadValue(m_file, frame.gapBefore)) return false;
+				break;
+			case ChunkType::Frame:
+			{
+				uint8_t parts;
+				if (!ReadValue(m_file, frame.record) || !ReadValue(m_file, parts)) return false;
+				frame.inputs = ToInputs(frame.record, GetSpell(frame.record.primarySpellFormId), GetSpell(frame.record.secondarySpellFormId));
+
+				MagicCore::Outputs &outputs = frame.outputs;
+				outputs = MagicCore::Outputs();
+				outputs.hasPrimaryAimForward = (parts & kOutput_PrimaryAimForward) != 0;
+				outputs.hasSecondaryAimForward = (parts & kOutput_SecondaryAimForward) != 0;
+				outputs.hasSecondaryAimPosition = (parts & kOutput_SecondaryAimPosition) != 0;
+				outputs.hasOffsetWorldTransforms = (parts & kOutput_OffsetWorldTransforms) != 0;
+				outputs.hasOffsetLocalTransforms = (parts & kOutput_OffsetLocalTransforms) != 0;
+				if (outputs.hasPrimaryAimForward && !ReadValue(m_file, outputs.primaryAimForward)) return false;
+				if (outputs.hasSecondaryAimForward && !ReadValue(m_file, outputs.secondaryAimForward)) return false;
+				if (outputs.hasSecondaryAimPosition && !ReadValue(m_file, outputs.secondaryAimPosition)) return false;
+				if (outputs.hasOffsetWorldTransforms && (!ReadValue(m_file, outputs.primaryOffsetWorld) || !ReadValue(m_file, outputs.secondaryOffsetWorld))) return false;
+				if (outputs.hasOffsetLocalTransforms && (!ReadValue(m_file, outputs.primaryOffsetLocal) || !ReadValue(m_file, outputs.secondaryOffsetLocal))) return false;
+				return true;
+			}
+			default:
+				// Not something this version writes
+				return false;
+			}
+		}
+		return false;
+	}
+
+	MagicCore::Outputs Replayer::Step(const Config::Options &options, const Frame &frame)
+	{
+		if (frame.record.flags & FrameRecord::kFlag_ResetSmoothing) {
+			m_caster.ResetSmoothing();
+		}
+		return m_caster.Step(options, frame.inputs, frame.record.deltaTime);
+	}
+
+	float GetOutputsDifference(const MagicCore::Outputs &a, const MagicCore::Outputs &b)
+	{
+		if (a.hasPrimaryAimForward != b.hasPrimaryAimForward || a.hasSecondaryAimForward != b.hasSecondaryAimForward || a.hasSecondaryAimPosition != b.hasSecondaryAimPosition ||
+			a.hasOffsetWorldTransforms != b.hasOffsetWorldTransforms || a.hasOffsetLocalTransforms != b.hasOffsetLocalTransforms)
+		{
+			return std::numeric_limits<float>::infinity();
+		}
+
+		float difference = 0.f;
+		if (a.hasPrimaryAimForward) difference = std::fmax(difference, GetDifference(a.primaryAimForward, b.primaryAimForward));
+		if (a.hasSecondaryAimForward) difference = std::fmax(difference, GetDifference(a.secondaryAimForward, b.secondaryAimForward));
+		if (a.hasSecondaryAimPosition) difference = std::fmax(difference, GetDifference(a.secondaryAimPosition, b.secondaryAimPosition));
+		if (a.hasOffsetWorldTransforms) {
+			difference = std::fmax(difference, GetDifference(a.primaryOffsetWorld, b.primaryOffsetWorld));
+			difference = std::fmax(difference, GetDifference(a.secondaryOffsetWorld, b.secondaryOffsetWorld));
+		}
+		if (a.hasOffsetLocalTransforms) {
+			difference = std::fmax(difference, GetDifference(a.primaryOffsetLocal, b.primaryOffsetLocal));
+			difference = std::fmax(difference, GetDifference(a.secondaryOffsetLocal, b.secondaryOffsetLocal));
+		}
+		return difference;
+	}
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "asynclog.h"
+#include "magiccore.h"
+
+
+// Compact binary recording of the per-frame inputs to the hook logic and what the core made of them, so that sessions can be replayed, profiled
+// and checked outside of the game. A file is a FileHeader followed by chunks, each a ChunkType byte and then that chunk's data:
+//  - Spell: a SpellRecord, the first time a spell is seen and whenever its params change (e.g. the overrides were reloaded)
+//  - Gap: a GapRecord, for frames that the core wasn't stepped in. Only written before the frame that ends the gap.
+//  - Frame: a FrameRecord, then the outputs - an OutputParts byte followed by only the parts that are there
+// Everything is plain data in the machine's native layout.
+namespace Replay {
+	enum class ChunkType : uint8_t
+	{
+		Spell = 1,
+		Gap = 2,
+		Frame = 3,
+	};
+
+	struct SpellRecord
+	{
+		uint32_t formId;
+		MagicCore::SpellParams params;
+	};
+
+	struct GapRecord
+	{
+		uint32_t numInactiveFrames; // nothing to cast, or nothing drawn to cast it with
+		uint32_t numDroppedFrames; // stepped, but the recorder couldn't keep up. A replay can't be expected to match after these.
+	};
+
+	struct FrameRecord
+	{
+		enum Flags : uint16_t
+		{
+			kFlag_IsLeftHanded = 1 << 0,
+			kFlag_IsWeaponDrawn = 1 << 1,
+			kFlag_IsCastingPrimary = 1 << 2,
+			kFlag_IsCastingSecondary = 1 << 3,
+			kFlag_IsCastingDual = 1 << 4,
+			kFlag_HasDualCaster = 1 << 5,
+			kFlag_ResetSmoothing = 1 << 6, // the aim history was reset before this frame
+		};
+
+		// Exactly what the core was stepped with, in the order of MagicCore::Inputs. The aim node transforms are from after the extra roll / yaw was applied.
+		MagicCore::Transform primaryAimWorld;
+		MagicCore::Transform secondaryAimWorld;
+		MagicCore::Transform primaryOffsetWorld;
+		MagicCore::Transform primaryOffsetLocal;
+		MagicCore::Transform primaryOffsetParentWorld;
+		MagicCore::Transform secondaryOffsetWorld;
+		MagicCore::Transform secondaryOffsetLocal;
+		MagicCore::Transform secondaryOffsetParentWorld;
+
+		uint32_t primarySpellFormId; // 0 if there is no spell equipped, otherwise there's a SpellRecord for it further up
+		uint32_t secondarySpellFormId;
+
+		float magickaPercentage;
+		float deltaTime;
+		float magicRotationPitch;
+
+		uint16_t flags;
+		uint8_t dualCasterState;
+		uint8_t pad;
+	};
+
+	// Which parts of MagicCore::Outputs follow a FrameRecord
+	enum OutputParts : uint8_t
+	{
+		kOutput_PrimaryAimForward = 1 << 0, // Vec3
+		kOutput_SecondaryAimForward = 1 << 1, // Vec3
+		kOutput_SecondaryAimPosition = 1 << 2, // Vec3
+		kOutput_OffsetWorldTransforms = 1 << 3, // primary, secondary Transform
+		kOutput_OffsetLocalTransforms = 1 << 4, // primary, secondary Transform
+	};
+
+	struct FileHeader
+	{
+		static constexpr uint32_t kMagic = 0x5253494D; // "MISR" on disk
+		static constexpr uint32_t kVersion = 4;
+
+		uint32_t magic = kMagic;
+		uint32_t version = kVersion;
+		uint32_t frameRecordSize = sizeof(FrameRecord); // only there to catch a file from a build with a different layout
+		uint32_t spellRecordSize = sizeof(SpellRecord);
+	};
+
+	// Everything the record of one frame holds
+	struct Frame
+	{
+		FrameRecord record;
+		MagicCore::Inputs inputs;
+		MagicCore::Outputs outputs;
+		GapRecord gapBefore;
+	};
+
+	MagicCore::Inputs ToInputs(const FrameRecord &record, const MagicCore::SpellParams &primarySpell, const MagicCore::SpellParams &secondarySpell);
+
+	// Fills in everything but the spell form ids and whatever isn't in Inputs
+	void FromInputs(const MagicCore::Inputs &inputs, FrameRecord &record);
+
+	// Writes from the hook thread without ever touching the file there: each chunk is packed into a ring, and a writer thread of its own drains it into the file.
+	// If the ring is full the frame is dropped and counted, and shows up in the next GapRecord.
+	class Recorder
+	{
+	public:
+		Recorder();
+		~Recorder() { Close(); }
+
+		bool Open(const char *path);
+		// Writes out everything that was recorded before the call
+		void Close();
+		bool IsOpen() const { return m_file != nullptr; }
+
+		// The rest are for the one thread that steps the core.
+
+		// A frame in which the core wasn't stepped
+		void AddInactiveFrame() { m_gap.numInactiveFrames++; }
+		// The core's aim history was reset, before whatever frame is written next
+		void AddResetSmoothing() { m_isSmoothingReset = true; }
+
+		// record's spell form ids go with inputs' spell params. The rest of inputs is taken from the record.
+		void WriteFrame(const FrameRecord &record, const MagicCore::Inputs &inputs, const MagicCore::Outputs &outputs);
+
+		// Waits for the writer thread to write out everything recorded so far. Not for the hook thread: it's for tools that record faster than the game
+		// ever would, and would otherwise fill the ring.
+		void Flush();
+
+		uint64_t GetNumDropped() const { return m_numDropped; }
+
+	private:
+		struct Chunk
+		{
+			static constexpr int kMaxSize = 768;
+
+			uint16_t size;
+			uint8_t data[kMaxSize];
+
+			void Append(const void *bytes, size_t numBytes);
+		};
+		static_assert(1 + sizeof(GapRecord) + 1 + sizeof(FrameRecord) + 1 + 3 * sizeof(MagicCore::Vec3) + 4 * sizeof(MagicCore::Transform) <= Chunk::kMaxSize,
+			"A frame and the gap before it have to fit in one chunk");
+
+		typedef AsyncLog::MpscRing<Chunk, 1024> Ring;
+
+		// Whether a SpellRecord with these params has to be written first
+		bool IsSpellNew(uint32_t formId, const MagicCore::SpellParams &params) const;
+		bool WriteSpell(uint32_t formId, const MagicCore::SpellParams &params);
+		bool Push(const Chunk &chunk);
+		void WriterThread();
+		// Writer thread only. Returns whether anything was written.
+		bool Drain();
+
+		std::FILE *m_file = nullptr;
+		std::unique_ptr<Ring> m_ring;
+		std::thread m_writerThread;
+		std::atomic<bool> m_isClosing{ false };
+		std::atomic<uint64_t> m_numWritten{ 0 }; // chunks, by the writer thread
+
+		// Recording thread only
+		std::vector<SpellRecord> m_writtenSpells;
+		GapRecord m_gap = {};
+		bool m_isSmoothingReset = false;
+		uint64_t m_numPushed = 0;
+		uint64_t m_numDropped = 0;
+	};
+
+	class Reader
+	{
+	public:
+		~Reader() { Close(); }
+
+		bool Open(const char *path);
+		void Close();
+
+		// Reads up to and including the next frame. False at the end of the file or if it's cut short.
+		bool Read(Frame &frame);
+
+	private:
+		const MagicCore::SpellParams & GetSpell(uint32_t formId) const;
+
+		std::FILE *m_file = nullptr;
+		std::vector<SpellRecord> m_spells;
+	};
+
+	// Steps a Caster through recorded frames the way the hooks step the player's
+	class Replayer
+	{
+	public:
+		MagicCore::Outputs Step(const Config::Options &options, const Frame &frame);
+
+		const MagicCore::Caster & GetCaster() const { return m_caster; }
+
+	private:
+		MagicCore::Caster m_caster;
+	};
+
+	// Largest difference between any two numbers in a and b, or infinity if one has an output the other doesn't
+	float GetOutputsDifference(const MagicCore::Outputs &a, const MagicCore::Outputs &b);
+}
@@ -0,0 +1,171 @@
+#include <Windows.h>
+
+#include "scalemodifiers.h"
+#include "attachmentmap.h"
+#include "profiling.h"
+
+
+namespace ScaleModifiers {
+	constexpr int kUpdateIndex = 25;
+	// Modifier classes whose Update() we've hooked. Only the few that end up last on spell particle systems ever get here.
+	constexpr int kMaxHookedClasses = 32;
+	constexpr int kMaxAttachments = 512;
+
+	typedef bool(*_NiPSysModifier_Update)(NiPSysModifier *_this, float time, NiPSysData *data, NiPoint3 *position, NiPoint3 *radii, NiColorA *rotation);
+
+	struct HookedClass
+	{
+		UInt64 *vtable;
+		_NiPSysModifier_Update originalUpdate;
+	};
+
+	struct Attachment
+	{
+		NiPointer<NiPSysModifier> modifier;
+		const SharedParticleScale *sharedScale = nullptr;
+		int hookedClass = -1;
+
+		// Only touched from inside the particle update
+		MagicCore::ParticleScaler scaler;
+	};
+
+	// Only ever added to, even once a class is unhooked, since an update can still be on its way into ScaledUpdate. An entry is complete before the count
+	// that includes it is published.
+	HookedClass g_hookedClasses[kMaxHookedClasses];
+	std::atomic<int> g_numHookedClasses{ 0 };
+	// Main thread only. A class's Update() is only swapped out while it has attachments.
+	int g_numAttachedByClass[kMaxHookedClasses];
+
+	typedef MagicCore::AttachmentMap<NiPSysModifier, Attachment, kMaxAttachments> AttachmentMap;
+	AttachmentMap g_attachments;
+
+	bool IsCodeAddress(UInt64 address)
+	{
+		static UInt64 codeStart = 0;
+		static UInt64 codeEnd = 0;
+		if (!codeStart) {
+			UInt64 base = UInt64(GetModuleHandle(NULL));
+			auto dosHeader = (IMAGE_DOS_HEADER *)base;
+			auto ntHeaders = (IMAGE_NT_HEADERS64 *)(base + dosHeader->e_lfanew);
+			codeStart = base + ntHeaders->OptionalHeader.BaseOfCode;
+			codeEnd = codeStart + ntHeaders->OptionalHeader.SizeOfCode;
+		}
+		return address >= codeStart && address < codeEnd;
+	}
+
+	_NiPSysModifier_Update GetOriginalUpdate(UInt64 *vtable)
+	{
+		int numHookedClasses = g_numHookedClasses.load(std::memory_order_acquire);
+		for (int i = 0; i < numHookedClasses; i++) {
+			if (g_hookedClasses[i].vtable == vtable) return g_hookedClasses[i].originalUpdate;
+		}
+		return nullptr;
+	}
+
+	bool ScaledUpdate(NiPSysModifier *modifier, float time, NiPSysData *data, NiPoint3 *position, NiPoint3 *radii, NiColorA *rotation)
+	{
+		// Only ever installed in vtables that are in the list
+		bool result = GetOriginalUpdate(get_vtbl(modifier))(modifier, time, data, position, radii, rotation);
+
+		AttachmentMap::ReadScope scope(g_attachments);
+		if (Attachment *attachment = g_attachments.Find(modifier)) {
+			const SharedParticleScale *sharedScale = attachment->sharedScale;
+			float scale = sharedScale->scale.load(std::memory_order_relaxed);
+			bool scaleVelocity = sharedScale->scaleVelocity.load(std::memory_order_relaxed);
+			ScaleParticles(data, scale, scaleVelocity, attachment->scaler);
+		}
+
+		return result;
+	}
+
+	// Swaps Update() in the vtable from what's expected to be there to update. Does nothing if something else has been swapped in meanwhile.
+	// Another thread can be calling through this vtable right now, so the swap has to be a single write.
+	bool SwapUpdate(UInt64 *vtable, UInt64 expected, UInt64 update)
+	{
+		DWORD oldProtect;
+		if (!VirtualProtect(&vtable[kUpdateIndex], sizeof(UInt64), PAGE_READWRITE, &oldProtect)) return false;
+		bool isSwapped = UInt64(InterlockedCompareExchange64((volatile LONG64 *)&vtable[kUpdateIndex], LONG64(update), LONG64(expected))) == expected;
+		VirtualProtect(&vtable[kUpdateIndex], sizeof(UInt64), oldProtect, &oldProtect);
+		return isSwapped;
+	}
+
+	// Swaps ScaledUpdate into the class's vtable, if it isn't already. Returns the class's index in g_hookedClasses, or -1.
+	int HookUpdate(UInt64 *vtable)
+	{
+		int numHookedClasses = g_numHookedClasses.load(std::memory_order_relaxed);
+		for (int i = 0; i < numHookedClasses; i++) {
+			if (g_hookedClasses[i].vtable != vtable) continue;
+
+			if (g_numAttachedByClass[i] > 0) return i;
+			return SwapUpdate(vtable, UInt64(g_hookedClasses[i].originalUpdate), UInt64(ScaledUpdate)) ? i : -1;
+		}
+
+		if (numHookedClasses >= kMaxHookedClasses) return -1;
+
+		// Not an actual modifier if Update() isn't in the exe
+		UInt64 originalUpdate = vtable[kUpdateIndex];
+		if (!IsCodeAddress(originalUpdate)) return -1;
+
+		g_hookedClasses[numHookedClasses] = { vtable, (_NiPSysModifier_Update)originalUpdate };
+		g_numAttachedByClass[numHookedClasses] = 0;
+		g_numHookedClasses.store(numHookedClasses + 1, std::memory_order_release);
+		return SwapUpdate(vtable, originalUpdate, UInt64(ScaledUpdate)) ? numHookedClasses : -1;
+	}
+
+	// Puts the class's own Update() back once nothing of it is attached, so that the rest of the game's particle systems stop paying for the lookup
+	void UnhookUpdateIfUnused(int hookedClass)
+	{
+		if (g_numAttachedByClass[hookedClass] > 0) return;
+
+		const HookedClass &hooked = g_hookedClasses[hookedClass];
+		SwapUpdate(hooked.vtable, UInt64(ScaledUpdate), UInt64(hooked.originalUpdate));
+	}
+
+	MagicCore::SlotHandle Attach(NiParticleSystem *particles, const SharedParticleScale *sharedScale)
+	{
+		// The last modifier runs last, so scaling from there is the same as adding a modifier of our own to the end
+		NiTListItem<NiPointer<NiPSysModifier>> *tail = particles->modifierList.tail;
+		if (!tail) return MagicCore::SlotHandle();
+
+		NiPSysModifier *modifier = tail->item;
+		if (!modifier) return MagicCore::SlotHandle();
+
+		int hookedClass = HookUpdate(get_vtbl(modifier));
+		if (hookedClass < 0) return MagicCore::SlotHandle();
+
+		MagicCore::SlotHandle handle = g_attachments.Add(modifier, [&](Attachment &attachment) {
+			attachment.modifier = modifier;
+			attachment.sharedScale = sharedScale;
+			attachment.hookedClass = hookedClass;
+			attachment.scaler.Reset();
+		});
+		if (handle) {
+			g_numAttachedByClass[hookedClass]++;
+		}
+		else {
+			UnhookUpdateIfUnused(hookedClass);
+		}
+		return handle;
+	}
+
+	void Detach(MagicCore::SlotHandle handle)
+	{
+		Attachment *attachment = g_attachments.Get(handle);
+		if (!attachment || !attachment->modifier) return;
+
+		// An update that already found the attachment can still be running in it, so it isn't reused until that update is done.
+		// The modifier itself is safe to let go of: anything still updating it has it in a particle system's modifier list.
+		g_attachments.Remove(handle, attachment->modifier);
+		attachment->modifier = nullptr;
+
+		g_numAttachedByClass[attachment->hookedClass]--;
+		UnhookUpdateIfUnused(attachment->hookedClass);
+	}
+
+	void CollectGarbage()
+	{
+		g_attachments.EndFrame();
+
+		Profiling::SetGauge(Profiling::Gauge::ScaleModifiersAttached, int64_t(g_attachments.GetNumAttached()));
+	}
+}
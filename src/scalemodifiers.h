@@ -0,0 +1,20 @@
+#pragma once
+
+#include "utils.h"
+#include "slotpool.h"
+
+
+// Spell scaling done by the particle systems themselves, as part of the engine's own particle update (ParticleScaleMode 2).
+// A modifier of our own in modifierList isn't something we can safely make: only Update() of NiPSysModifier's virtuals is known, and the engine also
+// clones, streams, RTTI-casts and resets the modifiers on a particle system through the rest, so any of those reaching ours would call into nothing.
+// Instead we hook Update() in the vtable of the class of the last modifier on a particle system. The hook runs the original and then, for modifiers that
+// are attached, scales the particles with the scale from the caster's SharedParticleScale. Every other modifier of that class pays for a lookup, but only
+// while the class has attachments: the original Update() is put back when its last one is detached. Detaching leaves the modifier itself untouched.
+namespace ScaleModifiers {
+	// Returns an invalid handle if the particle system has no modifier we can hook
+	MagicCore::SlotHandle Attach(NiParticleSystem *particles, const SharedParticleScale *sharedScale);
+	void Detach(MagicCore::SlotHandle attachment);
+
+	// Lets detached attachments be reused once the particle updates can't be running in them anymore. Call once per frame.
+	void CollectGarbage();
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+
+namespace MagicCore {
+	enum class ScaleTargetKind
+	{
+		Other,
+		Geometry,
+		ParticleSystem,
+		Node
+	};
+
+	// The walk that finds what a spell scale applies to under a magic node, written against a traits type instead of the engine's scene graph
+	// so that it can be tested and benchmarked on synthetic trees. Traits provides:
+	//   Object, Node                  the scene graph types
+	//   ObjectHandle, NodeHandle      what a cache holds on to them with (e.g. ref-counting pointers), convertible from and to Object * / Node *
+	//   static ScaleTargetKind Classify(Object *object, Node *&node)   sets node when it returns Node
+	//   static int GetNumChildren(Node *node)
+	//   static Object * GetChild(Node *node, int index)               may be null
+	template <typename Traits>
+	uint64_t GetChildrenChecksum(typename Traits::Node *node)
+	{
+		uint64_t checksum = 0;
+		int numChildren = Traits::GetNumChildren(node);
+		for (int i = 0; i < numChildren; i++) {
+			checksum = checksum * 31 + uint64_t(uintptr_t(Traits::GetChild(node, i)));
+		}
+		return checksum;
+	}
+
+	// Calls onNode(node) for each node passed through, parents first, and onTarget(object, isParticleSystem) for each geometry and particle system.
+	// Doesn't look below a target.
+	template <typename Traits, typename OnNode, typename OnTarget>
+	void WalkScaleTargets(typename Traits::Object *root, OnNode &onNode, OnTarget &onTarget)
+	{
+		typename Traits::Node *node = nullptr;
+		switch (Traits::Classify(root, node)) {
+		case ScaleTargetKind::Geometry:
+			onTarget(root, false);
+			return;
+		case ScaleTargetKind::ParticleSystem:
+			onTarget(root, true);
+			return;
+		case ScaleTargetKind::Node:
+		{
+			onNode(node);
+			int numChildren = Traits::GetNumChildren(node);
+			for (int i = 0; i < numChildren; i++) {
+				typename Traits::Object *child = Traits::GetChild(node, i);
+				if (child) {
+					WalkScaleTargets<Traits>(child, onNode, onTarget);
+				}
+			}
+			return;
+		}
+		default:
+			return;
+		}
+	}
+
+	// Flat list of the scale targets under a root.
+	// Building it takes the full walk, but checking that it is still current only has to look at the child arrays of the nodes it passed through.
+	// Target must be constructible from { ObjectHandle, bool isParticleSystem }.
+	template <typename Traits, typename Target>
+	struct ScaleTargetCache
+	{
+		typedef typename Traits::Object Object;
+		typedef typename Traits::Node Node;
+
+		struct NodeRecord
+		{
+			typename Traits::NodeHandle node;
+			int numChildren;
+			uint64_t childrenChecksum;
+		};
+
+		typename Traits::ObjectHandle root;
+		std::vector<NodeRecord> nodes;
+		std::vector<Target> targets;
+
+		bool IsValidFor(Object *root) const
+		{
+			if ((Object *)this->root != root) return false;
+
+			// Nodes are recorded parent-first, so any node we look at here is still attached if everything before it matched
+			for (const NodeRecord &record : nodes) {
+				Node *node = record.node;
+				if (Traits::GetNumChildren(node) != record.numChildren || GetChildrenChecksum<Traits>(node) != record.childrenChecksum) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// Doesn't do anything about the old targets - whoever owns the cache cleans up after them first
+		void Build(Object *root)
+		{
+			// Keep the allocations around, the new tree will most likely need about the same amount
+			nodes.clear();
+			targets.clear();
+			this->root = root;
+
+			auto onNode = [this](Node *node) {
+				nodes.push_back({ node, Traits::GetNumChildren(node), GetChildrenChecksum<Traits>(node) });
+			};
+			auto onTarget = [this](Object *object, bool isParticleSystem) {
+				targets.push_back({ object, isParticleSystem });
+			};
+			WalkScaleTargets<Traits>(root, onNode, onTarget);
+		}
+
+		void Reset()
+		{
+			root = nullptr;
+			nodes.clear();
+			targets.clear();
+		}
+	};
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+
+namespace MagicCore {
+	// One writer publishes a T, any number of readers on other threads take consistent copies of the latest one, and neither side ever blocks.
+	// There are two copies: the writer always writes the one readers weren't pointed at, and each copy has a sequence number that is odd while it's being written,
+	// so a reader that raced a write sees the number change and tries again. With two copies that only happens if a reader is slower than a whole frame.
+	// The data itself is stored as relaxed atomic words, so the racing reads are well-defined rather than just harmless.
+	template <typename T>
+	class SeqlockDoubleBuffer
+	{
+	public:
+		static_assert(std::is_trivially_copyable<T>::value, "SeqlockDoubleBuffer copies T as raw words");
+		static_assert(sizeof(T) % sizeof(uint32_t) == 0, "SeqlockDoubleBuffer needs T to be a whole number of 32 bit words");
+
+		SeqlockDoubleBuffer()
+		{
+			T initial{};
+			for (Slot &slot : m_slots) {
+				slot.sequence.store(0, std::memory_order_relaxed);
+				StoreWords(slot, initial);
+			}
+		}
+
+		// Single writer only
+		void Publish(const T &value)
+		{
+			uint32_t index = m_latest.load(std::memory_order_relaxed) ^ 1;
+			Slot &slot = m_slots[index];
+
+			uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+			slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release); // the odd sequence number has to be visible before any of the new data
+			StoreWords(slot, value);
+			slot.sequence.store(sequence + 2, std::memory_order_release);
+
+			m_latest.store(index, std::memory_order_release);
+		}
+
+		// Returns false if a consistent copy couldn't be had in maxAttempts, which means the writer kept lapping us
+		bool Read(T &out, int maxAttempts = 8) const
+		{
+			for (int attempt = 0; attempt < maxAttempts; attempt++) {
+				const Slot &slot = m_slots[m_latest.load(std::memory_order_acquire)];
+
+				uint32_t sequenceBefore = slot.sequence.load(std::memory_order_acquire);
+				if (sequenceBefore & 1) continue;
+
+				LoadWords(slot, out);
+
+				std::atomic_thread_fence(std::memory_order_acquire); // the data has to be read before we check the sequence number again
+				if (slot.sequence.load(std::memory_order_relaxed) == sequenceBefore) return true;
+			}
+			return false;
+		}
+
+	private:
+		static constexpr size_t kNumWords = sizeof(T) / sizeof(uint32_t);
+
+		struct Slot
+		{
+			std::atomic<uint32_t> sequence;
+			std::atomic<uint32_t> words[kNumWords];
+		};
+
+		static void StoreWords(Slot &slot, const T &value)
+		{
+			uint32_t words[kNumWords];
+			memcpy(words, &value, sizeof(T));
+			for (size_t i = 0; i < kNumWords; i++) {
+				slot.words[i].store(words[i], std::memory_order_relaxed);
+			}
+		}
+
+		static void LoadWords(const Slot &slot, T &out)
+		{
+			uint32_t words[kNumWords];
+			for (size_t i = 0; i < kNumWords; i++) {
+				words[i] = slot.words[i].load(std::memory_order_relaxed);
+			}
+			memcpy(&out, words, sizeof(T));
+		}
+
+		Slot m_slots[2];
+		std::atomic<uint32_t> m_latest{ 0 };
+	};
+}
@@ -0,0 +1,143 @@
+#include <cstring>
+
+#include "sigscan.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define SIGSCAN_SIMD 1
+#include <emmintrin.h>
+#else
+#define SIGSCAN_SIMD 0
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace SigScan {
+	namespace {
+		int HexDigit(char c)
+		{
+			if (c >= '0' && c <= '9') return c - '0';
+			if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+			if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+			return -1;
+		}
+
+		inline bool MatchesAt(const uint8_t *at, const Pattern &pattern)
+		{
+			size_t length = pattern.bytes.size();
+			for (size_t i = 0; i < length; i++) {
+				if (pattern.isFixed[i] && at[i] != pattern.bytes[i]) return false;
+			}
+			return true;
+		}
+
+#if SIGSCAN_SIMD
+		// Of a mask that isn't 0
+		inline unsigned int LowestSetBit(unsigned int mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return unsigned(index);
+#else
+			return unsigned(__builtin_ctz(mask));
+#endif
+		}
+#endif
+	}
+
+	bool Parse(const char *text, Pattern &out)
+	{
+		out.bytes.clear();
+		out.isFixed.clear();
+
+		const char *c = text;
+		while (*c) {
+			if (*c == ' ') {
+				c++;
+				continue;
+			}
+
+			if (*c == '?') {
+				c++;
+				if (*c == '?') c++;
+				out.bytes.push_back(0);
+				out.isFixed.push_back(0);
+			}
+			else {
+				int high = HexDigit(c[0]);
+				int low = high >= 0 ? HexDigit(c[1]) : -1;
+				if (low < 0) return false;
+				c += 2;
+				out.bytes.push_back(uint8_t((high << 4) | low));
+				out.isFixed.push_back(1);
+			}
+
+			if (*c && *c != ' ') return false; // bytes have to be separated
+		}
+
+		const uint8_t *firstFixed = (const uint8_t *)memchr(out.isFixed.data(), 1, out.isFixed.size());
+		if (!firstFixed) return false;
+		out.firstAnchor = firstFixed - out.isFixed.data();
+		out.lastAnchor = out.isFixed.size() - 1;
+		while (!out.isFixed[out.lastAnchor]) out.lastAnchor--;
+		return true;
+	}
+
+	const uint8_t * FindScalar(const uint8_t *begin, size_t size, const Pattern &pattern)
+	{
+		size_t length = pattern.bytes.size();
+		if (length == 0 || size < length) return nullptr;
+
+		for (size_t i = 0; i <= size - length; i++) {
+			if (MatchesAt(begin + i, pattern)) return begin + i;
+		}
+		return nullptr;
+	}
+
+	const uint8_t * Find(const uint8_t *begin, size_t size, const Pattern &pattern)
+	{
+		size_t length = pattern.bytes.size();
+		if (length == 0 || size < length) return nullptr;
+
+		size_t numPositions = size - length + 1;
+		size_t i = 0;
+
+#if SIGSCAN_SIMD
+		// Compare 16 candidate positions at once against both anchors, and only check the whole pattern where both of them match.
+		// Checking two bytes far apart rules out nearly every position, even in code where any one byte value is common.
+		size_t firstAnchor = pattern.firstAnchor;
+		size_t lastAnchor = pattern.lastAnchor;
+		const __m128i first = _mm_set1_epi8(char(pattern.bytes[firstAnchor]));
+		const __m128i last = _mm_set1_epi8(char(pattern.bytes[lastAnchor]));
+
+		// Every load reads 16 bytes starting at most at begin + (numPositions - 16) + lastAnchor, which is inside the range
+		for (; i + 16 <= numPositions; i += 16) {
+			__m128i firstBlock = _mm_loadu_si128((const __m128i *)(begin + i + firstAnchor));
+			__m128i lastBlock = _mm_loadu_si128((const __m128i *)(begin + i + lastAnchor));
+			unsigned int candidates = unsigned(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(firstBlock, first), _mm_cmpeq_epi8(lastBlock, last))));
+
+			while (candidates) {
+				unsigned int bit = LowestSetBit(candidates);
+				candidates &= candidates - 1;
+
+				if (MatchesAt(begin + i + bit, pattern)) return begin + i + bit;
+			}
+		}
+#endif
+
+		// Whatever is left over
+		for (; i < numPositions; i++) {
+			if (MatchesAt(begin + i, pattern)) return begin + i;
+		}
+		return nullptr;
+	}
+
+	bool IsUnique(const uint8_t *begin, size_t size, const Pattern &pattern, const uint8_t *match)
+	{
+		const uint8_t *end = begin + size;
+		const uint8_t *next = match + 1;
+		return next >= end || !Find(next, size_t(end - next), pattern);
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Byte signature scanning, for finding code in an exe whose addresses we don't know ahead of time.
+// Signatures are written the usual way, as hex bytes with ?? (or ?) for any byte: "48 8B 05 ?? ?? ?? ?? 48 85 C0".
+namespace SigScan {
+	struct Pattern
+	{
+		std::vector<uint8_t> bytes;
+		std::vector<uint8_t> isFixed; // 0 for wildcards
+		// Two fixed bytes, as far apart as possible, that the vectorized scan looks for before checking the rest
+		size_t firstAnchor = 0;
+		size_t lastAnchor = 0;
+	};
+
+	// Fails on malformed text, and on patterns that are empty or all wildcards
+	bool Parse(const char *text, Pattern &out);
+
+	// Returns the first match in [begin, begin + size), or nullptr
+	const uint8_t * Find(const uint8_t *begin, size_t size, const Pattern &pattern);
+	// Same result as Find(), a byte at a time. The reference for the vectorized version.
+	const uint8_t * FindScalar(const uint8_t *begin, size_t size, const Pattern &pattern);
+
+	// Whether pattern matches nowhere after match, the first match. A signature that matches in more than one place can't be trusted.
+	bool IsUnique(const uint8_t *begin, size_t size, const Pattern &pattern, const uint8_t *match);
+}
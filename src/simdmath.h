@@ -0,0 +1,150 @@
+#pragma once
+
+#include "coremath.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define MAGICCORE_SIMD 1
+#include <emmintrin.h>
+#else
+#define MAGICCORE_SIMD 0
+#endif
+
+
+// SSE versions of the transform math in coremath.h.
+// The scalar operators there stay as the reference implementation, and are what these fall back to on targets without SSE2.
+namespace MagicCore {
+	namespace Simd {
+#if MAGICCORE_SIMD
+		// All the loads below read 4 floats where only 3 are wanted. Each one stays inside the Transform / Mat33 being read,
+		// since every row is followed by another row, the position, or the scale.
+		inline __m128 LoadRow(const float *row) { return _mm_loadu_ps(row); }
+
+		inline void StoreVec3(float *out, __m128 v)
+		{
+			_mm_storel_pi((__m64 *)out, v);
+			_mm_store_ss(out + 2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+		}
+
+		inline __m128 Splat(__m128 v, int i)
+		{
+			switch (i) {
+			case 0: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+			case 1: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+			default: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+			}
+		}
+
+		// Row i of a * b is a[i][0] * b.row0 + a[i][1] * b.row1 + a[i][2] * b.row2
+		inline __m128 RowTimesMatrix(__m128 row, __m128 b0, __m128 b1, __m128 b2)
+		{
+			__m128 result = _mm_mul_ps(Splat(row, 0), b0);
+			result = _mm_add_ps(result, _mm_mul_ps(Splat(row, 1), b1));
+			return _mm_add_ps(result, _mm_mul_ps(Splat(row, 2), b2));
+		}
+
+		inline void Transpose3(__m128 &r0, __m128 &r1, __m128 &r2)
+		{
+			__m128 r3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		}
+#endif
+
+		// Same result as a * b
+		inline Transform Multiply(const Transform &a, const Transform &b)
+		{
+#if MAGICCORE_SIMD
+			__m128 a0 = LoadRow(a.rot.data[0]);
+			__m128 a1 = LoadRow(a.rot.data[1]);
+			__m128 a2 = LoadRow(a.rot.data[2]);
+			__m128 b0 = LoadRow(b.rot.data[0]);
+			__m128 b1 = LoadRow(b.rot.data[1]);
+			__m128 b2 = LoadRow(b.rot.data[2]);
+			__m128 bPos = LoadRow(&b.pos.x);
+			__m128 aPos = LoadRow(&a.pos.x);
+
+			Transform result;
+			StoreVec3(result.rot.data[0], RowTimesMatrix(a0, b0, b1, b2));
+			StoreVec3(result.rot.data[1], RowTimesMatrix(a1, b0, b1, b2));
+			StoreVec3(result.rot.data[2], RowTimesMatrix(a2, b0, b1, b2));
+
+			// a.rot * b.pos is the sum of a's columns weighted by b.pos
+			Transpose3(a0, a1, a2);
+			__m128 rotated = RowTimesMatrix(bPos, a0, a1, a2);
+			StoreVec3(&result.pos.x, _mm_add_ps(aPos, _mm_mul_ps(rotated, _mm_set1_ps(a.scale))));
+
+			result.scale = a.scale * b.scale;
+			return result;
+#else
+			return a * b;
+#endif
+		}
+
+		// Same result as InverseTransform(t)
+		inline Transform Inverse(const Transform &t)
+		{
+#if MAGICCORE_SIMD
+			__m128 r0 = LoadRow(t.rot.data[0]);
+			__m128 r1 = LoadRow(t.rot.data[1]);
+			__m128 r2 = LoadRow(t.rot.data[2]);
+			__m128 pos = LoadRow(&t.pos.x);
+
+			float inverseScale = 1.f / t.scale;
+
+			// The columns of the transposed rotation are the rows of the original
+			__m128 rotated = RowTimesMatrix(pos, r0, r1, r2);
+			__m128 inversePos = _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), rotated), _mm_set1_ps(inverseScale));
+
+			Transpose3(r0, r1, r2);
+
+			Transform inverse;
+			StoreVec3(inverse.rot.data[0], r0);
+			StoreVec3(inverse.rot.data[1], r1);
+			StoreVec3(inverse.rot.data[2], r2);
+			StoreVec3(&inverse.pos.x, inversePos);
+			inverse.scale = inverseScale;
+			return inverse;
+#else
+			return InverseTransform(t);
+#endif
+		}
+
+#if MAGICCORE_SIMD
+		inline void NormalizeVectors4(Vec3 *v)
+		{
+			__m128 x = _mm_setr_ps(v[0].x, v[1].x, v[2].x, v[3].x);
+			__m128 y = _mm_setr_ps(v[0].y, v[1].y, v[2].y, v[3].y);
+			__m128 z = _mm_setr_ps(v[0].z, v[1].z, v[2].z, v[3].z);
+
+			__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+			__m128 length = _mm_sqrt_ps(lengthSquared);
+			__m128 isNonZero = _mm_cmpgt_ps(length, _mm_setzero_ps());
+			// Divide by the full precision length rather than using rsqrt, so that results match the scalar path exactly.
+			// Zero lengths divide by 1 instead and then get masked to 0.
+			__m128 safeLength = _mm_or_ps(_mm_and_ps(isNonZero, length), _mm_andnot_ps(isNonZero, _mm_set1_ps(1.f)));
+
+			alignas(16) float outX[4], outY[4], outZ[4];
+			_mm_store_ps(outX, _mm_and_ps(_mm_div_ps(x, safeLength), isNonZero));
+			_mm_store_ps(outY, _mm_and_ps(_mm_div_ps(y, safeLength), isNonZero));
+			_mm_store_ps(outZ, _mm_and_ps(_mm_div_ps(z, safeLength), isNonZero));
+			for (int j = 0; j < 4; j++) {
+				v[j] = { outX[j], outY[j], outZ[j] };
+			}
+		}
+#endif
+
+		// Normalizes every vector in place, 4 at a time. Zero-length vectors stay zero, same as VectorNormalized().
+		inline void NormalizeVectors(Vec3 *vectors, int count)
+		{
+			int i = 0;
+#if MAGICCORE_SIMD
+			for (; i + 4 <= count; i += 4) {
+				NormalizeVectors4(vectors + i);
+			}
+#endif
+			// The tail one at a time. Padding it out to a group of 4 measured slower than this for the 2 aim directions a frame (bench_simdmath).
+			for (; i < count; i++) {
+				vectors[i] = VectorNormalized(vectors[i]);
+			}
+		}
+	}
+}
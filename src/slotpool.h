@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+
+
+namespace MagicCore {
+	// Refers to a slot in a SlotPool. The low 16 bits are the slot index and the high 16 bits are the slot's generation when the handle was given out,
+	// so a handle to a slot that has since been released (and maybe reused) no longer resolves. 0 is never a valid handle.
+	struct SlotHandle
+	{
+		uint32_t value = 0;
+
+		uint16_t GetIndex() const { return uint16_t(value & 0xFFFF); }
+		uint16_t GetGeneration() const { return uint16_t(value >> 16); }
+		explicit operator bool() const { return value != 0; }
+		bool operator==(SlotHandle other) const { return value == other.value; }
+		bool operator!=(SlotHandle other) const { return value != other.value; }
+	};
+
+	// Fixed-capacity pool of T addressed by generational handles. Allocate() and Release() are O(1) and never touch the heap.
+	// The items live for as long as the pool does - releasing a slot doesn't destroy its item, so any allocations it owns can be reused by the next owner.
+	// It's up to the caller to reset an item when it gets (re)allocated.
+	template <typename T, int capacity>
+	class SlotPool
+	{
+	public:
+		static constexpr int kCapacity = capacity;
+		static_assert(kCapacity > 0 && kCapacity < 0xFFFF, "SlotPool capacity must fit in a 16 bit index, with one value left over");
+
+		SlotPool()
+		{
+			for (int i = 0; i < kCapacity; i++) {
+				m_generations[i] = 1;
+				m_nextFree[i] = uint16_t(i + 1);
+			}
+		}
+		SlotPool(const SlotPool &) = delete;
+		SlotPool & operator=(const SlotPool &) = delete;
+
+		// Returns an invalid handle when the pool is full
+		SlotHandle Allocate()
+		{
+			if (m_firstFree >= kCapacity) return SlotHandle();
+
+			uint16_t index = m_firstFree;
+			m_firstFree = m_nextFree[index];
+			m_nextFree[index] = kAllocated;
+			m_numAllocated++;
+			return MakeHandle(index);
+		}
+
+		// Releasing a stale handle does nothing
+		void Release(SlotHandle handle)
+		{
+			if (!IsValid(handle)) return;
+
+			uint16_t index = handle.GetIndex();
+			// Bump the generation so that every outstanding handle to this slot goes stale. Skip 0 on wraparound, so that no handle is ever 0.
+			uint16_t generation = uint16_t(m_generations[index] + 1);
+			m_generations[index] = generation ? generation : 1;
+			m_nextFree[index] = m_firstFree;
+			m_firstFree = index;
+			m_numAllocated--;
+		}
+
+		bool IsValid(SlotHandle handle) const
+		{
+			uint16_t index = handle.GetIndex();
+			return handle && index < kCapacity && m_nextFree[index] == kAllocated && m_generations[index] == handle.GetGeneration();
+		}
+
+		// nullptr for stale handles
+		T * Get(SlotHandle handle) { return IsValid(handle) ? &m_items[handle.GetIndex()] : nullptr; }
+		const T * Get(SlotHandle handle) const { return IsValid(handle) ? &m_items[handle.GetIndex()] : nullptr; }
+
+		// For handles the caller knows are still allocated. Doesn't read the pool's own state, so unlike Get() it can be used from another thread
+		// while the owner allocates and releases, as long as the slot itself can't be released in the meantime.
+		T & GetUnchecked(SlotHandle handle) { return m_items[handle.GetIndex()]; }
+
+		int GetNumAllocated() const { return m_numAllocated; }
+
+	private:
+		static constexpr uint16_t kAllocated = 0xFFFF;
+
+		SlotHandle MakeHandle(uint16_t index) const { return SlotHandle{ (uint32_t(m_generations[index]) << 16) | index }; }
+
+		T m_items[kCapacity];
+		uint16_t m_generations[kCapacity];
+		uint16_t m_nextFree[kCapacity]; // kAllocated for slots in use, otherwise the next slot in the free list (kCapacity ends it)
+		uint16_t m_firstFree = 0;
+		int m_numAllocated = 0;
+	};
+}
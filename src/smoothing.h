@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cmath>
+
+#include "coremath.h"
+
+
+namespace MagicCore {
+	// Fixed-capacity ring of per-frame aim directions.
+	// Rather than the samples themselves, each slot holds the running sum of every sample pushed up to and including it,
+	// so the sum over the most recent n samples is the difference of two slots - O(1) for any window length.
+	class AimHistory
+	{
+	public:
+		static constexpr int kCapacity = 512; // must be a power of two
+		static constexpr int kMaxWindow = kCapacity - 1;
+
+		void Push(const Vec3 &vector)
+		{
+			int prev = m_head;
+			m_head = (m_head + 1) & kMask;
+			m_sums[m_head] = m_sums[prev] + vector;
+
+			if (m_head == 0) {
+				// Keep the running sums small so that float precision doesn't degrade over a long session.
+				// Subtracting the same base from every slot leaves all of the differences intact.
+				Vec3 base = m_sums[1];
+				for (Vec3 &sum : m_sums) {
+					sum -= base;
+				}
+			}
+		}
+
+		void Reset()
+		{
+			for (Vec3 &sum : m_sums) {
+				sum = Vec3();
+			}
+			m_head = 0;
+		}
+
+		// Sum of the most recent numFrames samples
+		Vec3 GetSum(int numFrames) const
+		{
+			numFrames = numFrames < 1 ? 1 : (numFrames > kMaxWindow ? kMaxWindow : numFrames);
+			return m_sums[m_head] - m_sums[(m_head - numFrames) & kMask];
+		}
+
+		// Sum of numFrames samples, ending numFramesAgo samples before the most recent one
+		Vec3 GetSum(int numFrames, int numFramesAgo) const
+		{
+			numFramesAgo = numFramesAgo < 0 ? 0 : (numFramesAgo > kMaxWindow - 1 ? kMaxWindow - 1 : numFramesAgo);
+			int maxFrames = kMaxWindow - numFramesAgo;
+			numFrames = numFrames < 1 ? 1 : (numFrames > maxFrames ? maxFrames : numFrames);
+			int end = m_head - numFramesAgo;
+			return m_sums[end & kMask] - m_sums[(end - numFrames) & kMask];
+		}
+
+	private:
+		static constexpr int kMask = kCapacity - 1;
+		static_assert((kCapacity & kMask) == 0, "AimHistory capacity must be a power of two");
+
+		Vec3 m_sums[kCapacity]{};
+		int m_head = 0;
+	};
+
+
+	// Exponential smoothing driven by a time constant instead of a frame count.
+	// Its delay is roughly the time constant regardless of frame rate, and it only needs the current value as state.
+	class ExponentialAimFilter
+	{
+	public:
+		void Update(const Vec3 &vector, float deltaTime, float timeConstant)
+		{
+			if (timeConstant <= 0.f) {
+				m_value = vector;
+				return;
+			}
+
+			float alpha = 1.f - expf(-deltaTime / timeConstant);
+			m_value += (vector - m_value) * alpha;
+		}
+
+		const Vec3 & Get() const { return m_value; }
+		void Reset() { m_value = Vec3(); }
+
+	private:
+		Vec3 m_value;
+	};
+
+
+	// Extrapolates a smoothed aim direction forward in time, to win back some of the delay that the smoothing adds.
+	// The rate of turn comes from comparing the means of consecutive windows of windowFrames samples, so it is itself smoothed and doesn't bring the jitter back.
+	// leadFrames is how far ahead to look, and the result never turns more than maxAngle (radians) away from smoothedForward.
+	inline Vec3 PredictAim(const AimHistory &history, const Vec3 &smoothedForward, int windowFrames, float leadFrames, bool useAcceleration, float maxAngle)
+	{
+		int maxWindowFrames = AimHistory::kMaxWindow / 3;
+		windowFrames = windowFrames < 2 ? 2 : (windowFrames > maxWindowFrames ? maxWindowFrames : windowFrames);
+		float inverseWindow = 1.f / float(windowFrames);
+
+		Vec3 recentMean = history.GetSum(windowFrames, 0) * inverseWindow;
+		Vec3 previousMean = history.GetSum(windowFrames, windowFrames) * inverseWindow;
+
+		// Per frame, and per frame squared. The window centers are windowFrames apart.
+		Vec3 velocity = (recentMean - previousMean) * inverseWindow;
+		Vec3 predicted = smoothedForward + velocity * leadFrames;
+		if (useAcceleration) {
+			Vec3 olderMean = history.GetSum(windowFrames, windowFrames * 2) * inverseWindow;
+			Vec3 acceleration = (recentMean - previousMean * 2.f + olderMean) * (inverseWindow * inverseWindow);
+			predicted += acceleration * (0.5f * leadFrames * leadFrames);
+		}
+		predicted = VectorNormalized(predicted);
+
+		float cosAngle = DotProduct(predicted, smoothedForward);
+		if (cosAngle < cosf(maxAngle)) {
+			Vec3 axis = VectorNormalized(CrossProduct(smoothedForward, predicted));
+			if (VectorLengthSquared(axis) == 0.f) return smoothedForward; // predicted straight backwards, which means something's off
+			return RotateVectorByAxisAngle(smoothedForward, axis, maxAngle);
+		}
+		return predicted;
+	}
+}
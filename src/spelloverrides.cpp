@@ -0,0 +1,150 @@
+#include "skse64/GameData.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "spelloverrides.h"
+#include "overridetable.h"
+#include "config.h"
+#include "asynclog.h"
+
+
+namespace SpellOverrideTable {
+	using Field = Config::SpellOverrides::Field;
+	using Overrides = Config::SpellOverrides;
+
+	struct OverrideDescriptor
+	{
+		OverrideDescriptor(const char *key, Field field, float Overrides::*member) : key(key), field(field), isInt(false), floatMember(member) {}
+		OverrideDescriptor(const char *key, Field field, int Overrides::*member) : key(key), field(field), isInt(true), intMember(member) {}
+
+		const char *key;
+		Field field;
+		bool isInt;
+		union {
+			float Overrides::*floatMember;
+			int Overrides::*intMember;
+		};
+	};
+
+	// Same names as the [Settings] keys they replace, minus the skill level for the smoothing ones
+	const OverrideDescriptor g_overrideDescriptors[] = {
+		{ "numSmoothingFrames", Overrides::kNumSmoothingFrames, &Overrides::numSmoothingFrames },
+		{ "smoothingTime", Overrides::kSmoothingTime, &Overrides::smoothingTime },
+		{ "spellMergeTime", Overrides::kSpellMergeTime, &Overrides::spellMergeTime },
+		{ "spellUnMergeTime", Overrides::kSpellUnMergeTime, &Overrides::spellUnMergeTime },
+		{ "SpellScaleWhenMagickaEmpty", Overrides::kSpellScaleWhenMagickaEmpty, &Overrides::spellScaleWhenMagickaEmpty },
+		{ "SpellScaleWhenMagickaFull", Overrides::kSpellScaleWhenMagickaFull, &Overrides::spellScaleWhenMagickaFull },
+		{ "dualCastHandsCloseSpellScale", Overrides::kDualCastHandsCloseSpellScale, &Overrides::dualCastHandsCloseSpellScale },
+		{ "dualCastHandsFarSpellScale", Overrides::kDualCastHandsFarSpellScale, &Overrides::dualCastHandsFarSpellScale },
+	};
+
+	Config::SpellOverrideTable g_table;
+
+	bool ParseFormId(const char *text, UInt32 &out)
+	{
+		char *end;
+		unsigned long value = strtoul(text, &end, 16); // also accepts a 0x prefix
+		if (end == text || *end) return false;
+		out = UInt32(value);
+		return true;
+	}
+
+	// "Plugin.esp|0x123456" or "0x01123456"
+	bool ResolveSection(const char *section, UInt32 &formId)
+	{
+		const char *separator = strrchr(section, '|');
+		if (!separator) {
+			return ParseFormId(section, formId);
+		}
+
+		UInt32 localId;
+		if (!ParseFormId(separator + 1, localId)) return false;
+
+		std::string pluginName(section, separator - section);
+		UInt8 modIndex = DataHandler::GetSingleton()->GetModIndex(pluginName.c_str());
+		if (modIndex == 0xFF) {
+			AsyncLog::Message("Spell overrides: %s is not loaded, skipping [%s]", pluginName.c_str(), section);
+			return false;
+		}
+
+		formId = (UInt32(modIndex) << 24) | (localId & 0x00FFFFFF);
+		return true;
+	}
+
+	bool Load()
+	{
+		g_table.Clear();
+
+		const std::string &configPath = Config::GetConfigPath();
+		if (configPath.empty()) return false;
+		std::string path = configPath.substr(0, configPath.find_last_of('\\') + 1) + "misvr_spells.ini";
+
+		Ini::File file;
+		if (!file.Load(path.c_str())) {
+			// The file is optional
+			return true;
+		}
+
+		bool readAll = true;
+		const char *lastSection = nullptr;
+		Overrides *overrides = nullptr;
+		for (const Ini::Entry &iniEntry : file.GetEntries()) {
+			if (iniEntry.section != lastSection) {
+				// Entries from the same section share its name
+				lastSection = iniEntry.section;
+				overrides = nullptr;
+
+				UInt32 formId;
+				if (ResolveSection(iniEntry.section, formId)) {
+					overrides = &g_table.Add(formId);
+				}
+				else if (!strchr(iniEntry.section, '|')) {
+					AsyncLog::Warning("Spell overrides: can't make a form id out of section [%s] on line %d", iniEntry.section, iniEntry.line);
+					readAll = false;
+				}
+			}
+			if (!overrides) continue;
+
+			const OverrideDescriptor *descriptor = nullptr;
+			for (const OverrideDescriptor &candidate : g_overrideDescriptors) {
+				if (Ini::EqualsNoCase(iniEntry.key, candidate.key)) {
+					descriptor = &candidate;
+					break;
+				}
+			}
+			if (!descriptor) {
+				AsyncLog::Warning("Spell overrides: unknown option on line %d: %s", iniEntry.line, iniEntry.key);
+				readAll = false;
+				continue;
+			}
+
+			bool parsed = descriptor->isInt ?
+				Ini::ParseInt(iniEntry.value, overrides->*descriptor->intMember) :
+				Ini::ParseFloat(iniEntry.value, overrides->*descriptor->floatMember);
+			if (!parsed) {
+				AsyncLog::Warning("Spell overrides: failed to parse option on line %d: %s = %s", iniEntry.line, iniEntry.key, iniEntry.value);
+				readAll = false;
+				continue;
+			}
+			overrides->fields |= descriptor->field;
+		}
+
+		// Sections for the same form merge, later keys winning, like a duplicate key within one section would
+		g_table.Build();
+
+		AsyncLog::Message("Loaded overrides for %d spells / effects from %s", GetNumEntries(), path.c_str());
+		return readAll;
+	}
+
+	const Config::SpellOverrides * Find(UInt32 formId)
+	{
+		return g_table.Find(formId);
+	}
+
+	int GetNumEntries()
+	{
+		return g_table.GetNumEntries();
+	}
+}
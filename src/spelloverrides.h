@@ -0,0 +1,24 @@
+#pragma once
+
+#include "options.h"
+
+
+// Per-spell settings from Data\SKSE\Plugins\misvr_spells.ini. Each section names a spell or magic effect, and its keys replace the matching [Settings] options
+// for that one spell:
+//
+//   [Skyrim.esm|0x012FCD]    ; form id local to a plugin, so load order doesn't matter
+//   spellMergeTime = 0.5
+//   [0x0001C789]             ; or a full form id
+//   numSmoothingFrames = 20
+//
+// The file is compiled once, after the game data has loaded, into a Config::SpellOverrideTable. Nothing is looked up per frame:
+// GetSpellInfo() resolves a spell's overrides the first time it sees the spell and keeps them with the rest of its info.
+namespace SpellOverrideTable {
+	// Must run after kMessage_DataLoaded, since plugin names only resolve to form ids then. Not thread-safe; lookups must not run concurrently with this.
+	bool Load();
+
+	// Returns nullptr if the form has no overrides
+	const Config::SpellOverrides * Find(UInt32 formId);
+
+	int GetNumEntries();
+}
@@ -1,16 +1,27 @@
 #include "skse64/GameRTTI.h"
 #include "skse64/PapyrusSpell.h"
 
+#include <algorithm>
+#include <unordered_map>
+
 #include "utils.h"
+#include "simdmath.h"
+#include "scalemodifiers.h"
+#include "spelloverrides.h"
+#include "profiling.h"
 #include "RE.h"
 
 
+RelocAddr<_Actor_GetActorValuePercentage> Actor_GetActorValuePercentage(0x5DEB30);
+
+MagicCore::EmissionBudget g_emissionBudget;
+
 NiTransform GetLocalTransform(NiAVObject *node, const NiTransform &worldTransform)
 {
 	NiPointer<NiNode> parent = node->m_parent;
 	if (parent) {
-		NiTransform inverseParent = InverseTransform(node->m_parent->m_worldTransform);
-		return inverseParent * worldTransform;
+		MagicCore::Transform inverseParent = MagicCore::Simd::Inverse(ToCore(parent->m_worldTransform));
+		return FromCore(MagicCore::Simd::Multiply(inverseParent, ToCore(worldTransform)));
 	}
 	return worldTransform;
 }
@@ -21,6 +32,91 @@ void UpdateNodeTransformLocal(NiAVObject *node, const NiTransform &worldTransfor
 	node->m_localTransform = GetLocalTransform(node, worldTransform);
 }
 
+void UpdateNodeTransformWorld(NiAVObject *node)
+{
+	// Recompute only this node's world transform from its local transform, without running controllers or touching the children
+	NiPointer<NiNode> parent = node->m_parent;
+	if (parent) {
+		node->m_worldTransform = FromCore(MagicCore::Simd::Multiply(ToCore(parent->m_worldTransform), ToCore(node->m_localTransform)));
+	}
+	else {
+		node->m_worldTransform = node->m_localTransform;
+	}
+}
+
+void NodeUpdateBatch::MarkDirty(NiAVObject *node)
+{
+	m_numRequests++;
+
+	for (int i = 0; i < m_numNodes; i++) {
+		if (m_nodes[i] == node) return;
+	}
+
+	if (m_numNodes >= kMaxNodes) {
+		// Shouldn't happen, but don't lose the update if it does
+		NiAVObject::ControllerUpdateContext ctx{ 0, 0 };
+		CALL_MEMBER_FN(node, UpdateNode)(&ctx);
+		m_numRequests--;
+		return;
+	}
+
+	m_nodes[m_numNodes++] = node;
+}
+
+int GetNodeDepth(NiAVObject *node)
+{
+	int depth = 0;
+	for (NiAVObject *parent = node->m_parent; parent; parent = parent->m_parent) {
+		depth++;
+	}
+	return depth;
+}
+
+void NodeUpdateBatch::Flush()
+{
+	// Parents before children
+	int depths[kMaxNodes];
+	for (int i = 0; i < m_numNodes; i++) {
+		depths[i] = GetNodeDepth(m_nodes[i]);
+	}
+	for (int i = 1; i < m_numNodes; i++) {
+		NiAVObject *node = m_nodes[i];
+		int depth = depths[i];
+		int j = i - 1;
+		for (; j >= 0 && depths[j] > depth; j--) {
+			m_nodes[j + 1] = m_nodes[j];
+			depths[j + 1] = depths[j];
+		}
+		m_nodes[j + 1] = node;
+		depths[j + 1] = depth;
+	}
+
+	int numUpdates = 0;
+	for (int i = 0; i < m_numNodes; i++) {
+		NiAVObject *node = m_nodes[i];
+
+		bool isAncestorDirty = false;
+		for (NiAVObject *parent = node->m_parent; parent && !isAncestorDirty; parent = parent->m_parent) {
+			for (int j = 0; j < i; j++) {
+				if (m_nodes[j] == parent) {
+					isAncestorDirty = true;
+					break;
+				}
+			}
+		}
+		if (isAncestorDirty) continue;
+
+		NiAVObject::ControllerUpdateContext ctx{ 0, 0 };
+		CALL_MEMBER_FN(node, UpdateNode)(&ctx);
+		numUpdates++;
+	}
+
+	Profiling::AddToCounter(Profiling::Counter::NodeUpdatesSaved, UInt64(m_numRequests - numUpdates));
+
+	m_numNodes = 0;
+	m_numRequests = 0;
+}
+
 bool GetAnimVariableBool(Actor *actor, BSFixedString &variableName)
 {
 	IAnimationGraphManagerHolder *animGraph = &actor->animGraphHolder;
@@ -65,38 +161,150 @@ NiPoint3 RotateVectorByAxisAngle(const NiPoint3 &vector, const NiPoint3 &axis, f
 }
 
 
+MagicCore::ScaleTargetKind NiScaleTargetTraits::Classify(NiAVObject *object, NiNode *&node)
+{
+	if (object->GetAsBSTriShape()) {
+		return MagicCore::ScaleTargetKind::Geometry;
+	}
+	if (DYNAMIC_CAST(object, NiAVObject, NiParticleSystem)) {
+		return MagicCore::ScaleTargetKind::ParticleSystem;
+	}
+	node = object->GetAsNiNode();
+	return node ? MagicCore::ScaleTargetKind::Node : MagicCore::ScaleTargetKind::Other;
+}
+
 void SetParticleScaleDownstream(NiAVObject *root, float scale)
 {
-	BSTriShape *geom = root->GetAsBSTriShape();
-	if (geom) {
-		// Normally, we'd need to set the local transform and update,
-		// but as long as this is called after any update calls to this node, we can set the world transform directly.
-		geom->m_worldTransform.scale *= scale;
-		return;
+	auto onNode = [](NiNode *) {};
+	auto onTarget = [scale](NiAVObject *object, bool isParticleSystem) {
+		if (isParticleSystem) {
+			static_cast<NiParticleSystem *>(object)->size *= scale;
+		}
+		else {
+			// Normally, we'd need to set the local transform and update,
+			// but as long as this is called after any update calls to this node, we can set the world transform directly.
+			object->m_worldTransform.scale *= scale;
+		}
+	};
+	MagicCore::WalkScaleTargets<NiScaleTargetTraits>(root, onNode, onTarget);
+}
+
+void ParticleScaleCache::Rebuild(NiAVObject *root)
+{
+	Clear();
+	Build(root);
+}
+
+void RestoreEmission(ParticleScaleCache::Target &target, NiParticleSystem *particles)
+{
+	if (target.writtenEmitScale < 0.f) return;
+
+	if (particles->unk1C0 == target.writtenEmitScale) {
+		// Leave it alone if the game has set its own since
+		particles->unk1C0 = target.baseEmitScale;
 	}
+	target.writtenEmitScale = -1.f;
+	target.emissionScale = 1.f;
+}
 
-	NiParticleSystem *particles = DYNAMIC_CAST(root, NiAVObject, NiParticleSystem);
-	if (particles) {
-		particles->size *= scale;
-		return;
+void ReduceEmission(ParticleScaleCache::Target &target, NiParticleSystem *particles, float emissionScale)
+{
+	if (particles->unk1C0 != target.writtenEmitScale) {
+		// First time, or the game set a new emit scale of its own
+		target.baseEmitScale = particles->unk1C0;
+	}
+
+	// What's alive now was emitted at the previous scale
+	g_emissionBudget.AddParticleSystem(particles->data ? particles->data->numParticles : 0, target.emissionScale);
+
+	particles->unk1C0 = target.writtenEmitScale = target.baseEmitScale * emissionScale;
+	target.emissionScale = emissionScale;
+}
+
+void ParticleScaleCache::Clear()
+{
+	for (Target &target : targets) {
+		if (target.attachment) {
+			ScaleModifiers::Detach(target.attachment);
+		}
+		if (target.isParticleSystem) {
+			RestoreEmission(target, static_cast<NiParticleSystem *>((NiAVObject *)target.object));
+		}
+	}
+
+	Reset();
+}
+
+void ScaleParticles(NiPSysData *data, float scale, bool scaleVelocity, MagicCore::ParticleScaler &scaler)
+{
+	if (!data || !data->sizes) return;
+
+	scaler.Apply(data->sizes, (MagicCore::ParticleInfo *)data->particleInfos, data->numParticles, scale, scaleVelocity);
+}
+
+void SetParticleScaleDownstream(const Config::Options &options, ParticleScaleCache &cache, NiAVObject *root, float scale)
+{
+	if (!cache.IsValidFor(root)) {
+		// Something was attached / detached somewhere in the subtree (e.g. the equipped spell changed)
+		cache.Rebuild(root);
 	}
 
-	NiNode *node = root->GetAsNiNode();
-	if (node) {
-		for (int i = 0; i < node->m_children.m_emptyRunStart; i++) {
-			NiAVObject *child = node->m_children.m_data[i];
-			if (child) {
-				SetParticleScaleDownstream(child, scale);
+	bool scaleEachParticle = options.particleScaleMode == 1;
+	bool useModifiers = options.particleScaleMode == 2;
+	if (useModifiers) {
+		// Picked up by the particle systems during their next update
+		cache.sharedScale.scale.store(scale, std::memory_order_relaxed);
+		cache.sharedScale.scaleVelocity.store(options.scaleParticleVelocity, std::memory_order_relaxed);
+	}
+
+	float emissionScale = MagicCore::GetEmissionScale(options, scale) * g_emissionBudget.GetBudgetScale();
+
+	for (ParticleScaleCache::Target &target : cache.targets) {
+		if (target.isParticleSystem) {
+			NiParticleSystem *particles = static_cast<NiParticleSystem *>((NiAVObject *)target.object);
+
+			if (options.enableEmissionLod) {
+				ReduceEmission(target, particles, emissionScale);
+			}
+			else {
+				RestoreEmission(target, particles);
+			}
+
+			if (useModifiers) {
+				if (!target.attachment && target.canAttach) {
+					target.attachment = ScaleModifiers::Attach(particles, &cache.sharedScale);
+					target.canAttach = bool(target.attachment);
+				}
+				if (target.attachment) continue;
+				// Otherwise fall back to doing the same thing from here
+			}
+			else if (target.attachment) {
+				// The mode was changed in the config
+				ScaleModifiers::Detach(target.attachment);
+				target.attachment = MagicCore::SlotHandle();
+			}
+
+			if (scaleEachParticle || useModifiers) {
+				ScaleParticles(particles->data, scale, options.scaleParticleVelocity, target.scaler);
+			}
+			else {
+				particles->size *= scale;
 			}
 		}
+		else {
+			// Same as in SetParticleScaleDownstream, it's fine to set the world transform directly as long as this is called after any node updates.
+			target.object->m_worldTransform.scale *= scale;
+		}
 	}
 }
 
 SpellItem *GetEquippedSpell(Actor *actor, bool isOffhand)
 {
 	TESForm *form = actor->GetEquippedObject(isOffhand);
-	if (form) {
-		return DYNAMIC_CAST(form, TESForm, SpellItem);
+	// Scrolls are SpellItems too, so they have to be let through along with spells.
+	// Comparing the form type saves the RTTI walk of a DYNAMIC_CAST.
+	if (form && (form->formType == kFormType_Spell || form->formType == kFormType_ScrollItem)) {
+		return static_cast<SpellItem *>(form);
 	}
 	return nullptr;
 }
@@ -136,3 +344,42 @@ bool IsTwoHandedEffectMergeable(EffectSetting *effect)
 
 	return false;
 }
+
+std::unordered_map<UInt32, SpellInfo> g_spellInfoCache;
+
+const SpellInfo * GetSpellInfo(SpellItem *spell)
+{
+	if (!spell) return nullptr;
+
+	SpellInfo &info = g_spellInfoCache[spell->formID];
+	if (info.spell != spell) {
+		// Not seen before, or a temporary form id that has since been reused for a different spell
+		info.spell = spell;
+		info.costliestEffect = GetCostliestEffect(spell);
+		info.skillLevel = GetEffectSkillLevel(info.costliestEffect);
+		info.isTwoHanded = get_vfunc<_SpellItem_IsTwoHanded>(spell, 0x67)(spell);
+		info.isTwoHandedEffectMergeable = IsTwoHandedEffectMergeable(info.costliestEffect);
+		info.castingTime = info.costliestEffect ? info.costliestEffect->properties.castingTime : 0.f;
+
+		const Config::SpellOverrides *overrides = SpellOverrideTable::Find(spell->formID);
+		if (!overrides && info.costliestEffect) {
+			overrides = SpellOverrideTable::Find(info.costliestEffect->formID);
+		}
+		info.overrides = overrides ? *overrides : Config::SpellOverrides();
+	}
+	return &info;
+}
+
+MagicCore::SpellParams ToSpellParams(const SpellInfo *spell)
+{
+	MagicCore::SpellParams params;
+	if (spell) {
+		params.isValid = true;
+		params.skillLevel = spell->skillLevel;
+		params.isTwoHanded = spell->isTwoHanded;
+		params.isTwoHandedEffectMergeable = spell->isTwoHandedEffectMergeable;
+		params.castingTime = spell->castingTime;
+		params.overrides = spell->overrides;
+	}
+	return params;
+}
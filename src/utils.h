@@ -5,11 +5,21 @@
 #include "skse64/PapyrusSpell.h"
 
 #include "RE.h"
+#include "magiccore.h"
+#include "emissionlod.h"
+#include "particlescale.h"
+#include "scaletargets.h"
+#include "slotpool.h"
+
+#include <atomic>
+#include <vector>
 
 
 typedef bool(*IAnimationGraphManagerHolder_GetGraphVariableInt)(IAnimationGraphManagerHolder *_this, const BSFixedString& a_variableName, SInt32& a_out);
 typedef bool(*IAnimationGraphManagerHolder_GetGraphVariableBool)(IAnimationGraphManagerHolder* _this, const BSFixedString& a_variableName, bool& a_out);
 typedef bool(*_SpellItem_IsTwoHanded)(SpellItem *_this);
+typedef float(*_Actor_GetActorValuePercentage)(Actor *_this, UInt32 actorValue);
+extern RelocAddr<_Actor_GetActorValuePercentage> Actor_GetActorValuePercentage;
 
 inline UInt64* get_vtbl(void* object) { return *((UInt64**)object); }
 
@@ -31,7 +41,60 @@ inline NiPoint3 VectorNormalized(const NiPoint3 &vec) { float length = VectorLen
 NiPoint3 CrossProduct(const NiPoint3 &vec1, const NiPoint3 &vec2);
 NiPoint3 RotateVectorByAxisAngle(const NiPoint3 &vector, const NiPoint3 &axis, float angle);
 
+// The core types have the same layout as the engine ones
+inline MagicCore::Vec3 ToCore(const NiPoint3 &v)
+{
+	static_assert(sizeof(NiPoint3) == sizeof(MagicCore::Vec3));
+	MagicCore::Vec3 out;
+	memcpy(&out, &v, sizeof(out));
+	return out;
+}
+
+inline NiPoint3 FromCore(const MagicCore::Vec3 &v)
+{
+	NiPoint3 out;
+	memcpy(&out, &v, sizeof(out));
+	return out;
+}
+
+inline MagicCore::Transform ToCore(const NiTransform &t)
+{
+	static_assert(sizeof(NiTransform) == sizeof(MagicCore::Transform));
+	MagicCore::Transform out;
+	memcpy(&out, &t, sizeof(out));
+	return out;
+}
+
+inline NiTransform FromCore(const MagicCore::Transform &t)
+{
+	NiTransform out;
+	memcpy(&out, &t, sizeof(out));
+	return out;
+}
+
+inline MagicCore::Transform GetParentWorldTransform(NiAVObject *node)
+{
+	return node->m_parent ? ToCore(node->m_parent->m_worldTransform) : MagicCore::Transform();
+}
+
 void UpdateNodeTransformLocal(NiAVObject *node, const NiTransform &worldTransform);
+void UpdateNodeTransformWorld(NiAVObject *node);
+
+// Collects the nodes whose transforms get written during a hook, so that each one only has UpdateNode called on it once at the end.
+// UpdateNode already recurses into the children, so a node is skipped entirely if one of its ancestors is dirty too.
+class NodeUpdateBatch
+{
+public:
+	static constexpr int kMaxNodes = 8;
+
+	void MarkDirty(NiAVObject *node);
+	void Flush();
+
+private:
+	NiAVObject *m_nodes[kMaxNodes];
+	int m_numNodes = 0;
+	int m_numRequests = 0;
+};
 bool GetAnimVariableBool(Actor *actor, BSFixedString &variableName);
 bool IsCastingRight(Actor *actor);
 bool IsCastingLeft(Actor *actor);
@@ -49,14 +112,81 @@ inline EffectSetting * GetCostliestEffect(SpellItem *spell)
 	return nullptr;
 }
 
-enum class SpellSkillLevel {
-	Novice,
-	Apprentice,
-	Adept,
-	Expert,
-	Master,
-};
+using SpellSkillLevel = MagicCore::SpellSkillLevel;
 SpellSkillLevel GetEffectSkillLevel(EffectSetting *effect);
 bool IsTwoHandedEffectMergeable(EffectSetting *effect);
 
+// Everything we derive from a spell. Spells essentially never change, so this is resolved once per spell and looked up by form id after that.
+struct SpellInfo
+{
+	SpellItem *spell = nullptr;
+	EffectSetting *costliestEffect = nullptr;
+	SpellSkillLevel skillLevel = SpellSkillLevel::Novice;
+	bool isTwoHanded = false;
+	bool isTwoHandedEffectMergeable = false;
+	float castingTime = 0.f;
+	Config::SpellOverrides overrides; // from the spell override file, for the spell itself or else its costliest effect
+};
+const SpellInfo * GetSpellInfo(SpellItem *spell);
+MagicCore::SpellParams ToSpellParams(const SpellInfo *spell);
+
 void SetParticleScaleDownstream(NiAVObject *root, float scale);
+
+static_assert(sizeof(NiParticleInfo) == sizeof(MagicCore::ParticleInfo) && offsetof(NiParticleInfo, lifeSpan) == offsetof(MagicCore::ParticleInfo, lifeSpan), "The core's ParticleInfo has to match NiParticleInfo");
+
+// Scales each particle's size (and optionally velocity) without compounding on last frame's scale. Keep one scaler per particle system.
+void ScaleParticles(NiPSysData *data, float scale, bool scaleVelocity, MagicCore::ParticleScaler &scaler);
+
+// What the particle systems scaled from inside the engine's particle update (ParticleScaleMode 2) read, which may happen off the main thread
+struct SharedParticleScale
+{
+	std::atomic<float> scale{ 1.f };
+	std::atomic<bool> scaleVelocity{ false };
+};
+
+// How the scale target walk (scaletargets.h) sees the scene graph
+struct NiScaleTargetTraits
+{
+	typedef NiAVObject Object;
+	typedef NiNode Node;
+	typedef NiPointer<NiAVObject> ObjectHandle;
+	typedef NiPointer<NiNode> NodeHandle;
+
+	static MagicCore::ScaleTargetKind Classify(NiAVObject *object, NiNode *&node);
+	static int GetNumChildren(NiNode *node) { return node->m_children.m_emptyRunStart; }
+	static NiAVObject * GetChild(NiNode *node, int index) { return node->m_children.m_data[index]; }
+};
+
+struct ParticleScaleTarget
+{
+	NiPointer<NiAVObject> object;
+	bool isParticleSystem;
+
+	// For scaling the particles one by one
+	MagicCore::ParticleScaler scaler;
+
+	// For scaling them from inside the particle update
+	MagicCore::SlotHandle attachment;
+	bool canAttach = true;
+
+	// For turning down emission. baseEmitScale is what the game had set, writtenEmitScale what we replaced it with (or -1 if we haven't).
+	float baseEmitScale = 1.f;
+	float writtenEmitScale = -1.f;
+	float emissionScale = 1.f;
+};
+
+// Flat list of everything under a node that SetParticleScaleDownstream would scale, along with our per-target state
+struct ParticleScaleCache : MagicCore::ScaleTargetCache<NiScaleTargetTraits, ParticleScaleTarget>
+{
+	typedef ParticleScaleTarget Target;
+
+	SharedParticleScale sharedScale; // the attachments point at this, so the cache must stay put
+
+	void Rebuild(NiAVObject *root);
+	void Clear();
+};
+// Shared by every ParticleScaleCache. BeginFrame() it once per frame, before any SetParticleScaleDownstream().
+extern MagicCore::EmissionBudget g_emissionBudget;
+
+// Scales particle systems as a whole, their particles one by one, or has the particle systems scale their own particles, depending on options.particleScaleMode
+void SetParticleScaleDownstream(const Config::Options &options, ParticleScaleCache &cache, NiAVObject *root, float scale);
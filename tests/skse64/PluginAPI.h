@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+
+// The parts of SKSE's PluginAPI.h that misvrinterface001.h refers to, with the same layout, so that the interface header can be tested as is without SKSE
+typedef uint32_t UInt32;
+typedef UInt32 PluginHandle;
+
+struct SKSEMessagingInterface
+{
+	struct Message
+	{
+		const char *sender;
+		UInt32 type;
+		UInt32 dataLen;
+		void *data;
+	};
+
+	typedef void(*EventCallback)(Message *msg);
+
+	UInt32 interfaceVersion;
+	bool(*RegisterListener)(PluginHandle listener, const char *sender, EventCallback handler);
+	bool(*Dispatch)(PluginHandle sender, UInt32 messageType, void *data, UInt32 dataLen, const char *receiver);
+	void * (*GetEventDispatcher)(UInt32 dispatcherId);
+};
@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#include "testing.h"
+#include "addresscache.h"
+#include "addressresolver.h"
+
+using namespace Addresses;
+
+
+namespace {
+	const char *kCachePath = "test_addressresolver.ini";
+
+	const size_t kHeaderSize = 0x400;
+	const size_t kCodeOffset = 0x1000;
+	const size_t kCodeSize = 3 << 20;
+	const size_t kImageSize = kCodeOffset + kCodeSize + (1 << 20); // data after the code
+
+	// Where things are put in the synthetic exe
+	const uint64_t kFunctionOffset = kCodeOffset + 0x12340;
+	const uint64_t kCallSiteOffset = kCodeOffset + 0x200000;
+	const uint64_t kCalledOffset = kCodeOffset + 0x5000;
+	const uint64_t kLoadOffset = kCodeOffset + 0x2ABCDE;
+	const uint64_t kDataOffset = kCodeOffset + kCodeSize + 0x1230;
+
+	const Descriptor kDescriptors[] = {
+		{ "Function", Source::Signature, "40 53 48 83 EC 20 48 8B D9 E8 ?? ?? ?? ?? 84 C0", 0, -1 },
+		{ "HookLoc", Source::Signature, "48 8B CB E8 ?? ?? ?? ?? 0F 28 C6 F3 0F 11 43 54", 3, -1 },
+		{ "HookedFunc", Source::CallTarget, nullptr, 0, 1 },
+		{ "DeltaTime", Source::RipRelative, "F3 0F 10 05 ?? ?? ?? ?? F3 0F 59 C1 F3 0F 11 47", 4, -1 },
+	};
+	const int kNumDescriptors = sizeof(kDescriptors) / sizeof(kDescriptors[0]);
+
+	void Put(std::vector<uint8_t> &image, uint64_t offset, std::initializer_list<uint8_t> bytes)
+	{
+		memcpy(image.data() + offset, bytes.begin(), bytes.size());
+	}
+
+	void PutInt32(std::vector<uint8_t> &image, uint64_t offset, int64_t value)
+	{
+		int32_t value32 = int32_t(value);
+		memcpy(image.data() + offset, &value32, sizeof(value32));
+	}
+
+	// Random bytes, with the code each descriptor looks for planted in it
+	std::vector<uint8_t> MakeImage(uint32_t seed)
+	{
+		std::vector<uint8_t> image(kImageSize);
+		uint32_t state = seed;
+		for (uint8_t &byte : image) {
+			state = state * 1664525u + 1013904223u;
+			byte = uint8_t(state >> 24);
+		}
+
+		Put(image, kFunctionOffset, { 0x40, 0x53, 0x48, 0x83, 0xEC, 0x20, 0x48, 0x8B, 0xD9, 0xE8, 0, 0, 0, 0, 0x84, 0xC0 });
+		Put(image, kCallSiteOffset - 3, { 0x48, 0x8B, 0xCB, 0xE8, 0, 0, 0, 0, 0x0F, 0x28, 0xC6, 0xF3, 0x0F, 0x11, 0x43, 0x54 });
+		PutInt32(image, kCallSiteOffset + 1, int64_t(kCalledOffset) - int64_t(kCallSiteOffset + 5));
+		Put(image, kLoadOffset, { 0xF3, 0x0F, 0x10, 0x05, 0, 0, 0, 0, 0xF3, 0x0F, 0x59, 0xC1, 0xF3, 0x0F, 0x11, 0x47 });
+		PutInt32(image, kLoadOffset + 4, int64_t(kDataOffset) - int64_t(kLoadOffset + 8));
+		return image;
+	}
+
+	Image GetImage(const std::vector<uint8_t> &bytes)
+	{
+		return Image{ bytes.data(), bytes.size(), kCodeOffset, kCodeSize, kHeaderSize };
+	}
+
+	void CheckOffsets(const uint64_t *offsets)
+	{
+		CHECK_EQ(offsets[0], kFunctionOffset);
+		CHECK_EQ(offsets[1], kCallSiteOffset);
+		CHECK_EQ(offsets[2], kCalledOffset);
+		CHECK_EQ(offsets[3], kDataOffset);
+	}
+}
+
+TEST(ScanningFindsEveryKindOfAddress)
+{
+	std::vector<uint8_t> bytes = MakeImage(1);
+	uint64_t offsets[kNumDescriptors];
+	CHECK(Resolve(GetImage(bytes), kDescriptors, kNumDescriptors, nullptr, offsets) == Result::Scanned);
+	CheckOffsets(offsets);
+}
+
+TEST(LaterStartupsUseTheCacheForTheSameExe)
+{
+	std::remove(kCachePath);
+	std::vector<uint8_t> bytes = MakeImage(2);
+	uint64_t offsets[kNumDescriptors];
+	CHECK(Resolve(GetImage(bytes), kDescriptors, kNumDescriptors, kCachePath, offsets) == Result::Scanned);
+	CheckOffsets(offsets);
+
+	// With the code gone, only the cache can have the addresses
+	memset(bytes.data() + kCodeOffset, 0xCC, kCodeSize);
+	memset(offsets, 0, sizeof(offsets));
+	CHECK(Resolve(GetImage(bytes), kDescriptors, kNumDescriptors, kCachePath, offsets) == Result::Cached);
+	CheckOffsets(offsets);
+
+	// A different build of the exe has different headers, and isn't given the cached addresses
+	bytes[kHeaderSize / 2] ^= 1;
+	CHECK(Resolve(GetImage(bytes), kDescriptors, kNumDescriptors, kCachePath, offsets) == Result::Failed);
+	std::remove(kCachePath);
+}
+
+TEST(AmbiguousSignaturesFailAndAreNotCached)
+{
+	std::remove(kCachePath);
+	std::vector<uint8_t> bytes = MakeImage(3);
+	// A second copy of the function
+	memcpy(bytes.data() + kFunctionOffset + 0x100000, bytes.data() + kFunctionOffset, 16);
+
+	uint64_t offsets[kNumDescriptors];
+	CHECK(Resolve(GetImage(bytes), kDescriptors, kNumDescriptors, kCachePath, offsets) == Result::Failed);
+	CHECK_EQ(offsets[0], uint64_t(0));
+	CHECK_EQ(offsets[2], kCalledOffset);
+
+	std::FILE *file = std::fopen(kCachePath, "r");
+	CHECK(file == nullptr);
+	if (file) std::fclose(file);
+}
+
+TEST(CallTargetsMustBeCallsInsideTheImage)
+{
+	std::vector<uint8_t> bytes = MakeImage(4);
+	Image image = GetImage(bytes);
+	CHECK_EQ(GetCallTarget(image, kCallSiteOffset), kCalledOffset);
+	CHECK_EQ(GetCallTarget(image, kCallSiteOffset + 1), uint64_t(0));
+	CHECK_EQ(GetCallTarget(image, 0), uint64_t(0));
+	CHECK_EQ(GetCallTarget(image, kImageSize - 2), uint64_t(0));
+
+	PutInt32(bytes, kCallSiteOffset + 1, 0x7FFFFFF0);
+	CHECK_EQ(GetCallTarget(image, kCallSiteOffset), uint64_t(0));
+}
+
+TEST(CacheFilesMustHaveEveryAddressForTheExe)
+{
+	const char *names[] = { "A", "B" };
+	const uint64_t saved[] = { 0x1234, 0xABCDEF };
+	CHECK(AddressCache::Save(kCachePath, 0x1122334455667788ull, names, saved, 2));
+
+	uint64_t loaded[2] = {};
+	CHECK(AddressCache::Load(kCachePath, 0x1122334455667788ull, names, loaded, 2));
+	CHECK_EQ(loaded[0], saved[0]);
+	CHECK_EQ(loaded[1], saved[1]);
+
+	CHECK(!AddressCache::Load(kCachePath, 0x1122334455667789ull, names, loaded, 2));
+	const char *moreNames[] = { "A", "B", "C" };
+	uint64_t more[3];
+	CHECK(!AddressCache::Load(kCachePath, 0x1122334455667788ull, moreNames, more, 3));
+	CHECK(!AddressCache::Load("does_not_exist.ini", 0x1122334455667788ull, names, loaded, 2));
+	std::remove(kCachePath);
+
+	const uint8_t header[] = { 'M', 'Z', 0x90, 0 };
+	uint8_t other[] = { 'M', 'Z', 0x90, 1 };
+	CHECK(AddressCache::HashImage(header, sizeof(header)) != AddressCache::HashImage(other, sizeof(other)));
+}
@@ -0,0 +1,105 @@
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "testing.h"
+#include "asynclog.h"
+
+
+namespace {
+	std::mutex g_linesMutex;
+	std::vector<std::string> g_lines;
+
+	void CollectingSink(AsyncLog::Level level, const char *line)
+	{
+		if (level == AsyncLog::Level::Warning) return;
+
+		std::lock_guard<std::mutex> lock(g_linesMutex);
+		g_lines.push_back(line);
+	}
+
+	// Everything logged so far, once the writer has got to it
+	std::vector<std::string> TakeLines(size_t numLines)
+	{
+		for (int i = 0; i < 5000; i++) {
+			{
+				std::lock_guard<std::mutex> lock(g_linesMutex);
+				if (g_lines.size() >= numLines) {
+					std::vector<std::string> lines;
+					lines.swap(g_lines);
+					return lines;
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		std::lock_guard<std::mutex> lock(g_linesMutex);
+		std::vector<std::string> lines;
+		lines.swap(g_lines);
+		return lines;
+	}
+
+	// Not from a static constructor: the log's own globals might not have been constructed yet
+	void StartOnce()
+	{
+		static bool isStarted = (AsyncLog::Start(CollectingSink), true);
+		(void)isStarted;
+	}
+}
+
+TEST(ArgumentsAreFormattedByTheWriter)
+{
+	StartOnce();
+	int value = 42;
+	AsyncLog::Message("int %d, unsigned %u, hex %04X, float %.2f, string %s, char %c, percent %%", -7, 7u, 0xAB, 1.005f * 2, "text", 'x');
+	AsyncLog::Message("long %lld, size %zu, padded [%5s] [%-5d]", 1234567890123ll, size_t(99), "ab", 3);
+	AsyncLog::Message("pointer %p, missing %d", (const void *)&value);
+
+	std::vector<std::string> lines = TakeLines(3);
+	CHECK_EQ(lines.size(), size_t(3));
+	if (lines.size() < 3) return;
+
+	CHECK_EQ(lines[0], std::string("int -7, unsigned 7, hex 00AB, float 2.01, string text, char x, percent %"));
+	CHECK_EQ(lines[1], std::string("long 1234567890123, size 99, padded [   ab] [3    ]"));
+	CHECK(lines[2].find("pointer ") == 0);
+	CHECK(lines[2].find(", missing ?") != std::string::npos);
+}
+
+TEST(StringsAreCopiedAndCutOff)
+{
+	StartOnce();
+	std::string text = "changes after the call";
+	const char *nullString = nullptr;
+	AsyncLog::Message("%s|%s", text.c_str(), nullString);
+	text = "something else entirely";
+
+	std::string longString(1000, 'a');
+	AsyncLog::Message("%s", longString.c_str());
+
+	std::vector<std::string> lines = TakeLines(2);
+	CHECK_EQ(lines.size(), size_t(2));
+	if (lines.size() < 2) return;
+
+	CHECK_EQ(lines[0], std::string("changes after the call|(null)"));
+	CHECK_EQ(lines[1], std::string(AsyncLog::kMaxStringLength, 'a'));
+}
+
+TEST(StringSlotsAreReusedOnceWritten)
+{
+	StartOnce();
+	// Many times more strings than there are slots, with the writer let catch up now and then the way frames would
+	int numDropped = 0;
+	for (int batch = 0; batch < 40; batch++) {
+		for (int i = 0; i < 32; i++) {
+			AsyncLog::Debug("%d %s %s", i, "first", "second");
+		}
+		std::vector<std::string> lines = TakeLines(32);
+		CHECK_EQ(lines.size(), size_t(32));
+		for (const std::string &line : lines) {
+			if (line.find("(dropped)") != std::string::npos) numDropped++;
+		}
+	}
+	CHECK_EQ(numDropped, 0);
+	CHECK_EQ(AsyncLog::GetNumDropped(), uint64_t(0));
+}
@@ -0,0 +1,273 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "testing.h"
+#include "attachmentmap.h"
+#include "particlescale.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	// Stands in for a particle modifier and the NiPSysData it updates
+	struct FakeModifier
+	{
+		std::vector<float> sizes;
+		std::vector<ParticleInfo> infos;
+	};
+
+	struct SharedScale
+	{
+		std::atomic<float> scale{ 1.f };
+		std::atomic<bool> scaleVelocity{ false };
+	};
+
+	struct Attachment
+	{
+		const FakeModifier *modifier = nullptr;
+		const SharedScale *sharedScale = nullptr;
+		ParticleScaler scaler;
+	};
+
+	typedef AttachmentMap<FakeModifier, Attachment, 16> Map;
+
+	SlotHandle Attach(Map &map, FakeModifier *modifier, const SharedScale *sharedScale = nullptr)
+	{
+		return map.Add(modifier, [&](Attachment &attachment) {
+			attachment.modifier = modifier;
+			attachment.sharedScale = sharedScale;
+			attachment.scaler.Reset();
+		});
+	}
+
+	// Same as the hooked Update() does after running the original
+	void ScaledUpdate(Map &map, FakeModifier &modifier)
+	{
+		Map::ReadScope scope(map);
+		if (Attachment *attachment = map.Find(&modifier)) {
+			float scale = attachment->sharedScale->scale.load(std::memory_order_relaxed);
+			bool scaleVelocity = attachment->sharedScale->scaleVelocity.load(std::memory_order_relaxed);
+			attachment->scaler.Apply(modifier.sizes.data(), modifier.infos.data(), int(modifier.sizes.size()), scale, scaleVelocity);
+		}
+	}
+}
+
+TEST(OnlyAttachedObjectsAreFound)
+{
+	Map map;
+	FakeModifier modifiers[3];
+	SlotHandle a = Attach(map, &modifiers[0]);
+	SlotHandle b = Attach(map, &modifiers[1]);
+	CHECK(a && b);
+	CHECK_EQ(map.GetNumAttached(), 2);
+
+	CHECK(map.Find(&modifiers[0]) == map.Get(a));
+	CHECK(map.Find(&modifiers[1]) == map.Get(b));
+	CHECK(map.Find(&modifiers[0])->modifier == &modifiers[0]);
+	CHECK(map.Find(&modifiers[2]) == nullptr);
+}
+
+TEST(RemovedItemsAreNotReusedStraightAway)
+{
+	Map map;
+	std::vector<FakeModifier> modifiers(Map::kFramesBeforeReuse + 16);
+	SlotHandle handle = Attach(map, &modifiers[0]);
+	Attachment *item = map.Get(handle);
+	map.Remove(handle, &modifiers[0]);
+	CHECK(map.Find(&modifiers[0]) == nullptr);
+	CHECK_EQ(map.GetNumAttached(), 0);
+
+	// Removing it again, or with the wrong key, does nothing
+	map.Remove(handle, &modifiers[0]);
+	map.Remove(handle, &modifiers[1]);
+	CHECK_EQ(map.GetNumAttached(), 0);
+
+	// Until enough frames have passed, whatever gets attached gets another slot
+	for (uint32_t frame = 0; frame < Map::kFramesBeforeReuse; frame++) {
+		CHECK(item->modifier == &modifiers[0]);
+		SlotHandle other = Attach(map, &modifiers[frame + 1]);
+		CHECK(map.Get(other) != item);
+		map.Remove(other, &modifiers[frame + 1]);
+		map.EndFrame();
+	}
+
+	// Now it's back in the pool
+	CHECK(map.Get(handle) == nullptr);
+	bool isReused = false;
+	for (int i = 0; i < 16; i++) {
+		isReused |= map.Get(Attach(map, &modifiers[Map::kFramesBeforeReuse + i])) == item;
+	}
+	CHECK(isReused);
+}
+
+TEST(NothingIsReusedWhileAReaderMightHoldIt)
+{
+	Map map;
+	std::vector<FakeModifier> modifiers(Map::kCapacity + 1);
+	SlotHandle handle = Attach(map, &modifiers[0]);
+	Attachment *item = map.Get(handle);
+	{
+		Map::ReadScope scope(map);
+		CHECK(map.Find(&modifiers[0]) == item);
+		map.Remove(handle, &modifiers[0]);
+
+		// However many frames go by, the removed item stays as it was found
+		for (int frame = 0; frame < 10; frame++) {
+			map.EndFrame();
+		}
+		for (int i = 1; i < Map::kCapacity; i++) {
+			CHECK(map.Get(Attach(map, &modifiers[i])) != item);
+		}
+		CHECK(!Attach(map, &modifiers[Map::kCapacity]));
+		CHECK(item->modifier == &modifiers[0]);
+	}
+
+	// Once the reader is gone it takes the usual number of frames
+	for (uint32_t frame = 0; frame < Map::kFramesBeforeReuse; frame++) {
+		map.EndFrame();
+	}
+	CHECK(map.Get(Attach(map, &modifiers[Map::kCapacity])) == item);
+}
+
+TEST(KeysCanBeAttachedAgain)
+{
+	Map map;
+	FakeModifier modifier;
+	for (int i = 0; i < 100; i++) {
+		SlotHandle handle = Attach(map, &modifier);
+		CHECK(map.Find(&modifier) == map.Get(handle));
+		map.Remove(handle, &modifier);
+		CHECK(map.Find(&modifier) == nullptr);
+		map.EndFrame();
+	}
+}
+
+TEST(TheTableIsRebuiltOnceFullOfRemovedKeys)
+{
+	// Far more distinct keys over time than the table has room for
+	Map map;
+	std::vector<FakeModifier> modifiers(1000);
+	std::vector<SlotHandle> handles(modifiers.size());
+	int numFailed = 0;
+	for (size_t i = 0; i < modifiers.size(); i++) {
+		handles[i] = Attach(map, &modifiers[i]);
+		if (!handles[i]) numFailed++;
+		// A few stay attached for a while
+		if (i >= 8) {
+			map.Remove(handles[i - 8], &modifiers[i - 8]);
+		}
+		map.EndFrame();
+
+		for (size_t j = i >= 7 ? i - 7 : 0; j <= i; j++) {
+			if (handles[j]) {
+				CHECK(map.Find(&modifiers[j]) == map.Get(handles[j]));
+			}
+		}
+	}
+	CHECK_EQ(numFailed, 0);
+}
+
+TEST(HeavyChurnNeverRunsOutOfRoom)
+{
+	// As many new keys each frame as the pool can take while the ones from the last frames wait to be released, so the table is rebuilt every few frames
+	Map map;
+	const int kPerFrame = Map::kCapacity / int(Map::kFramesBeforeReuse + 1);
+	std::vector<FakeModifier> modifiers(kPerFrame * 200);
+	int numFailed = 0;
+	for (size_t first = 0; first < modifiers.size(); first += kPerFrame) {
+		std::vector<SlotHandle> handles;
+		for (size_t i = first; i < first + kPerFrame; i++) {
+			handles.push_back(Attach(map, &modifiers[i]));
+			if (!handles.back()) numFailed++;
+		}
+		for (size_t i = first; i < first + kPerFrame; i++) {
+			CHECK(map.Find(&modifiers[i]) == map.Get(handles[i - first]));
+			map.Remove(handles[i - first], &modifiers[i]);
+		}
+		map.EndFrame();
+	}
+	CHECK_EQ(numFailed, 0);
+}
+
+TEST(AttachedModifiersScaleTheirParticles)
+{
+	Map map;
+	SharedScale sharedScale;
+	FakeModifier attached, other;
+	for (FakeModifier *modifier : { &attached, &other }) {
+		for (int i = 0; i < 5; i++) {
+			ParticleInfo info = {};
+			info.velocity = { 10.f, 0.f, float(i) };
+			info.lifeSpan = 1.f + 0.1f * float(i);
+			modifier->sizes.push_back(1.f + float(i));
+			modifier->infos.push_back(info);
+		}
+	}
+	SlotHandle handle = Attach(map, &attached, &sharedScale);
+
+	sharedScale.scale = 0.5f;
+	sharedScale.scaleVelocity = true;
+	ScaledUpdate(map, attached);
+	ScaledUpdate(map, other);
+	CHECK_NEAR(attached.sizes[4], 2.5f, 1e-6f);
+	CHECK_NEAR(attached.infos[4].velocity.x, 5.f, 1e-6f);
+	CHECK_NEAR(other.sizes[4], 5.f, 1e-6f);
+
+	// The next update applies the new scale to the unscaled sizes, not on top of the last one
+	sharedScale.scale = 0.25f;
+	ScaledUpdate(map, attached);
+	CHECK_NEAR(attached.sizes[4], 1.25f, 1e-6f);
+	CHECK_NEAR(attached.infos[4].velocity.x, 2.5f, 1e-6f);
+
+	// Detached modifiers are left as they were last scaled
+	map.Remove(handle, &attached);
+	ScaledUpdate(map, attached);
+	CHECK_NEAR(attached.sizes[4], 1.25f, 1e-6f);
+}
+
+TEST(FindIsSafeWhileAttaching)
+{
+	// A particle update thread looking modifiers up while the main thread attaches and detaches them, frame after frame.
+	// Whatever it finds has to be the item for that modifier, fully set up.
+	Map map;
+	std::vector<FakeModifier> modifiers(64);
+	std::atomic<bool> isDone{ false };
+	std::atomic<int> numMismatches{ 0 };
+
+	std::atomic<bool> isStarted{ false };
+	std::thread reader([&] {
+		isStarted = true;
+		while (!isDone.load()) {
+			for (FakeModifier &modifier : modifiers) {
+				Map::ReadScope scope(map);
+				if (Attachment *attachment = map.Find(&modifier)) {
+					if (attachment->modifier != &modifier) numMismatches++;
+				}
+			}
+		}
+	});
+
+	// Otherwise on a single core, the frames could all be over before the reader gets going
+	while (!isStarted.load()) {
+		std::this_thread::yield();
+	}
+	std::vector<SlotHandle> handles(modifiers.size());
+	for (int frame = 0; frame < 2000; frame++) {
+		for (int i = 0; i < 4; i++) {
+			size_t index = size_t(frame * 7 + i * 13) % modifiers.size();
+			if (handles[index]) {
+				map.Remove(handles[index], &modifiers[index]);
+				handles[index] = SlotHandle();
+			}
+			else {
+				handles[index] = Attach(map, &modifiers[index]);
+			}
+		}
+		map.EndFrame();
+	}
+	isDone = true;
+	reader.join();
+
+	CHECK_EQ(numMismatches.load(), 0);
+}
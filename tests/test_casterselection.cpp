@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <vector>
+
+#include "testing.h"
+#include "casterselection.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	std::vector<uint32_t> GetSelectedIds(const std::vector<CasterCandidate> &candidates, int numSelected)
+	{
+		std::vector<uint32_t> ids;
+		for (int i = 0; i < numSelected; i++) ids.push_back(candidates[i].id);
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+}
+
+TEST(EveryoneIsSelectedWhenThereIsRoom)
+{
+	std::vector<CasterCandidate> candidates = { { 1, 900.f, false }, { 2, 100.f, false }, { 3, 400.f, true } };
+	CHECK_EQ(SelectNearestCasters(candidates.data(), int(candidates.size()), 3), 3);
+	CHECK_EQ(SelectNearestCasters(candidates.data(), int(candidates.size()), 16), 3);
+	CHECK_EQ(SelectNearestCasters(candidates.data(), int(candidates.size()), 0), 0);
+	CHECK_EQ(SelectNearestCasters(candidates.data(), 0, 16), 0);
+}
+
+TEST(TheClosestAreSelected)
+{
+	std::vector<CasterCandidate> candidates;
+	for (uint32_t i = 0; i < 200; i++) {
+		// Far ones first, so that taking the first few would be wrong
+		candidates.push_back({ i, float((200 - i) * (200 - i)), false });
+	}
+	int numSelected = SelectNearestCasters(candidates.data(), int(candidates.size()), 16);
+	CHECK_EQ(numSelected, 16);
+
+	std::vector<uint32_t> ids = GetSelectedIds(candidates, numSelected);
+	for (int i = 0; i < 16; i++) {
+		CHECK_EQ(ids[i], uint32_t(184 + i));
+	}
+}
+
+TEST(TrackedCastersKeepTheirPlaceAgainstSlightlyCloserOnes)
+{
+	// 1 is being looked after and 2 is a little closer, so 1 stays
+	std::vector<CasterCandidate> candidates = { { 1, 1000.f * 1000.f, true }, { 2, 950.f * 950.f, false }, { 3, 5000.f * 5000.f, false } };
+	CHECK_EQ(SelectNearestCasters(candidates.data(), int(candidates.size()), 1), 1);
+	CHECK_EQ(candidates[0].id, 1u);
+
+	// But not against one much closer
+	candidates = { { 1, 1000.f * 1000.f, true }, { 2, 500.f * 500.f, false }, { 3, 5000.f * 5000.f, false } };
+	CHECK_EQ(SelectNearestCasters(candidates.data(), int(candidates.size()), 1), 1);
+	CHECK_EQ(candidates[0].id, 2u);
+}
@@ -0,0 +1,97 @@
+#include <cstring>
+
+#include "testing.h"
+#include "config.h"
+
+
+TEST(IniParsingFollowsGetPrivateProfileString)
+{
+	Ini::File file;
+	file.Parse(
+		"; comment\n"
+		"[Settings]\n"
+		"  spellMergeTime = 0.25 ; trailing comment\r\n"
+		"Quoted = \"a b\"\n"
+		"spellMergeTime = 0.5\n"
+		"[other]\n"
+		"key=value\n"
+		"#key = hash\n");
+
+	const Ini::Entry *entry = file.Find("settings", "SPELLMERGETIME");
+	CHECK(entry != nullptr);
+	if (entry) {
+		// Duplicates resolve to the last one
+		CHECK(strcmp(entry->value, "0.5") == 0);
+		CHECK_EQ(entry->line, 5);
+	}
+
+	entry = file.Find("Settings", "quoted");
+	CHECK(entry && strcmp(entry->value, "a b") == 0);
+	CHECK(file.Find("Settings", "key") == nullptr);
+	CHECK(file.Find("Other", "Key") != nullptr);
+	entry = file.Find("other", "#KEY");
+	CHECK(entry && strcmp(entry->value, "hash") == 0);
+}
+
+TEST(IniNumbersParseLikeStof)
+{
+	float f;
+	CHECK(Ini::ParseFloat("1.5 ; comment", f));
+	CHECK_NEAR(f, 1.5f, 0.f);
+	CHECK(!Ini::ParseFloat("abc", f));
+
+	int i;
+	CHECK(Ini::ParseInt("-12", i));
+	CHECK_EQ(i, -12);
+	CHECK(!Ini::ParseInt("", i));
+
+	bool b;
+	CHECK(Ini::ParseBool("1", b) && b);
+	CHECK(Ini::ParseBool("0", b) && !b);
+	CHECK(!Ini::ParseBool("2", b));
+}
+
+TEST(ConfigOptionsAreReadThroughTheDescriptorTable)
+{
+	Ini::File file;
+	file.Parse(
+		"[Settings]\n"
+		"spellMergeTime = 0.3\n"
+		"numSmoothingFramesMaster = 12\n"
+		"useTimeBasedSmoothing = 1\n"
+		"MaxNpcCasters = 4\n");
+
+	Config::Options options;
+	CHECK(Config::ReadConfigOptions(file, options));
+	CHECK_NEAR(options.spellMergeTime, 0.3f, 1e-7f);
+	CHECK_EQ(options.numSmoothingFramesMaster, 12);
+	CHECK(options.useTimeBasedSmoothing);
+	CHECK_EQ(options.maxNpcCasters, 4);
+}
+
+TEST(MissingConfigKeysKeepTheirDefaults)
+{
+	Ini::File file;
+	file.Parse("[Settings]\nspellUnMergeTime = 0.2\n");
+
+	Config::Options options;
+	// Not a failure - an INI from an older version just doesn't have the newer keys
+	CHECK(Config::ReadConfigOptions(file, options));
+	CHECK_NEAR(options.spellUnMergeTime, 0.2f, 1e-7f);
+	CHECK_NEAR(options.spellMergeTime, Config::Options().spellMergeTime, 0.f);
+}
+
+TEST(MalformedConfigValuesFailButTheRestIsRead)
+{
+	Ini::File file;
+	file.Parse(
+		"[Settings]\n"
+		"spellMergeTime = fast\n"
+		"spellUnMergeTime = 0.2\n"
+		"SomethingElse = 1\n");
+
+	Config::Options options;
+	CHECK(!Config::ReadConfigOptions(file, options));
+	CHECK_NEAR(options.spellMergeTime, Config::Options().spellMergeTime, 0.f);
+	CHECK_NEAR(options.spellUnMergeTime, 0.2f, 1e-7f);
+}
@@ -0,0 +1,147 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "testing.h"
+#include "configsnapshot.h"
+
+
+namespace {
+	// Options where every field that's checked comes from one number, so a reader can tell whether what it sees was ever published as a whole
+	Config::Options MakeOptions(int value)
+	{
+		Config::Options options;
+		options.magicRotationRoll = float(value);
+		options.magicRotationYaw = float(-value);
+		options.spellMergeTime = float(value) * 0.5f;
+		options.maxNpcCasters = value;
+		options.numSmoothingFramesMaster = value % 500;
+		return options;
+	}
+
+	bool IsConsistent(const Config::Options &options)
+	{
+		int value = options.maxNpcCasters;
+		return options.magicRotationRoll == float(value) && options.magicRotationYaw == float(-value) && options.spellMergeTime == float(value) * 0.5f &&
+			options.numSmoothingFramesMaster == value % 500;
+	}
+}
+
+TEST(SnapshotSeesWhatWasPublished)
+{
+	Config::Publish(MakeOptions(7));
+	{
+		Config::Snapshot snapshot;
+		CHECK(IsConsistent(*snapshot));
+		CHECK_EQ(snapshot->maxNpcCasters, 7);
+
+		uint32_t generation = snapshot.GetGeneration();
+		Config::Snapshot other;
+		CHECK_EQ(other.GetGeneration(), generation);
+	}
+
+	uint32_t generation;
+	{
+		Config::Snapshot snapshot;
+		generation = snapshot.GetGeneration();
+	}
+	Config::Publish(MakeOptions(8));
+	Config::Snapshot snapshot;
+	CHECK_EQ(snapshot->maxNpcCasters, 8);
+	CHECK(snapshot.GetGeneration() != generation);
+}
+
+TEST(ReadersHammeringWhileTheConfigReloads)
+{
+	// Readers hold each snapshot for a little while and check it's whole and never goes back in time, while the publisher frees the old ones
+	// as fast as it can. A snapshot freed too early would most likely show up as an inconsistent or stale read here (and as a use-after-free under ASan).
+	const int kNumReaders = 4;
+	const int kNumPublishes = 100;
+
+	std::atomic<int> numStarted{ 0 };
+	std::atomic<bool> isDone{ false };
+	std::atomic<int> numFailures{ 0 };
+	std::atomic<uint64_t> numReads{ 0 };
+
+	std::vector<std::thread> readers;
+	for (int r = 0; r < kNumReaders; r++) {
+		readers.emplace_back([&]() {
+			uint32_t lastGeneration = 0;
+			int lastValue = 0;
+			uint64_t reads = 0;
+			numStarted.fetch_add(1);
+			while (!isDone.load(std::memory_order_relaxed)) {
+				Config::Snapshot snapshot;
+				int value = snapshot->maxNpcCasters;
+				bool isOk = IsConsistent(*snapshot) && snapshot.GetGeneration() >= lastGeneration && value >= lastValue;
+				// Still the same after a while
+				for (int i = 0; i < 50; i++) {
+					isOk = isOk && IsConsistent(*snapshot) && snapshot->maxNpcCasters == value;
+				}
+				if (!isOk) numFailures.fetch_add(1, std::memory_order_relaxed);
+
+				lastGeneration = snapshot.GetGeneration();
+				lastValue = value;
+				reads++;
+			}
+			numReads.fetch_add(reads, std::memory_order_relaxed);
+		});
+	}
+
+	// Otherwise on a single core, the publishes could all be over before any reader gets going
+	while (numStarted.load() != kNumReaders) {
+		std::this_thread::yield();
+	}
+	for (int i = 1; i <= kNumPublishes; i++) {
+		Config::Publish(MakeOptions(1000 + i));
+	}
+	isDone.store(true, std::memory_order_relaxed);
+	for (std::thread &reader : readers) {
+		reader.join();
+	}
+
+	CHECK_EQ(numFailures.load(), 0);
+	CHECK(numReads.load() > 0);
+
+	Config::Snapshot snapshot;
+	CHECK_EQ(snapshot->maxNpcCasters, 1000 + kNumPublishes);
+}
+
+TEST(PublishersTakeTurns)
+{
+	// Reload from the file watcher and from an explicit trigger at the same time
+	const int kNumPublishers = 3;
+	const int kNumPublishes = 50;
+
+	std::atomic<bool> isStarted{ false };
+	std::atomic<bool> isDone{ false };
+	std::atomic<int> numFailures{ 0 };
+	std::thread reader([&]() {
+		isStarted.store(true);
+		while (!isDone.load(std::memory_order_relaxed)) {
+			Config::Snapshot snapshot;
+			if (!IsConsistent(*snapshot)) numFailures.fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+
+	while (!isStarted.load()) {
+		std::this_thread::yield();
+	}
+	std::vector<std::thread> publishers;
+	for (int p = 0; p < kNumPublishers; p++) {
+		publishers.emplace_back([p]() {
+			for (int i = 0; i < kNumPublishes; i++) {
+				Config::Publish(MakeOptions(p * 10000 + i));
+			}
+		});
+	}
+	for (std::thread &publisher : publishers) {
+		publisher.join();
+	}
+	isDone.store(true, std::memory_order_relaxed);
+	reader.join();
+
+	CHECK_EQ(numFailures.load(), 0);
+	Config::Snapshot snapshot;
+	CHECK(IsConsistent(*snapshot));
+}
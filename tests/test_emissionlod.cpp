@@ -0,0 +1,98 @@
+#include <cmath>
+
+#include "testing.h"
+#include "emissionlod.h"
+
+using namespace MagicCore;
+
+
+TEST(EmissionFollowsTheCurveBelowFullScale)
+{
+	Config::Options options;
+	options.emissionLodExponent = 2.f;
+	options.minEmissionScale = 0.1f;
+
+	CHECK_NEAR(GetEmissionScale(options, 0.5f), 0.25f, 1e-6f);
+	CHECK_NEAR(GetEmissionScale(options, 0.8f), 0.64f, 1e-6f);
+	// Floored at the minimum
+	CHECK_NEAR(GetEmissionScale(options, 0.2f), 0.1f, 1e-6f);
+	CHECK_NEAR(GetEmissionScale(options, 0.f), 0.1f, 1e-6f);
+	CHECK_NEAR(GetEmissionScale(options, -1.f), 0.1f, 1e-6f);
+
+	options.emissionLodExponent = 1.f;
+	CHECK_NEAR(GetEmissionScale(options, 0.35f), 0.35f, 1e-6f);
+}
+
+TEST(EmissionIsNeverTurnedUp)
+{
+	Config::Options options;
+	options.emissionLodExponent = 0.5f;
+	CHECK_NEAR(GetEmissionScale(options, 1.f), 1.f, 0.f);
+	// Dual casting makes effects bigger, but they keep their usual rate
+	CHECK_NEAR(GetEmissionScale(options, 2.f), 1.f, 0.f);
+
+	// A minimum above 1 doesn't turn it up either
+	options.minEmissionScale = 3.f;
+	CHECK_NEAR(GetEmissionScale(options, 0.5f), 1.f, 0.f);
+}
+
+TEST(BudgetOnlyKicksInOverTheLimit)
+{
+	EmissionBudget budget;
+	budget.AddParticleSystem(300, 1.f);
+	budget.AddParticleSystem(200, 1.f);
+	budget.BeginFrame(1000);
+	CHECK_NEAR(budget.GetBudgetScale(), 1.f, 0.f);
+
+	budget.AddParticleSystem(1500, 1.f);
+	budget.AddParticleSystem(500, 1.f);
+	budget.BeginFrame(1000);
+	CHECK_NEAR(budget.GetBudgetScale(), 0.5f, 1e-6f);
+
+	// 0 means no budget
+	budget.AddParticleSystem(100000, 1.f);
+	budget.BeginFrame(0);
+	CHECK_NEAR(budget.GetBudgetScale(), 1.f, 0.f);
+}
+
+TEST(BudgetSettlesInsteadOfOscillating)
+{
+	// Two effects that would have 1500 particles each at their full rate, and whose particle counts follow whatever rate they were last given
+	const float kFullParticles[2] = { 1500.f, 1500.f };
+	const int kBudget = 1000;
+	float emissionScales[2] = { 1.f, 1.f };
+
+	EmissionBudget budget;
+	float lastBudgetScale = -1.f;
+	for (int frame = 0; frame < 20; frame++) {
+		for (int i = 0; i < 2; i++) {
+			budget.AddParticleSystem(int(kFullParticles[i] * emissionScales[i]), emissionScales[i]);
+		}
+		budget.BeginFrame(kBudget);
+		for (int i = 0; i < 2; i++) {
+			emissionScales[i] = budget.GetBudgetScale();
+		}
+
+		if (frame > 0) {
+			// Counting what the particles would have been without any reduction keeps the scale from bouncing around
+			CHECK_NEAR(budget.GetBudgetScale(), lastBudgetScale, 1e-3f);
+		}
+		lastBudgetScale = budget.GetBudgetScale();
+	}
+	CHECK_NEAR(lastBudgetScale, 1000.f / 3000.f, 1e-3f);
+	CHECK_NEAR(budget.GetParticlesSavedLastFrame(), 2000.f, 2.f);
+}
+
+TEST(ParticlesSavedComeFromTheReducedEffects)
+{
+	EmissionBudget budget;
+	// Emitting at a quarter of the rate, so there would have been 4 times as many
+	budget.AddParticleSystem(100, 0.25f);
+	budget.AddParticleSystem(50, 1.f);
+	budget.BeginFrame(0);
+	CHECK_NEAR(budget.GetParticlesSavedLastFrame(), 300.f, 1e-3f);
+
+	// And nothing was saved the frame after, when nothing was added
+	budget.BeginFrame(0);
+	CHECK_NEAR(budget.GetParticlesSavedLastFrame(), 0.f, 0.f);
+}
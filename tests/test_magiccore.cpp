@@ -0,0 +1,239 @@
+#include <cmath>
+#include <initializer_list>
+
+#include "testing.h"
+#include "magiccore.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	// Rotation about z whose forward (+y) column points angle radians left of +y
+	Mat33 AimRotation(float angle)
+	{
+		Mat33 rot;
+		rot.data[0][0] = cosf(angle); rot.data[0][1] = -sinf(angle);
+		rot.data[1][0] = sinf(angle); rot.data[1][1] = cosf(angle);
+		return rot;
+	}
+
+	// Two hands 20 apart with a one-handed spell in each and a dual caster, as for a regular dual cast
+	Inputs MakeDualCastInputs(bool isCastingDual)
+	{
+		Inputs inputs;
+		inputs.primaryOffsetWorld.pos = { 10.f, 0.f, 0.f };
+		inputs.secondaryOffsetWorld.pos = { -10.f, 0.f, 0.f };
+		inputs.primaryOffsetLocal = inputs.primaryOffsetWorld;
+		inputs.secondaryOffsetLocal = inputs.secondaryOffsetWorld;
+		inputs.primarySpell.isValid = true;
+		inputs.secondarySpell.isValid = true;
+		inputs.hasDualCaster = true;
+		inputs.isCastingDual = isCastingDual;
+		return inputs;
+	}
+
+	const float kDeltaTime = 1.f / 90.f;
+}
+
+TEST(DualCastMergesHandsToTheMidpoint)
+{
+	Config::Options options;
+	Caster caster;
+	Inputs inputs = MakeDualCastInputs(true);
+
+	Outputs outputs = caster.Step(options, inputs, kDeltaTime);
+	CHECK(caster.GetDualCastState() == DualCastState::Cast);
+	CHECK(caster.GetMergeState() == HandMergeState::Merging);
+	CHECK(outputs.hasOffsetWorldTransforms);
+	// Part of the way there after one frame
+	CHECK(outputs.primaryOffsetWorld.pos.x < 10.f && outputs.primaryOffsetWorld.pos.x > 0.f);
+
+	int numFrames = int(options.spellMergeTime / kDeltaTime) + 2;
+	for (int i = 0; i < numFrames; i++) {
+		outputs = caster.Step(options, inputs, kDeltaTime);
+	}
+	CHECK(caster.GetMergeState() == HandMergeState::Merged);
+	CHECK_NEAR(outputs.primaryOffsetWorld.pos.x, 0.f, 1e-5f);
+	CHECK_NEAR(outputs.secondaryOffsetWorld.pos.x, 0.f, 1e-5f);
+}
+
+TEST(UnmergingRestoresTheLocalTransforms)
+{
+	Config::Options options;
+	Caster caster;
+	Inputs inputs = MakeDualCastInputs(true);
+	for (int i = 0; i < 30; i++) {
+		caster.Step(options, inputs, kDeltaTime);
+	}
+
+	inputs.isCastingDual = false;
+	Outputs outputs = caster.Step(options, inputs, kDeltaTime);
+	CHECK(caster.GetDualCastState() == DualCastState::Idle);
+	CHECK(caster.GetMergeState() == HandMergeState::Unmerging);
+	CHECK(!caster.IsIdle());
+
+	int numFrames = 0;
+	while (!outputs.hasOffsetLocalTransforms && numFrames++ < 100) {
+		outputs = caster.Step(options, inputs, kDeltaTime);
+	}
+	CHECK(outputs.hasOffsetLocalTransforms);
+	CHECK_EQ(numFrames, int(ceilf(options.spellUnMergeTime / kDeltaTime)) - 1);
+	CHECK_NEAR(outputs.primaryOffsetLocal.pos.x, 10.f, 1e-6f);
+	CHECK_NEAR(outputs.secondaryOffsetLocal.pos.x, -10.f, 1e-6f);
+	CHECK(caster.IsIdle());
+}
+
+TEST(MergersGiveBackTheLocalTransformsTheyMovedAwayFrom)
+{
+	Config::Options options;
+	DualCastMerger merger;
+	Transform primaryLocal, secondaryLocal;
+	CHECK(!merger.GetUnmergedLocalTransforms(primaryLocal, secondaryLocal));
+
+	Inputs inputs = MakeDualCastInputs(true);
+	for (int i = 0; i < 5; i++) {
+		merger.Step(options, inputs, kDeltaTime);
+	}
+	CHECK(merger.GetMergeState() == HandMergeState::Merging);
+	CHECK(merger.GetUnmergedLocalTransforms(primaryLocal, secondaryLocal));
+	CHECK_NEAR(primaryLocal.pos.x, 10.f, 1e-6f);
+	CHECK_NEAR(secondaryLocal.pos.x, -10.f, 1e-6f);
+
+	// Nothing to give back once it has put them back itself
+	inputs.isCastingDual = false;
+	for (int i = 0; i < 100 && !merger.IsIdle(); i++) {
+		merger.Step(options, inputs, kDeltaTime);
+	}
+	CHECK(merger.IsIdle());
+	CHECK(!merger.GetUnmergedLocalTransforms(primaryLocal, secondaryLocal));
+}
+
+TEST(SpellOverridesReplaceTheMergeTime)
+{
+	Config::Options options;
+	Inputs inputs = MakeDualCastInputs(true);
+	inputs.primarySpell.overrides.fields = Config::SpellOverrides::kSpellMergeTime;
+	inputs.primarySpell.overrides.spellMergeTime = 0.5f;
+
+	DualCastMerger merger;
+	int numFrames = 0;
+	while (merger.GetMergeState() != HandMergeState::Merged && numFrames < 1000) {
+		merger.Step(options, inputs, kDeltaTime);
+		numFrames++;
+	}
+	// Much longer than the default 0.15 seconds
+	CHECK(numFrames >= int(0.5f / kDeltaTime));
+	CHECK(numFrames <= int(0.5f / kDeltaTime) + 2);
+}
+
+TEST(SpellScaleFollowsMagicka)
+{
+	Config::Options options;
+	DualCastMerger merger;
+	SpellParams spell;
+	spell.isValid = true;
+
+	CHECK_NEAR(merger.GetSpellScale(options, spell, 0.f), options.spellScaleWhenMagickaEmpty, 1e-6f);
+	CHECK_NEAR(merger.GetSpellScale(options, spell, 1.f), options.spellScaleWhenMagickaFull, 1e-6f);
+	CHECK_NEAR(merger.GetSpellScale(options, spell, 0.5f), 0.5f * (options.spellScaleWhenMagickaEmpty + options.spellScaleWhenMagickaFull), 1e-6f);
+
+	spell.overrides.fields = Config::SpellOverrides::kSpellScaleWhenMagickaFull;
+	spell.overrides.spellScaleWhenMagickaFull = 3.f;
+	CHECK_NEAR(merger.GetSpellScale(options, spell, 1.f), 3.f, 1e-6f);
+}
+
+TEST(DualCastScaleGrowsWithHandSeparation)
+{
+	Config::Options options;
+	SpellParams spell;
+	spell.isValid = true;
+
+	DualCastMerger close;
+	Inputs inputs = MakeDualCastInputs(true);
+	inputs.primaryOffsetWorld.pos.x = 0.f;
+	inputs.secondaryOffsetWorld.pos.x = 0.f;
+	close.Step(options, inputs, kDeltaTime);
+	CHECK_NEAR(close.GetDualCastScale(), options.dualCastHandsCloseSpellScale, 1e-6f);
+
+	DualCastMerger far;
+	inputs.primaryOffsetWorld.pos.x = 500.f;
+	far.Step(options, inputs, kDeltaTime);
+	CHECK_NEAR(far.GetDualCastScale(), options.dualCastHandsFarSpellScale, 1e-6f);
+	CHECK_NEAR(far.GetSpellScale(options, spell, 1.f), options.dualCastHandsFarSpellScale * options.spellScaleWhenMagickaFull, 1e-6f);
+}
+
+TEST(SmoothingFramesFollowTheFrameRate)
+{
+	Config::Options options;
+	SpellParams spell;
+	spell.skillLevel = SpellSkillLevel::Master;
+
+	CHECK_EQ(GetNumSmoothingFrames(options, spell, false, 0.011f), options.numSmoothingFramesMaster);
+	CHECK_EQ(GetNumSmoothingFrames(options, spell, false, 0.022f), options.numSmoothingFramesMaster / 2);
+	CHECK_EQ(GetNumSmoothingFrames(options, spell, true, 0.011f), int(roundf(options.numSmoothingFramesMaster * options.smoothingDualCastMultiplier)));
+
+	spell.overrides.fields = Config::SpellOverrides::kNumSmoothingFrames;
+	spell.overrides.numSmoothingFrames = 4;
+	CHECK_EQ(GetNumSmoothingFrames(options, spell, false, 0.011f), 4);
+}
+
+TEST(SmoothedAimSettlesOnASteadyAim)
+{
+	for (bool useTimeBasedSmoothing : { false, true }) {
+		Config::Options options;
+		options.useTimeBasedSmoothing = useTimeBasedSmoothing;
+		Caster caster;
+		Inputs inputs = MakeDualCastInputs(false);
+		inputs.primaryAimWorld.rot = AimRotation(0.3f);
+		inputs.secondaryAimWorld.rot = AimRotation(-0.2f);
+
+		Outputs outputs;
+		for (int i = 0; i < 200; i++) {
+			outputs = caster.Step(options, inputs, kDeltaTime);
+		}
+		CHECK(outputs.hasPrimaryAimForward);
+		CHECK(outputs.hasSecondaryAimForward);
+		CHECK_NEAR(outputs.primaryAimForward.x, -sinf(0.3f), 1e-4f);
+		CHECK_NEAR(outputs.primaryAimForward.y, cosf(0.3f), 1e-4f);
+		CHECK_NEAR(outputs.secondaryAimForward.x, sinf(0.2f), 1e-4f);
+	}
+}
+
+TEST(SmoothedAimLagsBehindATurn)
+{
+	Config::Options options;
+	Caster caster;
+	Inputs inputs = MakeDualCastInputs(false);
+	for (int i = 0; i < 100; i++) {
+		caster.Step(options, inputs, kDeltaTime);
+	}
+
+	// Snap the aim 90 degrees. The window still mostly holds the old direction for a few frames.
+	inputs.primaryAimWorld.rot = AimRotation(1.5707964f);
+	Outputs outputs = caster.Step(options, inputs, kDeltaTime);
+	float angle = atan2f(-outputs.primaryAimForward.x, outputs.primaryAimForward.y);
+	CHECK(angle > 0.f && angle < 0.5f);
+
+	for (int i = 0; i < options.numSmoothingFramesNovice; i++) {
+		outputs = caster.Step(options, inputs, kDeltaTime);
+	}
+	angle = atan2f(-outputs.primaryAimForward.x, outputs.primaryAimForward.y);
+	CHECK_NEAR(angle, 1.5707964f, 1e-3f);
+}
+
+TEST(ResetSmoothingForgetsTheOldAim)
+{
+	Config::Options options;
+	Caster caster;
+	Inputs inputs = MakeDualCastInputs(false);
+	for (int i = 0; i < 100; i++) {
+		caster.Step(options, inputs, kDeltaTime);
+	}
+
+	caster.ResetSmoothing();
+	inputs.primaryAimWorld.rot = AimRotation(1.f);
+	Outputs outputs = caster.Step(options, inputs, kDeltaTime);
+	// Only the new direction is in the history now, so there is nothing to lag behind
+	CHECK_NEAR(outputs.primaryAimForward.x, -sinf(1.f), 1e-5f);
+	CHECK_NEAR(outputs.primaryAimForward.y, cosf(1.f), 1e-5f);
+}
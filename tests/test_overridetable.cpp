@@ -0,0 +1,91 @@
+#include <initializer_list>
+
+#include "testing.h"
+#include "overridetable.h"
+
+using namespace Config;
+
+
+TEST(FindsOnlyWhatWasAdded)
+{
+	SpellOverrideTable table;
+	for (uint32_t formId : { 0x0001C789u, 0x00012FCDu, 0x05000D62u, 0xFE001802u }) {
+		SpellOverrides &overrides = table.Add(formId);
+		overrides.fields = SpellOverrides::kSpellMergeTime;
+		overrides.spellMergeTime = float(formId & 0xFF);
+	}
+	table.Build();
+
+	CHECK_EQ(table.GetNumEntries(), 4);
+	for (uint32_t formId : { 0x0001C789u, 0x00012FCDu, 0x05000D62u, 0xFE001802u }) {
+		const SpellOverrides *overrides = table.Find(formId);
+		CHECK(overrides != nullptr);
+		if (overrides) CHECK_EQ(overrides->spellMergeTime, float(formId & 0xFF));
+	}
+	for (uint32_t formId : { 0u, 0x00012FCCu, 0x00012FCEu, 0x05000D61u, 0xFFFFFFFFu }) {
+		CHECK(table.Find(formId) == nullptr);
+	}
+}
+
+TEST(AnEmptyTableFindsNothing)
+{
+	SpellOverrideTable table;
+	table.Build();
+	CHECK_EQ(table.GetNumEntries(), 0);
+	CHECK(table.Find(0x00012FCD) == nullptr);
+}
+
+TEST(SectionsForTheSameFormMergeWithLaterFieldsWinning)
+{
+	SpellOverrideTable table;
+	{
+		SpellOverrides &first = table.Add(0x00012FCD);
+		first.fields = SpellOverrides::kSpellMergeTime | SpellOverrides::kNumSmoothingFrames;
+		first.spellMergeTime = 0.5f;
+		first.numSmoothingFrames = 20;
+	}
+	table.Add(0x0001C789).fields = SpellOverrides::kSmoothingTime;
+	{
+		SpellOverrides &second = table.Add(0x00012FCD);
+		second.fields = SpellOverrides::kNumSmoothingFrames | SpellOverrides::kDualCastHandsFarSpellScale;
+		second.numSmoothingFrames = 5;
+		second.dualCastHandsFarSpellScale = 3.f;
+	}
+	table.Build();
+
+	CHECK_EQ(table.GetNumEntries(), 2);
+	const SpellOverrides *merged = table.Find(0x00012FCD);
+	CHECK(merged != nullptr);
+	if (!merged) return;
+	CHECK(merged->Has(SpellOverrides::kSpellMergeTime));
+	CHECK(merged->Has(SpellOverrides::kNumSmoothingFrames));
+	CHECK(merged->Has(SpellOverrides::kDualCastHandsFarSpellScale));
+	CHECK(!merged->Has(SpellOverrides::kSmoothingTime));
+	CHECK_EQ(merged->spellMergeTime, 0.5f);
+	CHECK_EQ(merged->numSmoothingFrames, 5);
+	CHECK_EQ(merged->dualCastHandsFarSpellScale, 3.f);
+}
+
+TEST(ThousandsOfEntries)
+{
+	SpellOverrideTable table;
+	const uint32_t kNumEntries = 5000;
+	// Added out of order, every form twice
+	for (uint32_t i = 0; i < kNumEntries * 2; i++) {
+		uint32_t index = (i * 7919) % kNumEntries;
+		SpellOverrides &overrides = table.Add(index * 3 + 1);
+		overrides.fields = SpellOverrides::kNumSmoothingFrames;
+		overrides.numSmoothingFrames = int(i);
+	}
+	table.Build();
+
+	CHECK_EQ(table.GetNumEntries(), int(kNumEntries));
+	for (uint32_t index = 0; index < kNumEntries; index++) {
+		const SpellOverrides *overrides = table.Find(index * 3 + 1);
+		CHECK(overrides != nullptr);
+		// From the second time the form was added
+		if (overrides) CHECK(overrides->numSmoothingFrames >= int(kNumEntries));
+		CHECK(table.Find(index * 3) == nullptr);
+		CHECK(table.Find(index * 3 + 2) == nullptr);
+	}
+}
@@ -0,0 +1,243 @@
+#include <cstdlib>
+#include <initializer_list>
+#include <vector>
+
+#include "testing.h"
+#include "particlescale.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	float RandomFloat(float min, float max)
+	{
+		return min + (max - min) * float(rand()) / float(RAND_MAX);
+	}
+
+	// The arrays of a particle system, updated the way the engine does it: dead particles are replaced by the last one, new ones go on the end.
+	// Also keeps what every particle's size and velocity would be without any scaling, to check against.
+	struct FakeParticles
+	{
+		std::vector<float> sizes;
+		std::vector<ParticleInfo> infos;
+		std::vector<float> unscaledSizes;
+		std::vector<Vec3> unscaledVelocities;
+
+		int GetCount() const { return int(sizes.size()); }
+
+		void Spawn(float lifeSpan)
+		{
+			ParticleInfo info = {};
+			info.velocity = { RandomFloat(-50.f, 50.f), RandomFloat(-50.f, 50.f), RandomFloat(0.f, 100.f) };
+			info.lifeSpan = lifeSpan;
+			sizes.push_back(RandomFloat(0.5f, 2.f));
+			infos.push_back(info);
+			unscaledSizes.push_back(sizes.back());
+			unscaledVelocities.push_back(info.velocity);
+		}
+
+		void Kill(int i)
+		{
+			sizes[i] = sizes.back();
+			infos[i] = infos.back();
+			unscaledSizes[i] = unscaledSizes.back();
+			unscaledVelocities[i] = unscaledVelocities.back();
+			sizes.pop_back();
+			infos.pop_back();
+			unscaledSizes.pop_back();
+			unscaledVelocities.pop_back();
+		}
+
+		// Ages everything and pulls it down with gravity. What gravity adds doesn't depend on the scale, so it adds the same to the unscaled velocity.
+		void Update(float deltaTime)
+		{
+			for (int i = 0; i < GetCount(); i++) {
+				infos[i].age += deltaTime;
+				infos[i].lastUpdate += deltaTime;
+				infos[i].velocity.z -= 980.f * deltaTime;
+				unscaledVelocities[i].z -= 980.f * deltaTime;
+			}
+		}
+
+		// Like a size-over-life modifier, which writes sizes from scratch
+		void SetSize(int i, float size)
+		{
+			sizes[i] = unscaledSizes[i] = size;
+		}
+
+		void Apply(ParticleScaler &scaler, float scale, bool scaleVelocity)
+		{
+			scaler.Apply(sizes.data(), infos.data(), GetCount(), scale, scaleVelocity);
+		}
+
+		void CheckScaled(float scale, bool isVelocityScaled) const
+		{
+			for (int i = 0; i < GetCount(); i++) {
+				CHECK_NEAR(sizes[i], unscaledSizes[i] * scale, 1e-5f);
+				float velocityScale = isVelocityScaled ? scale : 1.f;
+				CHECK_NEAR(infos[i].velocity.x, unscaledVelocities[i].x * velocityScale, 1e-2f);
+				CHECK_NEAR(infos[i].velocity.y, unscaledVelocities[i].y * velocityScale, 1e-2f);
+				CHECK_NEAR(infos[i].velocity.z, unscaledVelocities[i].z * velocityScale, 1e-2f);
+			}
+		}
+	};
+
+	const float kDeltaTime = 1.f / 90.f;
+}
+
+TEST(ScalesNeverCompound)
+{
+	srand(20);
+	FakeParticles particles;
+	for (int i = 0; i < 20; i++) particles.Spawn(RandomFloat(1.f, 3.f));
+
+	ParticleScaler scaler;
+	for (float scale : { 0.5f, 0.5f, 0.25f, 1.f, 2.f, 0.f, 0.7f }) {
+		particles.Update(kDeltaTime);
+		particles.Apply(scaler, scale, true);
+		particles.CheckScaled(scale, true);
+	}
+}
+
+TEST(SizesTheGameSetsAreTakenAsUnscaled)
+{
+	srand(21);
+	FakeParticles particles;
+	for (int i = 0; i < 10; i++) particles.Spawn(RandomFloat(1.f, 3.f));
+
+	ParticleScaler scaler;
+	particles.Apply(scaler, 0.5f, false);
+	particles.SetSize(3, 4.f);
+	particles.SetSize(7, 0.25f);
+	particles.Update(kDeltaTime);
+	particles.Apply(scaler, 0.5f, false);
+	particles.CheckScaled(0.5f, false);
+	CHECK_NEAR(particles.sizes[3], 2.f, 1e-6f);
+}
+
+TEST(ParticlesMovedIntoAGapKeepTheirOwnScale)
+{
+	srand(22);
+	FakeParticles particles;
+	for (int i = 0; i < 30; i++) particles.Spawn(RandomFloat(1.f, 3.f));
+
+	ParticleScaler scaler;
+	float scale = 0.6f;
+	particles.Apply(scaler, scale, true);
+
+	// Particles dying all over, sometimes with new ones spawning in the same update, for long enough that every slot has been shuffled around
+	for (int frame = 0; frame < 200; frame++) {
+		particles.Update(kDeltaTime);
+		int numDeaths = rand() % 3;
+		for (int i = 0; i < numDeaths && particles.GetCount() > 1; i++) {
+			particles.Kill(rand() % particles.GetCount());
+		}
+		int numSpawns = rand() % 3;
+		for (int i = 0; i < numSpawns; i++) {
+			particles.Spawn(RandomFloat(1.f, 3.f));
+		}
+
+		scale = 0.5f + 0.1f * float(frame % 7);
+		particles.Apply(scaler, scale, true);
+		particles.CheckScaled(scale, true);
+	}
+}
+
+TEST(NewParticlesAreScaledStraightAway)
+{
+	srand(23);
+	FakeParticles particles;
+	ParticleScaler scaler;
+	particles.Apply(scaler, 0.5f, true);
+
+	particles.Spawn(2.f);
+	particles.Spawn(2.5f);
+	particles.Apply(scaler, 0.5f, true);
+	// Velocity included, rather than only picking up later changes in scale
+	particles.CheckScaled(0.5f, true);
+}
+
+TEST(ParticlesWithoutRandomLifeSpansStillWork)
+{
+	// Every particle has the same lifeSpan, so they can only be told apart by age
+	srand(24);
+	FakeParticles particles;
+	ParticleScaler scaler;
+	for (int frame = 0; frame < 100; frame++) {
+		particles.Update(kDeltaTime);
+		if (particles.GetCount() > 0 && frame % 3 == 0) {
+			particles.Kill(0); // the oldest, as it would be with a fixed lifeSpan
+		}
+		if (frame % 2 == 0) {
+			particles.Spawn(2.f);
+		}
+
+		float scale = frame % 2 ? 0.4f : 0.8f;
+		particles.Apply(scaler, scale, true);
+		particles.CheckScaled(scale, true);
+	}
+}
+
+TEST(TurningVelocityScalingOffRestoresTheVelocities)
+{
+	srand(25);
+	FakeParticles particles;
+	for (int i = 0; i < 8; i++) particles.Spawn(RandomFloat(1.f, 3.f));
+
+	ParticleScaler scaler;
+	particles.Apply(scaler, 0.5f, true);
+	particles.CheckScaled(0.5f, true);
+
+	particles.Update(kDeltaTime);
+	particles.Apply(scaler, 0.5f, false);
+	particles.CheckScaled(0.5f, false);
+
+	// And on again, from whatever they are at that point
+	particles.Update(kDeltaTime);
+	particles.Apply(scaler, 0.5f, true);
+	particles.CheckScaled(0.5f, true);
+}
+
+TEST(SizesAreScaledWithoutParticleInfos)
+{
+	std::vector<float> sizes = { 1.f, 2.f, 3.f };
+	ParticleScaler scaler;
+	for (float scale : { 0.5f, 0.25f, 1.f }) {
+		scaler.Apply(sizes.data(), nullptr, int(sizes.size()), scale, true);
+		CHECK_NEAR(sizes[0], 1.f * scale, 1e-6f);
+		CHECK_NEAR(sizes[2], 3.f * scale, 1e-6f);
+	}
+}
+
+TEST(EveryKernelGivesTheSameResult)
+{
+	std::vector<SimdLevel> levels = { SimdLevel::Scalar };
+	if (GetSupportedSimdLevel() >= SimdLevel::Sse2) levels.push_back(SimdLevel::Sse2);
+	if (GetSupportedSimdLevel() >= SimdLevel::Avx2) levels.push_back(SimdLevel::Avx2);
+
+	std::vector<FakeParticles> results;
+	for (SimdLevel level : levels) {
+		srand(26);
+		FakeParticles particles;
+		ParticleScaler scaler;
+		scaler.SetSimdLevel(level);
+		// Counts that leave every possible tail after the groups of 4 and 8
+		for (int frame = 0; frame < 40; frame++) {
+			particles.Update(kDeltaTime);
+			particles.Spawn(RandomFloat(1.f, 3.f));
+			if (frame % 5 == 4) particles.Kill(rand() % particles.GetCount());
+			particles.Apply(scaler, RandomFloat(0.2f, 1.5f), true);
+		}
+		results.push_back(particles);
+	}
+
+	for (size_t i = 1; i < results.size(); i++) {
+		CHECK_EQ(results[i].GetCount(), results[0].GetCount());
+		for (int j = 0; j < results[0].GetCount(); j++) {
+			CHECK_EQ(results[i].sizes[j], results[0].sizes[j]);
+			CHECK_EQ(results[i].infos[j].velocity.x, results[0].infos[j].velocity.x);
+			CHECK_EQ(results[i].infos[j].velocity.z, results[0].infos[j].velocity.z);
+			CHECK_EQ(results[i].infos[j].age, results[0].infos[j].age);
+		}
+	}
+}
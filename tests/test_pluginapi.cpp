@@ -0,0 +1,171 @@
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "testing.h"
+#include "magiccore.h"
+#include "misvrinterface001.h"
+#include "seqlock.h"
+
+using namespace MisvrPluginAPI;
+
+
+namespace {
+	// A frame whose every field can be checked against its frame number, to catch a read that mixes two frames
+	FrameData MakeFrame(uint32_t frameNumber)
+	{
+		FrameData frame = {};
+		frame.frameNumber = frameNumber;
+		frame.flags = frameNumber * 3;
+		for (int i = 0; i < 3; i++) {
+			frame.primaryAimForward[i] = float(frameNumber + i);
+			frame.secondaryAimForward[i] = float(frameNumber + 10 + i);
+			frame.dualCastAimForward[i] = float(frameNumber + 20 + i);
+		}
+		frame.dualCastScale = float(frameNumber) * 0.5f;
+		frame.primarySpellScale = float(frameNumber) * 0.25f;
+		frame.secondarySpellScale = float(frameNumber) * 0.125f;
+		frame.dualCastState = uint8_t(frameNumber);
+		frame.mergeState = uint8_t(frameNumber >> 8);
+		return frame;
+	}
+
+	bool IsConsistent(const FrameData &frame)
+	{
+		FrameData expected = MakeFrame(frame.frameNumber);
+		return memcmp(&frame, &expected, sizeof(FrameData)) == 0;
+	}
+
+	// Stands in for MISVR answering the message
+	IMisvrInterface001 *g_fakeInterface = reinterpret_cast<IMisvrInterface001 *>(uintptr_t(0x1000));
+	unsigned int g_requestedRevision = 0;
+	const char *g_receiver = nullptr;
+
+	void * FakeGetApi(unsigned int revisionNumber)
+	{
+		g_requestedRevision = revisionNumber;
+		return g_fakeInterface;
+	}
+
+	bool FakeDispatch(PluginHandle, UInt32 messageType, void *data, UInt32 dataLen, const char *receiver)
+	{
+		g_receiver = receiver;
+		if (messageType != MisvrMessage::kMessage_GetInterface || dataLen != sizeof(MisvrMessage)) return false;
+		static_cast<MisvrMessage *>(data)->getApiFunction = FakeGetApi;
+		return true;
+	}
+
+	bool NobodyAnswers(PluginHandle, UInt32, void *, UInt32, const char *)
+	{
+		return false;
+	}
+}
+
+TEST(FrameDataLayoutIsFixed)
+{
+	// Other plugins are built against a copy of the header, so none of this may ever change
+	CHECK_EQ(sizeof(FrameData), size_t(60));
+	CHECK_EQ(alignof(FrameData), size_t(4));
+	CHECK(std::is_trivially_copyable<FrameData>::value);
+	CHECK(std::is_standard_layout<FrameData>::value);
+
+	CHECK_EQ(offsetof(FrameData, frameNumber), size_t(0));
+	CHECK_EQ(offsetof(FrameData, flags), size_t(4));
+	CHECK_EQ(offsetof(FrameData, primaryAimForward), size_t(8));
+	CHECK_EQ(offsetof(FrameData, secondaryAimForward), size_t(20));
+	CHECK_EQ(offsetof(FrameData, dualCastAimForward), size_t(32));
+	CHECK_EQ(offsetof(FrameData, dualCastScale), size_t(44));
+	CHECK_EQ(offsetof(FrameData, primarySpellScale), size_t(48));
+	CHECK_EQ(offsetof(FrameData, secondarySpellScale), size_t(52));
+	CHECK_EQ(offsetof(FrameData, dualCastState), size_t(56));
+	CHECK_EQ(offsetof(FrameData, mergeState), size_t(57));
+
+	CHECK_EQ(sizeof(MisvrMessage), sizeof(void *));
+	CHECK_EQ(uint32_t(MisvrMessage::kMessage_GetInterface), uint32_t(0x4D495356));
+	CHECK_EQ(uint32_t(kFrameFlag_IsActive | kFrameFlag_IsLeftHanded | kFrameFlag_IsDualCasting | kFrameFlag_HasPrimaryAim | kFrameFlag_HasSecondaryAim), uint32_t(0x1F));
+}
+
+TEST(PublishedStatesMatchTheCoreStates)
+{
+	// main.cpp publishes the core's states by casting them
+	CHECK_EQ(int(kDualCastState_Idle), int(MagicCore::DualCastState::Idle));
+	CHECK_EQ(int(kDualCastState_Cast), int(MagicCore::DualCastState::Cast));
+	CHECK_EQ(int(kMergeState_None), int(MagicCore::HandMergeState::None));
+	CHECK_EQ(int(kMergeState_PreMerge), int(MagicCore::HandMergeState::PreMerge));
+	CHECK_EQ(int(kMergeState_Merging), int(MagicCore::HandMergeState::Merging));
+	CHECK_EQ(int(kMergeState_Merged), int(MagicCore::HandMergeState::Merged));
+	CHECK_EQ(int(kMergeState_Unmerging), int(MagicCore::HandMergeState::Unmerging));
+}
+
+TEST(GettingTheInterfaceGoesThroughMessaging)
+{
+	SKSEMessagingInterface messaging = {};
+	messaging.Dispatch = FakeDispatch;
+	CHECK(GetMisvrInterface001(1, &messaging) == g_fakeInterface);
+	CHECK_EQ(g_requestedRevision, 1u);
+	CHECK(g_receiver && strcmp(g_receiver, "MISVR") == 0);
+
+	// Not installed
+	messaging.Dispatch = NobodyAnswers;
+	CHECK(GetMisvrInterface001(1, &messaging) == nullptr);
+}
+
+TEST(ReadsGetTheLatestFrame)
+{
+	MagicCore::SeqlockDoubleBuffer<FrameData> frames;
+	FrameData frame;
+	CHECK(frames.Read(frame));
+	CHECK_EQ(frame.frameNumber, 0u);
+	CHECK_EQ(frame.flags, 0u);
+
+	for (uint32_t i = 1; i <= 5; i++) {
+		frames.Publish(MakeFrame(i));
+		CHECK(frames.Read(frame));
+		CHECK_EQ(frame.frameNumber, i);
+		CHECK(IsConsistent(frame));
+	}
+}
+
+TEST(ReadersNeverSeeATornFrame)
+{
+	MagicCore::SeqlockDoubleBuffer<FrameData> frames;
+	std::atomic<bool> isDone{ false };
+	const uint32_t kNumFrames = 200000;
+
+	std::thread writer([&]() {
+		for (uint32_t i = 1; i <= kNumFrames; i++) {
+			frames.Publish(MakeFrame(i));
+		}
+		isDone.store(true);
+	});
+
+	const int kNumReaders = 3;
+	std::vector<std::thread> readers;
+	std::atomic<int> numTorn{ 0 }, numBackwards{ 0 }, numReads{ 0 };
+	for (int r = 0; r < kNumReaders; r++) {
+		readers.emplace_back([&]() {
+			uint32_t lastFrameNumber = 0;
+			while (!isDone.load()) {
+				FrameData frame;
+				// Failing to get a copy at all is allowed when the writer keeps lapping us. Getting a bad one isn't.
+				if (!frames.Read(frame)) continue;
+				numReads++;
+				if (!IsConsistent(frame)) numTorn++;
+				if (frame.frameNumber < lastFrameNumber) numBackwards++;
+				lastFrameNumber = frame.frameNumber;
+			}
+		});
+	}
+
+	writer.join();
+	for (std::thread &reader : readers) reader.join();
+
+	CHECK_EQ(numTorn.load(), 0);
+	CHECK_EQ(numBackwards.load(), 0);
+
+	FrameData last;
+	CHECK(frames.Read(last));
+	CHECK_EQ(last.frameNumber, kNumFrames);
+}
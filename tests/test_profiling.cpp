@@ -0,0 +1,116 @@
+#include <thread>
+#include <vector>
+
+#include "testing.h"
+#include "profiling.h"
+
+using namespace Profiling;
+
+
+TEST(BucketsAreExactForSmallValuesAndWithinSixPercentAbove)
+{
+	for (uint64_t value = 0; value < Histogram::kNumSubBuckets; value++) {
+		CHECK_EQ(Histogram::GetBucketValue(Histogram::GetBucketIndex(value)), value);
+	}
+
+	int lastIndex = 0;
+	for (uint64_t value = Histogram::kNumSubBuckets; value < (uint64_t(1) << 40); value += value / 7 + 1) {
+		int index = Histogram::GetBucketIndex(value);
+		CHECK(index >= lastIndex);
+		CHECK(index < Histogram::kNumBuckets);
+		lastIndex = index;
+
+		double bucketValue = double(Histogram::GetBucketValue(index));
+		CHECK_NEAR(bucketValue / double(value), 1.0, 0.0625);
+	}
+	CHECK(Histogram::GetBucketIndex(~uint64_t(0)) < Histogram::kNumBuckets);
+}
+
+TEST(PercentilesOfAKnownDistribution)
+{
+	static Histogram histogram;
+	histogram.Reset();
+	// 1000 ns to 100000 ns, evenly
+	for (uint64_t i = 1; i <= 100; i++) {
+		for (int j = 0; j < 10; j++) {
+			histogram.Record(i * 1000);
+		}
+	}
+
+	Histogram::Summary summary = histogram.Summarize();
+	CHECK_EQ(summary.count, uint64_t(1000));
+	CHECK_EQ(summary.max, uint64_t(100000));
+	CHECK_NEAR(double(summary.p50), 50000.0, 50000.0 * 0.0625);
+	CHECK_NEAR(double(summary.p95), 95000.0, 95000.0 * 0.0625);
+	CHECK_NEAR(double(summary.p99), 99000.0, 99000.0 * 0.0625);
+}
+
+TEST(PercentilesOfFewSamplesAreNeverAnEmptyBucket)
+{
+	static Histogram histogram;
+	histogram.Reset();
+	histogram.Record(5000);
+
+	Histogram::Summary summary = histogram.Summarize();
+	CHECK_EQ(summary.count, uint64_t(1));
+	CHECK_NEAR(double(summary.p50), 5000.0, 5000.0 * 0.0625);
+	CHECK_NEAR(double(summary.p99), 5000.0, 5000.0 * 0.0625);
+
+	// Never past what was actually recorded
+	histogram.Reset();
+	histogram.Record(1100);
+	summary = histogram.Summarize();
+	CHECK(summary.p50 <= 1100);
+	CHECK(summary.p99 <= 1100);
+
+	histogram.Reset();
+	summary = histogram.Summarize();
+	CHECK_EQ(summary.count, uint64_t(0));
+	CHECK_EQ(summary.p99, uint64_t(0));
+}
+
+TEST(RecordingFromManyThreadsLosesNothing)
+{
+	static Histogram histogram;
+	histogram.Reset();
+	const int kNumThreads = 4;
+	const int kNumRecords = 100000;
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < kNumThreads; t++) {
+		threads.emplace_back([t]() {
+			for (int i = 0; i < kNumRecords; i++) {
+				histogram.Record(uint64_t(100 + (i % 1000) * (t + 1)));
+			}
+		});
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	Histogram::Summary summary = histogram.Summarize();
+	CHECK_EQ(summary.count, uint64_t(kNumThreads * kNumRecords));
+	CHECK_EQ(summary.max, uint64_t(100 + 999 * kNumThreads));
+}
+
+TEST(ScopedTimerOnlyRecordsWhileEnabled)
+{
+	Histogram &histogram = g_histograms[int(Stage::Smoothing)];
+	histogram.Reset();
+
+	g_isEnabled = false;
+	{
+		ScopedTimer timer(Stage::Smoothing);
+	}
+	CHECK_EQ(histogram.Summarize().count, uint64_t(0));
+
+	g_isEnabled = true;
+	{
+		ScopedTimer timer(Stage::Smoothing);
+		// Stopping early records once, not again at the end of the scope
+		timer.Stop();
+	}
+	g_isEnabled = false;
+	CHECK_EQ(histogram.Summarize().count, uint64_t(1));
+	histogram.Reset();
+}
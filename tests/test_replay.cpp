@@ -0,0 +1,244 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "testing.h"
+#include "replay.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	const char *kPath = "test_replay.bin";
+	const uint32_t kFireboltId = 0x00012FCD;
+	const uint32_t kFlamesId = 0x00012FCC;
+	const uint32_t kHealingId = 0x00012FCE;
+	const float kDeltaTime = 1.f / 90.f;
+
+	Mat33 AimRotation(float angle)
+	{
+		Mat33 rot;
+		rot.data[0][0] = cosf(angle); rot.data[0][1] = -sinf(angle);
+		rot.data[1][0] = sinf(angle); rot.data[1][1] = cosf(angle);
+		return rot;
+	}
+
+	struct SessionFrame
+	{
+		Inputs inputs;
+		uint32_t secondarySpellFormId;
+		bool isActive;
+	};
+
+	// A few seconds of play the way the hooks would see it: the hands sweeping, a dual cast that merges and unmerges, two breaks with the spell put away,
+	// and the off hand spell's overrides reloaded halfway through
+	std::vector<SessionFrame> MakeSession(int numFrames)
+	{
+		std::vector<SessionFrame> session(numFrames);
+		for (int i = 0; i < numFrames; i++) {
+			SessionFrame &frame = session[i];
+			Inputs &inputs = frame.inputs;
+			float angle = 0.3f * sinf(i * 0.05f);
+			inputs.primaryAimWorld.rot = AimRotation(angle);
+			inputs.secondaryAimWorld.rot = AimRotation(-angle + 0.1f * sinf(i * 0.7f));
+			inputs.primaryOffsetWorld.pos = { 10.f, 0.f, 0.f };
+			inputs.secondaryOffsetWorld.pos = { -10.f, 0.f, 0.f };
+			inputs.primaryOffsetLocal = inputs.primaryOffsetWorld;
+			inputs.secondaryOffsetLocal = inputs.secondaryOffsetWorld;
+			inputs.primarySpell.isValid = true;
+			inputs.primarySpell.skillLevel = SpellSkillLevel::Master;
+			inputs.primarySpell.castingTime = 0.5f;
+			inputs.secondarySpell.isValid = true;
+			inputs.secondarySpell.skillLevel = SpellSkillLevel::Adept;
+			if (i >= numFrames / 2) {
+				inputs.secondarySpell.overrides.fields = Config::SpellOverrides::kNumSmoothingFrames;
+				inputs.secondarySpell.overrides.numSmoothingFrames = 3;
+			}
+			inputs.hasDualCaster = true;
+			inputs.isCastingDual = (i % 200) >= 50 && (i % 200) < 120;
+			inputs.isCastingPrimary = (i % 90) < 30;
+
+			frame.secondarySpellFormId = i < numFrames / 3 ? kFlamesId : kHealingId;
+			frame.isActive = !(i % 250 >= 230);
+		}
+		return session;
+	}
+
+	// Steps a caster through the session the way the hooks do, recording every frame
+	void RecordSession(const std::vector<SessionFrame> &session, const Config::Options &options, std::vector<Outputs> *recordedOutputs)
+	{
+		Replay::Recorder recorder;
+		CHECK(recorder.Open(kPath));
+
+		Caster caster;
+		bool wasActive = false;
+		int numFrames = 0;
+		for (const SessionFrame &frame : session) {
+			// Much faster than any game, so the writer thread has to be let catch up
+			if (++numFrames % 256 == 0) recorder.Flush();
+
+			if (!frame.isActive) {
+				recorder.AddInactiveFrame();
+				wasActive = false;
+				continue;
+			}
+			if (!wasActive) {
+				caster.ResetSmoothing();
+				recorder.AddResetSmoothing();
+				wasActive = true;
+			}
+
+			Outputs outputs = caster.Step(options, frame.inputs, kDeltaTime);
+
+			Replay::FrameRecord record{};
+			record.primarySpellFormId = kFireboltId;
+			record.secondarySpellFormId = frame.secondarySpellFormId;
+			record.magickaPercentage = 0.75f;
+			record.deltaTime = kDeltaTime;
+			record.flags = Replay::FrameRecord::kFlag_IsWeaponDrawn;
+			Replay::FromInputs(frame.inputs, record);
+			recorder.WriteFrame(record, frame.inputs, outputs);
+
+			if (recordedOutputs) recordedOutputs->push_back(outputs);
+		}
+		recorder.Close();
+		CHECK_EQ(recorder.GetNumDropped(), uint64_t(0));
+	}
+
+	bool IsSameTransform(const Transform &a, const Transform &b)
+	{
+		return memcmp(&a, &b, sizeof(Transform)) == 0;
+	}
+}
+
+TEST(RecordedFramesReadBackWithTheirSpellsAndGaps)
+{
+	std::vector<SessionFrame> session = MakeSession(600);
+	Config::Options options;
+	RecordSession(session, options, nullptr);
+
+	Replay::Reader reader;
+	CHECK(reader.Open(kPath));
+
+	Replay::Frame frame;
+	size_t i = 0;
+	int numFrames = 0;
+	while (reader.Read(frame)) {
+		// Everything inactive before this frame should be in its gap
+		uint32_t numInactive = 0;
+		while (i < session.size() && !session[i].isActive) {
+			numInactive++;
+			i++;
+		}
+		CHECK_EQ(frame.gapBefore.numInactiveFrames, numInactive);
+		CHECK_EQ(frame.gapBefore.numDroppedFrames, uint32_t(0));
+		CHECK_EQ(frame.record.flags & Replay::FrameRecord::kFlag_ResetSmoothing, numInactive || numFrames == 0 ? int(Replay::FrameRecord::kFlag_ResetSmoothing) : 0);
+
+		const Inputs &expected = session[i].inputs;
+		CHECK(IsSameTransform(frame.inputs.primaryAimWorld, expected.primaryAimWorld));
+		CHECK(IsSameTransform(frame.inputs.secondaryAimWorld, expected.secondaryAimWorld));
+		CHECK(IsSameTransform(frame.inputs.secondaryOffsetLocal, expected.secondaryOffsetLocal));
+		CHECK_EQ(frame.inputs.isCastingDual, expected.isCastingDual);
+		CHECK_EQ(frame.inputs.isCastingPrimary, expected.isCastingPrimary);
+		CHECK_EQ(frame.inputs.hasDualCaster, expected.hasDualCaster);
+		CHECK_EQ(frame.record.secondarySpellFormId, session[i].secondarySpellFormId);
+		CHECK_EQ(frame.record.magickaPercentage, 0.75f);
+		CHECK(frame.record.flags & Replay::FrameRecord::kFlag_IsWeaponDrawn);
+
+		// Spell params come back from the spell records, including the overrides that changed partway
+		CHECK(frame.inputs.primarySpell.isValid);
+		CHECK(frame.inputs.primarySpell.skillLevel == SpellSkillLevel::Master);
+		CHECK_EQ(frame.inputs.primarySpell.castingTime, 0.5f);
+		CHECK(frame.inputs.secondarySpell.skillLevel == SpellSkillLevel::Adept);
+		CHECK_EQ(frame.inputs.secondarySpell.overrides.fields, expected.secondarySpell.overrides.fields);
+		CHECK_EQ(frame.inputs.secondarySpell.overrides.numSmoothingFrames, expected.secondarySpell.overrides.numSmoothingFrames);
+
+		i++;
+		numFrames++;
+	}
+	reader.Close();
+	std::remove(kPath);
+
+	int numActive = 0;
+	for (const SessionFrame &frame : session) numActive += frame.isActive ? 1 : 0;
+	CHECK_EQ(numFrames, numActive);
+}
+
+TEST(ReplayReproducesTheRecordedOutputs)
+{
+	std::vector<SessionFrame> session = MakeSession(1000);
+	for (int useTimeBasedSmoothing = 0; useTimeBasedSmoothing < 2; useTimeBasedSmoothing++) {
+		Config::Options options;
+		options.useTimeBasedSmoothing = useTimeBasedSmoothing != 0;
+		std::vector<Outputs> recordedOutputs;
+		RecordSession(session, options, &recordedOutputs);
+
+		Replay::Reader reader;
+		CHECK(reader.Open(kPath));
+		Replay::Replayer replayer;
+		Replay::Frame frame;
+		size_t numFrames = 0;
+		while (reader.Read(frame)) {
+			Outputs outputs = replayer.Step(options, frame);
+			// Same code, same inputs: no tolerance needed
+			CHECK_EQ(Replay::GetOutputsDifference(outputs, frame.outputs), 0.f);
+			CHECK_EQ(Replay::GetOutputsDifference(outputs, recordedOutputs[numFrames]), 0.f);
+			numFrames++;
+		}
+		CHECK_EQ(numFrames, recordedOutputs.size());
+		reader.Close();
+	}
+	std::remove(kPath);
+}
+
+TEST(ReplayWithoutTheRecordedResetsDiverges)
+{
+	// What the reset flag is there for: the aim history from before a break would otherwise leak into the frames after it
+	std::vector<SessionFrame> session = MakeSession(600);
+	Config::Options options;
+	RecordSession(session, options, nullptr);
+
+	Replay::Reader reader;
+	CHECK(reader.Open(kPath));
+	Caster caster;
+	Replay::Frame frame;
+	float maxDifference = 0.f;
+	while (reader.Read(frame)) {
+		Outputs outputs = caster.Step(options, frame.inputs, frame.record.deltaTime);
+		maxDifference = std::fmax(maxDifference, Replay::GetOutputsDifference(outputs, frame.outputs));
+	}
+	reader.Close();
+	std::remove(kPath);
+
+	CHECK(maxDifference > 1e-3f);
+}
+
+TEST(OutputsDifferenceNoticesMissingParts)
+{
+	Outputs a;
+	a.hasPrimaryAimForward = true;
+	a.primaryAimForward = { 0.f, 1.f, 0.f };
+	Outputs b = a;
+	CHECK_EQ(Replay::GetOutputsDifference(a, b), 0.f);
+
+	b.primaryAimForward.z = 0.25f;
+	CHECK_NEAR(Replay::GetOutputsDifference(a, b), 0.25f, 1e-6f);
+
+	b.hasSecondaryAimForward = true;
+	CHECK(std::isinf(Replay::GetOutputsDifference(a, b)));
+}
+
+TEST(ReaderRejectsOtherVersions)
+{
+	Replay::FileHeader header;
+	header.version = Replay::FileHeader::kVersion - 1;
+	std::FILE *file = std::fopen(kPath, "wb");
+	CHECK(file != nullptr);
+	std::fwrite(&header, sizeof(header), 1, file);
+	std::fclose(file);
+
+	Replay::Reader reader;
+	CHECK(!reader.Open(kPath));
+	std::remove(kPath);
+}
@@ -0,0 +1,182 @@
+#include <memory>
+#include <vector>
+
+#include "testing.h"
+#include "scaletargets.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	// Just enough of a scene graph to walk: nodes, geometry, particle systems and things that are neither
+	struct FakeNode;
+	struct FakeObject
+	{
+		virtual ~FakeObject() {}
+		virtual FakeNode * GetAsNode() { return nullptr; }
+		virtual bool IsGeometry() const { return false; }
+	};
+	struct FakeGeometry : FakeObject
+	{
+		bool IsGeometry() const override { return true; }
+	};
+	struct FakeParticleSystem : FakeObject {};
+	struct FakeNode : FakeObject
+	{
+		FakeNode * GetAsNode() override { return this; }
+		std::vector<FakeObject *> children;
+	};
+
+	struct FakeTraits
+	{
+		typedef FakeObject Object;
+		typedef FakeNode Node;
+		typedef FakeObject *ObjectHandle;
+		typedef FakeNode *NodeHandle;
+
+		static ScaleTargetKind Classify(FakeObject *object, FakeNode *&node)
+		{
+			if (object->IsGeometry()) return ScaleTargetKind::Geometry;
+			if (dynamic_cast<FakeParticleSystem *>(object)) return ScaleTargetKind::ParticleSystem;
+			node = object->GetAsNode();
+			return node ? ScaleTargetKind::Node : ScaleTargetKind::Other;
+		}
+		static int GetNumChildren(FakeNode *node) { return int(node->children.size()); }
+		static FakeObject * GetChild(FakeNode *node, int index) { return node->children[index]; }
+	};
+
+	struct FakeTarget
+	{
+		FakeObject *object;
+		bool isParticleSystem;
+	};
+
+	typedef ScaleTargetCache<FakeTraits, FakeTarget> FakeCache;
+
+	// Owns everything in a tree
+	struct FakeTree
+	{
+		std::vector<std::unique_ptr<FakeObject>> objects;
+
+		template <typename T>
+		T * Add(FakeNode *parent)
+		{
+			objects.emplace_back(new T());
+			T *object = static_cast<T *>(objects.back().get());
+			if (parent) parent->children.push_back(object);
+			return object;
+		}
+	};
+
+	// root
+	//   geometry
+	//   node
+	//     particles
+	//     (null)
+	//     other
+	//     node
+	//       geometry
+	//   particles
+	struct SampleTree : FakeTree
+	{
+		FakeNode *root, *middle, *deep;
+		FakeGeometry *geometry, *deepGeometry;
+		FakeParticleSystem *particles, *lastParticles;
+
+		SampleTree()
+		{
+			root = Add<FakeNode>(nullptr);
+			geometry = Add<FakeGeometry>(root);
+			middle = Add<FakeNode>(root);
+			particles = Add<FakeParticleSystem>(middle);
+			middle->children.push_back(nullptr);
+			Add<FakeObject>(middle);
+			deep = Add<FakeNode>(middle);
+			deepGeometry = Add<FakeGeometry>(deep);
+			lastParticles = Add<FakeParticleSystem>(root);
+		}
+	};
+}
+
+TEST(WalkFindsTheTargetsDepthFirst)
+{
+	SampleTree tree;
+	std::vector<FakeNode *> nodes;
+	std::vector<FakeTarget> targets;
+	auto onNode = [&](FakeNode *node) { nodes.push_back(node); };
+	auto onTarget = [&](FakeObject *object, bool isParticleSystem) { targets.push_back({ object, isParticleSystem }); };
+	WalkScaleTargets<FakeTraits>(tree.root, onNode, onTarget);
+
+	CHECK_EQ(int(nodes.size()), 3);
+	CHECK(nodes.size() == 3 && nodes[0] == tree.root && nodes[1] == tree.middle && nodes[2] == tree.deep);
+
+	CHECK_EQ(int(targets.size()), 4);
+	if (targets.size() == 4) {
+		CHECK(targets[0].object == tree.geometry && !targets[0].isParticleSystem);
+		CHECK(targets[1].object == tree.particles && targets[1].isParticleSystem);
+		CHECK(targets[2].object == tree.deepGeometry && !targets[2].isParticleSystem);
+		CHECK(targets[3].object == tree.lastParticles && targets[3].isParticleSystem);
+	}
+}
+
+TEST(CacheStaysValidWhileTheTreeIsUnchanged)
+{
+	SampleTree tree;
+	FakeCache cache;
+	CHECK(!cache.IsValidFor(tree.root));
+
+	cache.Build(tree.root);
+	CHECK(cache.IsValidFor(tree.root));
+	CHECK_EQ(int(cache.targets.size()), 4);
+	CHECK_EQ(int(cache.nodes.size()), 3);
+	CHECK(!cache.IsValidFor(tree.middle));
+
+	cache.Reset();
+	CHECK(!cache.IsValidFor(tree.root));
+	CHECK(cache.targets.empty());
+}
+
+TEST(CacheNoticesChangesDeepInTheTree)
+{
+	{
+		// Something attached
+		SampleTree tree;
+		FakeCache cache;
+		cache.Build(tree.root);
+		FakeParticleSystem *added = tree.Add<FakeParticleSystem>(tree.deep);
+		CHECK(!cache.IsValidFor(tree.root));
+
+		cache.Build(tree.root);
+		CHECK(cache.IsValidFor(tree.root));
+		CHECK_EQ(int(cache.targets.size()), 5);
+		CHECK(cache.targets.size() == 5 && cache.targets[3].object == added);
+	}
+	{
+		// Something detached
+		SampleTree tree;
+		FakeCache cache;
+		cache.Build(tree.root);
+		tree.middle->children.erase(tree.middle->children.begin());
+		CHECK(!cache.IsValidFor(tree.root));
+	}
+	{
+		// Swapped for something else, as when the equipped spell changes, without the number of children changing
+		SampleTree tree;
+		FakeCache cache;
+		cache.Build(tree.root);
+		FakeGeometry *replacement = tree.Add<FakeGeometry>(nullptr);
+		tree.deep->children[0] = replacement;
+		CHECK(!cache.IsValidFor(tree.root));
+
+		cache.Build(tree.root);
+		CHECK(cache.targets.size() == 4 && cache.targets[2].object == replacement);
+	}
+	{
+		// Null slot filled in
+		SampleTree tree;
+		FakeCache cache;
+		cache.Build(tree.root);
+		tree.middle->children[1] = tree.Add<FakeGeometry>(nullptr);
+		CHECK(!cache.IsValidFor(tree.root));
+	}
+}
@@ -0,0 +1,125 @@
+#include <cstring>
+#include <vector>
+
+#include "testing.h"
+#include "sigscan.h"
+
+
+namespace {
+	// Bytes with roughly the mix of x86-64 code: a few values (REX prefixes, movs, calls, padding) are far more common than the rest
+	std::vector<uint8_t> MakeCodeLikeBlob(size_t size, uint32_t seed)
+	{
+		static const uint8_t kCommon[] = { 0x00, 0x48, 0x89, 0x8B, 0xE8, 0xCC, 0x0F, 0x4C, 0x24, 0xFF };
+		std::vector<uint8_t> blob(size);
+		uint32_t state = seed;
+		for (size_t i = 0; i < size; i++) {
+			state = state * 1664525u + 1013904223u;
+			blob[i] = (state >> 31) ? kCommon[(state >> 8) % sizeof(kCommon)] : uint8_t(state >> 16);
+		}
+		return blob;
+	}
+
+	SigScan::Pattern Parse(const char *text)
+	{
+		SigScan::Pattern pattern;
+		CHECK(SigScan::Parse(text, pattern));
+		return pattern;
+	}
+}
+
+TEST(PatternsParseWithWildcards)
+{
+	SigScan::Pattern pattern = Parse("? 48 8b 05 ?? ?? ?? ?? E8 ??");
+	CHECK_EQ(pattern.bytes.size(), size_t(10));
+	CHECK_EQ(pattern.bytes[1], 0x48);
+	CHECK_EQ(pattern.bytes[2], 0x8B);
+	CHECK_EQ(pattern.isFixed[0], 0);
+	CHECK_EQ(pattern.isFixed[3], 1);
+	CHECK_EQ(pattern.isFixed[4], 0);
+	CHECK_EQ(pattern.firstAnchor, size_t(1));
+	CHECK_EQ(pattern.lastAnchor, size_t(8));
+
+	for (const char *bad : { "", "?? ??", "4", "48 8B0", "48 XY", "488B" }) {
+		SigScan::Pattern badPattern;
+		CHECK(!SigScan::Parse(bad, badPattern));
+	}
+}
+
+TEST(FindMatchesTheScalarScanOnCodeLikeBlobs)
+{
+	std::vector<uint8_t> blob = MakeCodeLikeBlob(1 << 20, 1);
+	const char *patterns[] = {
+		"48 8B 05 ?? ?? ?? ?? 48 85 C0",
+		"E8 ?? ?? ?? ?? 48",
+		"48 89",
+		"CC",
+		"?? FF ?? ?? ?? 24 ??",
+		"12 34 56 78 9A BC DE F0",
+	};
+
+	// Plant one of each somewhere, and one right at the end where the vectorized loop hands over to the byte loop
+	size_t plantAt = 12345;
+	for (const char *text : patterns) {
+		SigScan::Pattern pattern = Parse(text);
+		for (size_t i = 0; i < pattern.bytes.size(); i++) {
+			if (pattern.isFixed[i]) blob[plantAt + i] = pattern.bytes[i];
+		}
+		plantAt += 100003;
+	}
+	SigScan::Pattern last = Parse(patterns[5]);
+	memcpy(blob.data() + blob.size() - last.bytes.size(), last.bytes.data(), last.bytes.size());
+
+	for (const char *text : patterns) {
+		SigScan::Pattern pattern = Parse(text);
+		// Every match along the way, not just the first
+		const uint8_t *begin = blob.data();
+		size_t size = blob.size();
+		int numMatches = 0;
+		while (numMatches < 1000) {
+			const uint8_t *expected = SigScan::FindScalar(begin, size, pattern);
+			const uint8_t *found = SigScan::Find(begin, size, pattern);
+			CHECK(found == expected);
+			if (!expected) break;
+
+			numMatches++;
+			size -= size_t(expected + 1 - begin);
+			begin = expected + 1;
+		}
+		CHECK(numMatches > 0);
+	}
+}
+
+TEST(FindHandlesShortRanges)
+{
+	std::vector<uint8_t> blob = MakeCodeLikeBlob(64, 2);
+	SigScan::Pattern pattern = Parse("AA ?? ?? ?? BB");
+	for (size_t offset = 0; offset + 5 <= 40; offset++) {
+		std::vector<uint8_t> bytes(blob.begin(), blob.begin() + 40);
+		for (uint8_t &byte : bytes) {
+			if (byte == 0xAA) byte = 0;
+		}
+		bytes[offset] = 0xAA;
+		bytes[offset + 4] = 0xBB;
+		for (size_t size = 0; size <= bytes.size(); size++) {
+			const uint8_t *found = SigScan::Find(bytes.data(), size, pattern);
+			CHECK(found == SigScan::FindScalar(bytes.data(), size, pattern));
+			CHECK(found == (offset + 5 <= size ? bytes.data() + offset : nullptr));
+		}
+	}
+}
+
+TEST(OnlyOneMatchIsUnique)
+{
+	std::vector<uint8_t> blob(4096, 0x90);
+	SigScan::Pattern pattern = Parse("48 8D 0D ?? ?? ?? ?? E8");
+	uint8_t code[] = { 0x48, 0x8D, 0x0D, 1, 2, 3, 4, 0xE8 };
+	memcpy(blob.data() + 1000, code, sizeof(code));
+
+	const uint8_t *match = SigScan::Find(blob.data(), blob.size(), pattern);
+	CHECK(match == blob.data() + 1000);
+	CHECK(SigScan::IsUnique(blob.data(), blob.size(), pattern, match));
+
+	code[3] = 9;
+	memcpy(blob.data() + 3000, code, sizeof(code));
+	CHECK(!SigScan::IsUnique(blob.data(), blob.size(), pattern, match));
+}
@@ -0,0 +1,102 @@
+#include <cstdlib>
+#include <vector>
+
+#include "testing.h"
+#include "simdmath.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	float RandomFloat(float min, float max)
+	{
+		return min + (max - min) * float(rand()) / float(RAND_MAX);
+	}
+
+	Vec3 RandomVector(float range)
+	{
+		return { RandomFloat(-range, range), RandomFloat(-range, range), RandomFloat(-range, range) };
+	}
+
+	// A scaled rotation and translation, like the node transforms in the hooks
+	Transform RandomTransform()
+	{
+		Vec3 axis = VectorNormalized(RandomVector(1.f));
+		float angle = RandomFloat(-3.1f, 3.1f);
+		Transform t;
+		for (int i = 0; i < 3; i++) {
+			Vec3 column = RotateVectorByAxisAngle({ i == 0 ? 1.f : 0.f, i == 1 ? 1.f : 0.f, i == 2 ? 1.f : 0.f }, axis, angle);
+			t.rot.data[0][i] = column.x;
+			t.rot.data[1][i] = column.y;
+			t.rot.data[2][i] = column.z;
+		}
+		t.pos = RandomVector(1000.f);
+		t.scale = RandomFloat(0.5f, 2.f);
+		return t;
+	}
+
+	void CheckTransformsNear(const Transform &a, const Transform &b, float rotTolerance, float posTolerance)
+	{
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				CHECK_NEAR(a.rot.data[i][j], b.rot.data[i][j], rotTolerance);
+			}
+		}
+		CHECK_NEAR(a.pos.x, b.pos.x, posTolerance);
+		CHECK_NEAR(a.pos.y, b.pos.y, posTolerance);
+		CHECK_NEAR(a.pos.z, b.pos.z, posTolerance);
+		CHECK_NEAR(a.scale, b.scale, 1e-6f * a.scale);
+	}
+}
+
+TEST(SimdMultiplyMatchesTheScalarReference)
+{
+	srand(10);
+	for (int i = 0; i < 1000; i++) {
+		Transform a = RandomTransform(), b = RandomTransform();
+		CheckTransformsNear(Simd::Multiply(a, b), a * b, 1e-6f, 1e-3f);
+	}
+}
+
+TEST(SimdInverseMatchesTheScalarReference)
+{
+	srand(11);
+	for (int i = 0; i < 1000; i++) {
+		Transform t = RandomTransform();
+		Transform inverse = Simd::Inverse(t);
+		CheckTransformsNear(inverse, InverseTransform(t), 1e-6f, 1e-3f);
+
+		// And it is actually the inverse
+		CheckTransformsNear(Simd::Multiply(t, inverse), Transform(), 1e-5f, 1e-3f);
+	}
+}
+
+TEST(SimdMultiplyDoesntReadPastTheTransform)
+{
+	// The 4-wide loads of the last row and the position stay inside the struct, so a transform at the very end of an array is fine.
+	// (Run under a memory checker, this would catch a load off the end.)
+	std::vector<Transform> transforms(2);
+	transforms[1] = RandomTransform();
+	Transform result = Simd::Multiply(transforms[1], transforms[1]);
+	CheckTransformsNear(result, transforms[1] * transforms[1], 1e-6f, 1e-3f);
+}
+
+TEST(BatchedNormalizationMatchesVectorNormalized)
+{
+	srand(12);
+	// Counts that leave every possible tail after the groups of 4
+	for (int count : { 1, 2, 3, 4, 5, 7, 8, 13 }) {
+		std::vector<Vec3> vectors(count), expected(count);
+		for (int i = 0; i < count; i++) {
+			vectors[i] = i % 5 == 3 ? Vec3() : RandomVector(100.f);
+			expected[i] = VectorNormalized(vectors[i]);
+		}
+
+		Simd::NormalizeVectors(vectors.data(), count);
+		for (int i = 0; i < count; i++) {
+			CHECK_NEAR(vectors[i].x, expected[i].x, 1e-7f);
+			CHECK_NEAR(vectors[i].y, expected[i].y, 1e-7f);
+			CHECK_NEAR(vectors[i].z, expected[i].z, 1e-7f);
+		}
+	}
+}
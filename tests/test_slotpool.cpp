@@ -0,0 +1,96 @@
+#include <vector>
+
+#include "testing.h"
+#include "slotpool.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	struct Item
+	{
+		int value = 0;
+		std::vector<int> buffer;
+	};
+}
+
+TEST(SlotPoolHandsOutEverySlotOnce)
+{
+	SlotPool<Item, 8> pool;
+	std::vector<SlotHandle> handles;
+	for (int i = 0; i < 8; i++) {
+		SlotHandle handle = pool.Allocate();
+		CHECK(bool(handle));
+		for (SlotHandle other : handles) {
+			CHECK(other.GetIndex() != handle.GetIndex());
+		}
+		handles.push_back(handle);
+		pool.Get(handle)->value = i;
+	}
+	CHECK_EQ(pool.GetNumAllocated(), 8);
+
+	// Full
+	CHECK(!pool.Allocate());
+
+	for (int i = 0; i < 8; i++) {
+		CHECK(pool.Get(handles[i]) && pool.Get(handles[i])->value == i);
+	}
+}
+
+TEST(ReleasedHandlesGoStale)
+{
+	SlotPool<Item, 4> pool;
+	SlotHandle first = pool.Allocate();
+	pool.Release(first);
+	CHECK(!pool.IsValid(first));
+	CHECK(pool.Get(first) == nullptr);
+	CHECK_EQ(pool.GetNumAllocated(), 0);
+
+	// The slot gets reused, but the old handle still doesn't resolve to it
+	SlotHandle second = pool.Allocate();
+	CHECK_EQ(second.GetIndex(), first.GetIndex());
+	CHECK(second != first);
+	CHECK(pool.Get(first) == nullptr);
+	CHECK(pool.Get(second) != nullptr);
+
+	// Releasing the stale one again doesn't free the new owner's slot
+	pool.Release(first);
+	CHECK(pool.IsValid(second));
+	CHECK_EQ(pool.GetNumAllocated(), 1);
+}
+
+TEST(InvalidHandlesNeverResolve)
+{
+	SlotPool<Item, 4> pool;
+	CHECK(pool.Get(SlotHandle()) == nullptr);
+	CHECK(!pool.IsValid(SlotHandle{ (1u << 16) | 0 })); // the right generation for slot 0, but it isn't allocated
+	CHECK(!pool.IsValid(SlotHandle{ (1u << 16) | 1000 })); // out of range
+
+	SlotHandle handle = pool.Allocate();
+	CHECK(!pool.IsValid(SlotHandle{ handle.value + (1u << 16) })); // right slot, wrong generation
+}
+
+TEST(GenerationsSkipZeroWhenTheyWrapAround)
+{
+	SlotPool<Item, 1> pool;
+	for (int i = 0; i < 0x10000 + 10; i++) {
+		SlotHandle handle = pool.Allocate();
+		CHECK(bool(handle));
+		CHECK(handle.GetGeneration() != 0);
+		pool.Release(handle);
+		if (!handle) break;
+	}
+}
+
+TEST(ItemsKeepTheirAllocationsAcrossOwners)
+{
+	// Releasing doesn't destroy the item, so whoever gets the slot next can reuse what it allocated
+	SlotPool<Item, 2> pool;
+	SlotHandle handle = pool.Allocate();
+	pool.Get(handle)->buffer.resize(100);
+	const int *data = pool.Get(handle)->buffer.data();
+	pool.Release(handle);
+
+	handle = pool.Allocate();
+	CHECK(pool.Get(handle)->buffer.data() == data);
+}
@@ -0,0 +1,112 @@
+#include <cstdlib>
+#include <initializer_list>
+
+#include "testing.h"
+#include "smoothing.h"
+
+using namespace MagicCore;
+
+
+namespace {
+	Vec3 RandomVector()
+	{
+		return { float(rand()) / RAND_MAX - 0.5f, float(rand()) / RAND_MAX - 0.5f, float(rand()) / RAND_MAX - 0.5f };
+	}
+
+	// What the ring's running sums stand in for: a plain sum over the most recent samples
+	Vec3 NaiveSum(const Vec3 *samples, int numSamples, int numFrames, int numFramesAgo)
+	{
+		Vec3 sum;
+		for (int i = 0; i < numFrames; i++) {
+			int index = numSamples - 1 - numFramesAgo - i;
+			if (index >= 0) sum += samples[index];
+		}
+		return sum;
+	}
+}
+
+TEST(AimHistoryMatchesANaiveSumAcrossWraparounds)
+{
+	srand(1);
+	const int kNumSamples = AimHistory::kCapacity * 5 + 37;
+	static Vec3 samples[kNumSamples];
+
+	AimHistory history;
+	for (int i = 0; i < kNumSamples; i++) {
+		samples[i] = RandomVector();
+		history.Push(samples[i]);
+
+		if (i % 97 != 0 && i != kNumSamples - 1) continue;
+		for (int window : { 1, 10, 25, 100, 250, 500, AimHistory::kMaxWindow }) {
+			Vec3 expected = NaiveSum(samples, i + 1, window, 0);
+			Vec3 actual = history.GetSum(window);
+			CHECK_NEAR(actual.x, expected.x, 1e-3f);
+			CHECK_NEAR(actual.y, expected.y, 1e-3f);
+			CHECK_NEAR(actual.z, expected.z, 1e-3f);
+		}
+	}
+}
+
+TEST(AimHistoryWindowsEndingInThePast)
+{
+	srand(2);
+	const int kNumSamples = 1000;
+	static Vec3 samples[kNumSamples];
+
+	AimHistory history;
+	for (int i = 0; i < kNumSamples; i++) {
+		samples[i] = RandomVector();
+		history.Push(samples[i]);
+	}
+
+	for (int ago : { 0, 1, 20, 200 }) {
+		for (int window : { 1, 15, 100 }) {
+			Vec3 expected = NaiveSum(samples, kNumSamples, window, ago);
+			Vec3 actual = history.GetSum(window, ago);
+			CHECK_NEAR(actual.x, expected.x, 1e-3f);
+			CHECK_NEAR(actual.z, expected.z, 1e-3f);
+		}
+	}
+}
+
+TEST(AimHistoryClampsTheWindow)
+{
+	AimHistory history;
+	for (int i = 0; i < AimHistory::kCapacity * 2; i++) {
+		history.Push({ 1.f, 0.f, 0.f });
+	}
+	CHECK_NEAR(history.GetSum(0).x, 1.f, 1e-6f);
+	CHECK_NEAR(history.GetSum(100000).x, float(AimHistory::kMaxWindow), 1e-3f);
+
+	history.Reset();
+	CHECK_NEAR(history.GetSum(50).x, 0.f, 0.f);
+}
+
+TEST(AimHistoryStaysPreciseOverALongSession)
+{
+	// Half a day at 90 fps. Without the rebasing the running sums would reach ~4e6, where a float step is 0.25.
+	AimHistory history;
+	for (int i = 0; i < 90 * 60 * 60 * 12; i++) {
+		history.Push({ 1.f, -1.f, 0.5f });
+	}
+	CHECK_NEAR(history.GetSum(10).x, 10.f, 1e-3f);
+	CHECK_NEAR(history.GetSum(10).y, -10.f, 1e-3f);
+	CHECK_NEAR(history.GetSum(10).z, 5.f, 1e-3f);
+}
+
+TEST(ExponentialFilterDelayDoesNotDependOnTheFrameRate)
+{
+	// After a step the filter should cover 1 - 1/e of it in one time constant, at any frame rate
+	const float kTimeConstant = 0.1f;
+	for (int frameRate : { 72, 90, 120, 144 }) {
+		float deltaTime = 1.f / float(frameRate);
+		ExponentialAimFilter filter;
+		float t = 0.f;
+		while (filter.Get().x < 1.f - expf(-1.f)) {
+			filter.Update({ 1.f, 0.f, 0.f }, deltaTime, kTimeConstant);
+			t += deltaTime;
+		}
+		CHECK(t >= kTimeConstant - 1e-5f);
+		CHECK(t < kTimeConstant + deltaTime + 1e-5f);
+	}
+}
@@ -0,0 +1,47 @@
+#include <cstdio>
+#include <vector>
+
+#include "testing.h"
+
+
+namespace Testing {
+	struct Test
+	{
+		const char *name;
+		TestFunction function;
+	};
+
+	std::vector<Test> & GetTests()
+	{
+		static std::vector<Test> s_tests;
+		return s_tests;
+	}
+
+	int g_numFailures = 0;
+
+	Registrar::Registrar(const char *name, TestFunction function)
+	{
+		GetTests().push_back({ name, function });
+	}
+
+	void ReportFailure(const char *file, int line, const char *what)
+	{
+		std::printf("  %s:%d: CHECK failed: %s\n", file, line, what);
+		g_numFailures++;
+	}
+}
+
+int main()
+{
+	int numFailedTests = 0;
+	for (const Testing::Test &test : Testing::GetTests()) {
+		int failuresBefore = Testing::g_numFailures;
+		test.function();
+		bool passed = Testing::g_numFailures == failuresBefore;
+		std::printf("%s %s\n", passed ? "[ OK ]" : "[FAIL]", test.name);
+		if (!passed) numFailedTests++;
+	}
+
+	std::printf("%d of %d tests passed\n", int(Testing::GetTests().size()) - numFailedTests, int(Testing::GetTests().size()));
+	return numFailedTests == 0 ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+
+// Just enough of a test framework for the core: TEST() defines a test, CHECK*() record failures without stopping it,
+// and main() (in testing.cpp) runs every test in the executable and fails if any check did.
+namespace Testing {
+	typedef void(*TestFunction)();
+
+	struct Registrar
+	{
+		Registrar(const char *name, TestFunction function);
+	};
+
+	void ReportFailure(const char *file, int line, const char *what);
+}
+
+#define TEST(name) \
+	static void name(); \
+	static Testing::Registrar name##_registrar(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do { if (!(condition)) Testing::ReportFailure(__FILE__, __LINE__, #condition); } while (0)
+
+#define CHECK_EQ(a, b) \
+	do { if (!((a) == (b))) Testing::ReportFailure(__FILE__, __LINE__, #a " == " #b); } while (0)
+
+#define CHECK_NEAR(a, b, tolerance) \
+	do { \
+		double checkA_ = double(a), checkB_ = double(b); \
+		if (!(std::fabs(checkA_ - checkB_) <= double(tolerance))) { \
+			char what_[256]; \
+			std::snprintf(what_, sizeof(what_), "%s ~= %s (%g vs %g)", #a, #b, checkA_, checkB_); \
+			Testing::ReportFailure(__FILE__, __LINE__, what_); \
+		} \
+	} while (0)